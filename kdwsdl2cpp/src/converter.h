@@ -87,8 +87,9 @@ private:
 
     // Server Stub
     void convertServerService();
+    void generateOperationLookup(const Binding &binding, const Operation::List &operations, KODE::Class &newClass);
     void generateServerMethod(KODE::Code &code, const Binding &binding, const Operation &operation,
-                              KODE::Class &newClass, bool first);
+                              KODE::Class &newClass, int operationIndex);
     void generateDelayedReponseMethod(const QString &methodName, const QString &retInputType,
                                       const Part &retPart, KODE::Class &newClass, const Binding &binding, const Message &outputMessage);
 
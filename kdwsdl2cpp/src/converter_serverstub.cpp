@@ -2,10 +2,151 @@
 #include "settings.h"
 #include <libkode/style.h>
 #include <QSet>
+#include <QMap>
+#include <QVector>
 #include <QDebug>
 
 using namespace KWSDL;
 
+// The generated processRequest() finds the operation with a perfect hash of its name, and
+// another one of its SOAP action: the FNV-1a hash of the key selects a bucket, whose seed
+// mixed with the hash gives the slot of the operation, without any collision.
+// generateOperationLookup() generates the same computations, keep them in sync.
+static const uint s_fnvPrime = 16777619u;
+
+static uint hashKey(uint basis, const QString &key)
+{
+    uint hash = basis;
+    for (int i = 0; i < key.size(); ++i) {
+        hash = (hash ^ key.at(i).unicode()) * s_fnvPrime;
+    }
+    return hash;
+}
+
+static uint mixSeed(uint hash, uint seed)
+{
+    uint slot = (hash ^ seed) * 2654435761u;
+    slot ^= slot >> 16;
+    return slot;
+}
+
+struct OperationHash {
+    uint basis;
+    QVector<uint> seeds; // per bucket
+    QVector<int> slots; // operation index, or -1
+};
+
+// Empty keys are skipped, as well as the keys of the operations already using the same key
+static OperationHash buildOperationHash(const QStringList &keys)
+{
+    QList<int> operations;
+    QSet<QString> seenKeys;
+    for (int i = 0; i < keys.count(); ++i) {
+        if (!keys.at(i).isEmpty() && !seenKeys.contains(keys.at(i))) {
+            seenKeys.insert(keys.at(i));
+            operations.append(i);
+        }
+    }
+    OperationHash table;
+    const int bucketCount = qMax(1, (operations.count() + 1) / 2);
+    const int slotCount = qMax(1, operations.count() * 2);
+    table.seeds.fill(0, bucketCount);
+    table.slots.fill(-1, slotCount);
+
+    // Find a basis for which all the keys have a different hash (almost always the first one)
+    QVector<QList<int> > buckets;
+    QVector<uint> hashes(keys.count());
+    for (table.basis = 2166136261u;; ++table.basis) {
+        QSet<uint> seenHashes;
+        Q_FOREACH (int op, operations) {
+            hashes[op] = hashKey(table.basis, keys.at(op));
+            seenHashes.insert(hashes.at(op));
+        }
+        if (seenHashes.count() == operations.count()) {
+            break;
+        }
+    }
+    buckets.resize(bucketCount);
+    Q_FOREACH (int op, operations) {
+        buckets[hashes.at(op) % bucketCount].append(op);
+    }
+
+    // Place the largest buckets first, while most slots are still free
+    QMultiMap<int, int> bucketsBySize;
+    for (int b = 0; b < bucketCount; ++b) {
+        if (!buckets.at(b).isEmpty()) {
+            bucketsBySize.insert(-buckets.at(b).count(), b);
+        }
+    }
+    Q_FOREACH (int b, bucketsBySize) {
+        const QList<int> &bucket = buckets.at(b);
+        for (uint seed = 0;; ++seed) {
+            QList<int> bucketSlots;
+            Q_FOREACH (int op, bucket) {
+                const int slot = mixSeed(hashes.at(op), seed) % slotCount;
+                if (table.slots.at(slot) != -1 || bucketSlots.contains(slot)) {
+                    break;
+                }
+                bucketSlots.append(slot);
+            }
+            if (bucketSlots.count() == bucket.count()) {
+                table.seeds[b] = seed;
+                for (int i = 0; i < bucket.count(); ++i) {
+                    table.slots[bucketSlots.at(i)] = bucket.at(i);
+                }
+                break;
+            }
+        }
+    }
+    return table;
+}
+
+template <typename T>
+static void addArray(KODE::Code &code, const QString &declaration, const QVector<T> &values)
+{
+    code += declaration + QString::fromLatin1("[%1] = {").arg(values.count());
+    code.indent();
+    const int perLine = 16;
+    for (int i = 0; i < values.count(); i += perLine) {
+        QStringList line;
+        for (int j = i; j < qMin(i + perLine, values.count()); ++j) {
+            line += QString::number(values.at(j));
+        }
+        code += line.join(", ") + (i + perLine < values.count() ? "," : "");
+    }
+    code.unindent();
+    code += "};";
+}
+
+static void addStringArray(KODE::Code &code, const QString &declaration, const QStringList &values)
+{
+    code += declaration + QString::fromLatin1("[%1] = {").arg(values.count());
+    code.indent();
+    for (int i = 0; i < values.count(); ++i) {
+        const QString value = values.at(i).isEmpty() ? QString::fromLatin1("0") : '"' + values.at(i) + '"';
+        code += value + (i + 1 < values.count() ? "," : "");
+    }
+    code.unindent();
+    code += "};";
+}
+
+// Generates the lookup of a key in a table built by buildOperationHash, see hashKey and mixSeed
+static void addOperationLookup(KODE::Code &code, const QString &prefix, const OperationHash &table,
+                               const QString &keyVar, const QString &unit)
+{
+    addArray(code, "static const uint " + prefix + "Seeds", table.seeds);
+    addArray(code, "static const int " + prefix + "Slots", table.slots);
+    code += QString::fromLatin1("hash = %1u;").arg(table.basis);
+    code += "for (int i = 0; i < " + keyVar + ".size(); ++i) {";
+    code.indent();
+    code += QString::fromLatin1("hash = (hash ^ %1) * %2u;").arg(unit).arg(s_fnvPrime);
+    code.unindent();
+    code += "}";
+    code += QString::fromLatin1("slot = (hash ^ %1Seeds[hash % %2]) * 2654435761u;").arg(prefix).arg(table.seeds.count());
+    code += "slot ^= slot >> 16;";
+    code += QString::fromLatin1("const int %1Index = %1Slots[slot % %2];").arg(prefix).arg(table.slots.count());
+}
+
 void Converter::convertServerService()
 {
     Q_FOREACH (const Service &service, mWSDL.definitions().services()) {
@@ -49,31 +190,34 @@ void Converter::convertServerService()
             KODE::Code body;
             const QString responseNs = mWSDL.definitions().targetNamespace();
             body.addLine("setResponseNamespace(QLatin1String(\"" + responseNs + "\"));" + COMMENT);
-            body.addLine("const QByteArray method = _request.name().toLatin1();");
 
             PortType portType = mWSDL.findPortType(binding.portTypeName());
             //qDebug() << portType.name();
-            bool first = true;
             const Operation::List operations = portType.operations();
-            Q_FOREACH (const Operation &operation, operations) {
+            if (!operations.isEmpty()) {
+                generateOperationLookup(binding, operations, serverClass);
+                body += "switch (_operationIndex(_request.name(), _soapAction)) {";
+            }
+            for (int i = 0; i < operations.count(); ++i) {
+                const Operation &operation = operations.at(i);
                 const Operation::OperationType opType = operation.operationType();
                 switch (opType) {
                 case Operation::OneWayOperation:
                 case Operation::RequestResponseOperation: // the standard case
                 case Operation::SolicitResponseOperation:
                 case Operation::NotificationOperation:
-                    generateServerMethod(body, binding, operation, serverClass, first);
+                    generateServerMethod(body, binding, operation, serverClass, i);
                     break;
                 }
-                first = false;
             }
 
-            if (!first) {
-                body += "else {";
+            if (!operations.isEmpty()) {
+                body += "default:";
                 body.indent();
             }
             body += "KDSoapServerObjectInterface::processRequest(_request, _response, _soapAction);"  + COMMENT;
-            if (!first) {
+            if (!operations.isEmpty()) {
+                body += "break;";
                 body.unindent();
                 body += "}";
             }
@@ -86,7 +230,62 @@ void Converter::convertServerService()
     }
 }
 
-void Converter::generateServerMethod(KODE::Code &code, const Binding &binding, const Operation &operation, KODE::Class &newClass, bool first)
+// Generates the static _operationIndex() method, which returns the index of the operation called,
+// found from the name of the request element or from the SOAP action, in constant time.
+// Like processRequest() used to do, the first operation in the WSDL matching either of them wins.
+void Converter::generateOperationLookup(const Binding &binding, const Operation::List &operations, KODE::Class &newClass)
+{
+    QStringList names;
+    QStringList soapActions;
+    Q_FOREACH (const Operation &operation, operations) {
+        names += operation.name();
+        QString action;
+        if (binding.type() == Binding::SOAPBinding) {
+            const SoapBinding soapBinding(binding.soapBinding());
+            action = soapBinding.operations().value(operation.name()).action();
+        }
+        soapActions += action;
+    }
+    bool hasSoapActions = false;
+    QStringList actionKeys; // hashed as UTF-8 bytes, like the QByteArray received
+    Q_FOREACH (const QString &action, soapActions) {
+        actionKeys += QString::fromLatin1(action.toUtf8().constData());
+        hasSoapActions = hasSoapActions || !action.isEmpty();
+    }
+
+    KODE::Function lookupMethod(QString::fromLatin1("_operationIndex"), QString::fromLatin1("int"), KODE::Function::Private, true);
+    lookupMethod.addArgument("const QString &_name");
+    lookupMethod.addArgument("const QByteArray &_soapAction");
+
+    KODE::Code code;
+    addStringArray(code, "static const char *const names", names);
+    code += "uint hash;";
+    code += "uint slot;";
+    addOperationLookup(code, "name", buildOperationHash(names), "_name", "_name.at(i).unicode()");
+    code += "int index = -1;";
+    code += "if (nameIndex != -1 && _name == QLatin1String(names[nameIndex])) {";
+    code.indent();
+    code += "index = nameIndex;";
+    code.unindent();
+    code += "}";
+    if (hasSoapActions) {
+        addStringArray(code, "static const char *const soapActions", soapActions);
+        addOperationLookup(code, "soapAction", buildOperationHash(actionKeys), "_soapAction", "uchar(_soapAction.at(i))");
+        code += "if (soapActionIndex != -1 && (index == -1 || soapActionIndex < index) && _soapAction == soapActions[soapActionIndex]) {";
+        code.indent();
+        code += "index = soapActionIndex;";
+        code.unindent();
+        code += "}";
+    } else {
+        code += "Q_UNUSED(_soapAction);";
+    }
+    code += "return index;";
+    lookupMethod.setBody(code);
+
+    newClass.addFunction(lookupMethod);
+}
+
+void Converter::generateServerMethod(KODE::Code &code, const Binding &binding, const Operation &operation, KODE::Class &newClass, int operationIndex)
 {
     const QString requestVarName = "_request";
     const QString responseVarName = "_response";
@@ -103,15 +302,7 @@ void Converter::generateServerMethod(KODE::Code &code, const Binding &binding, c
     KODE::Function virtualMethod(methodName);
     virtualMethod.setVirtualMode(KODE::Function::PureVirtual);
 
-    QString condition = "method == \"" + operationName + "\"";
-    if (binding.type() == Binding::SOAPBinding) {
-        const SoapBinding soapBinding(binding.soapBinding());
-        const SoapBinding::Operation op = soapBinding.operations().value(operation.name());
-        if (!op.action().isEmpty()) {
-            condition += " || _soapAction == \"" + op.action() + "\"";
-        }
-    }
-    code += QString(first ? "" : "else ") + "if (" + condition + ") {";
+    code += QString::fromLatin1("case %1: { // %2").arg(operationIndex).arg(operationName);
     code.indent();
 
     QStringList inputVars;
@@ -193,6 +384,7 @@ void Converter::generateServerMethod(KODE::Code &code, const Binding &binding, c
 
         generateDelayedReponseMethod(methodName, retInputType, retPart, newClass, binding, outputMessage);
     }
+    code += "break;";
     code.unindent();
     code += "}";
 
@@ -0,0 +1,279 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapAtomTable_p.h"
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QThreadStorage>
+#include <QVector>
+
+// Indexed by KDSoapAtomTable::WellKnownAtom
+static const char *const s_wellKnownNames[KDSoapAtomTable::WellKnownAtomCount] = {
+    "http://www.w3.org/1999/XMLSchema",
+    "http://www.w3.org/2001/XMLSchema",
+    "http://www.w3.org/1999/XMLSchema-instance",
+    "http://www.w3.org/2001/XMLSchema-instance",
+    "http://schemas.xmlsoap.org/soap/envelope/",
+    "http://www.w3.org/2003/05/soap-envelope",
+    "http://schemas.xmlsoap.org/soap/encoding/",
+    "http://www.w3.org/2003/05/soap-encoding",
+    "http://www.w3.org/2005/08/addressing",
+    "string",
+    "base64Binary",
+    "int",
+    "long",
+    "unsignedInt",
+    "boolean",
+    "float",
+    "double",
+    "time",
+    "date"
+};
+
+static const int s_maxAtomCount = 8192;
+// Longer names don't get an atom, so that they can't pin much memory in the table
+static const int s_maxAtomLength = 256;
+
+// The names without an atom which are cached by each thread, once the table is full
+static const int s_maxCachedNoAtomCount = 1024;
+
+// Same as qHash(QString) in Qt 4, which has no qHash(QStringRef)
+static uint hashChars(const QChar *p, int n)
+{
+    uint h = 0;
+    while (n--) {
+        h = (h << 4) + (*p++).unicode();
+        h ^= (h & 0xf0000000) >> 23;
+        h &= 0x0fffffff;
+    }
+    return h;
+}
+
+// The atoms already used by a thread, in an open-addressing hash table which can be
+// looked up with a QStringRef, unlike QHash<QString, int>.
+// Once the table is full, also some of the names which got NoAtom, so that they aren't copied each time.
+struct KDSoapAtomCache {
+    struct Entry {
+        Entry() : hash(0), atom(KDSoapAtomTable::NoAtom) {}
+        uint hash;
+        int atom;
+        QString string; // null for a free entry
+    };
+
+    KDSoapAtomCache() : entries(64), count(0), noAtomCount(0) {}
+
+    int find(const QStringRef &str, uint hash) const
+    {
+        const int mask = entries.size() - 1;
+        int i = hash & mask;
+        while (!entries.at(i).string.isNull()) {
+            const Entry &entry = entries.at(i);
+            if (entry.hash == hash && entry.string == str) {
+                return i;
+            }
+            i = (i + 1) & mask;
+        }
+        return i; // free entry
+    }
+
+    void insert(const QString &string, uint hash, int atom)
+    {
+        if ((count + 1) * 2 > entries.size()) {
+            QVector<Entry> oldEntries(entries.size() * 2);
+            oldEntries.swap(entries);
+            for (int i = 0; i < oldEntries.size(); ++i) {
+                if (!oldEntries.at(i).string.isNull()) {
+                    entries[find(QStringRef(&oldEntries.at(i).string), oldEntries.at(i).hash)] = oldEntries.at(i);
+                }
+            }
+        }
+        Entry &entry = entries[find(QStringRef(&string), hash)];
+        entry.hash = hash;
+        entry.atom = atom;
+        entry.string = string;
+        ++count;
+    }
+
+    QVector<Entry> entries;
+    int count;
+    int noAtomCount;
+};
+
+class KDSoapAtomTableData
+{
+public:
+    KDSoapAtomTableData()
+    {
+        for (int atom = 0; atom < KDSoapAtomTable::WellKnownAtomCount; ++atom) {
+            strings[atom] = QString::fromLatin1(s_wellKnownNames[atom]);
+            atoms.insert(strings[atom], atom);
+        }
+        count.fetchAndStoreRelease(KDSoapAtomTable::WellKnownAtomCount);
+    }
+
+    // The number of atoms whose strings can be read without locking
+    int publishedCount() const
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+        return count.loadAcquire();
+#else
+        return int(count);
+#endif
+    }
+
+    KDSoapAtomCache *localCache()
+    {
+        KDSoapAtomCache *cache = caches.localData();
+        if (!cache) {
+            cache = new KDSoapAtomCache;
+            caches.setLocalData(cache);
+        }
+        return cache;
+    }
+
+    QString insert(const QStringRef &str, int *atom)
+    {
+        QString string = str.toString();
+        if (publishedCount() >= s_maxAtomCount) {
+            // The table is full, it doesn't change anymore
+            const QHash<QString, int> &fullAtoms = atoms;
+            *atom = fullAtoms.value(string, KDSoapAtomTable::NoAtom);
+            return *atom == KDSoapAtomTable::NoAtom ? string : strings[*atom];
+        }
+        QMutexLocker lock(&mutex);
+        const QHash<QString, int>::const_iterator it = atoms.constFind(string);
+        if (it != atoms.constEnd()) {
+            *atom = it.value();
+            return strings[it.value()];
+        }
+        const int n = publishedCount();
+        if (n >= s_maxAtomCount) {
+            *atom = KDSoapAtomTable::NoAtom;
+            return string;
+        }
+        *atom = n;
+        atoms.insert(string, n);
+        strings[n] = string;
+        count.fetchAndStoreRelease(n + 1);
+        return string;
+    }
+
+    int find(const QString &string)
+    {
+        if (publishedCount() >= s_maxAtomCount) {
+            const QHash<QString, int> &fullAtoms = atoms;
+            return fullAtoms.value(string, KDSoapAtomTable::NoAtom);
+        }
+        QMutexLocker lock(&mutex);
+        return atoms.value(string, KDSoapAtomTable::NoAtom);
+    }
+
+    QMutex mutex; // for atoms, until the table is full, and for adding strings
+    QHash<QString, int> atoms;
+    QString strings[s_maxAtomCount]; // append-only: the first count strings are never modified, read without locking
+    QAtomicInt count;
+    QThreadStorage<KDSoapAtomCache *> caches;
+};
+
+Q_GLOBAL_STATIC(KDSoapAtomTableData, s_atomTable)
+
+QString KDSoapAtomTable::intern(const QStringRef &str, int *atom)
+{
+    int dummy;
+    if (!atom) {
+        atom = &dummy;
+    }
+    KDSoapAtomTableData *table = s_atomTable();
+    if (str.isEmpty() || str.size() > s_maxAtomLength || !table) { // no table during the destruction of the global statics
+        *atom = NoAtom;
+        return str.toString();
+    }
+    KDSoapAtomCache *cache = table->localCache();
+    const uint hash = hashChars(str.unicode(), str.size());
+    const int i = cache->find(str, hash);
+    const KDSoapAtomCache::Entry &entry = cache->entries.at(i);
+    if (!entry.string.isNull()) {
+        *atom = entry.atom;
+        return entry.string;
+    }
+    // First time in this thread
+    const QString string = table->insert(str, atom);
+    if (*atom != NoAtom) {
+        cache->insert(string, hash, *atom);
+    } else if (cache->noAtomCount < s_maxCachedNoAtomCount) {
+        // The table is full, so the name will never get an atom
+        ++cache->noAtomCount;
+        cache->insert(string, hash, NoAtom);
+    }
+    return string;
+}
+
+QString KDSoapAtomTable::intern(const QString &str, int *atom)
+{
+    return intern(QStringRef(&str), atom);
+}
+
+int KDSoapAtomTable::find(const QString &str)
+{
+    KDSoapAtomTableData *table = s_atomTable();
+    if (str.isEmpty() || str.size() > s_maxAtomLength || !table) {
+        return NoAtom;
+    }
+    KDSoapAtomCache *cache = table->localCache();
+    const KDSoapAtomCache::Entry &entry = cache->entries.at(cache->find(QStringRef(&str), hashChars(str.unicode(), str.size())));
+    if (!entry.string.isNull()) {
+        return entry.atom;
+    }
+    return table->find(str);
+}
+
+QString KDSoapAtomTable::string(int atom)
+{
+    Q_ASSERT(atom >= 0);
+    KDSoapAtomTableData *table = s_atomTable();
+    if (!table) {
+        Q_ASSERT(atom < WellKnownAtomCount);
+        return QString::fromLatin1(s_wellKnownNames[atom]);
+    }
+    Q_ASSERT(atom < table->publishedCount());
+    return table->strings[atom];
+}
+
+int KDSoapAtomTable::atomCount()
+{
+    KDSoapAtomTableData *table = s_atomTable();
+    if (!table) {
+        return 0;
+    }
+    return table->publishedCount();
+}
+
+int KDSoapAtomTable::maxAtomCount()
+{
+    return s_maxAtomCount;
+}
+
+int KDSoapAtomTable::maxAtomLength()
+{
+    return s_maxAtomLength;
+}
@@ -0,0 +1,95 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPATOMTABLE_P_H
+#define KDSOAPATOMTABLE_P_H
+
+#include "KDSoapGlobal.h"
+#include <QString>
+
+/**
+ * \internal
+ * Table of the element, attribute and namespace names found in SOAP messages ("atoms").
+ *
+ * A message usually repeats the same few dozen names many times: interning them means that
+ * every KDSoapValue gets an implicitly-shared copy of the same QString, rather than a new
+ * allocation per element. The well-known namespaces have fixed atoms, so that checking
+ * the namespace of an element or of an attribute is an integer comparison, and so have
+ * the built-in types of KDSoapTypeRegistry, which must not depend on the table being full.
+ *
+ * Thread-safe: each thread has a cache of the atoms it used, the shared table is only
+ * locked when a thread sees a name for the first time, and string() never locks.
+ * Since the names come from the network, the table is limited to maxAtomCount() atoms;
+ * after that, new names are simply copied, with NoAtom, and the table isn't locked anymore.
+ * Names longer than maxAtomLength() are always copied, with NoAtom.
+ */
+class KDSOAP_EXPORT KDSoapAtomTable
+{
+public:
+    enum WellKnownAtom {
+        NoAtom = -1,
+        XmlSchema1999,
+        XmlSchema2001,
+        XmlSchemaInstance1999,
+        XmlSchemaInstance2001,
+        SoapEnvelope,
+        SoapEnvelope200305,
+        SoapEncoding,
+        SoapEncoding200305,
+        SoapMessageAddressing,
+        // XML schema types, see KDSoapTypeRegistry
+        XsdString,
+        XsdBase64Binary,
+        XsdInt,
+        XsdLong,
+        XsdUnsignedInt,
+        XsdBoolean,
+        XsdFloat,
+        XsdDouble,
+        XsdTime,
+        XsdDate,
+        WellKnownAtomCount
+    };
+
+    /**
+     * Returns the shared copy of \p str, and its atom in \p atom if not null.
+     * An empty \p str gives a null QString, and NoAtom.
+     */
+    static QString intern(const QStringRef &str, int *atom = 0);
+    static QString intern(const QString &str, int *atom = 0);
+
+    /**
+     * Returns the atom of \p str, or NoAtom if it has none, without adding it to the table.
+     */
+    static int find(const QString &str);
+
+    /**
+     * Returns the string of \p atom, which must be a valid atom.
+     */
+    static QString string(int atom);
+
+    static int atomCount();
+    static int maxAtomCount();
+    static int maxAtomLength();
+};
+
+#endif // KDSOAPATOMTABLE_P_H
@@ -20,6 +20,7 @@ INSTALLHEADERS = KDSoapMessage.h \
     KDSoapJob.h \
     KDSoapAuthentication.h \
     KDSoapNamespaceManager.h \
+    KDSoapTypeRegistry.h \
     KDSoapSslHandler.h \
     KDDateTime.h \
     KDSoapFaultException.h \
@@ -31,7 +32,14 @@ PRIVATEHEADERS = KDSoapPendingCall_p.h \
     KDSoapClientThread_p.h \
     KDSoapMessageReader_p.h \
     KDSoapMessageWriter_p.h \
-    KDSoapNamespacePrefixes_p.h
+    KDSoapNamespacePrefixes_p.h \
+    KDSoapObjectPool_p.h \
+    KDSoapAtomTable_p.h \
+    KDSoapTypeRegistry_p.h \
+    KDSoapValueArena_p.h \
+    KDSoapXmlTokenizer_p.h \
+    KDSoapSimdXmlTokenizer_p.h \
+    KDSoapXmlSanitizer_p.h
 HEADERS = $$INSTALLHEADERS \
     $$PRIVATEHEADERS \
     KDSoapReplySslHandler_p.h \
@@ -54,7 +62,14 @@ SOURCES = KDSoapMessage.cpp \
     KDSoapReplySslHandler.cpp \
     KDSoapFaultException.cpp \
     KDSoapMessageAddressingProperties.cpp \
-    KDSoapEndpointReference.cpp
+    KDSoapEndpointReference.cpp \
+    KDSoapObjectPool.cpp \
+    KDSoapAtomTable.cpp \
+    KDSoapTypeRegistry.cpp \
+    KDSoapValueArena.cpp \
+    KDSoapXmlTokenizer.cpp \
+    KDSoapSimdXmlTokenizer.cpp \
+    KDSoapXmlSanitizer.cpp
 DEFINES += KDSOAP_BUILD_KDSOAP_LIB
 
 # installation targets:
@@ -66,7 +66,8 @@ KDSoapClientInterfacePrivate::KDSoapClientInterfacePrivate()
       m_authentication(),
       m_version(KDSoapClientInterface::SOAP1_1),
       m_style(KDSoapClientInterface::RPCStyle),
-      m_ignoreSslErrors(false)
+      m_ignoreSslErrors(false),
+      m_lazyResponseParsing(false)
 {
 #ifndef QT_NO_OPENSSL
     m_sslHandler = 0;
@@ -158,7 +159,7 @@ KDSoapPendingCall KDSoapClientInterface::asyncCall(const QString &method, const
     //qDebug() << "post()";
     QNetworkReply *reply = d->accessManager()->post(request, buffer);
     d->setupReply(reply);
-    return KDSoapPendingCall(reply, buffer);
+    return KDSoapPendingCall(reply, buffer, d->m_lazyResponseParsing);
 }
 
 KDSoapMessage KDSoapClientInterface::call(const QString &method, const KDSoapMessage &message, const QString &soapAction, const KDSoapHeaders &headers)
@@ -259,6 +260,16 @@ KDSoapClientInterface::Style KDSoapClientInterface::style() const
     return d->m_style;
 }
 
+void KDSoapClientInterface::setLazyResponseParsing(bool lazy)
+{
+    d->m_lazyResponseParsing = lazy;
+}
+
+bool KDSoapClientInterface::lazyResponseParsing() const
+{
+    return d->m_lazyResponseParsing;
+}
+
 QNetworkCookieJar *KDSoapClientInterface::cookieJar() const
 {
     return d->accessManager()->cookieJar();
@@ -287,6 +287,23 @@ public:
      */
     KDSoapHeaders lastResponseHeaders() const;
 
+    /**
+     * Sets whether the responses are parsed lazily: the values of a response are then only
+     * created when they are accessed (e.g. by KDSoapValue::childValues()), from a compact
+     * representation of the parsed XML. This saves memory and time with large responses,
+     * of which only part is used. The accessed values are the same as without lazy parsing.
+     *
+     * This is off by default. It only applies to the calls made after setting it.
+     * \since 1.7
+     */
+    void setLazyResponseParsing(bool lazy);
+
+    /**
+     * Returns whether the responses are parsed lazily, see setLazyResponseParsing().
+     * \since 1.7
+     */
+    bool lazyResponseParsing() const;
+
     /**
      * Asks Qt to ignore ssl errors in https requests. Use this for testing
      * only!
@@ -103,7 +103,7 @@ void KDSoapThreadTask::process(QNetworkAccessManager &accessManager)
     QNetworkRequest request = m_data->m_iface->d->prepareRequest(m_data->m_method, m_data->m_action);
     QNetworkReply *reply = accessManager.post(request, buffer);
     m_data->m_iface->d->setupReply(reply);
-    KDSoapPendingCall pendingCall(reply, buffer);
+    KDSoapPendingCall pendingCall(reply, buffer, m_data->m_iface->d->m_lazyResponseParsing);
 
     KDSoapPendingCallWatcher *watcher = new KDSoapPendingCallWatcher(pendingCall, this);
     connect(watcher, SIGNAL(finished(KDSoapPendingCallWatcher*)),
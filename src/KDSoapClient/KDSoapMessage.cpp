@@ -24,10 +24,13 @@
 #include "KDSoapNamespaceManager.h"
 #include "KDSoapNamespacePrefixes_p.h"
 #include "KDDateTime.h"
+#include "KDSoapObjectPool_p.h"
 #include <QDebug>
 #include <QXmlStreamReader>
 #include <QVariant>
 
+Q_GLOBAL_STATIC(KDSoapObjectPool, s_messagePool)
+
 class KDSoapMessageData : public QSharedData
 {
 public:
@@ -35,6 +38,22 @@ public:
         : use(KDSoapMessage::LiteralUse), isFault(false), hasMessageAddressingProperties(false)
     {}
 
+    // Several per call (request, response, headers), see KDSoapValue::Private
+    static void *operator new(size_t size)
+    {
+        KDSoapObjectPool *pool = s_messagePool();
+        return pool ? pool->allocate(size) : ::operator new(size);
+    }
+    static void operator delete(void *ptr, size_t size)
+    {
+        KDSoapObjectPool *pool = s_messagePool();
+        if (pool) {
+            pool->release(ptr, size);
+        } else {
+            ::operator delete(ptr);
+        }
+    }
+
     KDSoapMessage::Use use;
     bool isFault;
     bool hasMessageAddressingProperties;
@@ -24,29 +24,16 @@
 #include "KDSoapMessageReader_p.h"
 #include "KDSoapNamespaceManager.h"
 #include "KDSoapNamespacePrefixes_p.h"
-#include "KDDateTime.h"
+#include "KDSoapAtomTable_p.h"
+#include "KDSoapTypeRegistry_p.h"
+#include "KDSoapValueArena_p.h"
+#include "KDSoapSimdXmlTokenizer_p.h"
+#include "KDSoapXmlSanitizer_p.h"
 
 #include <QDebug>
-#include <QXmlStreamReader>
-
-// Wrapper for compatibility with Qt < 4.6.
-static bool readNextStartElement(QXmlStreamReader &reader)
-{
-#if QT_VERSION >= 0x040600
-    return reader.readNextStartElement();
-#else
-    while (reader.readNext() != QXmlStreamReader::Invalid) {
-        if (reader.isEndElement()) {
-            return false;
-        } else if (reader.isStartElement()) {
-            return true;
-        }
-    }
-    return false;
-#endif
-}
+#include <QVector>
 
-static QStringRef namespaceForPrefix(const QXmlStreamNamespaceDeclarations &decls, const QString &prefix)
+static QStringRef namespaceForPrefix(const QXmlStreamNamespaceDeclarations &decls, const QStringRef &prefix)
 {
     for (int i = 0; i < decls.count(); ++i) {
         const QXmlStreamNamespaceDeclaration &decl = decls.at(i);
@@ -57,208 +44,503 @@ static QStringRef namespaceForPrefix(const QXmlStreamNamespaceDeclarations &decl
     return QStringRef();
 }
 
-static int xmlTypeToMetaType(const QString &xmlType)
-{
-    // Reverse operation from variantToXmlType in KDSoapClientInterface, keep in sync
-    static const struct {
-        const char *xml; // xsd: prefix assumed
-        const int metaTypeId;
-    } s_types[] = {
-        { "string", QVariant::String }, // or QUrl
-        { "base64Binary", QVariant::ByteArray },
-        { "int", QVariant::Int }, // or long, or uint, or longlong
-        { "unsignedInt", QVariant::ULongLong },
-        { "boolean", QVariant::Bool },
-        { "float", QMetaType::Float },
-        { "double", QVariant::Double },
-        { "time", QVariant::Time },
-        { "date", QVariant::Date }
+class KDSoapMessageReader::Private
+{
+public:
+    enum State {
+        StartState,       // before <Envelope>
+        EnvelopeState,    // expecting <Header> or <Body>
+        HeaderState,      // inside <Header>
+        AfterHeaderState, // expecting <Body>
+        BodyState,        // inside <Body>
+        DoneState         // the message was parsed, the rest of the document is ignored
     };
-    // Speed: could be sorted and then we could use qBinaryFind
-    static const int s_numTypes = sizeof(s_types) / sizeof(*s_types);
-    for (int i = 0; i < s_numTypes; ++i) {
-        if (xmlType == QLatin1String(s_types[i].xml)) {
-            return s_types[i].metaTypeId;
-        }
+
+    // An element being parsed; the stack of these replaces recursion, so that parsing can
+    // stop at any point when running out of data, and resume when more data arrives.
+    struct Element {
+        KDSoapValue value;
+        int typeAtom; // of the xsi:type, for KDSoapTypeRegistry
+        QString text;
+    };
+
+    // The xsi:type of an element
+    struct XsiType {
+        QString nameSpace;
+        QString name;
+        int nameSpaceAtom;
+        int nameAtom;
+    };
+    enum AttributeKind {
+        ValueAttribute, // stored in the attributes of the element's value
+        TypeAttribute,
+        IgnoredAttribute
+    };
+
+    explicit Private(Tokenizer initialTokenizer)
+        : reader(0),
+          lazyValues(false),
+          sanitizeInput(false),
+          fixedCount(0)
+    {
+        setTokenizer(initialTokenizer);
+    }
+    ~Private()
+    {
+        delete reader;
     }
-    if (xmlType == QLatin1String("dateTime")) {
-        return qMetaTypeId<KDDateTime>();
+
+    void setTokenizer(Tokenizer tokenizer);
+
+    void clear();
+    void addData(const QByteArray &data);
+    void parse();
+    void finishInput();
+    void finishElements();
+    XmlError result(KDSoapMessage *pMsg, QString *pMessageNamespace, KDSoapHeaders *pRequestHeaders);
+
+    static Tokenizer s_defaultTokenizer;
+    Tokenizer tokenizer;
+    KDSoapXmlTokenizer *reader;
+    State state;
+    bool inText;
+    bool hasMessage;
+    QXmlStreamNamespaceDeclarations envNsDecls;
+    QVector<Element> stack;
+    KDSoapValue message;
+    KDSoapHeaders headers;
+    bool lazyValues;
+    QExplicitlySharedDataPointer<KDSoapValueArena> arena; // for the current document, with lazyValues (replaces stack)
+    bool sanitizeInput;
+    KDSoapXmlSanitizer sanitizer; // with sanitizeInput
+    int fixedCount; // by the sanitizer, in the last document
+
+private:
+    bool inElement() const;
+    AttributeKind readAttribute(int index, XsiType &type) const;
+    void startElement();
+    void endElement();
+    void startArenaElement();
+    void endArenaElement();
+    void addText(bool append);
+    void addTopLevelValue(const KDSoapValue &value);
+};
+
+KDSoapMessageReader::Tokenizer KDSoapMessageReader::Private::s_defaultTokenizer = KDSoapMessageReader::QXmlStreamTokenizer;
+
+static bool isSoapEnvelopeElement(const KDSoapXmlTokenizer &reader, const char *name)
+{
+    if (reader.name() != QLatin1String(name)) {
+        return false;
     }
-    // This will happen with any custom type, don't bother the user
-    //qDebug() << QString::fromLatin1("xmlTypeToMetaType: XML type %1 is not supported in "
-    //                                "KDSoap, see the documentation").arg(xmlType);
-    return -1;
+    int ns;
+    KDSoapAtomTable::intern(reader.namespaceUri(), &ns);
+    return ns == KDSoapAtomTable::SoapEnvelope || ns == KDSoapAtomTable::SoapEnvelope200305;
 }
 
-static KDSoapValue parseElement(QXmlStreamReader &reader, const QXmlStreamNamespaceDeclarations &envNsDecls)
-{
-    const QString name = reader.name().toString();
-    KDSoapValue val(name, QVariant());
-    val.setNamespaceUri(reader.namespaceUri().toString());
-    //qDebug() << "parsing" << name;
-    QVariant::Type metaTypeId = QVariant::Invalid;
-
-    const QXmlStreamAttributes attributes = reader.attributes();
-    Q_FOREACH (const QXmlStreamAttribute &attribute, attributes) {
-        const QStringRef name = attribute.name();
-        const QStringRef ns = attribute.namespaceUri();
-        const QStringRef attrValue = attribute.value();
-        // Parse xsi:type and soap-enc:arrayType
-        // and ignore anything else from the xsi or soap-enc namespaces until someone needs it...
-        if (ns == KDSoapNamespaceManager::xmlSchemaInstance1999() ||
-                ns == KDSoapNamespaceManager::xmlSchemaInstance2001()) {
-            if (name == QLatin1String("type")) {
-                // The type can be like xsd:float, resolve that
-                const QString type = attrValue.toString();
-                const int pos = type.indexOf(QLatin1Char(':'));
-                const QString dataType = type.mid(pos + 1);
-                val.setType(namespaceForPrefix(envNsDecls, type.left(pos)).toString(), dataType);
-                metaTypeId = static_cast<QVariant::Type>(xmlTypeToMetaType(dataType));
-            }
-            continue;
-        } else if (ns == KDSoapNamespaceManager::soapEncoding() || ns == KDSoapNamespaceManager::soapEncoding200305() ||
-                   ns == KDSoapNamespaceManager::soapEnvelope() || ns == KDSoapNamespaceManager::soapEnvelope200305()) {
-            continue;
-        }
-        //qDebug() << "Got attribute:" << name << ns << "=" << attrValue;
-        val.childValues().attributes().append(KDSoapValue(name.toString(), attrValue.toString()));
+void KDSoapMessageReader::Private::setTokenizer(Tokenizer newTokenizer)
+{
+    delete reader;
+    tokenizer = newTokenizer;
+    if (tokenizer == SimdTokenizer) {
+        reader = new KDSoapSimdXmlTokenizer;
+    } else {
+        reader = new KDSoapQXmlStreamTokenizer;
     }
-    QString text;
-    while (reader.readNext() != QXmlStreamReader::Invalid) {
-        if (reader.isEndElement()) {
-            break;
-        }
-        if (reader.isCharacters()) {
-            text = reader.text().toString();
-            //qDebug() << "text=" << text;
-        } else if (reader.isStartElement()) {
-            const KDSoapValue subVal = parseElement(reader, envNsDecls); // recurse
-            val.childValues().append(subVal);
-        }
+    clear();
+}
+
+void KDSoapMessageReader::Private::clear()
+{
+    reader->clear();
+    state = StartState;
+    inText = false;
+    hasMessage = false;
+    envNsDecls.clear();
+    stack.clear();
+    arena.reset();
+    message = KDSoapValue();
+    headers.clear();
+    sanitizer.reset();
+}
+
+bool KDSoapMessageReader::Private::inElement() const
+{
+    if (lazyValues) {
+        return arena && arena->openElementCount() > 0;
     }
+    return !stack.isEmpty();
+}
 
-    if (!text.isEmpty()) {
-        QVariant variant(text);
-        //qDebug() << text << variant << metaTypeId;
-        // With use=encoded, we have type info, we can convert the variant here
-        // Otherwise, for servers, we do it later, once we know the method's parameter types.
-        if (metaTypeId != QVariant::Invalid) {
-            QVariant copy = variant;
-            if (!variant.convert(metaTypeId)) {
-                variant = copy;
-            }
+KDSoapMessageReader::Private::AttributeKind KDSoapMessageReader::Private::readAttribute(int index, XsiType &type) const
+{
+    int ns;
+    KDSoapAtomTable::intern(reader->attributeNamespaceUri(index), &ns);
+    // Parse xsi:type and soap-enc:arrayType
+    // and ignore anything else from the xsi or soap-enc namespaces until someone needs it...
+    if (ns == KDSoapAtomTable::XmlSchemaInstance1999 || ns == KDSoapAtomTable::XmlSchemaInstance2001) {
+        if (reader->attributeName(index) != QLatin1String("type")) {
+            return IgnoredAttribute;
         }
-        val.setValue(variant);
+        // The type can be like xsd:float, resolve that
+        const QString typeValue = reader->attributeValue(index).toString();
+        const int pos = typeValue.indexOf(QLatin1Char(':'));
+        type.nameSpace = KDSoapAtomTable::intern(namespaceForPrefix(envNsDecls, typeValue.leftRef(pos)), &type.nameSpaceAtom);
+        type.name = KDSoapAtomTable::intern(typeValue.midRef(pos + 1), &type.nameAtom);
+        return TypeAttribute;
+    } else if (ns == KDSoapAtomTable::SoapEncoding || ns == KDSoapAtomTable::SoapEncoding200305 ||
+               ns == KDSoapAtomTable::SoapEnvelope || ns == KDSoapAtomTable::SoapEnvelope200305) {
+        return IgnoredAttribute;
     }
-    return val;
+    return ValueAttribute;
 }
 
-KDSoapMessageReader::KDSoapMessageReader()
+void KDSoapMessageReader::Private::startElement()
 {
+    if (lazyValues) {
+        startArenaElement();
+        return;
+    }
+    // The names are interned: the values of a message share the QStrings of the names they repeat
+    Element element;
+    element.value = KDSoapValue(KDSoapAtomTable::intern(reader->name()), QVariant());
+    element.value.setNamespaceUri(KDSoapAtomTable::intern(reader->namespaceUri()));
+    //qDebug() << "parsing" << element.value.name();
+    element.typeAtom = KDSoapAtomTable::NoAtom;
+
+    const int attributeCount = reader->attributeCount();
+    for (int i = 0; i < attributeCount; ++i) {
+        XsiType type;
+        const AttributeKind kind = readAttribute(i, type);
+        if (kind == TypeAttribute) {
+            element.value.setType(type.nameSpace, type.name);
+            element.typeAtom = type.nameAtom;
+        } else if (kind == ValueAttribute) {
+            //qDebug() << "Got attribute:" << reader->attributeName(i) << reader->attributeNamespaceUri(i) << "=" << reader->attributeValue(i);
+            element.value.childValues().attributes().append(KDSoapValue(KDSoapAtomTable::intern(reader->attributeName(i)), reader->attributeValue(i).toString()));
+        }
+    }
+    stack.append(element);
 }
 
-static bool isInvalidCharRef(const QByteArray &charRef)
+void KDSoapMessageReader::Private::endElement()
 {
-    bool ok = true;
-    int symbol = charRef.indexOf('x');
-    int end = charRef.indexOf(';');
-
-    if (symbol == -1 || end == -1) {
-        return false;
+    if (lazyValues) {
+        endArenaElement();
+        return;
     }
+    Element element = stack.last();
+    stack.pop_back();
 
-    uint val = charRef.mid(symbol + 1, end - symbol - 1).toInt(&ok, 16);
+    if (!element.text.isEmpty()) {
+        // With use=encoded, we have type info, the text is decoded directly into the right type here.
+        // Otherwise, for servers, we do it later, once we know the method's parameter types.
+        QVariant variant;
+        if (!KDSoapTypeRegistryAtoms::decode(element.value.type(), element.typeAtom, element.text, variant)) {
+            variant = element.text;
+        }
+        //qDebug() << element.text << variant;
+        element.value.setValue(variant);
+    }
 
-    if (!ok) {
-        return false;
+    if (!stack.isEmpty()) {
+        stack.last().value.childValues().append(element.value);
+    } else {
+        addTopLevelValue(element.value);
     }
+}
 
-    if (val != 0x9 && val != 0xa && val != 0xd && (val <= 0x20)) {
-        return true;
+// Same as startElement, but only stores a node in the arena; the KDSoapValue is created later, if needed
+void KDSoapMessageReader::Private::startArenaElement()
+{
+    if (!arena) {
+        arena = new KDSoapValueArena;
     }
+    int nameAtom;
+    int nsAtom;
+    const QString name = KDSoapAtomTable::intern(reader->name(), &nameAtom);
+    const QString ns = KDSoapAtomTable::intern(reader->namespaceUri(), &nsAtom);
+    const int index = arena->startElement(arena->addSymbol(name, nameAtom), arena->addSymbol(ns, nsAtom));
 
-    return false;
+    const int attributeCount = reader->attributeCount();
+    for (int i = 0; i < attributeCount; ++i) {
+        XsiType type;
+        const AttributeKind kind = readAttribute(i, type);
+        if (kind == TypeAttribute) {
+            arena->setType(index, arena->addSymbol(type.nameSpace, type.nameSpaceAtom), arena->addSymbol(type.name, type.nameAtom));
+        } else if (kind == ValueAttribute) {
+            int attributeAtom;
+            const QString attributeName = KDSoapAtomTable::intern(reader->attributeName(i), &attributeAtom);
+            arena->addAttribute(arena->addSymbol(attributeName, attributeAtom), reader->attributeValue(i));
+        }
+    }
 }
 
-static QByteArray handleNotWellFormedError(const QByteArray &data, qint64 offset)
+void KDSoapMessageReader::Private::endArenaElement()
 {
-    qint64 i = offset - 1; // offset is the char following the failing one
-    QByteArray dataCleanedUp;
-    QByteArray originalSequence;
+    const int index = arena->currentElement();
+    arena->endElement();
+    if (arena->openElementCount() == 0) {
+        addTopLevelValue(arena->value(index));
+    }
+}
 
-    while (i >= 0 && data.at(i) != '&') {
-        if (data.at(i) == '<') { // InvalidXML but not invalid characters related
-            return dataCleanedUp;
-        }
+// The text of an element can arrive in several parts
+void KDSoapMessageReader::Private::addText(bool append)
+{
+    if (lazyValues) {
+        arena->addText(arena->currentElement(), reader->text(), append);
+    } else if (append) {
+        stack.last().text.append(reader->text());
+    } else {
+        stack.last().text = reader->text().toString();
+    }
+}
 
-        originalSequence.prepend(data.at(i));
-        i--;
+void KDSoapMessageReader::Private::addTopLevelValue(const KDSoapValue &value)
+{
+    if (state == HeaderState) {
+        KDSoapMessage header;
+        static_cast<KDSoapValue &>(header) = value;
+        headers.append(header);
+    } else {
+        Q_ASSERT(state == BodyState);
+        message = value;
+        hasMessage = true;
+        state = DoneState;
     }
+}
+
+void KDSoapMessageReader::Private::addData(const QByteArray &data)
+{
+    reader->addData(sanitizeInput ? sanitizer.filter(data) : data);
+    parse();
+}
 
-    if (isInvalidCharRef(originalSequence)) {
-        qWarning() << "found an invalid character sequence to remove:" << QLatin1String(originalSequence.prepend('&').constData());
-        dataCleanedUp = data;
-        dataCleanedUp = dataCleanedUp.replace(originalSequence, "?");
+// Called when no more data will come: parses what the sanitizer kept (an incomplete reference...)
+void KDSoapMessageReader::Private::finishInput()
+{
+    if (sanitizeInput) {
+        const QByteArray rest = sanitizer.finish();
+        if (!rest.isEmpty()) {
+            reader->addData(rest);
+            parse();
+        }
+        fixedCount = sanitizer.fixedCount();
+        if (fixedCount > 0) {
+            qWarning("KDSoapMessageReader: replaced or removed %d invalid characters", fixedCount);
+        }
+    } else {
+        fixedCount = 0;
     }
-    return dataCleanedUp;
 }
 
-KDSoapMessageReader::XmlError KDSoapMessageReader::xmlToMessage(const QByteArray &data, KDSoapMessage *pMsg, QString *pMessageNamespace, KDSoapHeaders *pRequestHeaders) const
+// Parses as much as the data received so far allows.
+// Stops at the end of the data (PrematureEndOfDocumentError, more data can be added), or on error.
+void KDSoapMessageReader::Private::parse()
 {
-    Q_ASSERT(pMsg);
-    QXmlStreamReader reader(data);
-    if (readNextStartElement(reader)) {
-        if (reader.name() == QLatin1String("Envelope") && (reader.namespaceUri() == KDSoapNamespaceManager::soapEnvelope() ||
-                reader.namespaceUri() == KDSoapNamespaceManager::soapEnvelope200305())) {
-            const QXmlStreamNamespaceDeclarations envNsDecls = reader.namespaceDeclarations();
-            if (readNextStartElement(reader)) {
-                if (reader.name() == QLatin1String("Header") && (reader.namespaceUri() == KDSoapNamespaceManager::soapEnvelope() ||
-                        reader.namespaceUri() == KDSoapNamespaceManager::soapEnvelope200305())) {
-                    while (readNextStartElement(reader)) {
-                        KDSoapMessage header;
-                        static_cast<KDSoapValue &>(header) = parseElement(reader, envNsDecls);
-                        pRequestHeaders->append(header);
-                    }
-                    readNextStartElement(reader); // read <Body>
-                }
-                if (reader.name() == QLatin1String("Body") && (reader.namespaceUri() == KDSoapNamespaceManager::soapEnvelope() ||
-                        reader.namespaceUri() == KDSoapNamespaceManager::soapEnvelope200305())) {
-                    if (readNextStartElement(reader)) {
-                        *pMsg = parseElement(reader, envNsDecls);
-                        if (pMessageNamespace) {
-                            *pMessageNamespace = pMsg->namespaceUri();
-                        }
-                        if (pMsg->name() == QLatin1String("Fault")) {
-                            pMsg->setFault(true);
-                        }
-                    }
-
-                } else {
-                    reader.raiseError(QObject::tr("Invalid SOAP Message, Body expected"));
-                }
+    while (state != DoneState && reader->readNext() != QXmlStreamReader::Invalid) {
+        const bool wasText = inText;
+        inText = false;
+        if (inElement()) {
+            if (reader->isStartElement()) {
+                startElement();
+            } else if (reader->isEndElement()) {
+                endElement();
+            } else if (reader->isCharacters()) {
+                addText(wasText);
+                inText = true;
+            }
+            continue;
+        }
+        if (!reader->isStartElement() && !reader->isEndElement()) {
+            continue;
+        }
+        switch (state) {
+        case StartState:
+            if (isSoapEnvelopeElement(*reader, "Envelope")) {
+                envNsDecls = reader->namespaceDeclarations();
+                state = EnvelopeState;
             } else {
-                reader.raiseError(QObject::tr("Invalid SOAP Message, empty Envelope"));
+                reader->raiseError(QObject::tr("Invalid SOAP Message, Envelope expected"));
             }
-        } else {
-            reader.raiseError(QObject::tr("Invalid SOAP Message, Envelope expected"));
+            break;
+        case EnvelopeState:
+            if (reader->isEndElement()) {
+                reader->raiseError(QObject::tr("Invalid SOAP Message, empty Envelope"));
+            } else if (isSoapEnvelopeElement(*reader, "Header")) {
+                state = HeaderState;
+            } else if (isSoapEnvelopeElement(*reader, "Body")) {
+                state = BodyState;
+            } else {
+                reader->raiseError(QObject::tr("Invalid SOAP Message, Body expected"));
+            }
+            break;
+        case HeaderState:
+            if (reader->isEndElement()) {
+                state = AfterHeaderState;
+            } else {
+                startElement();
+            }
+            break;
+        case AfterHeaderState:
+            if (reader->isStartElement() && isSoapEnvelopeElement(*reader, "Body")) {
+                state = BodyState;
+            } else {
+                reader->raiseError(QObject::tr("Invalid SOAP Message, Body expected"));
+            }
+            break;
+        case BodyState:
+            if (reader->isEndElement()) { // empty body
+                state = DoneState;
+            } else {
+                startElement();
+            }
+            break;
+        case DoneState:
+            break;
         }
     }
-    if (reader.hasError()) {
-        if (reader.error() == QXmlStreamReader::NotWellFormedError) {
-            qWarning() << "Handling a Not well Formed Error";
-            QByteArray dataCleanedUp = handleNotWellFormedError(data, reader.characterOffset());
-            if (!dataCleanedUp.isEmpty()) {
-                return xmlToMessage(dataCleanedUp, pMsg, pMessageNamespace, pRequestHeaders);
-            }
+}
+
+// Called when no more data will come: keeps what was parsed of unfinished elements,
+// and reports a missing Envelope child or Body as such, rather than as a generic XML error.
+void KDSoapMessageReader::Private::finishElements()
+{
+    if (!reader->hasError()) {
+        return;
+    }
+    while (inElement()) {
+        endElement();
+    }
+    if (reader->error() != QXmlStreamReader::CustomError) {
+        if (state == EnvelopeState) {
+            reader->raiseError(QObject::tr("Invalid SOAP Message, empty Envelope"));
+        } else if (state == HeaderState || state == AfterHeaderState) {
+            reader->raiseError(QObject::tr("Invalid SOAP Message, Body expected"));
+        }
+    }
+}
+
+KDSoapMessageReader::XmlError KDSoapMessageReader::Private::result(KDSoapMessage *pMsg, QString *pMessageNamespace, KDSoapHeaders *pRequestHeaders)
+{
+    if (!headers.isEmpty()) {
+        *pRequestHeaders += headers;
+    }
+    if (hasMessage) {
+        *pMsg = message;
+        if (pMessageNamespace) {
+            *pMessageNamespace = pMsg->namespaceUri();
         }
+        if (pMsg->name() == QLatin1String("Fault")) {
+            pMsg->setFault(true);
+        }
+    }
+    if (reader->hasError()) {
         pMsg->setFault(true);
-        pMsg->addArgument(QString::fromLatin1("faultcode"), QString::number(reader.error()));
+        pMsg->addArgument(QString::fromLatin1("faultcode"), QString::number(reader->error()));
         pMsg->addArgument(QString::fromLatin1("faultstring"),
-                          QString::fromLatin1("XML error: [%1:%2] %3").arg(QString::number(reader.lineNumber()),
-                                  QString::number(reader.columnNumber()),
-                                  reader.errorString()));
-        return reader.error() == QXmlStreamReader::PrematureEndOfDocumentError ? PrematureEndOfDocumentError : ParseError;
+                          QString::fromLatin1("XML error: [%1:%2] %3").arg(QString::number(reader->lineNumber()),
+                                  QString::number(reader->columnNumber()),
+                                  reader->errorString()));
+        return reader->error() == QXmlStreamReader::PrematureEndOfDocumentError ? PrematureEndOfDocumentError : ParseError;
     }
-
     return NoError;
 }
+
+KDSoapMessageReader::KDSoapMessageReader()
+    : d(new Private(Private::s_defaultTokenizer))
+{
+}
+
+KDSoapMessageReader::~KDSoapMessageReader()
+{
+    delete d;
+}
+
+KDSoapMessageReader::XmlError KDSoapMessageReader::xmlToMessage(const QByteArray &data, KDSoapMessage *pMsg, QString *pMessageNamespace, KDSoapHeaders *pRequestHeaders) const
+{
+    Q_ASSERT(pMsg);
+    Private parser(d->tokenizer);
+    parser.lazyValues = d->lazyValues;
+    parser.sanitizeInput = d->sanitizeInput;
+    parser.addData(data);
+    parser.finishInput();
+    if (parser.reader->error() == QXmlStreamReader::NotWellFormedError && !parser.sanitizeInput) {
+        // Some peers send invalid characters, such as "&#x13;" (SOAP-113): parse the document
+        // again, repaired by the sanitizer in a single pass
+        parser.clear();
+        parser.sanitizeInput = true;
+        parser.addData(data);
+        parser.finishInput();
+    }
+    parser.finishElements();
+    d->fixedCount = parser.fixedCount;
+    return parser.result(pMsg, pMessageNamespace, pRequestHeaders);
+}
+
+void KDSoapMessageReader::addData(const QByteArray &data)
+{
+    if (d->state == Private::DoneState ||
+            (d->reader->hasError() && d->reader->error() != QXmlStreamReader::PrematureEndOfDocumentError)) {
+        return; // no need to keep this data around
+    }
+    d->addData(data);
+}
+
+KDSoapMessageReader::XmlError KDSoapMessageReader::finish(KDSoapMessage *pMsg, QString *pMessageNamespace, KDSoapHeaders *pRequestHeaders)
+{
+    Q_ASSERT(pMsg);
+    d->finishInput();
+    d->finishElements();
+    const XmlError err = d->result(pMsg, pMessageNamespace, pRequestHeaders);
+    d->clear();
+    return err;
+}
+
+void KDSoapMessageReader::reset()
+{
+    d->clear();
+}
+
+void KDSoapMessageReader::setLazyValues(bool lazyValues)
+{
+    d->lazyValues = lazyValues;
+    d->clear();
+}
+
+bool KDSoapMessageReader::lazyValues() const
+{
+    return d->lazyValues;
+}
+
+void KDSoapMessageReader::setSanitizeInput(bool sanitize)
+{
+    d->sanitizeInput = sanitize;
+    d->clear();
+}
+
+bool KDSoapMessageReader::sanitizeInput() const
+{
+    return d->sanitizeInput;
+}
+
+int KDSoapMessageReader::fixedCharacterCount() const
+{
+    return d->fixedCount;
+}
+
+void KDSoapMessageReader::setTokenizer(Tokenizer tokenizer)
+{
+    d->setTokenizer(tokenizer);
+}
+
+KDSoapMessageReader::Tokenizer KDSoapMessageReader::tokenizer() const
+{
+    return d->tokenizer;
+}
+
+void KDSoapMessageReader::setDefaultTokenizer(Tokenizer tokenizer)
+{
+    Private::s_defaultTokenizer = tokenizer;
+}
@@ -34,10 +34,74 @@ public:
         ParseError,
         PrematureEndOfDocumentError
     };
+    enum Tokenizer {
+        QXmlStreamTokenizer, ///< QXmlStreamReader, which supports any XML document
+        SimdTokenizer        ///< KDSoapSimdXmlTokenizer, faster on the UTF-8 documents used in practice
+    };
 
     KDSoapMessageReader();
+    ~KDSoapMessageReader();
 
+    /**
+     * Parses a whole document. Without setSanitizeInput(), a document which isn't well-formed is
+     * parsed a second time through the sanitizer, in case it only has invalid characters.
+     */
     XmlError xmlToMessage(const QByteArray &data, KDSoapMessage *pParsedMessage, QString *pMessageNamespace, KDSoapHeaders *pRequestHeaders) const;
+
+    /**
+     * Incremental parsing, for documents which arrive in several parts (e.g. from a socket).
+     * Call addData() for each part as soon as it is available, the data is parsed right away
+     * and doesn't need to be kept around. Call finish() once the whole document was received.
+     * Note that unlike xmlToMessage(), this doesn't repair invalid character references,
+     * unless setSanitizeInput() is used.
+     */
+    void addData(const QByteArray &data);
+    XmlError finish(KDSoapMessage *pParsedMessage, QString *pMessageNamespace, KDSoapHeaders *pRequestHeaders);
+    /**
+     * Discards any partially parsed document, to start over with a new one.
+     */
+    void reset();
+
+    /**
+     * Stores the elements of the next documents in a compact representation (KDSoapValueArena),
+     * from which the KDSoapValue objects of the message are only created when they are accessed,
+     * e.g. by childValues(). This saves memory and time for large messages, when only part of
+     * them is used, or when they are only read once.
+     * Also discards any partially parsed document, like reset().
+     */
+    void setLazyValues(bool lazyValues);
+    bool lazyValues() const;
+
+    /**
+     * Selects the XML tokenizer used for the next documents.
+     * Also discards any partially parsed document, like reset().
+     */
+    void setTokenizer(Tokenizer tokenizer);
+    Tokenizer tokenizer() const;
+    /**
+     * The tokenizer of the readers created from now on (QXmlStreamTokenizer by default).
+     * Mostly for tests and benchmarks, not thread-safe: call it before creating any reader.
+     */
+    static void setDefaultTokenizer(Tokenizer tokenizer);
+
+    /**
+     * Passes the next documents through KDSoapXmlSanitizer before parsing them: the character
+     * references to characters which aren't allowed in XML are replaced with '?', and the control
+     * characters are removed, in a single pass over the data (also when parsing incrementally).
+     * Also discards any partially parsed document, like reset().
+     */
+    void setSanitizeInput(bool sanitize);
+    bool sanitizeInput() const;
+    /**
+     * Number of characters and character references fixed by the sanitizer in the last document
+     * parsed by xmlToMessage() or finish().
+     */
+    int fixedCharacterCount() const;
+
+private:
+    Q_DISABLE_COPY(KDSoapMessageReader)
+    class Private;
+    Private *const d;
 };
 
 #endif
@@ -25,6 +25,8 @@
 #include "KDSoapClientInterface_p.h"
 #include "KDSoapNamespaceManager.h"
 #include "KDSoapValue.h"
+#include <QBuffer>
+#include <QStack>
 #include <QVariant>
 #include <QDebug>
 
@@ -43,14 +45,51 @@ void KDSoapMessageWriter::setMessageNamespace(const QString &ns)
     m_messageNamespace = ns;
 }
 
+static QString bodyElementName(const KDSoapMessage &message, const QString &method)
+{
+    const QString elementName = !method.isEmpty() ? method : message.name();
+    if (elementName.isEmpty()) {
+        if (message.isNull()) {
+            // null message, ok (e.g. no arguments, in document/literal mode)
+        } else {
+            qWarning("ERROR: Non-empty message with an empty name!");
+            qDebug() << message;
+        }
+    }
+    return elementName;
+}
+
 QByteArray KDSoapMessageWriter::messageToXml(const KDSoapMessage &message, const QString &method,
         const KDSoapHeaders &headers, const QMap<QString, KDSoapMessage> &persistentHeaders) const
 {
     QByteArray data;
     QXmlStreamWriter writer(&data);
+    KDSoapNamespacePrefixes namespacePrefixes;
+    const QString messageNamespace = writeEnvelopeStart(writer, namespacePrefixes, message, headers, persistentHeaders);
+
+    const QString elementName = bodyElementName(message, method);
+    if (!elementName.isEmpty()) {
+        // Note that the message itself is always qualified.
+        // http://www.ibm.com/developerworks/webservices/library/ws-tip-namespace/index.html
+        // isQualified() is only for child elements.
+        writer.writeStartElement(messageNamespace, elementName);
+        message.writeElementContents(namespacePrefixes, writer, message.use(), messageNamespace);
+        writer.writeEndElement();
+    }
+    writeEnvelopeEnd(writer);
+
+    if (qgetenv("KDSOAP_DEBUG").toInt()) {
+        qDebug() << data;
+    }
+    return data;
+}
+
+// Writes everything up to the start of the body, returns the namespace of the message
+QString KDSoapMessageWriter::writeEnvelopeStart(QXmlStreamWriter &writer, KDSoapNamespacePrefixes &namespacePrefixes,
+        const KDSoapMessage &message, const KDSoapHeaders &headers, const QMap<QString, KDSoapMessage> &persistentHeaders) const
+{
     writer.writeStartDocument();
 
-    KDSoapNamespacePrefixes namespacePrefixes;
     namespacePrefixes.writeStandardNamespaces(writer, m_version, message.hasMessageAddressingProperties());
 
     QString soapEnvelope;
@@ -96,29 +135,104 @@ QByteArray KDSoapMessageWriter::messageToXml(const KDSoapMessage &message, const
     }
 
     writer.writeStartElement(soapEnvelope, QLatin1String("Body"));
+    return messageNamespace;
+}
 
-    const QString elementName = !method.isEmpty() ? method : message.name();
-    if (elementName.isEmpty()) {
-        if (message.isNull()) {
-            // null message, ok (e.g. no arguments, in document/literal mode)
-        } else {
-            qWarning("ERROR: Non-empty message with an empty name!");
-            qDebug() << message;
-        }
-    } else {
-        // Note that the message itself is always qualified.
-        // http://www.ibm.com/developerworks/webservices/library/ws-tip-namespace/index.html
-        // isQualified() is only for child elements.
-        writer.writeStartElement(messageNamespace, elementName);
-        message.writeElementContents(namespacePrefixes, writer, message.use(), messageNamespace);
-        writer.writeEndElement();
-    }
+void KDSoapMessageWriter::writeEnvelopeEnd(QXmlStreamWriter &writer) const
+{
     writer.writeEndElement(); // Body
     writer.writeEndElement(); // Envelope
     writer.writeEndDocument();
+}
 
-    if (qgetenv("KDSOAP_DEBUG").toInt()) {
-        qDebug() << data;
+////
+
+class KDSoapMessageStreamWriter::Private
+{
+public:
+    Private()
+        : writer(&buffer), finished(false)
+    {
+    }
+
+    // An element being written: the children still have to be written
+    struct Element {
+        Element() : nextChild(0) {}
+        explicit Element(const KDSoapValue &v) : value(v), children(v.childValues()), nextChild(0) {}
+        KDSoapValue value;
+        KDSoapValueList children;
+        int nextChild;
+    };
+
+    QBuffer buffer;
+    QXmlStreamWriter writer;
+    KDSoapNamespacePrefixes namespacePrefixes;
+    KDSoapMessageWriter messageWriter;
+    QString messageNamespace;
+    KDSoapValue::Use use;
+    QStack<Element> elements;
+    bool finished;
+};
+
+KDSoapMessageStreamWriter::KDSoapMessageStreamWriter(const KDSoapMessageWriter &messageWriter,
+        const KDSoapMessage &message, const QString &method,
+        const KDSoapHeaders &headers, const QMap<QString, KDSoapMessage> &persistentHeaders)
+    : d(new Private)
+{
+    d->buffer.open(QIODevice::WriteOnly);
+    d->messageWriter = messageWriter;
+    d->messageNamespace = messageWriter.writeEnvelopeStart(d->writer, d->namespacePrefixes, message, headers, persistentHeaders);
+    d->use = message.use();
+
+    // Same as messageToXml, one element at a time
+    const QString elementName = bodyElementName(message, method);
+    if (!elementName.isEmpty()) {
+        d->writer.writeStartElement(d->messageNamespace, elementName);
+        message.writeElementAttributes(d->namespacePrefixes, d->writer, d->use);
+        message.writeAttributes(d->writer, false);
+        d->elements.push(Private::Element(message));
+    }
+}
+
+KDSoapMessageStreamWriter::~KDSoapMessageStreamWriter()
+{
+    delete d;
+}
+
+QByteArray KDSoapMessageStreamWriter::next(int minimumSize)
+{
+    while (!d->finished && d->buffer.size() < minimumSize) {
+        writeStep();
     }
+    const QByteArray data = d->buffer.data();
+    d->buffer.buffer().clear();
+    d->buffer.seek(0);
     return data;
 }
+
+bool KDSoapMessageStreamWriter::atEnd() const
+{
+    return d->finished && d->buffer.size() == 0;
+}
+
+// Writes the start of the next child element, or the end of the current element
+void KDSoapMessageStreamWriter::writeStep()
+{
+    if (d->elements.isEmpty()) {
+        d->messageWriter.writeEnvelopeEnd(d->writer);
+        d->finished = true;
+        return;
+    }
+    Private::Element &current = d->elements.top();
+    if (current.nextChild < current.children.count()) {
+        const KDSoapValue child = current.children.at(current.nextChild++);
+        child.writeStartElement(d->writer, d->messageNamespace, false);
+        child.writeElementAttributes(d->namespacePrefixes, d->writer, d->use);
+        child.writeAttributes(d->writer, false);
+        d->elements.push(Private::Element(child)); // invalidates current
+    } else {
+        current.value.writeElementText(d->writer);
+        d->writer.writeEndElement();
+        d->elements.pop();
+    }
+}
@@ -52,9 +52,50 @@ public:
                             const QMap<QString, KDSoapMessage> &persistentHeaders) const;
 
 private:
+    friend class KDSoapMessageStreamWriter;
+    QString writeEnvelopeStart(QXmlStreamWriter &writer, KDSoapNamespacePrefixes &namespacePrefixes,
+                               const KDSoapMessage &message,
+                               const KDSoapHeaders &headers,
+                               const QMap<QString, KDSoapMessage> &persistentHeaders) const;
+    void writeEnvelopeEnd(QXmlStreamWriter &writer) const;
+
     QString m_messageNamespace;
     KDSoapClientInterface::SoapVersion m_version;
 
 };
 
+/**
+ * \internal
+ * Serializes a message piece by piece, so that large messages can be sent
+ * while they are being serialized, without ever holding the whole XML in memory.
+ * The result is the same as KDSoapMessageWriter::messageToXml.
+ * Internal class -- only exported for the server lib
+ */
+class KDSOAP_EXPORT KDSoapMessageStreamWriter
+{
+public:
+    KDSoapMessageStreamWriter(const KDSoapMessageWriter &messageWriter,
+                              const KDSoapMessage &message, const QString &method /*empty in document style*/,
+                              const KDSoapHeaders &headers,
+                              const QMap<QString, KDSoapMessage> &persistentHeaders);
+    ~KDSoapMessageStreamWriter();
+
+    /**
+     * Serializes the next part of the message, returning at least \p minimumSize bytes,
+     * unless the end of the message is reached.
+     */
+    QByteArray next(int minimumSize);
+
+    /**
+     * Returns true once the whole message was returned by next().
+     */
+    bool atEnd() const;
+
+private:
+    Q_DISABLE_COPY(KDSoapMessageStreamWriter)
+    void writeStep();
+    class Private;
+    Private *const d;
+};
+
 #endif // KDSOAPMESSAGEWRITER_P_H
@@ -21,6 +21,7 @@
 **
 **********************************************************************/
 #include "KDSoapNamespaceManager.h"
+#include "KDSoapAtomTable_p.h"
 
 KDSoapNamespaceManager::KDSoapNamespaceManager()
 {
@@ -28,45 +29,45 @@ KDSoapNamespaceManager::KDSoapNamespaceManager()
 
 QString KDSoapNamespaceManager::xmlSchema1999()
 {
-    return QString::fromLatin1("http://www.w3.org/1999/XMLSchema");
+    return KDSoapAtomTable::string(KDSoapAtomTable::XmlSchema1999);
 }
 
 QString KDSoapNamespaceManager::xmlSchema2001()
 {
-    return QString::fromLatin1("http://www.w3.org/2001/XMLSchema");
+    return KDSoapAtomTable::string(KDSoapAtomTable::XmlSchema2001);
 }
 
 QString KDSoapNamespaceManager::xmlSchemaInstance1999()
 {
-    return QString::fromLatin1("http://www.w3.org/1999/XMLSchema-instance");
+    return KDSoapAtomTable::string(KDSoapAtomTable::XmlSchemaInstance1999);
 }
 
 QString KDSoapNamespaceManager::xmlSchemaInstance2001()
 {
-    return QString::fromLatin1("http://www.w3.org/2001/XMLSchema-instance");
+    return KDSoapAtomTable::string(KDSoapAtomTable::XmlSchemaInstance2001);
 }
 
 QString KDSoapNamespaceManager::soapEnvelope()
 {
-    return QString::fromLatin1("http://schemas.xmlsoap.org/soap/envelope/");
+    return KDSoapAtomTable::string(KDSoapAtomTable::SoapEnvelope);
 }
 
 QString KDSoapNamespaceManager::soapEnvelope200305()
 {
-    return QString::fromLatin1("http://www.w3.org/2003/05/soap-envelope");
+    return KDSoapAtomTable::string(KDSoapAtomTable::SoapEnvelope200305);
 }
 
 QString KDSoapNamespaceManager::soapEncoding()
 {
-    return QString::fromLatin1("http://schemas.xmlsoap.org/soap/encoding/");
+    return KDSoapAtomTable::string(KDSoapAtomTable::SoapEncoding);
 }
 
 QString KDSoapNamespaceManager::soapEncoding200305()
 {
-    return QString::fromLatin1("http://www.w3.org/2003/05/soap-encoding");
+    return KDSoapAtomTable::string(KDSoapAtomTable::SoapEncoding200305);
 }
 
 QString KDSoapNamespaceManager::soapMessageAddressing()
 {
-    return QString::fromLatin1("http://www.w3.org/2005/08/addressing");
+    return KDSoapAtomTable::string(KDSoapAtomTable::SoapMessageAddressing);
 }
@@ -0,0 +1,118 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapObjectPool_p.h"
+#include <new>
+
+static QAtomicInt s_heapAllocations;
+
+struct KDSoapObjectPool::FreeList {
+    FreeList() : first(0), count(0) {}
+    ~FreeList()
+    {
+        while (first) {
+            Block *block = first;
+            first = block->next;
+            ::operator delete(block);
+        }
+    }
+    struct Block {
+        Block *next;
+    };
+    Block *first;
+    int count;
+};
+
+KDSoapObjectPool::KDSoapObjectPool(int maxFreeBlocks)
+    : m_blockSize(0),
+      m_maxFreeBlocks(maxFreeBlocks)
+{
+}
+
+// The free lists of the other threads are deleted by QThreadStorage, when these threads finish
+KDSoapObjectPool::~KDSoapObjectPool()
+{
+}
+
+void *KDSoapObjectPool::allocate(size_t size)
+{
+    Q_ASSERT(size >= sizeof(FreeList::Block));
+    // The first allocation decides the size of the recycled blocks
+    m_blockSize.testAndSetOrdered(0, int(size));
+    if (!hasBlockSize(size)) {
+        s_heapAllocations.ref();
+        return ::operator new(size);
+    }
+    FreeList *freeList = m_freeLists.localData();
+    if (!freeList) {
+        freeList = new FreeList;
+        m_freeLists.setLocalData(freeList);
+    }
+    if (freeList->first) {
+        FreeList::Block *block = freeList->first;
+        freeList->first = block->next;
+        --freeList->count;
+        return block;
+    }
+    s_heapAllocations.ref();
+    return ::operator new(size);
+}
+
+void KDSoapObjectPool::release(void *block, size_t size)
+{
+    if (!block) {
+        return;
+    }
+    // hasLocalData() is false in threads which never allocated, and after the thread's cleanup
+    FreeList *freeList = m_freeLists.hasLocalData() ? m_freeLists.localData() : 0;
+    if (!freeList || freeList->count >= m_maxFreeBlocks || !hasBlockSize(size)) {
+        ::operator delete(block);
+        return;
+    }
+    FreeList::Block *freeBlock = static_cast<FreeList::Block *>(block);
+    freeBlock->next = freeList->first;
+    freeList->first = freeBlock;
+    ++freeList->count;
+}
+
+bool KDSoapObjectPool::hasBlockSize(size_t size) const
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    return size_t(m_blockSize.loadAcquire()) == size;
+#else
+    return size_t(int(m_blockSize)) == size;
+#endif
+}
+
+int KDSoapObjectPool::freeBlockCount() const
+{
+    return m_freeLists.hasLocalData() ? m_freeLists.localData()->count : 0;
+}
+
+int KDSoapObjectPool::heapAllocationCount()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    return s_heapAllocations.loadAcquire();
+#else
+    return s_heapAllocations;
+#endif
+}
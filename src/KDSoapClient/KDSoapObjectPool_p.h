@@ -0,0 +1,73 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPOBJECTPOOL_P_H
+#define KDSOAPOBJECTPOOL_P_H
+
+#include "KDSoapGlobal.h"
+#include <QAtomicInt>
+#include <QThreadStorage>
+#include <stddef.h>
+
+/**
+ * \internal
+ * Recycles the memory blocks of the objects allocated for every SOAP message
+ * (e.g. one KDSoapValue::Private per element), instead of going through malloc/free each time.
+ *
+ * Each thread has its own list of free blocks, so that no locking is needed. A block
+ * released by another thread than the one which allocated it simply goes into that thread's list,
+ * so only a thread which frees the objects it allocates avoids the heap in the steady state.
+ * Only blocks of the size of the first allocation are recycled: any other size
+ * (e.g. a subclass sharing the pool) goes straight to the heap.
+ *
+ * Meant to be used from class-specific operator new/delete.
+ */
+class KDSOAP_EXPORT KDSoapObjectPool
+{
+public:
+    explicit KDSoapObjectPool(int maxFreeBlocks = 4096);
+    ~KDSoapObjectPool();
+
+    void *allocate(size_t size);
+    void release(void *block, size_t size);
+
+    /**
+     * Number of free blocks kept for the current thread.
+     */
+    int freeBlockCount() const;
+
+    /**
+     * Number of blocks allocated on the heap so far, by all the pools, in all the threads.
+     * Used by unittests to check that the steady state doesn't allocate anymore.
+     */
+    static int heapAllocationCount();
+
+private:
+    Q_DISABLE_COPY(KDSoapObjectPool)
+    bool hasBlockSize(size_t size) const;
+    struct FreeList;
+    mutable QThreadStorage<FreeList *> m_freeLists;
+    QAtomicInt m_blockSize;
+    const int m_maxFreeBlocks;
+};
+
+#endif // KDSOAPOBJECTPOOL_P_H
@@ -33,8 +33,8 @@ KDSoapPendingCall::Private::~Private()
     delete buffer;
 }
 
-KDSoapPendingCall::KDSoapPendingCall(QNetworkReply *reply, QBuffer *buffer)
-    : d(new Private(reply, buffer))
+KDSoapPendingCall::KDSoapPendingCall(QNetworkReply *reply, QBuffer *buffer, bool lazyParsing)
+    : d(new Private(reply, buffer, lazyParsing))
 {
 }
 
@@ -117,6 +117,7 @@ void KDSoapPendingCall::Private::parseReply()
 
     if (!data.isEmpty()) {
         KDSoapMessageReader reader;
+        reader.setLazyValues(lazyParsing);
         reader.xmlToMessage(data, &replyMessage, 0, &replyHeaders);
     }
 }
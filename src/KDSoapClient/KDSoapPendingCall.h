@@ -109,7 +109,7 @@ public:
 private:
     friend class KDSoapClientInterface;
     friend class KDSoapThreadTask;
-    KDSoapPendingCall(QNetworkReply *reply, QBuffer *buffer);
+    KDSoapPendingCall(QNetworkReply *reply, QBuffer *buffer, bool lazyParsing = false);
 
     friend class KDSoapPendingCallWatcher; // for connecting to d->reply
 
@@ -37,8 +37,8 @@ class KDSoapValue;
 class KDSoapPendingCall::Private : public QSharedData
 {
 public:
-    Private(QNetworkReply *r, QBuffer *b)
-        : reply(r), buffer(b), parsed(false)
+    Private(QNetworkReply *r, QBuffer *b, bool lazy)
+        : reply(r), buffer(b), parsed(false), lazyParsing(lazy)
     {
     }
     ~Private();
@@ -53,6 +53,7 @@ public:
     KDSoapMessage replyMessage;
     KDSoapHeaders replyHeaders;
     bool parsed;
+    bool lazyParsing; // see KDSoapClientInterface::setLazyResponseParsing
 };
 
 #endif // KDSOAPPENDINGCALL_P_H
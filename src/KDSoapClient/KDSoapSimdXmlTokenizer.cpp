@@ -0,0 +1,1422 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapSimdXmlTokenizer_p.h"
+#include <QObject>
+#include <QVector>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KDSOAP_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+// The SSE4.2 and AVX2 functions are compiled for these instruction sets,
+// and only called when the CPU supports them
+#define KDSOAP_HAVE_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline int countTrailingZeros(uint mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    int count = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+namespace
+{
+// The bytes which end a scan: three characters, and the control characters
+// (all of them, or all but tab and line feed)
+struct ScanSet {
+    ScanSet(char c0, char c1, char c2, bool allControls);
+    char chars[3];
+    bool allControls;
+    uchar table[256]; // for the scalar scan
+    char ranges[16]; // for the SSE4.2 scan (pcmpestri)
+    int rangesLength;
+};
+
+struct ScanSets {
+    ScanSets()
+        : text('<', '&', ']', false),
+          doubleQuoted('"', '&', '<', true),
+          singleQuoted('\'', '&', '<', true)
+    {
+    }
+    ScanSet text; // ']' for "]]>", '\r' is a control character: line breaks are normalized
+    ScanSet doubleQuoted; // all the white space is normalized in attribute values
+    ScanSet singleQuoted;
+};
+}
+
+ScanSet::ScanSet(char c0, char c1, char c2, bool controls)
+    : allControls(controls), rangesLength(0)
+{
+    chars[0] = c0;
+    chars[1] = c1;
+    chars[2] = c2;
+    memset(table, 0, sizeof(table));
+    for (int c = 0; c < 0x20; ++c) {
+        table[c] = allControls || (c != '\t' && c != '\n');
+    }
+    for (int i = 0; i < 3; ++i) {
+        table[uchar(chars[i])] = 1;
+    }
+    memset(ranges, 0, sizeof(ranges));
+    if (allControls) {
+        ranges[rangesLength++] = 0;
+        ranges[rangesLength++] = 0x1f;
+    } else {
+        ranges[rangesLength++] = 0;
+        ranges[rangesLength++] = 0x08;
+        ranges[rangesLength++] = 0x0b;
+        ranges[rangesLength++] = 0x1f;
+    }
+    for (int i = 0; i < 3; ++i) {
+        ranges[rangesLength++] = chars[i];
+        ranges[rangesLength++] = chars[i];
+    }
+}
+
+Q_GLOBAL_STATIC(ScanSets, s_scanSets)
+
+typedef const char *(*ScanFunction)(const ScanSet &set, const char *p, const char *end);
+
+static const char *scanScalar(const ScanSet &set, const char *p, const char *end)
+{
+    while (p != end && !set.table[uchar(*p)]) {
+        ++p;
+    }
+    return p;
+}
+
+#ifdef KDSOAP_HAVE_SSE2
+static const char *scanSse2(const ScanSet &set, const char *p, const char *end)
+{
+    const __m128i c0 = _mm_set1_epi8(set.chars[0]);
+    const __m128i c1 = _mm_set1_epi8(set.chars[1]);
+    const __m128i c2 = _mm_set1_epi8(set.chars[2]);
+    const __m128i lastControl = _mm_set1_epi8(0x1f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lineFeed = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, c0), _mm_cmpeq_epi8(chunk, c1)), _mm_cmpeq_epi8(chunk, c2));
+        __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(chunk, lastControl), chunk);
+        if (!set.allControls) {
+            controls = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, tab), _mm_cmpeq_epi8(chunk, lineFeed)), controls);
+        }
+        const uint mask = _mm_movemask_epi8(_mm_or_si128(found, controls));
+        if (mask) {
+            return p + countTrailingZeros(mask);
+        }
+        p += 16;
+    }
+    return scanScalar(set, p, end);
+}
+#endif
+
+#ifdef KDSOAP_HAVE_SIMD_DISPATCH
+__attribute__((target("sse4.2")))
+static const char *scanSse42(const ScanSet &set, const char *p, const char *end)
+{
+    const __m128i ranges = _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.ranges));
+    while (end - p >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const int index = _mm_cmpestri(ranges, set.rangesLength, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16) {
+            return p + index;
+        }
+        p += 16;
+    }
+    return scanScalar(set, p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *scanAvx2(const ScanSet &set, const char *p, const char *end)
+{
+    const __m256i c0 = _mm256_set1_epi8(set.chars[0]);
+    const __m256i c1 = _mm256_set1_epi8(set.chars[1]);
+    const __m256i c2 = _mm256_set1_epi8(set.chars[2]);
+    const __m256i lastControl = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i lineFeed = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const __m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, c0), _mm256_cmpeq_epi8(chunk, c1)), _mm256_cmpeq_epi8(chunk, c2));
+        __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, lastControl), chunk);
+        if (!set.allControls) {
+            controls = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, tab), _mm256_cmpeq_epi8(chunk, lineFeed)), controls);
+        }
+        const uint mask = _mm256_movemask_epi8(_mm256_or_si256(found, controls));
+        if (mask) {
+            return p + countTrailingZeros(mask);
+        }
+        p += 32;
+    }
+    return scanScalar(set, p, end);
+}
+#endif
+
+static ScanFunction scanFunction(int level)
+{
+    switch (level) {
+#ifdef KDSOAP_HAVE_SIMD_DISPATCH
+    case KDSoapSimdXmlTokenizer::Avx2Level:
+        return scanAvx2;
+    case KDSoapSimdXmlTokenizer::Sse42Level:
+        return scanSse42;
+#endif
+#ifdef KDSOAP_HAVE_SSE2
+    case KDSoapSimdXmlTokenizer::Sse2Level:
+        return scanSse2;
+#endif
+    default:
+        return scanScalar;
+    }
+}
+
+static QBasicAtomicInt s_simdLevel = Q_BASIC_ATOMIC_INITIALIZER(-1); // not detected yet
+
+KDSoapSimdXmlTokenizer::SimdLevel KDSoapSimdXmlTokenizer::maximumSimdLevel()
+{
+#ifdef KDSOAP_HAVE_SIMD_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Avx2Level;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return Sse42Level;
+    }
+#endif
+#ifdef KDSOAP_HAVE_SSE2
+    return Sse2Level;
+#else
+    return ScalarLevel;
+#endif
+}
+
+KDSoapSimdXmlTokenizer::SimdLevel KDSoapSimdXmlTokenizer::simdLevel()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    int level = s_simdLevel.loadAcquire();
+#else
+    int level = s_simdLevel;
+#endif
+    if (level < 0) {
+        level = maximumSimdLevel();
+        s_simdLevel.testAndSetOrdered(-1, level);
+    }
+    return SimdLevel(level);
+}
+
+KDSoapSimdXmlTokenizer::SimdLevel KDSoapSimdXmlTokenizer::setSimdLevel(SimdLevel level)
+{
+    SimdLevel used = qMin(level, maximumSimdLevel());
+#ifndef KDSOAP_HAVE_SSE2
+    if (used == Sse2Level) {
+        used = ScalarLevel;
+    }
+#endif
+    s_simdLevel.fetchAndStoreRelease(used);
+    return used;
+}
+
+const char *KDSoapSimdXmlTokenizer::findTextDelimiter(const char *begin, const char *end)
+{
+    return scanFunction(simdLevel())(s_scanSets()->text, begin, end);
+}
+
+const char *KDSoapSimdXmlTokenizer::findAttributeDelimiter(const char *begin, const char *end, char quote)
+{
+    const ScanSets *sets = s_scanSets();
+    return scanFunction(simdLevel())(quote == '"' ? sets->doubleQuoted : sets->singleQuoted, begin, end);
+}
+
+// Appends the UTF-8 input [begin, end) to str. ASCII is widened directly, 16 bytes at a time with SSE2
+static void appendUtf8(QString &str, const char *begin, const char *end)
+{
+    if (begin == end) {
+        return;
+    }
+    const int oldSize = str.size();
+    str.resize(oldSize + int(end - begin)); // UTF-16 never needs more code units than UTF-8 needs bytes
+    ushort *dst = reinterpret_cast<ushort *>(str.data()) + oldSize;
+    const char *p = begin;
+#ifdef KDSOAP_HAVE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    while (end - p >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        if (_mm_movemask_epi8(chunk)) {
+            break; // not ASCII
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi8(chunk, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 8), _mm_unpackhi_epi8(chunk, zero));
+        p += 16;
+        dst += 16;
+    }
+#endif
+    while (p != end && uchar(*p) < 0x80) {
+        *dst++ = uchar(*p++);
+    }
+    if (p != end) {
+        const QString decoded = QString::fromUtf8(p, int(end - p));
+        memcpy(dst, decoded.constData(), decoded.size() * sizeof(QChar));
+        dst += decoded.size();
+    }
+    str.resize(int(dst - reinterpret_cast<const ushort *>(str.constData())));
+}
+
+// Returns the end of the last complete UTF-8 sequence of [begin, end), for text split between two addData() calls
+static const char *utf8Boundary(const char *begin, const char *end)
+{
+    const char *p = end;
+    int continuationBytes = 0;
+    while (p != begin && continuationBytes < 3 && (uchar(p[-1]) & 0xc0) == 0x80) {
+        --p;
+        ++continuationBytes;
+    }
+    if (p == begin || uchar(p[-1]) < 0xc0) {
+        return end; // ASCII (or invalid, in which case it is replaced anyway)
+    }
+    const uchar lead = uchar(p[-1]);
+    const int length = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : 2;
+    return continuationBytes + 1 < length ? p - 1 : end;
+}
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+// Only the ASCII characters are checked, any other (UTF-8 encoded) character is accepted
+static inline bool isNameStartChar(char c)
+{
+    const uchar u = uchar(c);
+    return u >= 0x80 || (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || u == '_' || u == ':';
+}
+
+static inline bool isNameChar(char c)
+{
+    const uchar u = uchar(c);
+    return isNameStartChar(c) || (u >= '0' && u <= '9') || u == '-' || u == '.';
+}
+
+static const char *skipName(const char *p, const char *end)
+{
+    while (p != end && isNameChar(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+static inline bool isXmlChar(uint c)
+{
+    return c == 0x9 || c == 0xa || c == 0xd || (c >= 0x20 && c <= 0xd7ff)
+           || (c >= 0xe000 && c <= 0xfffd) || (c >= 0x10000 && c <= 0x10ffff);
+}
+
+// Parses the "#123" or "#x7B" of a character reference
+static bool parseCharacterReference(const char *p, const char *end, uint &c)
+{
+    const bool hex = p != end && *p == 'x';
+    if (hex) {
+        ++p;
+    }
+    if (p == end) {
+        return false;
+    }
+    c = 0;
+    for (; p != end; ++p) {
+        const char lower = *p | 0x20;
+        uint digit;
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (hex && lower >= 'a' && lower <= 'f') {
+            digit = lower - 'a' + 10;
+        } else {
+            return false;
+        }
+        c = c * (hex ? 16 : 10) + digit;
+        if (c > 0x10ffff) {
+            return false;
+        }
+    }
+    return isXmlChar(c);
+}
+
+class KDSoapSimdXmlTokenizer::Private
+{
+public:
+    struct Binding {
+        QByteArray prefix; // as in the input, empty for the default namespace
+        QString namespaceUri;
+    };
+    struct OpenElement {
+        int qualifiedNameOffset; // in openNames
+        int qualifiedNameLength;
+        int bindingCount; // before its namespace declarations
+    };
+    struct RawAttribute {
+        int qualifiedNameOffset; // in buffer, from the start of the tag
+        int qualifiedNameLength;
+        int valueOffset; // in strings
+        int valueLength;
+    };
+    struct Attribute {
+        int nameOffset; // in strings
+        int nameLength;
+        int binding; // -1 if none
+        int valueOffset;
+        int valueLength;
+    };
+    enum ReferenceResult {
+        ReferenceOk,
+        ReferenceIncomplete,
+        ReferenceInvalid
+    };
+    enum PartialToken {
+        NoPartialToken,
+        PartialStartTag,
+        PartialProcessingInstruction,
+        PartialComment,
+        PartialCData
+    };
+
+    Private()
+        : scan(scanFunction(KDSoapSimdXmlTokenizer::simdLevel())),
+          sets(s_scanSets()),
+          fallback(0)
+    {
+        clear();
+    }
+    ~Private()
+    {
+        delete fallback;
+    }
+
+    void clear();
+    void addData(const QByteArray &data);
+    QXmlStreamReader::TokenType readNext();
+    QXmlStreamReader::TokenType setError(QXmlStreamReader::Error err, const QString &message, const char *at);
+    QXmlStreamReader::TokenType needMoreData();
+    QXmlStreamReader::TokenType suspendSection(const char *content, const char *end, PartialToken token);
+    QXmlStreamReader::TokenType suspendStartTag(const char *p, const char *resume, int nameLength, char quote, const RawAttribute &attribute);
+    QXmlStreamReader::TokenType startFallback();
+    QXmlStreamReader::TokenType readText(const char *p, const char *end);
+    QXmlStreamReader::TokenType readStartElement(const char *p, const char *end);
+    QXmlStreamReader::TokenType readEndElement(const char *p, const char *end);
+    QXmlStreamReader::TokenType readProcessingInstruction(const char *p, const char *end);
+    QXmlStreamReader::TokenType readComment(const char *content, const char *end);
+    QXmlStreamReader::TokenType readCData(const char *content, const char *end);
+    ReferenceResult appendReference(const char *&p, const char *end);
+    void appendNormalized(const char *begin, const char *end);
+    bool resolve(const char *qualifiedName, int length, bool useDefaultNamespace, int &binding, const char *&localName, int &localNameLength);
+    int findBinding(const char *prefix, int length) const;
+    void popElement();
+    void discard(int count);
+    qint64 lineNumber(qint64 *column) const;
+    QStringRef stringRef(int offset, int length) const
+    {
+        return QStringRef(&strings, offset, length);
+    }
+    QStringRef bindingRef(int binding) const
+    {
+        return binding < 0 ? QStringRef() : QStringRef(&bindings.at(binding).namespaceUri);
+    }
+
+    ScanFunction scan;
+    const ScanSets *sets;
+
+    // Input
+    QByteArray buffer;
+    const char *data; // buffer.constData(), during readNext
+    int pos; // start of the next token
+    qint64 discarded; // number of bytes removed from the start of buffer
+    qint64 discardedLines; // line number at the end of the discarded bytes
+    qint64 discardedLineStart; // offset of the line containing the end of the discarded bytes
+
+    // State
+    QXmlStreamReader::TokenType type;
+    QXmlStreamReader::Error error;
+    QString errorString;
+    qint64 errorOffset;
+    bool started; // the root element was seen, the input can't be handed over to the fallback anymore
+    bool pendingEndElement; // after a StartElement for <foo/>
+    bool popOnNext; // after an EndElement, its names are valid until the next readNext()
+    bool rootClosed;
+    QVector<Binding> bindings;
+    int elementBindingStart; // the namespace declarations of the current StartElement
+    QVector<OpenElement> openElements;
+    QByteArray openNames;
+
+    // The incomplete token, whose scan continues where it stopped once more data was added.
+    // Comments and CDATA sections are decoded as they come: pos is moved after the decoded part
+    PartialToken partialToken;
+    int resumeOffset; // start tags and processing instructions: where the scan stopped, from pos
+    int resumeNameLength; // start tags: the length of the qualified name
+    char resumeQuote; // the quote of the attribute value being read, 0 if none
+    RawAttribute resumeAttribute; // that attribute
+
+    // Current token
+    QString strings; // the decoded names, values and text, see stringRef()
+    int nameOffset;
+    int nameLength;
+    int nameBinding;
+    int textOffset;
+    int textLength;
+    QVector<RawAttribute> rawAttributes;
+    QVector<Attribute> attributes;
+
+    // For the documents which are not in UTF-8
+    KDSoapQXmlStreamTokenizer *fallback;
+};
+
+void KDSoapSimdXmlTokenizer::Private::clear()
+{
+    buffer.clear();
+    data = 0;
+    pos = 0;
+    discarded = 0;
+    discardedLines = 1;
+    discardedLineStart = 0;
+    type = QXmlStreamReader::NoToken;
+    error = QXmlStreamReader::NoError;
+    errorString.clear();
+    errorOffset = 0;
+    started = false;
+    pendingEndElement = false;
+    popOnNext = false;
+    rootClosed = false;
+    bindings.resize(1);
+    bindings[0].prefix = "xml";
+    bindings[0].namespaceUri = QString::fromLatin1("http://www.w3.org/XML/1998/namespace");
+    elementBindingStart = bindings.count();
+    openElements.clear();
+    openNames.clear();
+    partialToken = NoPartialToken;
+    resumeOffset = resumeNameLength = 0;
+    resumeQuote = 0;
+    strings.resize(0);
+    strings.reserve(1024);
+    nameOffset = nameLength = 0;
+    nameBinding = -1;
+    textOffset = textLength = 0;
+    rawAttributes.clear();
+    attributes.clear();
+    delete fallback;
+    fallback = 0;
+}
+
+void KDSoapSimdXmlTokenizer::Private::addData(const QByteArray &newData)
+{
+    if (fallback) {
+        fallback->addData(newData);
+        return;
+    }
+    if (error == QXmlStreamReader::PrematureEndOfDocumentError) {
+        error = QXmlStreamReader::NoError;
+        errorString.clear();
+    }
+    // Drop the bytes already parsed, unless they might have to be handed over to the fallback
+    if (started && pos == buffer.size()) {
+        discard(pos);
+        buffer = newData;
+        pos = 0;
+        return;
+    }
+    if (started && pos >= 4096 && pos > buffer.size() / 2) {
+        discard(pos);
+        buffer.remove(0, pos);
+        pos = 0;
+    }
+    buffer += newData;
+}
+
+void KDSoapSimdXmlTokenizer::Private::discard(int count)
+{
+    const char *p = buffer.constData();
+    for (int i = 0; i < count; ++i) {
+        if (p[i] == '\n') {
+            ++discardedLines;
+            discardedLineStart = discarded + i + 1;
+        }
+    }
+    discarded += count;
+}
+
+qint64 KDSoapSimdXmlTokenizer::Private::lineNumber(qint64 *column) const
+{
+    const qint64 offset = error != QXmlStreamReader::NoError ? errorOffset : discarded + pos;
+    const int count = int(qBound(qint64(0), offset - discarded, qint64(buffer.size())));
+    const char *p = buffer.constData();
+    qint64 line = discardedLines;
+    qint64 lineStart = discardedLineStart;
+    for (int i = 0; i < count; ++i) {
+        if (p[i] == '\n') {
+            ++line;
+            lineStart = discarded + i + 1;
+        }
+    }
+    *column = offset - lineStart;
+    return line;
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::setError(QXmlStreamReader::Error err, const QString &message, const char *at)
+{
+    error = err;
+    errorString = message;
+    errorOffset = discarded + (at - data);
+    return type = QXmlStreamReader::Invalid;
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::needMoreData()
+{
+    // The scan of the current token continues once more data was added, see partialToken
+    return setError(QXmlStreamReader::PrematureEndOfDocumentError, QObject::tr("Premature end of document."), data + pos);
+}
+
+// The end of a comment or of a CDATA section wasn't found: decodes what can't be part of it,
+// that is all but the last two bytes, and the last incomplete character or line break
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::suspendSection(const char *content, const char *end, PartialToken token)
+{
+    const char *stop = end - content > 2 ? utf8Boundary(content, end - 2) : content;
+    if (stop != content && stop[-1] == '\r') {
+        --stop;
+    }
+    appendNormalized(content, stop);
+    partialToken = token;
+    pos = int(stop - data);
+    return needMoreData();
+}
+
+// The start tag at p is incomplete, its scan continues at resume
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::suspendStartTag(const char *p, const char *resume, int nameLength, char quote,
+        const RawAttribute &attribute)
+{
+    partialToken = PartialStartTag;
+    resumeOffset = int(resume - p);
+    resumeNameLength = nameLength;
+    resumeQuote = quote;
+    resumeAttribute = attribute;
+    return needMoreData();
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::startFallback()
+{
+    Q_ASSERT(!started && discarded == 0);
+    fallback = new KDSoapQXmlStreamTokenizer;
+    fallback->addData(buffer);
+    buffer.clear();
+    return fallback->readNext();
+}
+
+void KDSoapSimdXmlTokenizer::Private::popElement()
+{
+    const OpenElement element = openElements.last();
+    openElements.pop_back();
+    bindings.resize(element.bindingCount);
+    openNames.truncate(element.qualifiedNameOffset);
+    rootClosed = openElements.isEmpty();
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::readNext()
+{
+    if (error != QXmlStreamReader::NoError) {
+        return type = QXmlStreamReader::Invalid;
+    }
+    if (pendingEndElement) {
+        // Same names as the StartElement
+        pendingEndElement = false;
+        popOnNext = true;
+        attributes.clear();
+        elementBindingStart = bindings.count();
+        return type = QXmlStreamReader::EndElement;
+    }
+    if (popOnNext) {
+        popOnNext = false;
+        popElement();
+    }
+    if (partialToken == NoPartialToken) {
+        strings.resize(0);
+        rawAttributes.resize(0);
+    }
+    attributes.resize(0);
+    elementBindingStart = bindings.count();
+    if (rootClosed) {
+        // What follows the root element is not parsed
+        return type = (type == QXmlStreamReader::EndElement ? QXmlStreamReader::EndDocument : QXmlStreamReader::Invalid);
+    }
+
+    data = buffer.constData();
+    const char *const end = data + buffer.size();
+    const char *p = data + pos;
+    if (!started && discarded == 0 && pos == 0) {
+        if (end - p < 4) {
+            return needMoreData();
+        }
+        const uchar *bytes = reinterpret_cast<const uchar *>(p);
+        if (bytes[0] == 0 || bytes[1] == 0 || bytes[0] == 0xfe || bytes[0] == 0xff) {
+            return startFallback(); // UTF-16 or UTF-32
+        }
+        if (bytes[0] == 0xef && bytes[1] == 0xbb && bytes[2] == 0xbf) {
+            p += 3; // UTF-8 byte order mark
+            pos = 3;
+        }
+    }
+    if (partialToken == PartialComment) {
+        return readComment(p, end);
+    } else if (partialToken == PartialCData) {
+        return readCData(p, end);
+    }
+    Q_FOREVER {
+        if (p == end) {
+            return needMoreData();
+        }
+        if (*p != '<') {
+            if (!openElements.isEmpty()) {
+                return readText(p, end);
+            }
+            // Only white space is allowed outside of the root element
+            while (p != end && isSpace(*p)) {
+                ++p;
+            }
+            pos = p - data;
+            if (p != end && *p != '<') {
+                return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Start tag expected."), p);
+            }
+            continue;
+        }
+        if (end - p < 2) {
+            return needMoreData();
+        }
+        switch (p[1]) {
+        case '/':
+            return readEndElement(p, end);
+        case '?':
+            return readProcessingInstruction(p, end);
+        case '!': {
+            static const char comment[] = "<!--";
+            static const char cdata[] = "<![CDATA[";
+            const int available = int(end - p);
+            if (memcmp(p, comment, qMin(available, 4)) == 0) {
+                if (available < 4) {
+                    return needMoreData();
+                }
+                textOffset = strings.size();
+                return readComment(p + 4, end);
+            }
+            if (memcmp(p, cdata, qMin(available, 9)) == 0) {
+                if (openElements.isEmpty()) {
+                    return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Start tag expected."), p);
+                }
+                if (available < 9) {
+                    return needMoreData();
+                }
+                textOffset = strings.size();
+                return readCData(p + 9, end);
+            }
+            // <!DOCTYPE, forbidden in SOAP messages
+            return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("DTDs are not supported in SOAP messages."), p);
+        }
+        default:
+            return readStartElement(p, end);
+        }
+    }
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::readText(const char *p, const char *end)
+{
+    const char *const start = p;
+    const int textStart = strings.size();
+    Q_FOREVER {
+        const char *delimiter = scan(sets->text, p, end);
+        if (delimiter == end) {
+            // Report what we have, the rest of the text will come with the next data
+            delimiter = utf8Boundary(p, end);
+            appendUtf8(strings, p, delimiter);
+            p = delimiter;
+            break;
+        }
+        appendUtf8(strings, p, delimiter);
+        p = delimiter;
+        const char c = *p;
+        if (c == '<') {
+            break;
+        }
+        if (c == '&') {
+            const ReferenceResult result = appendReference(p, end);
+            if (result == ReferenceIncomplete) {
+                break;
+            } else if (result == ReferenceInvalid) {
+                return type;
+            }
+            continue;
+        }
+        if (c == ']') {
+            if (end - p < 3) {
+                break;
+            }
+            if (p[1] == ']' && p[2] == '>') {
+                return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Sequence ']]>' not allowed in content."), p);
+            }
+            strings.append(QLatin1Char(']'));
+            ++p;
+            continue;
+        }
+        if (c == '\r') {
+            if (p + 1 == end) {
+                break;
+            }
+            ++p;
+            if (*p != '\n') { // otherwise the line feed is copied with the next run
+                strings.append(QLatin1Char('\n'));
+            }
+            continue;
+        }
+        return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Invalid XML character."), p);
+    }
+    if (p == start) {
+        return needMoreData();
+    }
+    pos = p - data;
+    textOffset = textStart;
+    textLength = strings.size() - textStart;
+    return type = QXmlStreamReader::Characters;
+}
+
+// p is on '&'. Appends the character, and moves p after the reference
+KDSoapSimdXmlTokenizer::Private::ReferenceResult KDSoapSimdXmlTokenizer::Private::appendReference(const char *&p, const char *end)
+{
+    static const int maxLength = 32; // even with leading zeros...
+    const char *name = p + 1;
+    const char *semicolon = static_cast<const char *>(memchr(name, ';', qMin(int(end - name), maxLength)));
+    if (!semicolon) {
+        if (end - name < maxLength) {
+            return ReferenceIncomplete;
+        }
+        setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Invalid entity reference."), name);
+        return ReferenceInvalid;
+    }
+    const int length = int(semicolon - name);
+    if (length > 1 && *name == '#') {
+        uint c;
+        if (!parseCharacterReference(name + 1, semicolon, c)) {
+            // The offset is after the reference, like QXmlStreamReader
+            setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Invalid character reference."), semicolon + 1);
+            return ReferenceInvalid;
+        }
+        if (c > 0xffff) {
+            strings.append(QChar(ushort(0xd800 + ((c - 0x10000) >> 10))));
+            strings.append(QChar(ushort(0xdc00 + ((c - 0x10000) & 0x3ff))));
+        } else {
+            strings.append(QChar(ushort(c)));
+        }
+    } else {
+        static const struct {
+            const char *name;
+            int length;
+            char c;
+        } entities[] = {
+            { "lt", 2, '<' }, { "gt", 2, '>' }, { "amp", 3, '&' }, { "quot", 4, '"' }, { "apos", 4, '\'' }
+        };
+        int i = 0;
+        const int count = sizeof(entities) / sizeof(*entities);
+        while (i < count && (entities[i].length != length || memcmp(entities[i].name, name, length) != 0)) {
+            ++i;
+        }
+        if (i == count) {
+            setError(QXmlStreamReader::NotWellFormedError,
+                     QObject::tr("Entity '%1' not declared.").arg(QString::fromUtf8(name, length)), semicolon + 1);
+            return ReferenceInvalid;
+        }
+        strings.append(QLatin1Char(entities[i].c));
+    }
+    p = semicolon + 1;
+    return ReferenceOk;
+}
+
+// Appends [begin, end) with the line breaks normalized, for CDATA sections and comments
+void KDSoapSimdXmlTokenizer::Private::appendNormalized(const char *begin, const char *end)
+{
+    while (begin != end) {
+        const char *carriageReturn = static_cast<const char *>(memchr(begin, '\r', end - begin));
+        if (!carriageReturn) {
+            appendUtf8(strings, begin, end);
+            return;
+        }
+        appendUtf8(strings, begin, carriageReturn);
+        strings.append(QLatin1Char('\n'));
+        begin = carriageReturn + 1;
+        if (begin != end && *begin == '\n') {
+            ++begin;
+        }
+    }
+}
+
+int KDSoapSimdXmlTokenizer::Private::findBinding(const char *prefix, int length) const
+{
+    for (int i = bindings.count() - 1; i >= 0; --i) {
+        const QByteArray &bindingPrefix = bindings.at(i).prefix;
+        if (bindingPrefix.size() == length && memcmp(bindingPrefix.constData(), prefix, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool KDSoapSimdXmlTokenizer::Private::resolve(const char *qualifiedName, int length, bool useDefaultNamespace,
+        int &binding, const char *&localName, int &localNameLength)
+{
+    const char *colon = static_cast<const char *>(memchr(qualifiedName, ':', length));
+    if (!colon) {
+        localName = qualifiedName;
+        localNameLength = length;
+        binding = useDefaultNamespace ? findBinding("", 0) : -1;
+        return true;
+    }
+    const int prefixLength = int(colon - qualifiedName);
+    localName = colon + 1;
+    localNameLength = length - prefixLength - 1;
+    if (prefixLength == 0 || localNameLength == 0 || memchr(localName, ':', localNameLength)) {
+        setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Invalid qualified name."), qualifiedName);
+        return false;
+    }
+    binding = findBinding(qualifiedName, prefixLength);
+    if (binding < 0) {
+        setError(QXmlStreamReader::NotWellFormedError,
+                 QObject::tr("Namespace prefix '%1' not declared").arg(QString::fromUtf8(qualifiedName, prefixLength)), qualifiedName);
+        return false;
+    }
+    return true;
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::readStartElement(const char *p, const char *end)
+{
+    const char *const qualifiedName = p + 1;
+    const char *q;
+    int qualifiedNameLength;
+    char quote = 0;
+    RawAttribute attribute = { 0, 0, 0, 0 };
+    if (partialToken == PartialStartTag) {
+        // rawAttributes and strings still have what was read before
+        partialToken = NoPartialToken;
+        q = p + resumeOffset;
+        qualifiedNameLength = resumeNameLength;
+        quote = resumeQuote;
+        attribute = resumeAttribute;
+    } else {
+        q = skipName(qualifiedName, end);
+        if (q == end) {
+            return needMoreData();
+        }
+        if (q == qualifiedName || !isNameStartChar(*qualifiedName)) {
+            return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Invalid element name."), qualifiedName);
+        }
+        qualifiedNameLength = int(q - qualifiedName);
+    }
+    bool empty = false;
+    Q_FOREVER {
+        if (!quote) {
+            const char *afterPrevious = q;
+            while (q != end && isSpace(*q)) {
+                ++q;
+            }
+            if (q == end) {
+                return suspendStartTag(p, afterPrevious, qualifiedNameLength, 0, attribute);
+            }
+            if (*q == '>') {
+                ++q;
+                break;
+            }
+            if (*q == '/') {
+                if (q + 1 == end) {
+                    return suspendStartTag(p, afterPrevious, qualifiedNameLength, 0, attribute);
+                }
+                if (q[1] != '>') {
+                    return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Expected '>'."), q + 1);
+                }
+                q += 2;
+                empty = true;
+                break;
+            }
+            if (q == afterPrevious) {
+                return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Expected white space."), q);
+            }
+
+            // Attribute
+            const char *const attributeName = q;
+            q = skipName(q, end);
+            if (q == end) {
+                return suspendStartTag(p, afterPrevious, qualifiedNameLength, 0, attribute);
+            }
+            if (q == attributeName || !isNameStartChar(*attributeName)) {
+                return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Invalid attribute name."), attributeName);
+            }
+            attribute.qualifiedNameOffset = int(attributeName - p);
+            attribute.qualifiedNameLength = int(q - attributeName);
+            while (q != end && isSpace(*q)) {
+                ++q;
+            }
+            if (q == end) {
+                return suspendStartTag(p, afterPrevious, qualifiedNameLength, 0, attribute);
+            }
+            if (*q != '=') {
+                return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Expected '='."), q);
+            }
+            ++q;
+            while (q != end && isSpace(*q)) {
+                ++q;
+            }
+            if (q == end) {
+                return suspendStartTag(p, afterPrevious, qualifiedNameLength, 0, attribute);
+            }
+            quote = *q;
+            if (quote != '"' && quote != '\'') {
+                return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Expected a quoted attribute value."), q);
+            }
+            ++q;
+            attribute.valueOffset = strings.size();
+        }
+
+        // Attribute value, the scan continues from q when it was suspended
+        const ScanSet &set = quote == '"' ? sets->doubleQuoted : sets->singleQuoted;
+        Q_FOREVER {
+            const char *delimiter = scan(set, q, end);
+            if (delimiter == end) {
+                delimiter = utf8Boundary(q, end);
+                appendUtf8(strings, q, delimiter);
+                return suspendStartTag(p, delimiter, qualifiedNameLength, quote, attribute);
+            }
+            appendUtf8(strings, q, delimiter);
+            q = delimiter;
+            const char c = *q;
+            if (c == quote) {
+                ++q;
+                break;
+            }
+            if (c == '&') {
+                const ReferenceResult result = appendReference(q, end);
+                if (result == ReferenceIncomplete) {
+                    return suspendStartTag(p, q, qualifiedNameLength, quote, attribute);
+                } else if (result == ReferenceInvalid) {
+                    return type;
+                }
+                continue;
+            }
+            if (c == '<') {
+                return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("'<' is not allowed in attribute values."), q);
+            }
+            if (c == '\r' && q + 1 == end) {
+                return suspendStartTag(p, q, qualifiedNameLength, quote, attribute);
+            }
+            if (c == '\r' && q[1] == '\n') {
+                ++q; // the line feed becomes the space
+                continue;
+            }
+            if (c == '\t' || c == '\n' || c == '\r') {
+                strings.append(QLatin1Char(' '));
+                ++q;
+                continue;
+            }
+            return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Invalid XML character."), q);
+        }
+        quote = 0;
+
+        const char *const attributeName = p + attribute.qualifiedNameOffset;
+        for (int i = 0; i < rawAttributes.count(); ++i) {
+            const RawAttribute &other = rawAttributes.at(i);
+            if (other.qualifiedNameLength == attribute.qualifiedNameLength
+                    && memcmp(p + other.qualifiedNameOffset, attributeName, attribute.qualifiedNameLength) == 0) {
+                return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Attribute redefined."), attributeName);
+            }
+        }
+        attribute.valueLength = strings.size() - attribute.valueOffset;
+        rawAttributes.append(attribute);
+    }
+
+    // The whole tag was read: namespace declarations, then the names
+    for (int i = 0; i < rawAttributes.count(); ++i) {
+        const RawAttribute &attribute = rawAttributes.at(i);
+        const char *name = p + attribute.qualifiedNameOffset;
+        Binding binding;
+        if (attribute.qualifiedNameLength == 5 && memcmp(name, "xmlns", 5) == 0) {
+            // default namespace, empty prefix
+        } else if (attribute.qualifiedNameLength > 6 && memcmp(name, "xmlns:", 6) == 0) {
+            binding.prefix = QByteArray(name + 6, attribute.qualifiedNameLength - 6);
+        } else {
+            continue;
+        }
+        binding.namespaceUri = strings.mid(attribute.valueOffset, attribute.valueLength);
+        bindings.append(binding);
+    }
+    const char *localName;
+    int localNameLength;
+    if (!resolve(qualifiedName, qualifiedNameLength, true, nameBinding, localName, localNameLength)) {
+        bindings.resize(elementBindingStart);
+        return type;
+    }
+    nameOffset = strings.size();
+    appendUtf8(strings, localName, localName + localNameLength);
+    nameLength = strings.size() - nameOffset;
+    for (int i = 0; i < rawAttributes.count(); ++i) {
+        const RawAttribute &raw = rawAttributes.at(i);
+        const char *name = p + raw.qualifiedNameOffset;
+        if (raw.qualifiedNameLength >= 5 && memcmp(name, "xmlns", 5) == 0
+                && (raw.qualifiedNameLength == 5 || name[5] == ':')) {
+            continue;
+        }
+        Attribute attribute;
+        if (!resolve(name, raw.qualifiedNameLength, false, attribute.binding, localName, localNameLength)) {
+            bindings.resize(elementBindingStart);
+            return type;
+        }
+        attribute.nameOffset = strings.size();
+        appendUtf8(strings, localName, localName + localNameLength);
+        attribute.nameLength = strings.size() - attribute.nameOffset;
+        attribute.valueOffset = raw.valueOffset;
+        attribute.valueLength = raw.valueLength;
+        attributes.append(attribute);
+    }
+
+    const OpenElement element = { openNames.size(), qualifiedNameLength, elementBindingStart };
+    openNames.append(qualifiedName, qualifiedNameLength);
+    openElements.append(element);
+    started = true;
+    pendingEndElement = empty;
+    pos = int(q - data);
+    return type = QXmlStreamReader::StartElement;
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::readEndElement(const char *p, const char *end)
+{
+    const char *const qualifiedName = p + 2;
+    const char *q = skipName(qualifiedName, end);
+    const int qualifiedNameLength = int(q - qualifiedName);
+    while (q != end && isSpace(*q)) {
+        ++q;
+    }
+    if (q == end) {
+        return needMoreData();
+    }
+    if (*q != '>') {
+        return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Expected '>'."), q);
+    }
+    if (openElements.isEmpty()) {
+        return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Unexpected end tag."), p);
+    }
+    const OpenElement &element = openElements.last();
+    if (element.qualifiedNameLength != qualifiedNameLength
+            || memcmp(openNames.constData() + element.qualifiedNameOffset, qualifiedName, qualifiedNameLength) != 0) {
+        return setError(QXmlStreamReader::NotWellFormedError, QObject::tr("Opening and ending tag mismatch."), qualifiedName);
+    }
+    const char *localName;
+    int localNameLength;
+    if (!resolve(qualifiedName, qualifiedNameLength, true, nameBinding, localName, localNameLength)) {
+        return type;
+    }
+    nameOffset = strings.size();
+    appendUtf8(strings, localName, localName + localNameLength);
+    nameLength = strings.size() - nameOffset;
+    popOnNext = true;
+    pos = int(q + 1 - data);
+    return type = QXmlStreamReader::EndElement;
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::readProcessingInstruction(const char *p, const char *end)
+{
+    const char *questionMark = p + 2;
+    if (partialToken == PartialProcessingInstruction) {
+        questionMark = p + resumeOffset;
+        partialToken = NoPartialToken;
+    }
+    Q_FOREVER {
+        questionMark = static_cast<const char *>(memchr(questionMark, '?', end - questionMark));
+        if (!questionMark || questionMark + 1 == end) {
+            partialToken = PartialProcessingInstruction;
+            resumeOffset = int((questionMark ? questionMark : end) - p);
+            return needMoreData();
+        }
+        if (questionMark[1] == '>') {
+            break;
+        }
+        ++questionMark;
+    }
+    const char *target = p + 2;
+    const char *afterTarget = skipName(target, questionMark);
+    pos = int(questionMark + 2 - data);
+    if (afterTarget - target != 3 || memcmp(target, "xml", 3) != 0) {
+        return type = QXmlStreamReader::ProcessingInstruction;
+    }
+
+    // XML declaration: anything else than UTF-8 is left to QXmlStreamReader
+    if (!started && discarded == 0) {
+        const QByteArray declaration = QByteArray::fromRawData(afterTarget, int(questionMark - afterTarget));
+        int index = declaration.indexOf("encoding");
+        if (index >= 0) {
+            index = declaration.indexOf('=', index) + 1;
+            while (index > 0 && index < declaration.size() && isSpace(declaration.at(index))) {
+                ++index;
+            }
+            const int endQuote = index > 0 && index < declaration.size() ? declaration.indexOf(declaration.at(index), index + 1) : -1;
+            const QByteArray encoding = endQuote < 0 ? QByteArray() : declaration.mid(index + 1, endQuote - index - 1).toLower();
+            if (encoding != "utf-8" && encoding != "utf8" && encoding != "us-ascii") {
+                pos = 0;
+                return startFallback();
+            }
+        }
+    }
+    return type = QXmlStreamReader::StartDocument;
+}
+
+// content is after "<!--", or after the part decoded by the previous calls. textOffset was set by readNext
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::readComment(const char *content, const char *end)
+{
+    const char *dash = content;
+    Q_FOREVER {
+        dash = static_cast<const char *>(memchr(dash, '-', end - dash));
+        if (!dash || end - dash < 3) {
+            return suspendSection(content, end, PartialComment);
+        }
+        if (dash[1] == '-' && dash[2] == '>') {
+            break;
+        }
+        ++dash;
+    }
+    partialToken = NoPartialToken;
+    appendNormalized(content, dash);
+    textLength = strings.size() - textOffset;
+    pos = int(dash + 3 - data);
+    return type = QXmlStreamReader::Comment;
+}
+
+// Same as readComment, for the content after "<![CDATA["
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::Private::readCData(const char *content, const char *end)
+{
+    const char *bracket = content;
+    Q_FOREVER {
+        bracket = static_cast<const char *>(memchr(bracket, ']', end - bracket));
+        if (!bracket || end - bracket < 3) {
+            return suspendSection(content, end, PartialCData);
+        }
+        if (bracket[1] == ']' && bracket[2] == '>') {
+            break;
+        }
+        ++bracket;
+    }
+    partialToken = NoPartialToken;
+    appendNormalized(content, bracket);
+    textLength = strings.size() - textOffset;
+    pos = int(bracket + 3 - data);
+    return type = QXmlStreamReader::Characters;
+}
+
+KDSoapSimdXmlTokenizer::KDSoapSimdXmlTokenizer()
+    : d(new Private)
+{
+}
+
+KDSoapSimdXmlTokenizer::~KDSoapSimdXmlTokenizer()
+{
+    delete d;
+}
+
+void KDSoapSimdXmlTokenizer::addData(const QByteArray &data)
+{
+    d->addData(data);
+}
+
+void KDSoapSimdXmlTokenizer::clear()
+{
+    d->clear();
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::readNext()
+{
+    if (d->fallback) {
+        return d->fallback->readNext();
+    }
+    return d->readNext();
+}
+
+QXmlStreamReader::TokenType KDSoapSimdXmlTokenizer::tokenType() const
+{
+    if (d->fallback) {
+        return d->fallback->tokenType();
+    }
+    return d->type;
+}
+
+QStringRef KDSoapSimdXmlTokenizer::name() const
+{
+    if (d->fallback) {
+        return d->fallback->name();
+    }
+    if (d->type != QXmlStreamReader::StartElement && d->type != QXmlStreamReader::EndElement) {
+        return QStringRef();
+    }
+    return d->stringRef(d->nameOffset, d->nameLength);
+}
+
+QStringRef KDSoapSimdXmlTokenizer::namespaceUri() const
+{
+    if (d->fallback) {
+        return d->fallback->namespaceUri();
+    }
+    if (d->type != QXmlStreamReader::StartElement && d->type != QXmlStreamReader::EndElement) {
+        return QStringRef();
+    }
+    return d->bindingRef(d->nameBinding);
+}
+
+int KDSoapSimdXmlTokenizer::attributeCount() const
+{
+    if (d->fallback) {
+        return d->fallback->attributeCount();
+    }
+    return d->attributes.count();
+}
+
+QStringRef KDSoapSimdXmlTokenizer::attributeName(int i) const
+{
+    if (d->fallback) {
+        return d->fallback->attributeName(i);
+    }
+    const Private::Attribute &attribute = d->attributes.at(i);
+    return d->stringRef(attribute.nameOffset, attribute.nameLength);
+}
+
+QStringRef KDSoapSimdXmlTokenizer::attributeNamespaceUri(int i) const
+{
+    if (d->fallback) {
+        return d->fallback->attributeNamespaceUri(i);
+    }
+    return d->bindingRef(d->attributes.at(i).binding);
+}
+
+QStringRef KDSoapSimdXmlTokenizer::attributeValue(int i) const
+{
+    if (d->fallback) {
+        return d->fallback->attributeValue(i);
+    }
+    const Private::Attribute &attribute = d->attributes.at(i);
+    return d->stringRef(attribute.valueOffset, attribute.valueLength);
+}
+
+QXmlStreamNamespaceDeclarations KDSoapSimdXmlTokenizer::namespaceDeclarations() const
+{
+    if (d->fallback) {
+        return d->fallback->namespaceDeclarations();
+    }
+    QXmlStreamNamespaceDeclarations declarations;
+    if (d->type == QXmlStreamReader::StartElement) {
+        for (int i = d->elementBindingStart; i < d->bindings.count(); ++i) {
+            const Private::Binding &binding = d->bindings.at(i);
+            declarations.append(QXmlStreamNamespaceDeclaration(QString::fromUtf8(binding.prefix.constData(), binding.prefix.size()), binding.namespaceUri));
+        }
+    }
+    return declarations;
+}
+
+QStringRef KDSoapSimdXmlTokenizer::text() const
+{
+    if (d->fallback) {
+        return d->fallback->text();
+    }
+    if (d->type != QXmlStreamReader::Characters && d->type != QXmlStreamReader::Comment) {
+        return QStringRef();
+    }
+    return d->stringRef(d->textOffset, d->textLength);
+}
+
+void KDSoapSimdXmlTokenizer::raiseError(const QString &message)
+{
+    if (d->fallback) {
+        d->fallback->raiseError(message);
+        return;
+    }
+    d->type = QXmlStreamReader::Invalid;
+    d->error = QXmlStreamReader::CustomError;
+    d->errorString = message;
+    d->errorOffset = d->discarded + d->pos;
+}
+
+QXmlStreamReader::Error KDSoapSimdXmlTokenizer::error() const
+{
+    if (d->fallback) {
+        return d->fallback->error();
+    }
+    return d->error;
+}
+
+QString KDSoapSimdXmlTokenizer::errorString() const
+{
+    if (d->fallback) {
+        return d->fallback->errorString();
+    }
+    return d->errorString;
+}
+
+qint64 KDSoapSimdXmlTokenizer::lineNumber() const
+{
+    if (d->fallback) {
+        return d->fallback->lineNumber();
+    }
+    qint64 column;
+    return d->lineNumber(&column);
+}
+
+qint64 KDSoapSimdXmlTokenizer::columnNumber() const
+{
+    if (d->fallback) {
+        return d->fallback->columnNumber();
+    }
+    qint64 column;
+    d->lineNumber(&column);
+    return column;
+}
+
+qint64 KDSoapSimdXmlTokenizer::characterOffset() const
+{
+    if (d->fallback) {
+        return d->fallback->characterOffset();
+    }
+    return d->error != QXmlStreamReader::NoError ? d->errorOffset : d->discarded + d->pos;
+}
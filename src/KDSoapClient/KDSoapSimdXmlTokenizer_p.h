@@ -0,0 +1,94 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPSIMDXMLTOKENIZER_P_H
+#define KDSOAPSIMDXMLTOKENIZER_P_H
+
+#include "KDSoapXmlTokenizer_p.h"
+
+/**
+ * \internal
+ * XML tokenizer specialized for SOAP messages, see KDSoapMessageReader::setTokenizer.
+ *
+ * It works on the UTF-8 input directly: the runs of text and the attribute values are scanned
+ * 16 or 32 bytes at a time (SSE2, SSE4.2 or AVX2, selected at runtime, with a scalar fallback)
+ * for the bytes which end them or need decoding (markup, references, line breaks, control
+ * characters), and only the names and texts reported to the caller are converted to UTF-16.
+ *
+ * It supports the subset of XML allowed in SOAP messages: namespaces, CDATA sections,
+ * comments and processing instructions, but no DTD (a document type declaration is an error,
+ * as the SOAP specifications require). Documents which are not in UTF-8 (or ASCII) are
+ * handed over to QXmlStreamReader, transparently.
+ * Unlike QXmlStreamReader, it doesn't check every character of the names, and replaces
+ * invalid UTF-8 sequences rather than rejecting them; the document ends with the root element,
+ * whatever follows it is ignored.
+ */
+class KDSOAP_EXPORT KDSoapSimdXmlTokenizer : public KDSoapXmlTokenizer
+{
+public:
+    enum SimdLevel {
+        ScalarLevel,
+        Sse2Level,
+        Sse42Level,
+        Avx2Level
+    };
+    /// The best instruction set supported by the CPU (and the compiler)
+    static SimdLevel maximumSimdLevel();
+    /// The instruction set used by the tokenizers created from now on
+    static SimdLevel simdLevel();
+    /// For tests and benchmarks: use \p level, or the best supported one below it; returns the level used
+    static SimdLevel setSimdLevel(SimdLevel level);
+
+    /// Returns the first byte ending a run of text: '<', '&', ']', a carriage return or a control character
+    static const char *findTextDelimiter(const char *begin, const char *end);
+    /// Returns the first byte ending the part of an attribute value which can be copied as is
+    static const char *findAttributeDelimiter(const char *begin, const char *end, char quote);
+
+    KDSoapSimdXmlTokenizer();
+    ~KDSoapSimdXmlTokenizer();
+
+    virtual void addData(const QByteArray &data);
+    virtual void clear();
+    virtual QXmlStreamReader::TokenType readNext();
+    virtual QXmlStreamReader::TokenType tokenType() const;
+    virtual QStringRef name() const;
+    virtual QStringRef namespaceUri() const;
+    virtual int attributeCount() const;
+    virtual QStringRef attributeName(int i) const;
+    virtual QStringRef attributeNamespaceUri(int i) const;
+    virtual QStringRef attributeValue(int i) const;
+    virtual QXmlStreamNamespaceDeclarations namespaceDeclarations() const;
+    virtual QStringRef text() const;
+    virtual void raiseError(const QString &message);
+    virtual QXmlStreamReader::Error error() const;
+    virtual QString errorString() const;
+    virtual qint64 lineNumber() const;
+    virtual qint64 columnNumber() const;
+    virtual qint64 characterOffset() const;
+
+private:
+    Q_DISABLE_COPY(KDSoapSimdXmlTokenizer)
+    class Private;
+    Private *const d;
+};
+
+#endif // KDSOAPSIMDXMLTOKENIZER_P_H
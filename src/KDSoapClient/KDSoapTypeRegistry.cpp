@@ -0,0 +1,240 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapTypeRegistry.h"
+#include "KDSoapTypeRegistry_p.h"
+#include "KDSoapAtomTable_p.h"
+#include <QAtomicPointer>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QDebug>
+
+// The decoders give the same results as QVariant(text).convert(type), which the reader used before
+
+static bool decodeString(const QString &text, QVariant &value)
+{
+    value = text;
+    return true;
+}
+
+static bool decodeInt(const QString &text, QVariant &value)
+{
+    bool ok;
+    const int i = text.toInt(&ok);
+    if (ok) {
+        value = i;
+    }
+    return ok;
+}
+
+static bool decodeLong(const QString &text, QVariant &value)
+{
+    bool ok;
+    const qlonglong l = text.toLongLong(&ok);
+    if (ok) {
+        value = l;
+    }
+    return ok;
+}
+
+static bool decodeUnsignedInt(const QString &text, QVariant &value)
+{
+    bool ok;
+    const qulonglong u = text.toULongLong(&ok);
+    if (ok) {
+        value = u;
+    }
+    return ok;
+}
+
+static bool decodeBoolean(const QString &text, QVariant &value)
+{
+    value = !(text.isEmpty() || text == QLatin1String("0") || text.compare(QLatin1String("false"), Qt::CaseInsensitive) == 0);
+    return true;
+}
+
+static bool decodeFloat(const QString &text, QVariant &value)
+{
+    bool ok;
+    const float f = text.toFloat(&ok);
+    if (ok) {
+        value = f;
+    }
+    return ok;
+}
+
+static bool decodeDouble(const QString &text, QVariant &value)
+{
+    bool ok;
+    const double d = text.toDouble(&ok);
+    if (ok) {
+        value = d;
+    }
+    return ok;
+}
+
+static bool decodeDate(const QString &text, QVariant &value)
+{
+    const QDate date = QDate::fromString(text, Qt::ISODate);
+    if (date.isValid()) {
+        value = date;
+    }
+    return date.isValid();
+}
+
+static bool decodeTime(const QString &text, QVariant &value)
+{
+    const QTime time = QTime::fromString(text, Qt::ISODate);
+    if (time.isValid()) {
+        value = time;
+    }
+    return time.isValid();
+}
+
+static bool decodeBase64Binary(const QString &text, QVariant &value)
+{
+    value = text.toUtf8();
+    return true;
+}
+
+class KDSoapTypeRegistryData
+{
+public:
+    struct Decoders {
+        QHash<int, KDSoapTypeRegistry::Decoder> byAtom; // indexed by the atom of the type name
+        QHash<QString, KDSoapTypeRegistry::Decoder> byName; // the types which got no atom (the atom table is full)
+    };
+
+    KDSoapTypeRegistryData()
+        : m_decoders(builtinDecoders())
+    {
+        m_snapshots.append(decoders());
+    }
+
+    static Decoders *builtinDecoders()
+    {
+        // Reverse operation from variantToXMLType in KDSoapValue.cpp, keep in sync
+        // (note that dateTime is left as a string, for KDDateTime::fromDateString).
+        // These have well-known atoms, so they don't depend on the state of the atom table.
+        static const struct {
+            KDSoapAtomTable::WellKnownAtom xml; // xsd: prefix assumed
+            KDSoapTypeRegistry::Decoder decoder;
+        } s_types[] = {
+            { KDSoapAtomTable::XsdString, decodeString }, // or QUrl
+            { KDSoapAtomTable::XsdBase64Binary, decodeBase64Binary },
+            { KDSoapAtomTable::XsdInt, decodeInt }, // or uint
+            { KDSoapAtomTable::XsdLong, decodeLong },
+            { KDSoapAtomTable::XsdUnsignedInt, decodeUnsignedInt },
+            { KDSoapAtomTable::XsdBoolean, decodeBoolean },
+            { KDSoapAtomTable::XsdFloat, decodeFloat },
+            { KDSoapAtomTable::XsdDouble, decodeDouble },
+            { KDSoapAtomTable::XsdTime, decodeTime },
+            { KDSoapAtomTable::XsdDate, decodeDate }
+        };
+        Decoders *builtins = new Decoders;
+        for (size_t i = 0; i < sizeof(s_types) / sizeof(*s_types); ++i) {
+            builtins->byAtom.insert(s_types[i].xml, s_types[i].decoder);
+        }
+        return builtins;
+    }
+
+    ~KDSoapTypeRegistryData()
+    {
+        qDeleteAll(m_snapshots);
+    }
+
+    const Decoders *decoders() const
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+        return m_decoders.loadAcquire();
+#else
+        return m_decoders;
+#endif
+    }
+
+    // Publishes a modified copy, the readers don't lock. As in KDSoapServerThreadImpl,
+    // the previous copies are kept, since there are only a few registrations.
+    void registerDecoder(const QString &xmlType, KDSoapTypeRegistry::Decoder decoder)
+    {
+        int atom;
+        KDSoapAtomTable::intern(xmlType, &atom);
+        QMutexLocker lock(&m_mutex);
+        Decoders *newDecoders = new Decoders(*decoders());
+        if (atom == KDSoapAtomTable::NoAtom) {
+            if (decoder) {
+                newDecoders->byName.insert(xmlType, decoder);
+            } else {
+                newDecoders->byName.remove(xmlType);
+            }
+        } else if (decoder) {
+            newDecoders->byAtom.insert(atom, decoder);
+        } else {
+            newDecoders->byAtom.remove(atom);
+        }
+        m_snapshots.append(newDecoders);
+        m_decoders.fetchAndStoreRelease(newDecoders);
+    }
+
+private:
+    QAtomicPointer<const Decoders> m_decoders;
+    QMutex m_mutex; // for the writers
+    QList<const Decoders *> m_snapshots;
+};
+
+Q_GLOBAL_STATIC(KDSoapTypeRegistryData, s_typeRegistry)
+
+KDSoapTypeRegistry::KDSoapTypeRegistry()
+{
+}
+
+void KDSoapTypeRegistry::registerDecoder(const QString &xmlType, Decoder decoder)
+{
+    KDSoapTypeRegistryData *registry = s_typeRegistry();
+    if (registry) {
+        registry->registerDecoder(xmlType, decoder);
+    }
+}
+
+// Only looks the type up: a name which isn't in the atom table has no registered decoder,
+// unless it's one of the types registered by name once the table was full
+bool KDSoapTypeRegistry::decode(const QString &xmlType, const QString &text, QVariant &value)
+{
+    return KDSoapTypeRegistryAtoms::decode(xmlType, KDSoapAtomTable::find(xmlType), text, value);
+}
+
+bool KDSoapTypeRegistryAtoms::decode(const QString &xmlType, int xmlTypeAtom, const QString &text, QVariant &value)
+{
+    KDSoapTypeRegistryData *registry = s_typeRegistry();
+    if (!registry) {
+        return false;
+    }
+    const KDSoapTypeRegistryData::Decoders *decoders = registry->decoders();
+    KDSoapTypeRegistry::Decoder decoder = 0;
+    if (xmlTypeAtom != KDSoapAtomTable::NoAtom) {
+        decoder = decoders->byAtom.value(xmlTypeAtom);
+    } else if (!decoders->byName.isEmpty() && !xmlType.isEmpty()) {
+        decoder = decoders->byName.value(xmlType);
+    }
+    return decoder && decoder(text, value);
+}
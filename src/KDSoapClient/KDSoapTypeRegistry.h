@@ -0,0 +1,69 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPTYPEREGISTRY_H
+#define KDSOAPTYPEREGISTRY_H
+
+#include "KDSoapGlobal.h"
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+
+/**
+ * Decoding of the simple types of encoded messages (use="encoded").
+ *
+ * When an element of a received message has an xsi:type attribute, like xsi:type="xsd:int",
+ * the decoder registered for that type parses the text of the element directly into a
+ * QVariant of the right type (int, qlonglong, double, bool, QDate, QTime...).
+ * Elements with an unknown type, or whose text can't be decoded, keep their text as a QString.
+ *
+ * The types are identified by their name, without namespace. Decoders are provided for
+ * string, int, long, unsignedInt, boolean, float, double, date, time and base64Binary
+ * (the latter as an undecoded QByteArray, like before).
+ *
+ * \since 1.7
+ */
+class KDSOAP_EXPORT KDSoapTypeRegistry //krazy:exclude=dpointer
+{
+public:
+    /**
+     * Parses \p text into \p value, returns false if \p text isn't valid for the type.
+     */
+    typedef bool (*Decoder)(const QString &text, QVariant &value);
+
+    /**
+     * Registers \p decoder for the XML type \p xmlType (e.g. "duration"), replacing the
+     * previous decoder of that type, if any. A null \p decoder unregisters the type.
+     * Thread-safe, but decoders are meant to be registered once, at startup.
+     */
+    static void registerDecoder(const QString &xmlType, Decoder decoder);
+
+    /**
+     * Decodes \p text with the decoder registered for \p xmlType.
+     * Returns false if there's none, or if it failed.
+     */
+    static bool decode(const QString &xmlType, const QString &text, QVariant &value);
+
+private:
+    KDSoapTypeRegistry();
+};
+
+#endif // KDSOAPTYPEREGISTRY_H
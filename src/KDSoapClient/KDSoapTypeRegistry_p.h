@@ -0,0 +1,38 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPTYPEREGISTRY_P_H
+#define KDSOAPTYPEREGISTRY_P_H
+
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+
+// The lookups of KDSoapTypeRegistry for the message reader, which already has the atom of the type
+// name (see KDSoapAtomTable), so that the atom numbering isn't part of the public API.
+namespace KDSoapTypeRegistryAtoms
+{
+// Decodes \p text with the decoder registered for the type \p xmlTypeAtom; \p xmlType is only
+// used when \p xmlTypeAtom is NoAtom (the atom table is full, or the name is too long).
+bool decode(const QString &xmlType, int xmlTypeAtom, const QString &text, QVariant &value);
+}
+
+#endif // KDSOAPTYPEREGISTRY_P_H
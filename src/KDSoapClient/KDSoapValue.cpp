@@ -24,16 +24,53 @@
 #include "KDSoapNamespacePrefixes_p.h"
 #include "KDSoapNamespaceManager.h"
 #include "KDDateTime.h"
+#include "KDSoapObjectPool_p.h"
+#include "KDSoapValueArena_p.h"
 #include <QDateTime>
 #include <QUrl>
 #include <QDebug>
 
+Q_GLOBAL_STATIC(KDSoapObjectPool, s_valuePool)
+
 class KDSoapValue::Private : public QSharedData
 {
 public:
-    Private(): m_qualified(false), m_nillable(false) {}
+    Private(): m_qualified(false), m_nillable(false), m_node(-1), m_pending(0) {}
+    Private(const KDSoapValueArena *arena, int node)
+        : m_qualified(false), m_nillable(false), m_arena(const_cast<KDSoapValueArena *>(arena)), m_node(node), m_pending(1) {}
     Private(const QString &n, const QVariant &v, const QString &typeNameSpace, const QString &typeName)
-        : m_name(n), m_value(v), m_typeNamespace(typeNameSpace), m_typeName(typeName), m_qualified(false), m_nillable(false) {}
+        : m_name(n), m_value(v), m_typeNamespace(typeNameSpace), m_typeName(typeName), m_qualified(false), m_nillable(false),
+          m_node(-1), m_pending(0) {}
+    // Detaching a pending value: materialize it first, the copy doesn't need the arena
+    Private(const Private &other)
+        : QSharedData(other), m_node(-1), m_pending(0)
+    {
+        other.materialize();
+        m_name = other.m_name;
+        m_nameNamespace = other.m_nameNamespace;
+        m_value = other.m_value;
+        m_typeNamespace = other.m_typeNamespace;
+        m_typeName = other.m_typeName;
+        m_childValues = other.m_childValues;
+        m_qualified = other.m_qualified;
+        m_nillable = other.m_nillable;
+    }
+
+    // One per element of every message, so recycle them (the pool is gone during static destruction)
+    static void *operator new(size_t size)
+    {
+        KDSoapObjectPool *pool = s_valuePool();
+        return pool ? pool->allocate(size) : ::operator new(size);
+    }
+    static void operator delete(void *ptr, size_t size)
+    {
+        KDSoapObjectPool *pool = s_valuePool();
+        if (pool) {
+            pool->release(ptr, size);
+        } else {
+            ::operator delete(ptr);
+        }
+    }
 
     QString m_name;
     QString m_nameNamespace;
@@ -43,8 +80,42 @@ public:
     KDSoapValueList m_childValues;
     bool m_qualified;
     bool m_nillable;
+
+    // Lazy values (see KDSoapMessageReader::setLazyValues): m_value and m_childValues are
+    // only filled from the node of the arena the first time they are accessed, by any copy.
+    // m_arena and m_node are set once by the constructor and never change afterwards, other
+    // threads can still be reading them; the arena is released with the value.
+    const QExplicitlySharedDataPointer<KDSoapValueArena> m_arena;
+    const int m_node;
+    QAtomicInt m_pending;
+
+    bool isPending() const
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+        return m_pending.loadAcquire();
+#else
+        return m_pending;
+#endif
+    }
+    void materialize() const
+    {
+        if (isPending()) {
+            const_cast<Private *>(this)->materializeNode();
+        }
+    }
+    void materializeNode();
 };
 
+void KDSoapValue::Private::materializeNode()
+{
+    QMutexLocker lock(&m_arena->m_mutex);
+    if (!isPending()) { // done by another thread meanwhile
+        return;
+    }
+    m_arena->materialize(m_node, m_value, m_childValues);
+    m_pending.fetchAndStoreRelease(0);
+}
+
 uint qHash(const KDSoapValue &value)
 {
     return qHash(value.name());
@@ -66,6 +137,21 @@ KDSoapValue::KDSoapValue(const QString &n, const KDSoapValueList &children, cons
     d->m_childValues = children;
 }
 
+KDSoapValue::KDSoapValue(const KDSoapValueArena *arena, int node)
+    : d(0)
+{
+    const KDSoapValueArena::Node &n = arena->node(node);
+    if (n.textLength > 0 || n.attributeCount > 0 || n.childCount > 0) {
+        d = new Private(arena, node);
+    } else {
+        d = new Private;
+    }
+    d->m_name = arena->symbolString(n.name);
+    d->m_nameNamespace = arena->symbolString(n.nameNamespace);
+    d->m_typeNamespace = arena->symbolString(n.typeNamespace);
+    d->m_typeName = arena->symbolString(n.typeName);
+}
+
 KDSoapValue::~KDSoapValue()
 {
 }
@@ -82,6 +168,9 @@ bool KDSoapValue::isNull() const
 
 bool KDSoapValue::isNil() const
 {
+    if (d->isPending()) { // only the nodes with a value, attributes or children are pending
+        return false;
+    }
     return d->m_value.isNull() && d->m_childValues.isEmpty() && d->m_childValues.attributes().isEmpty();
 }
 
@@ -97,11 +186,13 @@ QString KDSoapValue::name() const
 
 QVariant KDSoapValue::value() const
 {
+    d->materialize();
     return d->m_value;
 }
 
 void KDSoapValue::setValue(const QVariant &value)
 {
+    d->materialize();
     d->m_value = value;
 }
 
@@ -117,6 +208,7 @@ void KDSoapValue::setQualified(bool qualified)
 
 KDSoapValueList &KDSoapValue::childValues() const
 {
+    d->materialize();
     // I want to fool the QSharedDataPointer mechanism here...
     return const_cast<KDSoapValueList &>(d->m_childValues);
 }
@@ -245,6 +337,13 @@ static QString variantToXMLType(const QVariant &value)
 }
 
 void KDSoapValue::writeElement(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use, const QString &messageNamespace, bool forceQualified) const
+{
+    writeStartElement(writer, messageNamespace, forceQualified);
+    writeElementContents(namespacePrefixes, writer, use, messageNamespace);
+    writer.writeEndElement();
+}
+
+void KDSoapValue::writeStartElement(QXmlStreamWriter &writer, const QString &messageNamespace, bool forceQualified) const
 {
     Q_ASSERT(!name().isEmpty());
     if (!d->m_nameNamespace.isEmpty() && d->m_nameNamespace != messageNamespace) {
@@ -261,11 +360,17 @@ void KDSoapValue::writeElement(KDSoapNamespacePrefixes &namespacePrefixes, QXmlS
     } else {
         writer.writeStartElement(name());
     }
-    writeElementContents(namespacePrefixes, writer, use, messageNamespace);
-    writer.writeEndElement();
 }
 
 void KDSoapValue::writeElementContents(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use, const QString &messageNamespace) const
+{
+    writeElementAttributes(namespacePrefixes, writer, use);
+    writeChildren(namespacePrefixes, writer, use, messageNamespace, false);
+    writeElementText(writer);
+}
+
+// The attributes coming from the value itself: nil, and the type information for use=encoded
+void KDSoapValue::writeElementAttributes(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use) const
 {
     const QVariant value = this->value();
 
@@ -293,14 +398,28 @@ void KDSoapValue::writeElementContents(KDSoapNamespacePrefixes &namespacePrefixe
             writer.writeAttribute(KDSoapNamespaceManager::soapEncoding(), QLatin1String("arrayType"), namespacePrefixes.resolve(list.arrayTypeNs(), list.arrayType()) + QLatin1Char('[') + QString::number(list.count()) + QLatin1Char(']'));
         }
     }
-    writeChildren(namespacePrefixes, writer, use, messageNamespace, false);
+}
 
+void KDSoapValue::writeElementText(QXmlStreamWriter &writer) const
+{
+    const QVariant value = this->value();
     if (!value.isNull()) {
         writer.writeCharacters(variantToTextValue(value, this->typeNs(), this->type()));
     }
 }
 
 void KDSoapValue::writeChildren(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use, const QString &messageNamespace, bool forceQualified) const
+{
+    writeAttributes(writer, forceQualified);
+    KDSoapValueListIterator it(childValues());
+    while (it.hasNext()) {
+        const KDSoapValue &element = it.next();
+        element.writeElement(namespacePrefixes, writer, use, messageNamespace, forceQualified);
+    }
+}
+
+// The attributes stored as child values
+void KDSoapValue::writeAttributes(QXmlStreamWriter &writer, bool forceQualified) const
 {
     const KDSoapValueList &args = childValues();
     Q_FOREACH (const KDSoapValue &attr, args.attributes()) {
@@ -313,11 +432,6 @@ void KDSoapValue::writeChildren(KDSoapNamespacePrefixes &namespacePrefixes, QXml
             writer.writeAttribute(attr.name(), variantToTextValue(attr.value(), attr.typeNs(), attr.type()));
         }
     }
-    KDSoapValueListIterator it(args);
-    while (it.hasNext()) {
-        const KDSoapValue &element = it.next();
-        element.writeElement(namespacePrefixes, writer, use, messageNamespace, forceQualified);
-    }
 }
 
 ////
@@ -43,6 +43,7 @@ Q_DECLARE_METATYPE(signed char)
 
 class KDSoapValueList;
 class KDSoapNamespacePrefixes;
+class KDSoapValueArena;
 QT_BEGIN_NAMESPACE
 class QXmlStreamWriter;
 QT_END_NAMESPACE
@@ -241,10 +242,20 @@ private:
     // To catch mistakes
     KDSoapValue(QString, QString, QString);
 
+    // Value created on demand from a parsed message, see KDSoapMessageReader::setLazyValues
+    friend class KDSoapValueArena;
+    KDSoapValue(const KDSoapValueArena *arena, int node);
+
     friend class KDSoapMessageWriter;
+    friend class KDSoapMessageStreamWriter;
     void writeElement(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use, const QString &messageNamespace, bool forceQualified) const;
     void writeElementContents(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use, const QString &messageNamespace) const;
     void writeChildren(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use, const QString &messageNamespace, bool forceQualified) const;
+    // The parts of writeElement, for KDSoapMessageStreamWriter
+    void writeStartElement(QXmlStreamWriter &writer, const QString &messageNamespace, bool forceQualified) const;
+    void writeElementAttributes(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use) const;
+    void writeAttributes(QXmlStreamWriter &writer, bool forceQualified) const;
+    void writeElementText(QXmlStreamWriter &writer) const;
 
     class Private;
     QSharedDataPointer<Private> d;
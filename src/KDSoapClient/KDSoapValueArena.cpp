@@ -0,0 +1,141 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapValueArena_p.h"
+#include "KDSoapAtomTable_p.h"
+#include "KDSoapTypeRegistry_p.h"
+
+KDSoapValueArena::KDSoapValueArena()
+{
+}
+
+// A symbol is an atom (>= 0), -1 for an empty string, or -2 - the index of the string in m_strings
+int KDSoapValueArena::addSymbol(const QString &str, int atom)
+{
+    if (atom != KDSoapAtomTable::NoAtom) {
+        return atom;
+    }
+    if (str.isEmpty()) {
+        return -1;
+    }
+    m_strings.append(str);
+    return -1 - m_strings.count();
+}
+
+QString KDSoapValueArena::symbolString(int symbol) const
+{
+    if (symbol >= 0) {
+        return KDSoapAtomTable::string(symbol);
+    }
+    if (symbol == -1) {
+        return QString();
+    }
+    return m_strings.at(-2 - symbol);
+}
+
+int KDSoapValueArena::startElement(int name, int nameNamespace)
+{
+    const int index = m_nodes.count();
+    if (!m_openElements.isEmpty()) {
+        OpenElement &parent = m_openElements.last();
+        if (parent.lastChild != -1) {
+            m_nodes[parent.lastChild].nextSibling = index;
+        }
+        parent.lastChild = index;
+        ++m_nodes[parent.index].childCount;
+    }
+    const Node node = { name, nameNamespace, -1, -1, 0, 0, 0, 0, -1 };
+    m_nodes.append(node);
+    const OpenElement element = { index, -1 };
+    m_openElements.append(element);
+    return index;
+}
+
+void KDSoapValueArena::setType(int element, int typeNamespace, int typeName)
+{
+    m_nodes[element].typeNamespace = typeNamespace;
+    m_nodes[element].typeName = typeName;
+}
+
+// Must be called right after startElement
+void KDSoapValueArena::addAttribute(int name, const QStringRef &value)
+{
+    Q_ASSERT(m_openElements.last().lastChild == -1);
+    const Node node = { name, -1, -1, -1, m_text.size(), value.size(), 0, 0, -1 };
+    m_nodes.append(node);
+    m_text.append(value);
+    ++m_nodes[m_openElements.last().index].attributeCount;
+}
+
+// Like KDSoapMessageReader, keeps the last run of text of the element
+void KDSoapValueArena::addText(int element, const QStringRef &text, bool append)
+{
+    Node &node = m_nodes[element];
+    if (!append) {
+        if (node.textLength > 0 && node.textOffset + node.textLength == m_text.size()) {
+            m_text.truncate(node.textOffset); // nothing else was stored since the previous run, reuse its space
+        }
+        node.textOffset = m_text.size();
+        node.textLength = 0;
+    }
+    m_text.append(text);
+    node.textLength += text.size();
+}
+
+void KDSoapValueArena::endElement()
+{
+    m_openElements.pop_back();
+    if (m_openElements.isEmpty()) {
+        m_nodes.squeeze();
+        m_text.squeeze();
+    }
+}
+
+KDSoapValue KDSoapValueArena::value(int node) const
+{
+    return KDSoapValue(this, node);
+}
+
+void KDSoapValueArena::materialize(int node, QVariant &elementValue, KDSoapValueList &childValues) const
+{
+    const Node &element = m_nodes.at(node);
+    if (element.textLength > 0) {
+        const QString text(m_text.constData() + element.textOffset, element.textLength);
+        // Same as KDSoapMessageReader::Private::endElement
+        const int typeAtom = element.typeName >= 0 ? element.typeName : int(KDSoapAtomTable::NoAtom);
+        const QString typeName = typeAtom == KDSoapAtomTable::NoAtom ? symbolString(element.typeName) : QString();
+        if (!KDSoapTypeRegistryAtoms::decode(typeName, typeAtom, text, elementValue)) {
+            elementValue = text;
+        }
+    }
+    int child = node + 1;
+    for (int i = 0; i < element.attributeCount; ++i, ++child) {
+        const Node &attribute = m_nodes.at(child);
+        childValues.attributes().append(KDSoapValue(symbolString(attribute.name),
+                                        QString(m_text.constData() + attribute.textOffset, attribute.textLength)));
+    }
+    if (element.childCount > 0) {
+        for (; child != -1; child = m_nodes.at(child).nextSibling) {
+            childValues.append(value(child));
+        }
+    }
+}
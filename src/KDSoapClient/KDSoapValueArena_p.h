@@ -0,0 +1,99 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPVALUEARENA_P_H
+#define KDSOAPVALUEARENA_P_H
+
+#include "KDSoapValue.h"
+#include <QSharedData>
+#include <QMutex>
+#include <QVector>
+
+/**
+ * \internal
+ * Compact representation of the elements of a parsed message, see KDSoapMessageReader::setLazyValues.
+ *
+ * Each element, and each attribute, is a fixed-size record of one vector, in document order:
+ * an element is followed by its attributes, then by its children. Names are atoms of
+ * KDSoapAtomTable, and the texts are stored one after the other in a single QString.
+ *
+ * The KDSoapValue objects are created from it on demand: a value created by value()
+ * only has its name and type, its value and child values are filled in the first time
+ * they are accessed (see materialize()). The arena is shared by these values.
+ */
+class KDSoapValueArena : public QSharedData
+{
+public:
+    struct Node {
+        int name; // symbol, see addSymbol()
+        int nameNamespace;
+        int typeNamespace; // from xsi:type
+        int typeName;
+        int textOffset; // in m_text
+        int textLength; // 0 if the element has no text
+        int attributeCount; // the attributes follow the element
+        int childCount; // then its children
+        int nextSibling; // -1 for the last child
+    };
+
+    KDSoapValueArena();
+
+    // Building, used by KDSoapMessageReader
+    int addSymbol(const QString &str, int atom);
+    int startElement(int name, int nameNamespace);
+    void setType(int element, int typeNamespace, int typeName);
+    void addAttribute(int name, const QStringRef &value);
+    void addText(int element, const QStringRef &text, bool append);
+    void endElement();
+    int openElementCount() const
+    {
+        return m_openElements.count();
+    }
+    int currentElement() const
+    {
+        return m_openElements.last().index;
+    }
+
+    // Reading
+    KDSoapValue value(int node) const;
+    const Node &node(int index) const
+    {
+        return m_nodes.at(index);
+    }
+    QString symbolString(int symbol) const;
+    void materialize(int node, QVariant &elementValue, KDSoapValueList &childValues) const;
+
+    mutable QMutex m_mutex; // for KDSoapValue, whose values can be read from several threads
+
+private:
+    Q_DISABLE_COPY(KDSoapValueArena)
+    QVector<Node> m_nodes;
+    QString m_text;
+    QVector<QString> m_strings; // the names which didn't get an atom (the atom table is full)
+    struct OpenElement {
+        int index;
+        int lastChild;
+    };
+    QVector<OpenElement> m_openElements;
+};
+
+#endif // KDSOAPVALUEARENA_P_H
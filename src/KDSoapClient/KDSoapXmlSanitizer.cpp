@@ -0,0 +1,216 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapXmlSanitizer_p.h"
+#include <string.h>
+
+static const int s_maxReferenceLength = 32; // even with leading zeros...
+
+static bool isXmlChar(uint c)
+{
+    return c == 0x9 || c == 0xa || c == 0xd || (c >= 0x20 && c <= 0xd7ff) ||
+           (c >= 0xe000 && c <= 0xfffd) || (c >= 0x10000 && c <= 0x10ffff);
+}
+
+// p is on '&'. Returns the length of the character reference ("&#...;"), 0 if this isn't
+// a well-formed character reference (left for the parser to report), -1 if the data ends before its end
+static int parseCharacterReference(const char *p, const char *end, uint &value)
+{
+    const char *q = p + 1;
+    if (q == end) {
+        return -1;
+    }
+    if (*q != '#') {
+        return 0;
+    }
+    if (++q == end) {
+        return -1;
+    }
+    const bool hex = *q == 'x';
+    if (hex) {
+        ++q;
+    }
+    const char *digits = q;
+    value = 0;
+    for (; q != end && q - p < s_maxReferenceLength; ++q) {
+        const char c = *q;
+        uint digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (hex && c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (hex && c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            break;
+        }
+        value = qMin(value * (hex ? 16 : 10) + digit, 0x110000u); // anything above 0x10ffff is invalid
+    }
+    if (q == end) {
+        return q - p < s_maxReferenceLength ? -1 : 0;
+    }
+    if (*q != ';' || q == digits) {
+        return 0;
+    }
+    return q + 1 - p;
+}
+
+// 1 if the data at p starts with the delimiter, 0 if it doesn't, -1 if the data ends before we know
+static int matchDelimiter(const char *p, const char *end, const char *delimiter, int length)
+{
+    const int available = qMin(int(end - p), length);
+    if (memcmp(p, delimiter, available) != 0) {
+        return 0;
+    }
+    return available == length ? 1 : -1;
+}
+
+KDSoapXmlSanitizer::KDSoapXmlSanitizer()
+{
+    reset();
+}
+
+QByteArray KDSoapXmlSanitizer::filter(const QByteArray &data)
+{
+    QByteArray input = data;
+    if (!m_pending.isEmpty()) {
+        input = m_pending + data;
+        m_pending.clear();
+    }
+    if (m_mode == UndecidedMode) {
+        if (input.size() < 2) {
+            m_pending = input;
+            return QByteArray();
+        }
+        // A byte order mark, or a null byte in the first character, means UTF-16 or UTF-32,
+        // where null bytes are part of the characters
+        const uchar first = input.at(0);
+        const uchar second = input.at(1);
+        m_mode = (first == 0 || second == 0 || first == 0xfe || first == 0xff) ? PassThroughMode : FilterMode;
+    }
+    if (m_mode == PassThroughMode) {
+        return input;
+    }
+
+    const char *const begin = input.constData();
+    const char *const end = begin + input.size();
+    const char *p = begin;
+    const char *copied = begin; // what comes before was appended to result
+    QByteArray result;
+    while (p != end) {
+        const uchar c = *p;
+        if (c < 0x20) {
+            if (c != '\t' && c != '\n' && c != '\r') {
+                result.append(copied, p - copied);
+                copied = p + 1;
+                ++m_fixedCount;
+            }
+            ++p;
+            continue;
+        }
+        int match = 0;
+        if (m_state == MarkupState) {
+            if (c == '&') {
+                uint value;
+                const int length = parseCharacterReference(p, end, value);
+                if (length < 0) {
+                    break;
+                }
+                if (length > 0 && !isXmlChar(value)) {
+                    result.append(copied, p - copied);
+                    result.append('?');
+                    copied = p + length;
+                    ++m_fixedCount;
+                }
+                p += qMax(length, 1);
+                continue;
+            }
+            if (c == '<') {
+                const int comment = matchDelimiter(p, end, "<!--", 4);
+                const int cdata = matchDelimiter(p, end, "<![CDATA[", 9);
+                if (comment < 0 || cdata < 0) {
+                    break;
+                }
+                if (comment) {
+                    m_state = CommentState;
+                    p += 4;
+                    continue;
+                } else if (cdata) {
+                    m_state = CDataState;
+                    p += 9;
+                    continue;
+                }
+            }
+        } else if (m_state == CommentState && c == '-') {
+            match = matchDelimiter(p, end, "-->", 3);
+        } else if (m_state == CDataState && c == ']') {
+            match = matchDelimiter(p, end, "]]>", 3);
+        }
+        if (match < 0) {
+            break;
+        } else if (match) {
+            m_state = MarkupState;
+            p += 3;
+        } else {
+            ++p;
+        }
+    }
+    if (p != end) {
+        m_pending = QByteArray(p, end - p);
+    }
+    if (copied == begin) {
+        return p == end ? input : input.left(p - begin);
+    }
+    result.append(copied, p - copied);
+    return result;
+}
+
+QByteArray KDSoapXmlSanitizer::finish()
+{
+    const QByteArray rest = m_pending;
+    const int fixedCount = m_fixedCount;
+    reset();
+    m_fixedCount = fixedCount;
+    return rest;
+}
+
+void KDSoapXmlSanitizer::reset()
+{
+    m_mode = UndecidedMode;
+    m_state = MarkupState;
+    m_fixedCount = 0;
+    m_pending.clear();
+}
+
+QByteArray KDSoapXmlSanitizer::sanitize(const QByteArray &data, int *fixedCount)
+{
+    KDSoapXmlSanitizer sanitizer;
+    QByteArray result = sanitizer.filter(data);
+    const QByteArray rest = sanitizer.finish();
+    if (!rest.isEmpty()) {
+        result += rest;
+    }
+    if (fixedCount) {
+        *fixedCount = sanitizer.fixedCount();
+    }
+    return result;
+}
@@ -0,0 +1,81 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPXMLSANITIZER_P_H
+#define KDSOAPXMLSANITIZER_P_H
+
+#include "KDSoapGlobal.h"
+#include <QByteArray>
+
+/**
+ * \internal
+ * Filter repairing the documents sent by peers which don't escape their data properly,
+ * see KDSoapMessageReader::setSanitizeInput.
+ *
+ * In a single pass over the data, it replaces the character references to characters which
+ * aren't allowed in XML (such as "&#x13;") with '?', and removes the control characters
+ * (other than tab, line feed and carriage return), which QXmlStreamReader rejects.
+ * The content of comments and CDATA sections is left as is, except for the control characters.
+ * Documents in UTF-16 or UTF-32 are passed through unchanged.
+ *
+ * The data can be filtered in parts of any size: a reference or a markup delimiter which
+ * isn't complete yet is kept until the next part arrives.
+ */
+class KDSOAP_EXPORT KDSoapXmlSanitizer
+{
+public:
+    KDSoapXmlSanitizer();
+
+    /// Returns the filtered data (the data itself, without any copy, if there was nothing to fix)
+    QByteArray filter(const QByteArray &data);
+    /// Returns what filter() kept at the end of the document, and prepares for the next document
+    QByteArray finish();
+    void reset();
+
+    /// Number of character references replaced and control characters removed since the last reset()
+    int fixedCount() const
+    {
+        return m_fixedCount;
+    }
+
+    /// Filters a whole document
+    static QByteArray sanitize(const QByteArray &data, int *fixedCount = 0);
+
+private:
+    enum Mode {
+        UndecidedMode, // until the encoding is known
+        FilterMode,
+        PassThroughMode
+    };
+    enum State {
+        MarkupState, // text and tags
+        CommentState,
+        CDataState
+    };
+
+    Mode m_mode;
+    State m_state;
+    int m_fixedCount;
+    QByteArray m_pending; // incomplete reference or delimiter, at the end of the previous data
+};
+
+#endif // KDSOAPXMLSANITIZER_P_H
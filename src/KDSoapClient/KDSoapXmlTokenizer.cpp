@@ -0,0 +1,126 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapXmlTokenizer_p.h"
+
+KDSoapXmlTokenizer::~KDSoapXmlTokenizer()
+{
+}
+
+KDSoapQXmlStreamTokenizer::KDSoapQXmlStreamTokenizer()
+{
+}
+
+void KDSoapQXmlStreamTokenizer::addData(const QByteArray &data)
+{
+    m_reader.addData(data);
+}
+
+void KDSoapQXmlStreamTokenizer::clear()
+{
+    m_reader.clear();
+    m_attributes.clear();
+}
+
+QXmlStreamReader::TokenType KDSoapQXmlStreamTokenizer::readNext()
+{
+    const QXmlStreamReader::TokenType type = m_reader.readNext();
+    if (type == QXmlStreamReader::StartElement) {
+        m_attributes = m_reader.attributes();
+    }
+    return type;
+}
+
+QXmlStreamReader::TokenType KDSoapQXmlStreamTokenizer::tokenType() const
+{
+    return m_reader.tokenType();
+}
+
+QStringRef KDSoapQXmlStreamTokenizer::name() const
+{
+    return m_reader.name();
+}
+
+QStringRef KDSoapQXmlStreamTokenizer::namespaceUri() const
+{
+    return m_reader.namespaceUri();
+}
+
+int KDSoapQXmlStreamTokenizer::attributeCount() const
+{
+    return m_attributes.count();
+}
+
+QStringRef KDSoapQXmlStreamTokenizer::attributeName(int i) const
+{
+    return m_attributes.at(i).name();
+}
+
+QStringRef KDSoapQXmlStreamTokenizer::attributeNamespaceUri(int i) const
+{
+    return m_attributes.at(i).namespaceUri();
+}
+
+QStringRef KDSoapQXmlStreamTokenizer::attributeValue(int i) const
+{
+    return m_attributes.at(i).value();
+}
+
+QXmlStreamNamespaceDeclarations KDSoapQXmlStreamTokenizer::namespaceDeclarations() const
+{
+    return m_reader.namespaceDeclarations();
+}
+
+QStringRef KDSoapQXmlStreamTokenizer::text() const
+{
+    return m_reader.text();
+}
+
+void KDSoapQXmlStreamTokenizer::raiseError(const QString &message)
+{
+    m_reader.raiseError(message);
+}
+
+QXmlStreamReader::Error KDSoapQXmlStreamTokenizer::error() const
+{
+    return m_reader.error();
+}
+
+QString KDSoapQXmlStreamTokenizer::errorString() const
+{
+    return m_reader.errorString();
+}
+
+qint64 KDSoapQXmlStreamTokenizer::lineNumber() const
+{
+    return m_reader.lineNumber();
+}
+
+qint64 KDSoapQXmlStreamTokenizer::columnNumber() const
+{
+    return m_reader.columnNumber();
+}
+
+qint64 KDSoapQXmlStreamTokenizer::characterOffset() const
+{
+    return m_reader.characterOffset();
+}
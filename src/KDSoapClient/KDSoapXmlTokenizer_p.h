@@ -0,0 +1,122 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPXMLTOKENIZER_P_H
+#define KDSOAPXMLTOKENIZER_P_H
+
+#include "KDSoapGlobal.h"
+#include <QXmlStreamReader>
+
+/**
+ * \internal
+ * The part of the QXmlStreamReader API used by KDSoapMessageReader, so that it can use
+ * either QXmlStreamReader or KDSoapSimdXmlTokenizer (see KDSoapMessageReader::setTokenizer).
+ *
+ * Same semantics as QXmlStreamReader: readNext() returns Invalid with PrematureEndOfDocumentError
+ * when it needs more data, and continues once addData() was called. The names, namespaces,
+ * texts and attributes returned are only valid until the next call to readNext().
+ * Unlike QXmlStreamReader::attributes(), the attributes are read by index, which doesn't
+ * create a QString per attribute; the namespace declarations are not part of them.
+ */
+class KDSOAP_EXPORT KDSoapXmlTokenizer
+{
+public:
+    virtual ~KDSoapXmlTokenizer();
+
+    virtual void addData(const QByteArray &data) = 0;
+    virtual void clear() = 0;
+    virtual QXmlStreamReader::TokenType readNext() = 0;
+    virtual QXmlStreamReader::TokenType tokenType() const = 0;
+
+    bool isStartElement() const
+    {
+        return tokenType() == QXmlStreamReader::StartElement;
+    }
+    bool isEndElement() const
+    {
+        return tokenType() == QXmlStreamReader::EndElement;
+    }
+    bool isCharacters() const
+    {
+        return tokenType() == QXmlStreamReader::Characters;
+    }
+
+    // StartElement and EndElement
+    virtual QStringRef name() const = 0;
+    virtual QStringRef namespaceUri() const = 0;
+    // StartElement
+    virtual int attributeCount() const = 0;
+    virtual QStringRef attributeName(int i) const = 0;
+    virtual QStringRef attributeNamespaceUri(int i) const = 0;
+    virtual QStringRef attributeValue(int i) const = 0;
+    virtual QXmlStreamNamespaceDeclarations namespaceDeclarations() const = 0;
+    // Characters
+    virtual QStringRef text() const = 0;
+
+    virtual void raiseError(const QString &message) = 0;
+    virtual QXmlStreamReader::Error error() const = 0;
+    virtual QString errorString() const = 0;
+    bool hasError() const
+    {
+        return error() != QXmlStreamReader::NoError;
+    }
+    virtual qint64 lineNumber() const = 0;
+    virtual qint64 columnNumber() const = 0;
+    /// QXmlStreamReader counts characters, KDSoapSimdXmlTokenizer counts bytes of input
+    virtual qint64 characterOffset() const = 0;
+};
+
+/**
+ * \internal
+ * The default tokenizer, using QXmlStreamReader.
+ */
+class KDSOAP_EXPORT KDSoapQXmlStreamTokenizer : public KDSoapXmlTokenizer
+{
+public:
+    KDSoapQXmlStreamTokenizer();
+
+    virtual void addData(const QByteArray &data);
+    virtual void clear();
+    virtual QXmlStreamReader::TokenType readNext();
+    virtual QXmlStreamReader::TokenType tokenType() const;
+    virtual QStringRef name() const;
+    virtual QStringRef namespaceUri() const;
+    virtual int attributeCount() const;
+    virtual QStringRef attributeName(int i) const;
+    virtual QStringRef attributeNamespaceUri(int i) const;
+    virtual QStringRef attributeValue(int i) const;
+    virtual QXmlStreamNamespaceDeclarations namespaceDeclarations() const;
+    virtual QStringRef text() const;
+    virtual void raiseError(const QString &message);
+    virtual QXmlStreamReader::Error error() const;
+    virtual QString errorString() const;
+    virtual qint64 lineNumber() const;
+    virtual qint64 columnNumber() const;
+    virtual qint64 characterOffset() const;
+
+private:
+    Q_DISABLE_COPY(KDSoapQXmlStreamTokenizer)
+    QXmlStreamReader m_reader;
+    QXmlStreamAttributes m_attributes; // of the current StartElement
+};
+
+#endif // KDSOAPXMLTOKENIZER_P_H
@@ -0,0 +1,289 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapCompression_p.h"
+#include <QList>
+
+#ifdef KDSOAP_HAVE_ZLIB
+#include <zlib.h>
+#include <string.h>
+#endif
+
+bool KDSoapCompression::isSupported()
+{
+#ifdef KDSOAP_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+KDSoapCompression::Encoding KDSoapCompression::encodingFromHeader(const QByteArray &contentEncoding)
+{
+    const QByteArray encoding = contentEncoding.trimmed().toLower();
+    if (encoding.isEmpty() || encoding == "identity") {
+        return Identity;
+    }
+    if (encoding == "gzip" || encoding == "x-gzip") {
+        return Gzip;
+    }
+    if (encoding == "deflate") {
+        return Deflate;
+    }
+    return Unsupported;
+}
+
+// For instance "gzip, deflate" or "deflate;q=1.0, gzip;q=0.5, *;q=0" (RFC 2616 section 14.3).
+// gzip is preferred when the client doesn't say otherwise.
+KDSoapCompression::Encoding KDSoapCompression::negotiate(const QByteArray &acceptEncoding)
+{
+    if (!isSupported() || acceptEncoding.isEmpty()) {
+        return Identity;
+    }
+    double gzipQuality = -1;
+    double deflateQuality = -1;
+    double anyQuality = -1;
+    const QList<QByteArray> items = acceptEncoding.split(',');
+    Q_FOREACH (const QByteArray &item, items) {
+        const int semicolon = item.indexOf(';');
+        const QByteArray coding = (semicolon == -1 ? item : item.left(semicolon)).trimmed().toLower();
+        double quality = 1;
+        if (semicolon != -1) {
+            const QByteArray parameter = item.mid(semicolon + 1).trimmed();
+            if (parameter.startsWith("q=")) {
+                quality = parameter.mid(2).toDouble();
+            }
+        }
+        if (coding == "gzip" || coding == "x-gzip") {
+            gzipQuality = quality;
+        } else if (coding == "deflate") {
+            deflateQuality = quality;
+        } else if (coding == "*") {
+            anyQuality = quality;
+        }
+    }
+    if (gzipQuality < 0) {
+        gzipQuality = anyQuality;
+    }
+    if (deflateQuality < 0) {
+        deflateQuality = anyQuality;
+    }
+    if (gzipQuality > 0 && gzipQuality >= deflateQuality) {
+        return Gzip;
+    }
+    if (deflateQuality > 0) {
+        return Deflate;
+    }
+    return Identity;
+}
+
+QByteArray KDSoapCompression::encodingName(Encoding encoding)
+{
+    switch (encoding) {
+    case Gzip:
+        return "gzip";
+    case Deflate:
+        return "deflate";
+    default:
+        break;
+    }
+    return "identity";
+}
+
+// Returns an empty array if the data couldn't be compressed
+QByteArray KDSoapCompression::compress(const QByteArray &data, Encoding encoding, int level)
+{
+#ifdef KDSOAP_HAVE_ZLIB
+    if (encoding != Gzip && encoding != Deflate) {
+        return QByteArray();
+    }
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // "deflate" is the zlib format (RFC 1950), not raw deflate data
+    const int windowBits = encoding == Gzip ? MAX_WBITS + 16 : MAX_WBITS;
+    if (deflateInit2(&stream, qBound(1, level, 9), Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return QByteArray();
+    }
+    QByteArray output;
+    output.resize(int(deflateBound(&stream, data.size())) + 32); // + the gzip header, for old zlib versions
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef *>(output.data());
+    stream.avail_out = output.size();
+    const int ret = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (ret != Z_STREAM_END) {
+        return QByteArray();
+    }
+    output.resize(int(stream.total_out));
+    return output;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(encoding);
+    Q_UNUSED(level);
+    return QByteArray();
+#endif
+}
+
+////
+
+class KDSoapInflater::Private
+{
+public:
+    Private()
+        : active(false), finished(false), detectFormat(false), tooLarge(false), outputSize(0), maxOutputSize(-1)
+    {
+#ifdef KDSOAP_HAVE_ZLIB
+        memset(&stream, 0, sizeof(stream));
+#endif
+    }
+
+#ifdef KDSOAP_HAVE_ZLIB
+    z_stream stream;
+#endif
+    bool active;
+    bool finished;
+    bool detectFormat; // "deflate": zlib format, or raw deflate data as sent by some clients
+    bool tooLarge;
+    qint64 outputSize;
+    qint64 maxOutputSize;
+};
+
+KDSoapInflater::KDSoapInflater()
+    : d(new Private)
+{
+}
+
+KDSoapInflater::~KDSoapInflater()
+{
+    end();
+    delete d;
+}
+
+void KDSoapInflater::end()
+{
+#ifdef KDSOAP_HAVE_ZLIB
+    if (d->active) {
+        inflateEnd(&d->stream);
+        memset(&d->stream, 0, sizeof(d->stream));
+    }
+#endif
+    d->active = false;
+    d->finished = false;
+    d->detectFormat = false;
+    d->tooLarge = false;
+    d->outputSize = 0;
+}
+
+void KDSoapInflater::setMaxOutputSize(qint64 size)
+{
+    d->maxOutputSize = size;
+}
+
+bool KDSoapInflater::start(KDSoapCompression::Encoding encoding)
+{
+    end();
+#ifdef KDSOAP_HAVE_ZLIB
+    if (encoding == KDSoapCompression::Gzip) {
+        d->active = inflateInit2(&d->stream, MAX_WBITS + 16) == Z_OK;
+        return d->active;
+    }
+    if (encoding == KDSoapCompression::Deflate) {
+        d->detectFormat = true; // see inflate()
+        return true;
+    }
+#else
+    Q_UNUSED(encoding);
+#endif
+    return false;
+}
+
+#ifdef KDSOAP_HAVE_ZLIB
+// RFC 1950 section 2.2: compression method 8, window size up to 32K, header checksum
+static bool looksLikeZlibHeader(const char *data, int size)
+{
+    const uchar cmf = uchar(data[0]);
+    if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7) {
+        return false;
+    }
+    return size < 2 || ((cmf << 8) | uchar(data[1])) % 31 == 0;
+}
+#endif
+
+bool KDSoapInflater::inflate(const char *data, int size, QByteArray &output)
+{
+#ifdef KDSOAP_HAVE_ZLIB
+    if (d->tooLarge) {
+        return false;
+    }
+    if (size == 0 || d->finished) {
+        return true; // ignore anything after the end of the compressed data
+    }
+    if (d->detectFormat) {
+        d->detectFormat = false;
+        const int windowBits = looksLikeZlibHeader(data, size) ? MAX_WBITS : -MAX_WBITS;
+        d->active = inflateInit2(&d->stream, windowBits) == Z_OK;
+    }
+    if (!d->active) {
+        return false;
+    }
+    d->stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    d->stream.avail_in = size;
+    char buffer[16384];
+    int ret;
+    do {
+        d->stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        d->stream.avail_out = sizeof(buffer);
+        ret = ::inflate(&d->stream, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            return false;
+        }
+        const int outputSize = int(sizeof(buffer) - d->stream.avail_out);
+        d->outputSize += outputSize;
+        // Checked for each buffer: a few kilobytes can decompress to gigabytes
+        if (d->maxOutputSize > -1 && d->outputSize > d->maxOutputSize) {
+            d->tooLarge = true;
+            return false;
+        }
+        output.append(buffer, outputSize);
+    } while (d->stream.avail_out == 0 && ret != Z_STREAM_END);
+    if (ret == Z_STREAM_END) {
+        d->finished = true;
+    }
+    return true;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(output);
+    return false;
+#endif
+}
+
+bool KDSoapInflater::isFinished() const
+{
+    return d->finished;
+}
+
+bool KDSoapInflater::isTooLarge() const
+{
+    return d->tooLarge;
+}
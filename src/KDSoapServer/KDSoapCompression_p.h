@@ -0,0 +1,78 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPCOMPRESSION_P_H
+#define KDSOAPCOMPRESSION_P_H
+
+#include "KDSoapServerGlobal.h"
+#include <QByteArray>
+
+/**
+ * HTTP content encodings (RFC 2616 section 3.5), for compressing the responses
+ * and decompressing the requests. Only available when building with zlib.
+ */
+namespace KDSoapCompression
+{
+enum Encoding { Identity, Gzip, Deflate, Unsupported };
+
+KDSOAPSERVER_EXPORT bool isSupported();
+
+// The encoding of a request, from its Content-Encoding header
+KDSOAPSERVER_EXPORT Encoding encodingFromHeader(const QByteArray &contentEncoding);
+
+// The preferred encoding for a response, from the Accept-Encoding header of the request
+KDSOAPSERVER_EXPORT Encoding negotiate(const QByteArray &acceptEncoding);
+
+KDSOAPSERVER_EXPORT QByteArray encodingName(Encoding encoding);
+
+// level: 1 (fastest) to 9 (best compression)
+KDSOAPSERVER_EXPORT QByteArray compress(const QByteArray &data, Encoding encoding, int level);
+}
+
+/**
+ * Decompresses a request body while it is being received.
+ */
+class KDSOAPSERVER_EXPORT KDSoapInflater
+{
+public:
+    KDSoapInflater();
+    ~KDSoapInflater();
+
+    // Returns false if the encoding isn't supported
+    bool start(KDSoapCompression::Encoding encoding);
+    // Maximum size of the decompressed data of each stream, -1 (the default) for no limit
+    void setMaxOutputSize(qint64 size);
+    // Appends the decompressed data to output. Returns false on invalid data, or if it exceeds the maximum size.
+    bool inflate(const char *data, int size, QByteArray &output);
+    // True once the end of the compressed stream was seen
+    bool isFinished() const;
+    // True if inflate() failed because of the maximum size
+    bool isTooLarge() const;
+
+private:
+    Q_DISABLE_COPY(KDSoapInflater)
+    void end();
+    class Private;
+    Private *d;
+};
+
+#endif // KDSOAPCOMPRESSION_P_H
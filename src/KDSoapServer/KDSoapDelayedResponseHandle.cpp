@@ -23,17 +23,33 @@
 
 #include "KDSoapDelayedResponseHandle.h"
 #include "KDSoapServerSocket_p.h"
+#include "KDSoapServerCall_p.h"
 #include <QSharedData>
 #include <QPointer>
 
 class KDSoapDelayedResponseHandleData : public QSharedData
 {
 public:
-    KDSoapDelayedResponseHandleData(KDSoapServerSocket *s)
-        : socket(s)
-    {}
+    KDSoapDelayedResponseHandleData(KDSoapServerSocket *s, KDSoapServerCall *c = 0)
+        : socket(s), responseId(0), call(c)
+    {
+        if (call) {
+            call->addResponseHandle();
+        }
+    }
+    ~KDSoapDelayedResponseHandleData()
+    {
+        if (call) {
+            call->releaseResponseHandle();
+        }
+    }
     // QPointer in case the client disconnects during a delayed response
     QPointer<KDSoapServerSocket> socket;
+    // Identifies the delayed response on the socket, which ignores it after its deadline
+    int responseId;
+    // In a worker thread (KDSoapThreadPool::RequestScheduling); the call outlives the socket,
+    // and is kept alive by its handles: the last one deletes it, if no reply was sent
+    KDSoapServerCall *call;
 };
 
 KDSoapDelayedResponseHandle::KDSoapDelayedResponseHandle() : data(new KDSoapDelayedResponseHandleData(0))
@@ -59,10 +75,26 @@ KDSoapDelayedResponseHandle::~KDSoapDelayedResponseHandle()
 KDSoapDelayedResponseHandle::KDSoapDelayedResponseHandle(KDSoapServerSocket *socket)
     : data(new KDSoapDelayedResponseHandleData(socket))
 {
-    socket->setResponseDelayed();
+    data->responseId = socket->setResponseDelayed();
+}
+
+KDSoapDelayedResponseHandle::KDSoapDelayedResponseHandle(KDSoapServerCall *call)
+    : data(new KDSoapDelayedResponseHandleData(0, call))
+{
+    call->setResponseDelayed();
 }
 
 KDSoapServerSocket *KDSoapDelayedResponseHandle::serverSocket() const
 {
     return data->socket;
 }
+
+KDSoapServerCall *KDSoapDelayedResponseHandle::serverCall() const
+{
+    return data->call;
+}
+
+int KDSoapDelayedResponseHandle::responseId() const
+{
+    return data->responseId;
+}
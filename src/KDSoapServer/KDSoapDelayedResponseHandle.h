@@ -29,6 +29,7 @@
 
 class KDSoapDelayedResponseHandleData;
 class KDSoapServerSocket;
+class KDSoapServerCall;
 
 /**
  * The delayed-response handle is an opaque data type representing
@@ -50,7 +51,10 @@ public:
 private:
     friend class KDSoapServerObjectInterface;
     explicit KDSoapDelayedResponseHandle(KDSoapServerSocket *socket);
+    explicit KDSoapDelayedResponseHandle(KDSoapServerCall *call);
     KDSoapServerSocket *serverSocket() const;
+    KDSoapServerCall *serverCall() const;
+    int responseId() const;
     QSharedDataPointer<KDSoapDelayedResponseHandleData> data;
 };
 
@@ -0,0 +1,603 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapEpollReactor_p.h"
+#include "KDSoapSocketList_p.h"
+#include "KDSoapServerSocket_p.h"
+#include "KDSoapServerObjectInterface.h"
+#include "KDSoapServerAuthInterface.h"
+#include "KDSoapServerRawXMLInterface.h"
+#include "KDSoapThreadPool.h"
+#include "KDSoapServer.h"
+#include <KDSoapClient/KDSoapMessage.h>
+#include <QSocketNotifier>
+#include <QTimerEvent>
+
+#ifdef Q_OS_LINUX
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#define KDSOAP_HAVE_EPOLL
+#endif
+
+#ifdef KDSOAP_HAVE_EPOLL
+
+enum {
+    MaxEvents = 256, // per epoll_wait() call, the notifier fires again if there are more
+    ReadSize = 16384,
+    MaxReadPerEvent = 16 * ReadSize, // then the other connections get their turn, see resumeReading()
+    MaxPendingOutput = 256 * 1024, // pipelined requests wait until the client reads the previous responses
+    IdleCheckInterval = 1000 // msecs, the keep-alive timeout is in seconds
+};
+
+KDSoapEpollReactor::Connection::Connection(int socketDescriptor)
+    : fd(socketDescriptor),
+      receivedData(false),
+      keepAlive(true),
+      closing(false),
+      callAdmitted(false),
+      callRejected(false),
+      readPaused(false),
+      requestCount(0),
+      lastActivity(0),
+      previous(0),
+      next(0),
+      outputPos(0),
+      messageReader(0),
+      requestSize(0),
+      parseTime(0)
+{
+}
+
+KDSoapEpollReactor::Connection::~Connection()
+{
+    delete messageReader;
+}
+
+KDSoapEpollReactor::KDSoapEpollReactor(KDSoapSocketList *owner, QObject *serverObject)
+    : QObject(0),
+      m_owner(owner),
+      m_serverObjectInterface(0),
+      m_epollFd(-1),
+      m_notifier(0),
+      m_idleHead(0),
+      m_idleTail(0),
+      m_servicingDepth(0),
+      m_current(0),
+      m_dispatching(false),
+      m_adoptedSocket(0),
+      m_requestSize(0),
+      m_callMetrics(0)
+{
+    // These interfaces are called with the socket of each request
+    if (!qobject_cast<KDSoapServerAuthInterface *>(serverObject) && !qobject_cast<KDSoapServerRawXMLInterface *>(serverObject)) {
+        m_serverObjectInterface = qobject_cast<KDSoapServerObjectInterface *>(serverObject);
+    }
+    m_clock.start();
+    m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd == -1) {
+        qWarning("KDSoapServer: epoll_create1 failed (%s), using QTcpSocket instead", strerror(errno));
+        return;
+    }
+    m_notifier = new QSocketNotifier(m_epollFd, QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)), this, SLOT(slotActivated()));
+}
+
+KDSoapEpollReactor::~KDSoapEpollReactor()
+{
+    closeAll();
+    qDeleteAll(m_removedConnections);
+    delete m_notifier;
+    if (m_epollFd != -1) {
+        ::close(m_epollFd);
+    }
+}
+
+bool KDSoapEpollReactor::addConnection(int socketDescriptor)
+{
+    if (m_epollFd == -1) {
+        return false;
+    }
+    const int flags = ::fcntl(socketDescriptor, F_GETFL);
+    if (flags == -1 || ::fcntl(socketDescriptor, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return false;
+    }
+    Connection *c = new Connection(socketDescriptor);
+    if (!watch(c, EPOLL_CTL_ADD)) {
+        delete c;
+        return false;
+    }
+    m_owner->socketAdded();
+    touch(c);
+    if (!m_idleTimer.isActive()) {
+        m_idleTimer.start(IdleCheckInterval, this);
+    }
+    return true;
+}
+
+// Edge-triggered: each event is reported once, so writeData goes on until EAGAIN, and so does readData,
+// unless it pauses the connection
+bool KDSoapEpollReactor::watch(Connection *c, int operation)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = c;
+    return ::epoll_ctl(m_epollFd, operation, c->fd, &event) != -1;
+}
+
+void KDSoapEpollReactor::closeAll()
+{
+    while (m_idleHead) {
+        closeConnection(m_idleHead);
+    }
+}
+
+void KDSoapEpollReactor::slotActivated()
+{
+    struct epoll_event events[MaxEvents];
+    int count;
+    do {
+        count = ::epoll_wait(m_epollFd, events, MaxEvents, 0);
+    } while (count == -1 && errno == EINTR);
+
+    // The connections closed meanwhile are only deleted at the end, since they can still be in events
+    ++m_servicingDepth;
+    for (int i = 0; i < count; ++i) {
+        Connection *c = static_cast<Connection *>(events[i].data.ptr);
+        if (c->fd != -1) {
+            serviceConnection(c);
+        }
+    }
+    if (--m_servicingDepth == 0) {
+        qDeleteAll(m_removedConnections);
+        m_removedConnections.clear();
+    }
+}
+
+void KDSoapEpollReactor::serviceConnection(Connection *c)
+{
+    touch(c);
+    m_current = c;
+    // Writing the pending output first makes room for the responses to the new requests
+    bool ok = writeData(c) && readData(c);
+    if (ok) {
+        handleRequests(c);
+        ok = c->fd == -1 || writeData(c);
+    }
+    m_current = 0;
+    if (c->fd == -1) {
+        return; // handed over to a socket, or closed by closeAll()
+    }
+    if (!ok || (c->closing && c->outputPos == c->output.size())) {
+        closeConnection(c);
+    } else if (c->readPaused && c->output.size() - c->outputPos < MaxPendingOutput) {
+        resumeReading(c);
+    }
+}
+
+// Returns false on error. Stops before EAGAIN once MaxReadPerEvent bytes were read, and doesn't read
+// anything while MaxPendingOutput bytes are waiting to be written: the connection is then paused.
+bool KDSoapEpollReactor::readData(Connection *c)
+{
+    if (c->output.size() - c->outputPos >= MaxPendingOutput) {
+        c->readPaused = true; // resumed once the client has read the responses
+        return true;
+    }
+    c->readPaused = false;
+    QByteArray &buffer = c->parser.buffer();
+    int totalRead = 0;
+    for (;;) {
+        if (totalRead >= MaxReadPerEvent) {
+            c->readPaused = true;
+            return true;
+        }
+        const int oldSize = buffer.size();
+        buffer.resize(oldSize + ReadSize);
+        const ssize_t nread = ::read(c->fd, buffer.data() + oldSize, ReadSize);
+        buffer.resize(nread > 0 ? oldSize + int(nread) : oldSize);
+        if (nread > 0) {
+            totalRead += int(nread);
+            // Counted like in KDSoapServerSocket::slotReadyRead
+            if (!c->receivedData) {
+                c->receivedData = true;
+                m_owner->increaseConnectionCount();
+            }
+        } else if (nread == 0) {
+            // The client won't send anything else, but still gets the responses to what it sent
+            c->closing = true;
+            return true;
+        } else if (errno != EINTR) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
+// The data left in the socket by a paused connection isn't reported again by the edge-triggered
+// epoll instance, unless the connection is modified: this queues a new event for it.
+void KDSoapEpollReactor::resumeReading(Connection *c)
+{
+    c->readPaused = false;
+    if (!watch(c, EPOLL_CTL_MOD)) {
+        closeConnection(c);
+    }
+}
+
+// Returns false on error
+bool KDSoapEpollReactor::writeData(Connection *c)
+{
+    while (c->outputPos < c->output.size()) {
+        const ssize_t written = ::send(c->fd, c->output.constData() + c->outputPos, c->output.size() - c->outputPos, MSG_NOSIGNAL);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK; // the rest is written on EPOLLOUT
+        }
+        c->outputPos += int(written);
+    }
+    c->output.clear(); // idle connections don't keep a buffer around
+    c->outputPos = 0;
+    return true;
+}
+
+// Same as KDSoapServerSocket::handleRequests, for the requests which don't need a socket
+void KDSoapEpollReactor::handleRequests(Connection *c)
+{
+    while (c->keepAlive && c->output.size() - c->outputPos < MaxPendingOutput) {
+        KDSoapHttpRequestParser::Status status;
+        while ((status = c->parser.parse()) == KDSoapHttpRequestParser::HeadersComplete) {
+            if (!canHandle(c->parser)) {
+                // The receive buffer still starts with this request, the socket parses it again
+                handOver(c)->handleRequests();
+                return;
+            }
+            c->callAdmitted = m_owner->admitCall();
+            c->callRejected = !c->callAdmitted;
+        }
+
+        if (status == KDSoapHttpRequestParser::BadRequest) {
+            c->output += "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+            c->parser.clear();
+            // No way to tell where the next request would start
+            c->keepAlive = false;
+            finishResponse(c);
+            return;
+        }
+        if (c->callRejected) {
+            c->parser.discardBody();
+        }
+        if (status == KDSoapHttpRequestParser::NeedMoreData) {
+            if (!c->callRejected && c->parser.bodySize() > 0) {
+                parseBody(c);
+            }
+            return;
+        }
+
+        KDSoapServer *server = m_owner->server();
+        m_connectionHeaders = KDSoapServerSocket::keepAliveHeaders(c->parser, ++c->requestCount, server, server->keepAliveTimeout(), c->keepAlive);
+        if (c->callRejected) {
+            c->output += "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: "
+                         + QByteArray::number(server->retryAfter()) + "\r\n" + m_connectionHeaders + "\r\n";
+            c->parser.reset();
+            c->callRejected = false;
+        } else {
+            handleCall(c);
+            if (c->fd == -1) {
+                return; // handed over during the call
+            }
+        }
+        c->receivedData = false;
+        finishResponse(c);
+    }
+}
+
+// Parses the part of the body received so far, like KDSoapServerSocket does,
+// so that a large body doesn't have to be kept around until it was fully received
+void KDSoapEpollReactor::parseBody(Connection *c)
+{
+    if (!c->messageReader) {
+        c->messageReader = new KDSoapMessageReader;
+        KDSoapServerSocket::setupMessageReader(*c->messageReader, m_owner->server());
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray body = c->parser.body();
+    c->requestSize += body.size();
+    // Deep copy: the body is a view into the receive buffer, which is about to be reused
+    c->messageReader->addData(QByteArray(body.constData(), body.size()));
+    c->parser.discardBody();
+    c->parseTime += KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+}
+
+// Everything but plain SOAP calls goes through KDSoapServerSocket, see KDSoapServer::setIoBackend
+bool KDSoapEpollReactor::canHandle(const KDSoapHttpRequestParser &request) const
+{
+    if (!m_serverObjectInterface || request.requestType() != "POST" || request.hasHeader("content-encoding")) {
+        return false;
+    }
+    KDSoapServer *server = m_owner->server();
+    if (server->compressionThreshold() > -1 || server->responseChunkSize() > 0 || server->logLevel() != KDSoapServer::LogNothing) {
+        return false;
+    }
+    KDSoapThreadPool *threadPool = server->threadPool();
+    return !threadPool || threadPool->schedulingMode() != KDSoapThreadPool::RequestScheduling;
+}
+
+// Same as the SOAP part of KDSoapServerSocket::handleRequest, the response is appended to the output
+void KDSoapEpollReactor::handleCall(Connection *c)
+{
+    KDSoapServer *server = m_owner->server();
+    const QString path = QString::fromLatin1(c->parser.path().constData());
+    const QByteArray soapAction = KDSoapServerSocket::soapActionFromHeaders(c->parser);
+
+    KDSoapMessage requestMsg;
+    KDSoapHeaders requestHeaders;
+    QElapsedTimer timer;
+    KDSoapMessageReader::XmlError err;
+    qint64 parseTime;
+    if (c->messageReader) {
+        // The rest of a body received in several parts, see parseBody
+        parseBody(c);
+        timer.start();
+        err = c->messageReader->finish(&requestMsg, &m_messageNamespace, &requestHeaders);
+        m_requestSize = c->requestSize;
+        parseTime = c->parseTime + KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+        delete c->messageReader;
+        c->messageReader = 0;
+        c->requestSize = 0;
+        c->parseTime = 0;
+    } else {
+        timer.start();
+        const QByteArray body = c->parser.body();
+        m_requestSize = body.size();
+        KDSoapServerSocket::setupMessageReader(m_messageReader, server);
+        err = m_messageReader.xmlToMessage(body, &requestMsg, &m_messageNamespace, &requestHeaders);
+        parseTime = KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+    }
+    c->parser.reset(); // keeps the pipelined requests, if any
+
+    KDSoapMessage replyMsg;
+    replyMsg.setUse(server->use());
+    m_method = requestMsg.name();
+    KDSoapMetricsRecorder *metrics = m_owner->metrics();
+    m_callMetrics = metrics->callStarted(m_method, m_requestSize, parseTime);
+
+    if (err == KDSoapMessageReader::PrematureEndOfDocumentError) {
+        // Like KDSoapServerSocket: the body is complete but the envelope isn't, the connection is closed
+        c->keepAlive = false;
+        m_connectionHeaders = "Connection: close\r\n";
+        KDSoapServerSocket::handleError(replyMsg, "Client.Data", QString::fromLatin1("Incomplete SOAP message"));
+    } else {
+        // The server object only gets a socket if it asks for one, see takeOverConnection
+        m_serverObjectInterface->setServerSocket(0);
+        m_serverObjectInterface->setEpollReactor(this);
+        m_dispatching = true;
+        m_notifier->setEnabled(false); // in case the server object runs a nested event loop
+        timer.start();
+        KDSoapServerSocket::makeCall(server, m_serverObjectInterface, requestMsg, replyMsg, requestHeaders, soapAction, path);
+        metrics->recordLatency(KDSoapServerMetrics::DispatchPhase, KDSoapMetricsRecorder::elapsedMicroseconds(timer));
+        m_notifier->setEnabled(true);
+        m_dispatching = false;
+        m_serverObjectInterface->setEpollReactor(0);
+
+        if (m_adoptedSocket) {
+            KDSoapServerSocket *socket = m_adoptedSocket;
+            m_adoptedSocket = 0;
+            socket->finishAdoptedCall(m_serverObjectInterface, replyMsg);
+            return;
+        }
+    }
+
+    timer.start();
+    const QByteArray xmlResponse = KDSoapServerSocket::replyToXml(m_serverObjectInterface, replyMsg, m_method, m_messageNamespace);
+    metrics->recordLatency(KDSoapServerMetrics::SerializePhase, KDSoapMetricsRecorder::elapsedMicroseconds(timer));
+
+    timer.start();
+    const QByteArray httpHeaders = KDSoapServerSocket::httpResponseHeaders(replyMsg.isFault(), "text/xml", xmlResponse.size(), m_connectionHeaders);
+    c->output += httpHeaders;
+    c->output += xmlResponse;
+    metrics->recordLatency(KDSoapServerMetrics::WritePhase, KDSoapMetricsRecorder::elapsedMicroseconds(timer));
+    metrics->callFinished(m_callMetrics, replyMsg.isFault(), httpHeaders.size() + xmlResponse.size());
+    m_callMetrics = 0;
+}
+
+void KDSoapEpollReactor::finishResponse(Connection *c)
+{
+    if (c->callAdmitted) {
+        c->callAdmitted = false;
+        m_owner->releaseCall();
+    }
+    if (!c->keepAlive) {
+        c->closing = true; // once the response is written, anything else the client sends is ignored
+    }
+}
+
+KDSoapServerSocket *KDSoapEpollReactor::takeOverConnection()
+{
+    if (!m_dispatching || !m_current || m_current->fd == -1) {
+        return 0;
+    }
+    Connection *c = m_current;
+    KDSoapServerSocket *socket = handOver(c);
+    // The state of the current call, see KDSoapServerSocket::handleRequest
+    socket->m_keepAlive = c->keepAlive;
+    socket->m_connectionHeaders = m_connectionHeaders;
+    socket->m_method = m_method;
+    socket->m_messageNamespace = m_messageNamespace;
+    socket->m_requestSize = m_requestSize;
+    socket->m_requestTimer.start();
+    socket->m_callMetrics = m_callMetrics;
+    m_callMetrics = 0;
+    socket->m_callAdmitted = c->callAdmitted;
+    c->callAdmitted = false;
+    m_adoptedSocket = socket; // see handleCall
+    return socket;
+}
+
+// The socket gets the data received and not handled yet, and the responses not written yet
+KDSoapServerSocket *KDSoapEpollReactor::handOver(Connection *c)
+{
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_DEL, c->fd, 0);
+    KDSoapServerSocket *socket = m_owner->createSocket(c->fd);
+    socket->m_receivedData = c->receivedData;
+    socket->m_requestCount = c->requestCount;
+    socket->m_requestParser.buffer() = c->parser.buffer();
+    if (c->outputPos < c->output.size()) {
+        socket->write(c->output.constData() + c->outputPos, c->output.size() - c->outputPos);
+    }
+    c->fd = -1;
+    removeConnection(c);
+    return socket;
+}
+
+void KDSoapEpollReactor::closeConnection(Connection *c)
+{
+    ::close(c->fd); // also removes it from the epoll instance
+    c->fd = -1;
+    c->keepAlive = false;
+    if (c->callAdmitted) {
+        c->callAdmitted = false;
+        m_owner->releaseCall();
+    }
+    removeConnection(c);
+}
+
+void KDSoapEpollReactor::removeConnection(Connection *c)
+{
+    unlink(c);
+    m_owner->socketRemoved();
+    if (m_servicingDepth > 0) {
+        m_removedConnections.append(c);
+    } else {
+        delete c;
+    }
+    if (!m_idleHead) {
+        m_idleTimer.stop();
+    }
+}
+
+// The idle list is sorted by last activity, so that the idle timeout only looks at its head
+void KDSoapEpollReactor::touch(Connection *c)
+{
+    c->lastActivity = m_clock.elapsed();
+    if (c == m_idleTail) {
+        return;
+    }
+    unlink(c);
+    c->previous = m_idleTail;
+    if (m_idleTail) {
+        m_idleTail->next = c;
+    } else {
+        m_idleHead = c;
+    }
+    m_idleTail = c;
+}
+
+void KDSoapEpollReactor::unlink(Connection *c)
+{
+    if (c->previous) {
+        c->previous->next = c->next;
+    } else if (m_idleHead == c) {
+        m_idleHead = c->next;
+    }
+    if (c->next) {
+        c->next->previous = c->previous;
+    } else if (m_idleTail == c) {
+        m_idleTail = c->previous;
+    }
+    c->previous = c->next = 0;
+}
+
+// Same as KDSoapServerSocket::timeout, for all the connections at once
+void KDSoapEpollReactor::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != m_idleTimer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+    const int idleTimeout = m_owner->server()->keepAliveTimeout();
+    if (idleTimeout <= 0) {
+        return;
+    }
+    const qint64 oldestActivity = m_clock.elapsed() - qint64(idleTimeout) * 1000;
+    while (m_idleHead && m_idleHead != m_current && m_idleHead->lastActivity <= oldestActivity) {
+        closeConnection(m_idleHead);
+    }
+}
+
+#else // KDSOAP_HAVE_EPOLL
+
+// Not available, KDSoapSocketList creates sockets instead
+
+KDSoapEpollReactor::KDSoapEpollReactor(KDSoapSocketList *owner, QObject *serverObject)
+    : QObject(0),
+      m_owner(owner),
+      m_serverObjectInterface(0),
+      m_epollFd(-1),
+      m_notifier(0),
+      m_idleHead(0),
+      m_idleTail(0),
+      m_servicingDepth(0),
+      m_current(0),
+      m_dispatching(false),
+      m_adoptedSocket(0),
+      m_requestSize(0),
+      m_callMetrics(0)
+{
+    Q_UNUSED(serverObject);
+}
+
+KDSoapEpollReactor::~KDSoapEpollReactor()
+{
+}
+
+bool KDSoapEpollReactor::addConnection(int socketDescriptor)
+{
+    Q_UNUSED(socketDescriptor);
+    return false;
+}
+
+void KDSoapEpollReactor::closeAll()
+{
+}
+
+KDSoapServerSocket *KDSoapEpollReactor::takeOverConnection()
+{
+    return 0;
+}
+
+void KDSoapEpollReactor::slotActivated()
+{
+}
+
+void KDSoapEpollReactor::timerEvent(QTimerEvent *event)
+{
+    QObject::timerEvent(event);
+}
+
+#endif // KDSOAP_HAVE_EPOLL
+
+#include "moc_KDSoapEpollReactor_p.cpp"
@@ -0,0 +1,150 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPEPOLLREACTOR_P_H
+#define KDSOAPEPOLLREACTOR_P_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include "KDSoapHttpRequestParser_p.h"
+#include "KDSoapMetricsRecorder_p.h"
+#include <KDSoapClient/KDSoapMessageReader_p.h>
+
+QT_BEGIN_NAMESPACE
+class QSocketNotifier;
+QT_END_NAMESPACE
+class KDSoapSocketList;
+class KDSoapServerSocket;
+class KDSoapServerObjectInterface;
+
+/**
+ * \internal
+ * The connections of one KDSoapSocketList, with KDSoapServer::EpollIoBackend.
+ *
+ * A single edge-triggered epoll instance watches all the connections, and is itself watched
+ * by a QSocketNotifier, so that the thread's event loop (timers, queued calls) keeps running.
+ * Each connection only costs a Connection structure (file descriptor, request parser,
+ * pending output), instead of a QTcpSocket.
+ *
+ * SOAP calls are parsed and dispatched to the server object right away, with the same
+ * keep-alive and admission control rules as KDSoapServerSocket. Anything else hands the
+ * connection over to a KDSoapServerSocket, see handOver().
+ *
+ * A connection only reads a limited amount of data per event, and none while too many of its
+ * responses are waiting to be written, see readData(), so that one client can't make the
+ * others wait or fill the memory.
+ */
+class KDSoapEpollReactor : public QObject
+{
+    Q_OBJECT
+public:
+    KDSoapEpollReactor(KDSoapSocketList *owner, QObject *serverObject);
+    ~KDSoapEpollReactor();
+
+    /**
+     * Takes ownership of \p socketDescriptor, unless false is returned
+     * (on other operating systems than Linux, or if epoll isn't available).
+     */
+    bool addConnection(int socketDescriptor);
+    void closeAll();
+
+    /**
+     * Called by KDSoapServerObjectInterface during a call, when the server object
+     * needs a socket: the connection is handed over to a new KDSoapServerSocket,
+     * which sends the response once the call returns.
+     */
+    KDSoapServerSocket *takeOverConnection();
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private Q_SLOTS:
+    void slotActivated();
+
+private:
+    struct Connection {
+        explicit Connection(int fd);
+        ~Connection();
+        int fd;
+        bool receivedData; // since the last request, like KDSoapServerSocket::m_receivedData
+        bool keepAlive;
+        bool closing; // close once the output is written
+        bool callAdmitted; // see KDSoapSocketList::admitCall
+        bool callRejected; // the body is ignored, and the client gets a 503 response
+        bool readPaused; // data can be left in the socket, see resumeReading
+        int requestCount;
+        qint64 lastActivity; // msecs, see m_clock
+        Connection *previous; // in the idle list, the least recently active first
+        Connection *next;
+        KDSoapHttpRequestParser parser;
+        QByteArray output;
+        int outputPos;
+        // For a body received in several parts, which is parsed as it arrives
+        KDSoapMessageReader *messageReader;
+        qint64 requestSize;
+        qint64 parseTime;
+    private:
+        Q_DISABLE_COPY(Connection)
+    };
+
+    bool watch(Connection *c, int operation);
+    void serviceConnection(Connection *c);
+    bool readData(Connection *c);
+    void resumeReading(Connection *c);
+    bool writeData(Connection *c);
+    void handleRequests(Connection *c);
+    void parseBody(Connection *c);
+    bool canHandle(const KDSoapHttpRequestParser &request) const;
+    void handleCall(Connection *c);
+    void finishResponse(Connection *c);
+    KDSoapServerSocket *handOver(Connection *c);
+    void closeConnection(Connection *c);
+    void removeConnection(Connection *c);
+    void touch(Connection *c);
+    void unlink(Connection *c);
+
+    KDSoapSocketList *m_owner;
+    KDSoapServerObjectInterface *m_serverObjectInterface; // null if the server object needs sockets
+    int m_epollFd;
+    QSocketNotifier *m_notifier;
+    QBasicTimer m_idleTimer;
+    QElapsedTimer m_clock;
+    Connection *m_idleHead;
+    Connection *m_idleTail;
+    int m_servicingDepth; // see slotActivated
+    QVector<Connection *> m_removedConnections;
+
+    // The connection being serviced, and the call being made, if any
+    Connection *m_current;
+    bool m_dispatching;
+    KDSoapServerSocket *m_adoptedSocket; // see takeOverConnection
+    QByteArray m_connectionHeaders;
+    KDSoapMessageReader m_messageReader; // shared by the connections whose body was received in one go
+    QString m_method;
+    QString m_messageNamespace;
+    qint64 m_requestSize;
+    KDSoapMetricsRecorder::Operation *m_callMetrics;
+};
+
+#endif // KDSOAPEPOLLREACTOR_P_H
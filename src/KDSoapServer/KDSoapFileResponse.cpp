@@ -0,0 +1,321 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapFileResponse_p.h"
+#include "KDSoapHttpRequestParser_p.h"
+#include <QAbstractSocket>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <errno.h>
+#endif
+
+// Blocks written into the socket's write buffer, which is kept below s_highWaterMark bytes
+static const qint64 s_blockSize = 64 * 1024;
+static const qint64 s_highWaterMark = 4 * s_blockSize;
+
+static const char s_dayNames[7][4] = { "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun" };
+static const char s_monthNames[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+KDSoapFileResponse::KDSoapFileResponse(QIODevice *device, bool allowZeroCopy)
+    : m_device(device),
+      m_file(qobject_cast<QFile *>(device)),
+      m_zeroCopy(false),
+      m_statusCode(200),
+      m_size(0),
+      m_position(0),
+      m_remaining(0)
+{
+#ifdef Q_OS_LINUX
+    m_zeroCopy = allowZeroCopy && m_file && m_file->handle() != -1; // not for Qt resources
+#else
+    Q_UNUSED(allowZeroCopy);
+#endif
+    if (m_file) {
+        const QDateTime lastModified = QFileInfo(*m_file).lastModified();
+        if (lastModified.isValid()) {
+            // HTTP dates have a precision of one second
+            m_lastModified = QDateTime::fromTime_t(lastModified.toTime_t()).toUTC();
+            m_etag = '"' + QByteArray::number(m_file->size(), 16) + '-' + QByteArray::number(lastModified.toMSecsSinceEpoch(), 16) + '"';
+        }
+    }
+}
+
+KDSoapFileResponse::~KDSoapFileResponse()
+{
+    delete m_device;
+}
+
+QByteArray KDSoapFileResponse::responseHeaders(const KDSoapHttpRequestParser &request, const QByteArray &contentType,
+        const QByteArray &connectionHeaders)
+{
+    const bool randomAccess = !m_device->isSequential();
+    m_size = m_device->size();
+    m_position = 0;
+    m_remaining = m_size;
+
+    qint64 first = 0;
+    qint64 last = m_size - 1;
+    if (isNotModified(request)) {
+        m_statusCode = 304;
+        m_remaining = 0;
+    } else {
+        RangeResult range = randomAccess ? parseRange(request.header("range"), m_size, first, last) : NoRange;
+        const QByteArray ifRange = request.header("if-range");
+        if (range != NoRange && !ifRange.isEmpty()) {
+            // Only send a part if the client has the same version of the file, and the whole file otherwise
+            const bool sameVersion = ifRange.startsWith('"') ? (!m_etag.isEmpty() && ifRange == m_etag)
+                                     : (m_lastModified.isValid() && parseHttpDate(ifRange) == m_lastModified);
+            if (!sameVersion) {
+                range = NoRange;
+            }
+        }
+        if (range == UnsatisfiableRange) {
+            m_statusCode = 416;
+            m_remaining = 0;
+        } else if (range == ValidRange) {
+            m_statusCode = 206;
+            m_position = first;
+            m_remaining = last - first + 1;
+        }
+    }
+
+    QByteArray headers;
+    headers.reserve(200);
+    switch (m_statusCode) {
+    case 304:
+        headers += "HTTP/1.1 304 Not Modified\r\n";
+        break;
+    case 416:
+        headers += "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + QByteArray::number(m_size) + "\r\n";
+        break;
+    case 206:
+        headers += "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + QByteArray::number(first) + '-' + QByteArray::number(last)
+                   + '/' + QByteArray::number(m_size) + "\r\n";
+        break;
+    default:
+        headers += "HTTP/1.1 200 OK\r\n";
+        break;
+    }
+    if (m_statusCode != 304) { // no body, and no Content-Length which would have to be the one of the whole file
+        if (m_statusCode != 416) {
+            headers += "Content-Type: " + contentType + "\r\n";
+        }
+        headers += "Content-Length: " + QByteArray::number(m_remaining) + "\r\n";
+    }
+    if (randomAccess) {
+        headers += "Accept-Ranges: bytes\r\n";
+    }
+    if (!m_etag.isEmpty()) {
+        headers += "ETag: " + m_etag + "\r\n";
+        headers += "Last-Modified: " + httpDate(m_lastModified) + "\r\n";
+    }
+    headers += connectionHeaders;
+    headers += "\r\n"; // end of headers
+    return headers;
+}
+
+int KDSoapFileResponse::statusCode() const
+{
+    return m_statusCode;
+}
+
+bool KDSoapFileResponse::atEnd() const
+{
+    return m_remaining == 0;
+}
+
+// If-None-Match takes precedence over If-Modified-Since (RFC 7232, section 6)
+bool KDSoapFileResponse::isNotModified(const KDSoapHttpRequestParser &request) const
+{
+    if (m_etag.isEmpty()) {
+        return false;
+    }
+    const QByteArray ifNoneMatch = request.header("if-none-match");
+    if (!ifNoneMatch.isEmpty()) {
+        return etagMatches(ifNoneMatch, m_etag);
+    }
+    const QDateTime ifModifiedSince = parseHttpDate(request.header("if-modified-since"));
+    return ifModifiedSince.isValid() && m_lastModified <= ifModifiedSince;
+}
+
+bool KDSoapFileResponse::writeBody(QAbstractSocket *socket)
+{
+#ifdef Q_OS_LINUX
+    if (m_zeroCopy) {
+        return sendFile(socket);
+    }
+#endif
+    while (m_remaining > 0 && socket->bytesToWrite() < s_highWaterMark) {
+        if (!writeBlock(socket)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+// sendfile() writes into the kernel socket buffer directly, so the socket's own write buffer
+// must be empty first, for the data to arrive in order.
+bool KDSoapFileResponse::sendFile(QAbstractSocket *socket)
+{
+    socket->flush();
+    if (socket->bytesToWrite() > 0) {
+        return true; // wait for bytesWritten()
+    }
+    const int socketDescriptor = int(socket->socketDescriptor());
+    while (m_remaining > 0) {
+        off_t offset = m_position;
+        const ssize_t sent = ::sendfile(socketDescriptor, m_file->handle(), &offset, size_t(qMin(m_remaining, qint64(1) << 30)));
+        if (sent > 0) {
+            m_position += sent;
+            m_remaining -= sent;
+        } else if (sent == 0) {
+            return false; // the file was truncated
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // The kernel buffer is full. Writing one block through the socket
+            // makes it emit bytesWritten() once there's room again.
+            return writeBlock(socket);
+        } else if (errno != EINTR) {
+            // Not supported for this file or socket, write the file the usual way
+            m_zeroCopy = false;
+            return writeBody(socket);
+        }
+    }
+    return true;
+}
+#endif
+
+bool KDSoapFileResponse::writeBlock(QAbstractSocket *socket)
+{
+    const qint64 size = qMin(m_remaining, s_blockSize);
+    if (!m_device->isSequential() && m_device->pos() != m_position && !m_device->seek(m_position)) {
+        return false;
+    }
+    const QByteArray block = m_device->read(size);
+    if (block.size() != size) {
+        return false; // e.g. the file was truncated
+    }
+    socket->write(block);
+    m_position += size;
+    m_remaining -= size;
+    return true;
+}
+
+KDSoapFileResponse::RangeResult KDSoapFileResponse::parseRange(const QByteArray &range, qint64 size, qint64 &first, qint64 &last)
+{
+    if (!range.toLower().startsWith("bytes=")) {
+        return NoRange;
+    }
+    const QByteArray spec = range.mid(6).trimmed();
+    const int dash = spec.indexOf('-');
+    if (dash == -1 || spec.contains(',')) {
+        return NoRange;
+    }
+    bool ok;
+    if (dash == 0) { // suffix range: the last N bytes
+        const qint64 suffixLength = spec.mid(1).toLongLong(&ok);
+        if (!ok || suffixLength < 0) {
+            return NoRange;
+        }
+        if (suffixLength == 0 || size == 0) {
+            return UnsatisfiableRange;
+        }
+        first = qMax(qint64(0), size - suffixLength);
+        last = size - 1;
+        return ValidRange;
+    }
+    first = spec.left(dash).toLongLong(&ok);
+    if (!ok || first < 0) {
+        return NoRange;
+    }
+    const QByteArray lastPos = spec.mid(dash + 1);
+    if (lastPos.isEmpty()) {
+        last = size - 1;
+    } else {
+        last = lastPos.toLongLong(&ok);
+        if (!ok || last < first) {
+            return NoRange; // invalid, ignored
+        }
+        last = qMin(last, size - 1);
+    }
+    if (first >= size) {
+        return UnsatisfiableRange;
+    }
+    return ValidRange;
+}
+
+QByteArray KDSoapFileResponse::httpDate(const QDateTime &dateTime)
+{
+    // Not QDateTime::toString, which would use localized day and month names
+    const QDateTime utc = dateTime.toUTC();
+    const QDate date = utc.date();
+    const QTime time = utc.time();
+    char buffer[32];
+    qsnprintf(buffer, sizeof(buffer), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+              s_dayNames[date.dayOfWeek() - 1], date.day(), s_monthNames[date.month() - 1], date.year(),
+              time.hour(), time.minute(), time.second());
+    return QByteArray(buffer);
+}
+
+QDateTime KDSoapFileResponse::parseHttpDate(const QByteArray &date)
+{
+    // "Sun, 06 Nov 1994 08:49:37 GMT"
+    const QList<QByteArray> parts = date.trimmed().split(' ');
+    if (parts.count() != 6 || parts.at(5) != "GMT") {
+        return QDateTime();
+    }
+    int month = 0;
+    while (month < 12 && parts.at(2) != s_monthNames[month]) {
+        ++month;
+    }
+    const QList<QByteArray> timeParts = parts.at(4).split(':');
+    if (month == 12 || timeParts.count() != 3) {
+        return QDateTime();
+    }
+    const QDate day(parts.at(3).toInt(), month + 1, parts.at(1).toInt());
+    const QTime time(timeParts.at(0).toInt(), timeParts.at(1).toInt(), timeParts.at(2).toInt());
+    if (!day.isValid() || !time.isValid()) {
+        return QDateTime();
+    }
+    return QDateTime(day, time, Qt::UTC);
+}
+
+bool KDSoapFileResponse::etagMatches(const QByteArray &ifNoneMatch, const QByteArray &etag)
+{
+    const QByteArray tags = ifNoneMatch.trimmed();
+    if (tags == "*") {
+        return true;
+    }
+    const QList<QByteArray> tagList = tags.split(',');
+    Q_FOREACH (const QByteArray &tag, tagList) {
+        // If-None-Match uses the weak comparison (RFC 7232, section 2.3.2)
+        const QByteArray trimmedTag = tag.trimmed();
+        if ((trimmedTag.startsWith("W/") ? trimmedTag.mid(2) : trimmedTag) == etag) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,102 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPFILERESPONSE_P_H
+#define KDSOAPFILERESPONSE_P_H
+
+#include "KDSoapServerGlobal.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+class QFile;
+class QAbstractSocket;
+QT_END_NAMESPACE
+class KDSoapHttpRequestParser;
+
+/**
+ * \internal
+ * Sends the device returned by KDSoapServerObjectInterface::processFileRequest.
+ *
+ * Regular files get an ETag and a Last-Modified header, so that conditional requests
+ * (If-None-Match, If-Modified-Since) are answered with 304 Not Modified, and random-access
+ * devices support single byte ranges (Range, If-Range, 206 Partial Content).
+ *
+ * The body is written a block at a time, only while the socket's write buffer is small,
+ * so that large files are never entirely loaded in memory. On Linux, regular files are sent
+ * with sendfile() when zero-copy is allowed (i.e. for unencrypted connections); otherwise
+ * they are read a block at a time. They aren't mapped in memory: reading a mapping raises
+ * SIGBUS if the file is truncated meanwhile, while a short read just ends the response.
+ *
+ * Only exported for the unittests.
+ */
+class KDSOAPSERVER_EXPORT KDSoapFileResponse
+{
+public:
+    // Takes ownership of the device, which must be open
+    KDSoapFileResponse(QIODevice *device, bool allowZeroCopy);
+    ~KDSoapFileResponse();
+
+    // Handles the conditional and range headers of \p request, returns the headers of the response
+    QByteArray responseHeaders(const KDSoapHttpRequestParser &request, const QByteArray &contentType,
+                               const QByteArray &connectionHeaders);
+
+    // 200, 206, 304 or 416, once responseHeaders() was called
+    int statusCode() const;
+
+    // Writes more of the body into \p socket, call it again when the socket emits bytesWritten().
+    // Returns false if the device couldn't be read, the response can't be completed then.
+    bool writeBody(QAbstractSocket *socket);
+
+    bool atEnd() const;
+
+    enum RangeResult { NoRange, ValidRange, UnsatisfiableRange };
+    // Parses a Range header (RFC 7233, section 2.1). Multiple ranges aren't supported and are
+    // ignored (NoRange), since the whole representation is a valid response to any range request.
+    static RangeResult parseRange(const QByteArray &range, qint64 size, qint64 &first, qint64 &last);
+
+    // RFC 7231, section 7.1.1.1 (IMF-fixdate only, like most servers)
+    static QByteArray httpDate(const QDateTime &dateTime);
+    static QDateTime parseHttpDate(const QByteArray &date);
+
+    // Whether an If-None-Match header (a list of entity tags, or "*") matches \p etag
+    static bool etagMatches(const QByteArray &ifNoneMatch, const QByteArray &etag);
+
+private:
+    Q_DISABLE_COPY(KDSoapFileResponse)
+    bool isNotModified(const KDSoapHttpRequestParser &request) const;
+    bool sendFile(QAbstractSocket *socket);
+    bool writeBlock(QAbstractSocket *socket);
+
+    QIODevice *m_device;
+    QFile *m_file; // m_device, if it's a regular file
+    bool m_zeroCopy;
+    int m_statusCode;
+    qint64 m_size;
+    qint64 m_position; // next byte to send
+    qint64 m_remaining;
+    QByteArray m_etag;
+    QDateTime m_lastModified; // UTC, second precision
+};
+
+#endif // KDSOAPFILERESPONSE_P_H
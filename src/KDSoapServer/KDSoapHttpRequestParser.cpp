@@ -0,0 +1,406 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapHttpRequestParser_p.h"
+#include <QDir>
+#include <QDebug>
+#include <string.h>
+
+KDSoapHttpRequestParser::KDSoapHttpRequestParser()
+{
+    clear();
+}
+
+void KDSoapHttpRequestParser::clear()
+{
+    m_buffer.clear();
+    m_pos = 0;
+    reset();
+}
+
+void KDSoapHttpRequestParser::reset()
+{
+    if (m_pos > 0) {
+        // Keep what follows the current request (e.g. a pipelined request)
+        m_buffer.remove(0, m_pos);
+    }
+    m_state = RequestLineState;
+    m_pos = 0;
+    m_scanPos = 0;
+    m_requestType.offset = m_requestType.length = 0;
+    m_uri = m_requestType;
+    m_httpVersion = m_requestType;
+    m_path.clear();
+    m_headers.clear();
+    m_chunked = false;
+    m_contentLength = 0;
+    m_chunkRemaining = 0;
+    m_bodyConsumed = 0;
+    m_bodyStart = 0;
+    m_bodySize = 0;
+}
+
+bool KDSoapHttpRequestParser::headersComplete() const
+{
+    return m_state != RequestLineState && m_state != HeadersState && m_state != ErrorState;
+}
+
+bool KDSoapHttpRequestParser::isComplete() const
+{
+    return m_state == CompleteState;
+}
+
+// Looks for the end of the line starting at m_pos. Accepts both "\r\n" and "\n".
+bool KDSoapHttpRequestParser::findLine(int *lineEnd, int *nextLine)
+{
+    const int from = qMax(m_pos, m_scanPos);
+    const char *data = m_buffer.constData();
+    const void *eol = memchr(data + from, '\n', m_buffer.size() - from);
+    if (!eol) {
+        m_scanPos = m_buffer.size();
+        return false;
+    }
+    const int pos = static_cast<const char *>(eol) - data;
+    *nextLine = pos + 1;
+    *lineEnd = (pos > m_pos && data[pos - 1] == '\r') ? pos - 1 : pos;
+    m_scanPos = *nextLine;
+    return true;
+}
+
+bool KDSoapHttpRequestParser::parseRequestLine(int lineEnd)
+{
+    // METHOD SP request-target SP HTTP-version
+    const char *data = m_buffer.constData();
+    const char *lineStart = data + m_pos;
+    const char *sp1 = static_cast<const char *>(memchr(lineStart, ' ', lineEnd - m_pos));
+    if (!sp1) {
+        return false;
+    }
+    const int uriStart = sp1 - data + 1;
+    const char *sp2 = static_cast<const char *>(memchr(data + uriStart, ' ', lineEnd - uriStart));
+    if (!sp2) {
+        return false;
+    }
+    const int versionStart = sp2 - data + 1;
+    m_requestType.offset = m_pos;
+    m_requestType.length = sp1 - lineStart;
+    m_uri.offset = uriStart;
+    m_uri.length = sp2 - data - uriStart;
+    m_httpVersion.offset = versionStart;
+    m_httpVersion.length = lineEnd - versionStart;
+    return m_requestType.length > 0 && m_uri.length > 0 && m_httpVersion.length > 0;
+}
+
+static inline bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// The views aren't null-terminated, so qstricmp can't be used on them
+static bool equalsIgnoreCase(const QByteArray &value, const char *str)
+{
+    const int len = int(qstrlen(str));
+    return value.size() == len && qstrnicmp(value.constData(), str, len) == 0;
+}
+
+void KDSoapHttpRequestParser::parseHeaderLine(int lineEnd)
+{
+    const char *data = m_buffer.constData();
+    const char *colon = static_cast<const char *>(memchr(data + m_pos, ':', lineEnd - m_pos));
+    if (!colon) {
+        qDebug() << "Malformed HTTP header:" << QByteArray(data + m_pos, lineEnd - m_pos);
+        return;
+    }
+    int nameEnd = colon - data;
+    while (nameEnd > m_pos && isWhitespace(data[nameEnd - 1])) {
+        --nameEnd;
+    }
+    int valueStart = colon - data + 1;
+    while (valueStart < lineEnd && isWhitespace(data[valueStart])) {
+        ++valueStart;
+    }
+    int valueEnd = lineEnd;
+    while (valueEnd > valueStart && isWhitespace(data[valueEnd - 1])) {
+        --valueEnd;
+    }
+    HeaderField field;
+    field.name.offset = m_pos;
+    field.name.length = nameEnd - m_pos;
+    field.value.offset = valueStart;
+    field.value.length = valueEnd - valueStart;
+    m_headers.append(field);
+}
+
+bool KDSoapHttpRequestParser::parseChunkSize(int lineEnd)
+{
+    // chunk-size [ chunk-ext ] CRLF
+    const char *data = m_buffer.constData();
+    int pos = m_pos;
+    while (pos < lineEnd && isWhitespace(data[pos])) {
+        ++pos;
+    }
+    qint64 size = 0;
+    int digits = 0;
+    for (; pos < lineEnd; ++pos, ++digits) {
+        const char c = data[pos];
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            break;
+        }
+        if (size > 0x7ffffff) { // we store the body in a QByteArray, no need to go further
+            return false;
+        }
+        size = size * 16 + digit;
+    }
+    while (pos < lineEnd && isWhitespace(data[pos])) {
+        ++pos;
+    }
+    if (digits == 0 || (pos < lineEnd && data[pos] != ';')) {
+        return false;
+    }
+    m_chunkRemaining = size;
+    return true;
+}
+
+KDSoapHttpRequestParser::Status KDSoapHttpRequestParser::finishHeaders()
+{
+    m_path = QDir::cleanPath(QString::fromLatin1(m_buffer.constData() + m_uri.offset, m_uri.length)).toLatin1();
+    m_bodyStart = m_pos;
+    m_bodySize = 0;
+    m_chunked = equalsIgnoreCase(header("transfer-encoding"), "chunked");
+    if (m_chunked) {
+        m_state = ChunkSizeState;
+    } else {
+        bool ok = false;
+        const QByteArray contentLength = header("content-length");
+        m_contentLength = contentLength.isEmpty() ? 0 : contentLength.toLongLong(&ok);
+        if (m_contentLength < 0 || (!contentLength.isEmpty() && !ok)) {
+            return fail();
+        }
+        m_state = m_contentLength > 0 ? BodyState : CompleteState;
+    }
+    return HeadersComplete;
+}
+
+KDSoapHttpRequestParser::Status KDSoapHttpRequestParser::fail()
+{
+    m_state = ErrorState;
+    return BadRequest;
+}
+
+KDSoapHttpRequestParser::Status KDSoapHttpRequestParser::parse()
+{
+    int lineEnd;
+    int nextLine;
+    for (;;) {
+        switch (m_state) {
+        case RequestLineState:
+            if (!findLine(&lineEnd, &nextLine)) {
+                return NeedMoreData;
+            }
+            // RFC 7230 section 3.5: ignore empty lines received before the request-line
+            if (lineEnd > m_pos) {
+                if (!parseRequestLine(lineEnd)) {
+                    qDebug() << "Malformed HTTP request:" << QByteArray(m_buffer.constData() + m_pos, lineEnd - m_pos);
+                    return fail();
+                }
+                m_state = HeadersState;
+            }
+            m_pos = nextLine;
+            break;
+        case HeadersState:
+            if (!findLine(&lineEnd, &nextLine)) {
+                return NeedMoreData;
+            }
+            if (lineEnd == m_pos) { // empty line, end of headers
+                m_pos = nextLine;
+                return finishHeaders();
+            }
+            parseHeaderLine(lineEnd);
+            m_pos = nextLine;
+            break;
+        case BodyState: {
+            const qint64 missing = m_contentLength - m_bodyConsumed - m_bodySize;
+            const int available = int(qMin<qint64>(m_buffer.size() - m_pos, missing));
+            m_bodySize += available;
+            m_pos += available;
+            if (available < missing) {
+                return NeedMoreData;
+            }
+            m_state = CompleteState;
+            break;
+        }
+        case ChunkSizeState:
+            if (!findLine(&lineEnd, &nextLine)) {
+                return NeedMoreData;
+            }
+            if (!parseChunkSize(lineEnd)) {
+                return fail();
+            }
+            m_pos = nextLine;
+            m_state = m_chunkRemaining > 0 ? ChunkDataState : TrailersState;
+            break;
+        case ChunkDataState: {
+            const int available = int(qMin<qint64>(m_buffer.size() - m_pos, m_chunkRemaining));
+            if (available == 0) {
+                return NeedMoreData;
+            }
+            // Decode in place: move the chunk data right after the body decoded so far
+            const int bodyEnd = m_bodyStart + m_bodySize;
+            if (bodyEnd != m_pos) {
+                char *data = m_buffer.data();
+                memmove(data + bodyEnd, data + m_pos, available);
+            }
+            m_bodySize += available;
+            m_pos += available;
+            m_chunkRemaining -= available;
+            if (m_chunkRemaining > 0) {
+                return NeedMoreData;
+            }
+            m_state = ChunkDataEndState;
+            break;
+        }
+        case ChunkDataEndState:
+            if (!findLine(&lineEnd, &nextLine)) {
+                return NeedMoreData;
+            }
+            if (lineEnd != m_pos) { // chunk data must be followed by CRLF
+                return fail();
+            }
+            m_pos = nextLine;
+            m_state = ChunkSizeState;
+            break;
+        case TrailersState:
+            // Trailers are ignored, just wait for the empty line
+            if (!findLine(&lineEnd, &nextLine)) {
+                return NeedMoreData;
+            }
+            if (lineEnd == m_pos) {
+                m_state = CompleteState;
+            }
+            m_pos = nextLine;
+            break;
+        case CompleteState:
+            return RequestComplete;
+        case ErrorState:
+            return BadRequest;
+        }
+    }
+}
+
+QByteArray KDSoapHttpRequestParser::view(const Range &range) const
+{
+    return QByteArray::fromRawData(m_buffer.constData() + range.offset, range.length);
+}
+
+QByteArray KDSoapHttpRequestParser::requestType() const
+{
+    return view(m_requestType);
+}
+
+QByteArray KDSoapHttpRequestParser::path() const
+{
+    return m_path;
+}
+
+QByteArray KDSoapHttpRequestParser::httpVersion() const
+{
+    return view(m_httpVersion);
+}
+
+int KDSoapHttpRequestParser::headerCount() const
+{
+    return m_headers.size();
+}
+
+QByteArray KDSoapHttpRequestParser::headerName(int index) const
+{
+    return view(m_headers.at(index).name);
+}
+
+QByteArray KDSoapHttpRequestParser::headerValue(int index) const
+{
+    return view(m_headers.at(index).value);
+}
+
+int KDSoapHttpRequestParser::findHeader(const char *name) const
+{
+    const int len = int(qstrlen(name));
+    const char *data = m_buffer.constData();
+    // Backwards, so that the last occurrence wins, like it did with QMap::insert
+    for (int i = m_headers.size() - 1; i >= 0; --i) {
+        const Range &range = m_headers.at(i).name;
+        if (range.length == len && qstrnicmp(data + range.offset, name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QByteArray KDSoapHttpRequestParser::header(const char *name) const
+{
+    const int index = findHeader(name);
+    return index == -1 ? QByteArray() : view(m_headers.at(index).value);
+}
+
+bool KDSoapHttpRequestParser::hasHeader(const char *name) const
+{
+    return findHeader(name) != -1;
+}
+
+QMap<QByteArray, QByteArray> KDSoapHttpRequestParser::headersMap() const
+{
+    const char *data = m_buffer.constData();
+    QMap<QByteArray, QByteArray> headers;
+    headers.insert("_requestType", QByteArray(data + m_requestType.offset, m_requestType.length));
+    headers.insert("_path", m_path);
+    headers.insert("_httpVersion", QByteArray(data + m_httpVersion.offset, m_httpVersion.length));
+    for (int i = 0; i < m_headers.size(); ++i) {
+        const HeaderField &field = m_headers.at(i);
+        headers.insert(QByteArray(data + field.name.offset, field.name.length).toLower(),
+                       QByteArray(data + field.value.offset, field.value.length));
+    }
+    return headers;
+}
+
+QByteArray KDSoapHttpRequestParser::body() const
+{
+    return QByteArray::fromRawData(m_buffer.constData() + m_bodyStart, m_bodySize);
+}
+
+void KDSoapHttpRequestParser::discardBody()
+{
+    if (m_bodySize == 0) {
+        return;
+    }
+    m_buffer.remove(m_bodyStart, m_bodySize);
+    m_pos -= m_bodySize;
+    m_scanPos = qMax(m_pos, m_scanPos - m_bodySize);
+    m_bodyConsumed += m_bodySize;
+    m_bodySize = 0;
+}
@@ -0,0 +1,178 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPHTTPREQUESTPARSER_P_H
+#define KDSOAPHTTPREQUESTPARSER_P_H
+
+#include "KDSoapServerGlobal.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QMap>
+#include <QtCore/QVarLengthArray>
+
+/**
+ * \internal
+ * Incremental HTTP/1.1 request parser, used by KDSoapServerSocket.
+ *
+ * Incoming data is appended to buffer(), then parse() resumes where the previous
+ * call stopped. The request line and the headers are not copied: they are kept as
+ * offsets into the receive buffer, and the accessors return views (QByteArray::fromRawData)
+ * which are only valid until the buffer is modified again.
+ * Chunked bodies are decoded in place, so body() is always one contiguous view as well.
+ *
+ * Only exported for the unittests.
+ */
+class KDSOAPSERVER_EXPORT KDSoapHttpRequestParser
+{
+public:
+    enum Status {
+        NeedMoreData,    ///< the request is incomplete, append more data to buffer() and call parse() again
+        HeadersComplete, ///< returned once per request, when the request line and all headers are available
+        RequestComplete, ///< the request, including its body, has been fully received
+        BadRequest       ///< the request is malformed
+    };
+
+    KDSoapHttpRequestParser();
+
+    /**
+     * The receive buffer. Append incoming data to it, then call parse().
+     */
+    QByteArray &buffer()
+    {
+        return m_buffer;
+    }
+
+    /**
+     * Parses as much of the buffered data as possible.
+     * HeadersComplete is returned once the headers are available; call parse() again
+     * to continue with the body.
+     */
+    Status parse();
+
+    bool headersComplete() const;
+    bool isComplete() const;
+
+    // Request line
+    QByteArray requestType() const;
+    QByteArray path() const; // cleaned up, like QDir::cleanPath
+    QByteArray httpVersion() const;
+
+    // Headers. Names are compared case-insensitively (RFC2616 section 4.2)
+    int headerCount() const;
+    QByteArray headerName(int index) const;
+    QByteArray headerValue(int index) const;
+    QByteArray header(const char *name) const;
+    bool hasHeader(const char *name) const;
+
+    bool isChunked() const
+    {
+        return m_chunked;
+    }
+    qint64 contentLength() const
+    {
+        return m_contentLength;
+    }
+
+    /**
+     * Returns a deep copy of the headers, with lowercased names, plus the
+     * "_requestType", "_path" and "_httpVersion" pseudo-headers.
+     * Only meant for the public interfaces which take a QMap of headers.
+     */
+    QMap<QByteArray, QByteArray> headersMap() const;
+
+    /**
+     * The (decoded) body data received so far and not discarded yet.
+     * This is a view into the receive buffer.
+     */
+    QByteArray body() const;
+    int bodySize() const
+    {
+        return m_bodySize;
+    }
+
+    /**
+     * Drops the body data returned by body(), once the caller has consumed it.
+     * This keeps the receive buffer small when the body is processed incrementally.
+     */
+    void discardBody();
+
+    /**
+     * Prepares for the next request. Bytes received after the end of the
+     * current request are kept in the buffer.
+     */
+    void reset();
+
+    /**
+     * Forgets everything, including the buffered data.
+     */
+    void clear();
+
+private:
+    enum State {
+        RequestLineState,
+        HeadersState,
+        BodyState,
+        ChunkSizeState,
+        ChunkDataState,
+        ChunkDataEndState,
+        TrailersState,
+        CompleteState,
+        ErrorState
+    };
+
+    struct Range {
+        int offset;
+        int length;
+    };
+    struct HeaderField {
+        Range name;
+        Range value;
+    };
+
+    bool findLine(int *lineEnd, int *nextLine);
+    bool parseRequestLine(int lineEnd);
+    void parseHeaderLine(int lineEnd);
+    bool parseChunkSize(int lineEnd);
+    Status finishHeaders();
+    Status fail();
+    QByteArray view(const Range &range) const;
+    int findHeader(const char *name) const;
+
+    QByteArray m_buffer;
+    State m_state;
+    int m_pos; // parse position in m_buffer
+    int m_scanPos; // where to resume looking for the end of the current line
+
+    Range m_requestType;
+    Range m_uri;
+    Range m_httpVersion;
+    QByteArray m_path;
+    QVarLengthArray<HeaderField, 16> m_headers;
+
+    bool m_chunked;
+    qint64 m_contentLength;
+    qint64 m_chunkRemaining;
+    qint64 m_bodyConsumed; // body bytes already discarded
+    int m_bodyStart;
+    int m_bodySize;
+};
+
+#endif // KDSOAPHTTPREQUESTPARSER_P_H
@@ -0,0 +1,286 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapLogWriter_p.h"
+#include <QMutexLocker>
+
+static inline int loadAcquire(QAtomicInt &value)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    return value.loadAcquire();
+#else
+    return value.fetchAndAddAcquire(0);
+#endif
+}
+
+static inline void storeRelease(QAtomicInt &value, int newValue)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    value.storeRelease(newValue);
+#else
+    value.fetchAndStoreRelease(newValue);
+#endif
+}
+
+// The indexes grow forever (wrapping around), the capacity is a power of two
+KDSoapLogBuffer::KDSoapLogBuffer(KDSoapLogWriter *writer, int capacity)
+    : m_writer(writer),
+      m_lines(new QByteArray[capacity]),
+      m_mask(capacity - 1),
+      m_head(0),
+      m_tail(0),
+      m_droppedCount(0)
+{
+    Q_ASSERT((capacity & (capacity - 1)) == 0);
+}
+
+KDSoapLogBuffer::~KDSoapLogBuffer()
+{
+    delete[] m_lines;
+}
+
+bool KDSoapLogBuffer::append(const QByteArray &line)
+{
+    const uint head = uint(loadAcquire(m_head));
+    const uint used = head - uint(loadAcquire(m_tail));
+    if (used > m_mask) {
+        m_droppedCount.ref();
+        return false;
+    }
+    m_lines[head & m_mask] = line;
+    storeRelease(m_head, int(head + 1));
+    if (used + 1 == (m_mask + 1) / 2) {
+        // Don't wait for the next flush interval, the buffer is filling up fast
+        m_writer->wakeUp();
+    }
+    return true;
+}
+
+int KDSoapLogBuffer::takeLines(QByteArray &out)
+{
+    uint tail = uint(loadAcquire(m_tail));
+    const uint head = uint(loadAcquire(m_head));
+    const int count = int(head - tail);
+    for (; tail != head; ++tail) {
+        QByteArray &line = m_lines[tail & m_mask];
+        out += line;
+        line = QByteArray(); // the producer must not share data with us anymore
+    }
+    storeRelease(m_tail, int(tail));
+    return count;
+}
+
+int KDSoapLogBuffer::takeDroppedCount()
+{
+    return m_droppedCount.fetchAndStoreRelaxed(0);
+}
+
+////
+
+KDSoapLogWriter::KDSoapLogWriter()
+    : m_pendingDroppedCount(0),
+      m_started(false),
+      m_quit(false),
+      m_maxFileSize(0),
+      m_backupCount(1)
+{
+}
+
+KDSoapLogWriter::~KDSoapLogWriter()
+{
+    stop();
+    writePendingLines();
+    qDeleteAll(m_buffers);
+}
+
+void KDSoapLogWriter::setFileName(const QString &fileName)
+{
+    QMutexLocker lock(&m_fileMutex);
+    m_fileName = fileName;
+}
+
+QString KDSoapLogWriter::fileName() const
+{
+    QMutexLocker lock(&m_fileMutex);
+    return m_fileName;
+}
+
+void KDSoapLogWriter::setMaxFileSize(qint64 maxSize)
+{
+    QMutexLocker lock(&m_fileMutex);
+    m_maxFileSize = maxSize;
+}
+
+qint64 KDSoapLogWriter::maxFileSize() const
+{
+    QMutexLocker lock(&m_fileMutex);
+    return m_maxFileSize;
+}
+
+void KDSoapLogWriter::setBackupCount(int count)
+{
+    QMutexLocker lock(&m_fileMutex);
+    m_backupCount = count;
+}
+
+int KDSoapLogWriter::backupCount() const
+{
+    QMutexLocker lock(&m_fileMutex);
+    return m_backupCount;
+}
+
+KDSoapLogBuffer *KDSoapLogWriter::createBuffer()
+{
+    KDSoapLogBuffer *buffer = new KDSoapLogBuffer(this, BufferCapacity);
+    QMutexLocker lock(&m_mutex);
+    m_buffers.append(buffer);
+    startLocked();
+    return buffer;
+}
+
+void KDSoapLogWriter::log(const QByteArray &line)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_pendingLines.size() + line.size() > MaxPendingSize) {
+        ++m_pendingDroppedCount;
+        return;
+    }
+    m_pendingLines += line;
+    startLocked();
+}
+
+void KDSoapLogWriter::startLocked()
+{
+    if (!m_started) {
+        m_started = true;
+        start();
+    }
+}
+
+void KDSoapLogWriter::stop()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_quit = true;
+        m_wakeUp.wakeOne();
+    }
+    wait();
+}
+
+void KDSoapLogWriter::wakeUp()
+{
+    QMutexLocker lock(&m_mutex);
+    m_wakeUp.wakeOne();
+}
+
+void KDSoapLogWriter::run()
+{
+    QMutexLocker lock(&m_mutex);
+    while (!m_quit) {
+        m_wakeUp.wait(&m_mutex, FlushInterval);
+        lock.unlock();
+        writePendingLines();
+        lock.relock();
+    }
+}
+
+void KDSoapLogWriter::flush()
+{
+    writePendingLines();
+    QMutexLocker lock(&m_fileMutex);
+    if (m_file.isOpen()) {
+        m_file.flush();
+    }
+}
+
+void KDSoapLogWriter::close()
+{
+    writePendingLines();
+    QMutexLocker lock(&m_fileMutex);
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+void KDSoapLogWriter::writePendingLines()
+{
+    QMutexLocker fileLock(&m_fileMutex);
+    QByteArray lines;
+    int droppedCount;
+    QList<KDSoapLogBuffer *> buffers;
+    {
+        QMutexLocker lock(&m_mutex);
+        lines = m_pendingLines;
+        m_pendingLines.clear();
+        droppedCount = m_pendingDroppedCount;
+        m_pendingDroppedCount = 0;
+        buffers = m_buffers;
+    }
+    Q_FOREACH (KDSoapLogBuffer *buffer, buffers) {
+        buffer->takeLines(lines);
+        droppedCount += buffer->takeDroppedCount();
+    }
+    if (droppedCount > 0) {
+        lines += "WARNING " + QByteArray::number(droppedCount) + " log lines dropped, the log file isn't written fast enough\n";
+    }
+    if (lines.isEmpty() || !openFile()) {
+        return;
+    }
+    if (m_maxFileSize > 0 && m_file.size() > 0 && m_file.size() + lines.size() > m_maxFileSize) {
+        rotateFile();
+        if (!openFile()) {
+            return;
+        }
+    }
+    m_file.write(lines);
+}
+
+// Called with m_fileMutex locked
+bool KDSoapLogWriter::openFile()
+{
+    if (!m_file.isOpen() && !m_fileName.isEmpty()) {
+        m_file.setFileName(m_fileName);
+        if (!m_file.open(QIODevice::Append)) {
+            qCritical("Could not open log file for writing: %s", qPrintable(m_fileName));
+            m_fileName.clear(); // don't retry every time lines are written
+        }
+    }
+    return m_file.isOpen();
+}
+
+// Called with m_fileMutex locked.
+// output.log becomes output.log.1, output.log.1 becomes output.log.2, etc.
+void KDSoapLogWriter::rotateFile()
+{
+    const QString fileName = m_file.fileName();
+    m_file.close();
+    if (m_backupCount <= 0) {
+        QFile::remove(fileName);
+        return;
+    }
+    const QString backupName = fileName + QLatin1Char('.');
+    QFile::remove(backupName + QString::number(m_backupCount));
+    for (int i = m_backupCount - 1; i >= 1; --i) {
+        QFile::rename(backupName + QString::number(i), backupName + QString::number(i + 1));
+    }
+    QFile::rename(fileName, backupName + QLatin1Char('1'));
+}
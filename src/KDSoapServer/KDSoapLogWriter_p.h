@@ -0,0 +1,129 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPLOGWRITER_P_H
+#define KDSOAPLOGWRITER_P_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+class KDSoapLogWriter;
+
+/**
+ * A ring buffer of log lines, filled by one thread (see KDSoapSocketList)
+ * and emptied by the log writer, without locking.
+ * When the buffer is full, lines are dropped rather than blocking the caller.
+ */
+class KDSoapLogBuffer
+{
+public:
+    KDSoapLogBuffer(KDSoapLogWriter *writer, int capacity);
+    ~KDSoapLogBuffer();
+
+    // Called by the thread owning the buffer. Returns false if the line was dropped.
+    bool append(const QByteArray &line);
+
+    // Called by the log writer
+    int takeLines(QByteArray &out);
+    int takeDroppedCount();
+
+private:
+    Q_DISABLE_COPY(KDSoapLogBuffer)
+    KDSoapLogWriter *m_writer;
+    QByteArray *m_lines;
+    const uint m_mask;
+    QAtomicInt m_head; // next slot to fill, only modified by the producer
+    QAtomicInt m_tail; // next slot to empty, only modified by the consumer
+    QAtomicInt m_droppedCount;
+};
+
+/**
+ * Writes the log of a KDSoapServer to its log file, from a separate thread.
+ *
+ * The socket threads append lines to their own KDSoapLogBuffer; this thread
+ * wakes up regularly and writes all pending lines with a single write call.
+ * The file is rotated when it would exceed the maximum size.
+ */
+class KDSoapLogWriter : public QThread
+{
+    Q_OBJECT
+public:
+    KDSoapLogWriter();
+    ~KDSoapLogWriter();
+
+    void setFileName(const QString &fileName);
+    QString fileName() const;
+    void setMaxFileSize(qint64 maxSize);
+    qint64 maxFileSize() const;
+    void setBackupCount(int count);
+    int backupCount() const;
+
+    // Returns a new buffer for the calling thread. It's owned by the log writer.
+    KDSoapLogBuffer *createBuffer();
+    // Slower, thread-safe version, for the odd line logged outside of the socket threads
+    void log(const QByteArray &line);
+
+    // Write all pending lines, without waiting for the writer thread
+    void flush();
+    void close();
+
+    void wakeUp();
+
+protected:
+    void run();
+
+private:
+    void startLocked();
+    void stop();
+    void writePendingLines();
+    bool openFile();
+    void rotateFile();
+
+    enum {
+        BufferCapacity = 4096, // lines, per thread
+        MaxPendingSize = 1024 * 1024, // bytes, for log()
+        FlushInterval = 50 // ms
+    };
+
+    // Protects the list of buffers, the lines from log(), and the thread state
+    QMutex m_mutex;
+    QWaitCondition m_wakeUp;
+    QList<KDSoapLogBuffer *> m_buffers;
+    QByteArray m_pendingLines;
+    int m_pendingDroppedCount;
+    bool m_started;
+    bool m_quit;
+
+    // Protects the file, and the reading side of the buffers
+    mutable QMutex m_fileMutex;
+    QFile m_file;
+    QString m_fileName;
+    qint64 m_maxFileSize;
+    int m_backupCount;
+};
+
+#endif // KDSOAPLOGWRITER_P_H
@@ -0,0 +1,111 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapMetricsRecorder_p.h"
+
+KDSoapMetricsRecorder::KDSoapMetricsRecorder()
+    : m_bucketBounds(KDSoapServerMetrics::latencyBucketBounds())
+{
+    Q_ASSERT(m_bucketBounds.count() + 1 == BucketCount);
+}
+
+KDSoapMetricsRecorder::~KDSoapMetricsRecorder()
+{
+    qDeleteAll(m_operations);
+}
+
+KDSoapMetricsRecorder::Operation *KDSoapMetricsRecorder::operation(const QString &name)
+{
+    // No locking needed for lookups, only this thread modifies the hash
+    Operation *op = m_operations.value(name);
+    if (op) {
+        return op;
+    }
+    const QString key = m_operations.count() < MaxOperations ? name : QString::fromLatin1("(other)");
+    op = m_operations.value(key);
+    if (!op) {
+        op = new Operation;
+        QMutexLocker lock(&m_operationsMutex);
+        m_operations.insert(key, op);
+    }
+    return op;
+}
+
+KDSoapMetricsRecorder::Operation *KDSoapMetricsRecorder::callStarted(const QString &operationName, qint64 bytesReceived, qint64 parseTime)
+{
+    Operation *op = operation(operationName);
+    op->requests.add(1);
+    op->bytesReceived.add(bytesReceived);
+    op->inFlight.add(1);
+    recordLatency(KDSoapServerMetrics::ParsePhase, parseTime);
+    return op;
+}
+
+void KDSoapMetricsRecorder::callFinished(Operation *op, bool isFault, qint64 bytesSent)
+{
+    op->inFlight.add(-1);
+    if (isFault) {
+        op->faults.add(1);
+    }
+    op->bytesSent.add(bytesSent);
+}
+
+// The client disconnected before getting the response
+void KDSoapMetricsRecorder::callAborted(Operation *op)
+{
+    op->inFlight.add(-1);
+}
+
+void KDSoapMetricsRecorder::recordLatency(KDSoapServerMetrics::Phase phase, qint64 usecs)
+{
+    int bucket = 0;
+    while (bucket < m_bucketBounds.count() && usecs > m_bucketBounds.at(bucket)) {
+        ++bucket;
+    }
+    Histogram &histogram = m_latencies[phase];
+    histogram.buckets[bucket].add(1);
+    histogram.count.add(1);
+    histogram.sum.add(usecs);
+}
+
+void KDSoapMetricsRecorder::addTo(KDSoapServerMetrics &metrics) const
+{
+    {
+        QMutexLocker lock(&m_operationsMutex);
+        QHash<QString, Operation *>::const_iterator it = m_operations.constBegin();
+        for (; it != m_operations.constEnd(); ++it) {
+            const Operation *op = it.value();
+            metrics.addOperation(it.key(), op->requests.value(), op->faults.value(),
+                                 op->bytesReceived.value(), op->bytesSent.value(), op->inFlight.value());
+        }
+    }
+    for (int phase = 0; phase < KDSoapServerMetrics::PhaseCount; ++phase) {
+        const Histogram &histogram = m_latencies[phase];
+        QVector<qint64> buckets(BucketCount);
+        for (int i = 0; i < BucketCount; ++i) {
+            buckets[i] = histogram.buckets[i].value();
+        }
+        metrics.addLatencies(KDSoapServerMetrics::Phase(phase), buckets, histogram.count.value(), histogram.sum.value());
+    }
+    metrics.addShedCalls(m_shedCalls.value());
+    metrics.addTlsHandshakes(m_tlsHandshakes.value(), m_tlsResumedHandshakes.value(), m_tlsHandshakeFailures.value(), m_tlsHandshakeTime.value());
+}
@@ -0,0 +1,140 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPMETRICSRECORDER_P_H
+#define KDSOAPMETRICSRECORDER_P_H
+
+#include "KDSoapServerMetrics.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QHash>
+
+// A counter written by one thread, and read by any thread
+class KDSoapMetricsCounter
+{
+public:
+    KDSoapMetricsCounter() : m_value(0) {}
+
+    void add(qint64 value)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5,3,0)
+        m_value.fetchAndAddRelaxed(value);
+#else
+        m_value.fetchAndAddRelaxed(int(value));
+#endif
+    }
+    qint64 value() const
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+        return m_value.loadAcquire();
+#else
+        return m_value;
+#endif
+    }
+
+private:
+    Q_DISABLE_COPY(KDSoapMetricsCounter)
+#if QT_VERSION >= QT_VERSION_CHECK(5,3,0)
+    QAtomicInteger<qint64> m_value;
+#else
+    QAtomicInt m_value; // 64-bit atomics need Qt 5.3
+#endif
+};
+
+/**
+ * The metrics of one server, collected by one thread (see KDSoapSocketList).
+ * Only that thread updates them, without locking; KDSoapServer::metrics()
+ * adds up the values of all the threads when asked for them.
+ */
+class KDSoapMetricsRecorder
+{
+public:
+    struct Operation {
+        KDSoapMetricsCounter requests;
+        KDSoapMetricsCounter faults;
+        KDSoapMetricsCounter bytesReceived;
+        KDSoapMetricsCounter bytesSent;
+        KDSoapMetricsCounter inFlight;
+    };
+
+    KDSoapMetricsRecorder();
+    ~KDSoapMetricsRecorder();
+
+    // Called by the thread owning the recorder
+    Operation *callStarted(const QString &operation, qint64 bytesReceived, qint64 parseTime);
+    void callFinished(Operation *operation, bool isFault, qint64 bytesSent);
+    void callAborted(Operation *operation);
+    void recordLatency(KDSoapServerMetrics::Phase phase, qint64 usecs);
+    void callShed()
+    {
+        m_shedCalls.add(1);
+    }
+    void tlsHandshakeFinished(qint64 usecs, bool resumed)
+    {
+        m_tlsHandshakes.add(1);
+        if (resumed) {
+            m_tlsResumedHandshakes.add(1);
+        }
+        m_tlsHandshakeTime.add(usecs);
+    }
+    void tlsHandshakeFailed()
+    {
+        m_tlsHandshakeFailures.add(1);
+    }
+
+    // Called from any thread
+    void addTo(KDSoapServerMetrics &metrics) const;
+
+    static qint64 elapsedMicroseconds(const QElapsedTimer &timer)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(4,8,0)
+        return timer.nsecsElapsed() / 1000;
+#else
+        return timer.elapsed() * 1000;
+#endif
+    }
+
+private:
+    Q_DISABLE_COPY(KDSoapMetricsRecorder)
+    Operation *operation(const QString &name);
+
+    enum { MaxOperations = 256 }; // the operation names come from the clients
+    mutable QMutex m_operationsMutex; // for adding operations, and for reading them from other threads
+    QHash<QString, Operation *> m_operations;
+
+    enum { BucketCount = 20 }; // KDSoapServerMetrics::latencyBucketBounds(), plus one
+    struct Histogram {
+        KDSoapMetricsCounter buckets[BucketCount];
+        KDSoapMetricsCounter count;
+        KDSoapMetricsCounter sum;
+    };
+    Histogram m_latencies[KDSoapServerMetrics::PhaseCount];
+    const QVector<qint64> m_bucketBounds;
+    KDSoapMetricsCounter m_shedCalls;
+    KDSoapMetricsCounter m_tlsHandshakes;
+    KDSoapMetricsCounter m_tlsResumedHandshakes;
+    KDSoapMetricsCounter m_tlsHandshakeFailures;
+    KDSoapMetricsCounter m_tlsHandshakeTime;
+};
+
+#endif // KDSOAPMETRICSRECORDER_P_H
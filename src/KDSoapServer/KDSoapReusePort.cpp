@@ -0,0 +1,102 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapReusePort_p.h"
+#include <QHostAddress>
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#endif
+
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+#define KDSOAP_HAVE_REUSEPORT
+#endif
+
+int KDSoapReusePort::bindSocket(const QHostAddress &address, quint16 port)
+{
+#ifdef KDSOAP_HAVE_REUSEPORT
+    const bool ipv6 = address.protocol() == QAbstractSocket::IPv6Protocol;
+    const int fd = ::socket(ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int on = 1;
+    // Like QTcpServer, to be able to restart the server while old connections are in TIME_WAIT
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    int ret;
+    if (ipv6) {
+        struct sockaddr_in6 sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin6_family = AF_INET6;
+        sa.sin6_port = htons(port);
+        const Q_IPV6ADDR ip6 = address.toIPv6Address();
+        memcpy(&sa.sin6_addr, &ip6, sizeof(ip6));
+        ret = ::bind(fd, reinterpret_cast<struct sockaddr *>(&sa), sizeof(sa));
+    } else {
+        struct sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(port);
+        // QHostAddress::Any gives 0, i.e. INADDR_ANY
+        sa.sin_addr.s_addr = htonl(address.toIPv4Address());
+        ret = ::bind(fd, reinterpret_cast<struct sockaddr *>(&sa), sizeof(sa));
+    }
+    if (ret != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    Q_UNUSED(address);
+    Q_UNUSED(port);
+    return -1;
+#endif
+}
+
+bool KDSoapReusePort::listen(int socketDescriptor)
+{
+#ifdef KDSOAP_HAVE_REUSEPORT
+    return ::listen(socketDescriptor, SOMAXCONN) == 0;
+#else
+    Q_UNUSED(socketDescriptor);
+    return false;
+#endif
+}
+
+void KDSoapReusePort::closeSocket(int socketDescriptor)
+{
+#ifdef KDSOAP_HAVE_REUSEPORT
+    ::close(socketDescriptor);
+#else
+    Q_UNUSED(socketDescriptor);
+#endif
+}
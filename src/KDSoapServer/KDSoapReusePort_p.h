@@ -0,0 +1,41 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPREUSEPORT_P_H
+#define KDSOAPREUSEPORT_P_H
+
+#include <QtGlobal>
+QT_BEGIN_NAMESPACE
+class QHostAddress;
+QT_END_NAMESPACE
+
+// Native sockets for KDSoapServer::listenWithReusePort()
+namespace KDSoapReusePort
+{
+// Returns a TCP socket bound to \p address and \p port with SO_REUSEPORT,
+// or -1 on error, or if the operating system doesn't support SO_REUSEPORT.
+int bindSocket(const QHostAddress &address, quint16 port);
+bool listen(int socketDescriptor);
+void closeSocket(int socketDescriptor);
+}
+
+#endif // KDSOAPREUSEPORT_P_H
@@ -23,8 +23,15 @@
 #include "KDSoapServer.h"
 #include "KDSoapThreadPool.h"
 #include "KDSoapSocketList_p.h"
+#include "KDSoapReusePort_p.h"
+#include "KDSoapLogWriter_p.h"
+#include "KDSoapWsdlCache_p.h"
+#include "KDSoapTlsSessionCache_p.h"
+#include <QSharedPointer>
 #include <QMutex>
-#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QTcpSocket>
 #ifdef Q_OS_UNIX
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -40,8 +47,23 @@ public:
           m_mainThreadSocketList(0),
           m_use(KDSoapMessage::LiteralUse),
           m_logLevel(KDSoapServer::LogNothing),
-          m_path(QString::fromLatin1("/")),
+          m_logFormat(KDSoapServer::PlainLogFormat),
+          m_maxPendingCalls(-1),
+          m_maxPendingCallsPerThread(-1),
+          m_retryAfter(1),
+          m_pendingCalls(0),
+          m_xmlParser(KDSoapServer::QtXmlParser),
           m_maxConnections(-1),
+          m_keepAliveTimeout(-1),
+          m_maxRequestsPerConnection(-1),
+          m_compressionThreshold(-1),
+          m_compressionLevel(6),
+          m_maxDecompressedRequestSize(16 * 1024 * 1024),
+          m_responseChunkSize(-1),
+          m_responseDeadline(-1),
+          m_ioBackend(KDSoapServer::QtIoBackend),
+          m_requestSettings(defaultRequestSettings()),
+          m_reusePort(false),
           m_portBeforeSuspend(0)
     {
     }
@@ -51,22 +73,81 @@ public:
         delete m_mainThreadSocketList;
     }
 
+    // The settings read for every request which can't be atomic integers. They are never
+    // modified once published: the mutex is only held to copy or replace the shared pointer,
+    // and a snapshot is deleted once the last request using it is done.
+    struct RequestSettings {
+        QString path;
+        QString metricsPath;
+        QHash<QString, int> operationResponseDeadlines;
+    };
+    typedef QSharedPointer<const RequestSettings> RequestSettingsPtr;
+
+    static RequestSettingsPtr defaultRequestSettings()
+    {
+        RequestSettings *settings = new RequestSettings;
+        settings->path = QString::fromLatin1("/");
+        return RequestSettingsPtr(settings);
+    }
+
+    RequestSettingsPtr requestSettings()
+    {
+        QMutexLocker lock(&m_serverDataMutex);
+        return m_requestSettings;
+    }
+
+    // Call with m_serverDataMutex locked, then publishRequestSettings
+    RequestSettings *copyRequestSettings() const
+    {
+        return new RequestSettings(*m_requestSettings);
+    }
+
+    void publishRequestSettings(RequestSettings *settings)
+    {
+        m_requestSettings = RequestSettingsPtr(settings);
+    }
+
+    static int load(const QAtomicInt &value)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+        return value.loadAcquire();
+#else
+        return value;
+#endif
+    }
+
     KDSoapThreadPool *m_threadPool;
     KDSoapSocketList *m_mainThreadSocketList;
     KDSoapMessage::Use m_use;
     KDSoapServer::Features m_features;
 
-    QMutex m_logMutex;
-    KDSoapServer::LogLevel m_logLevel;
-    QString m_logFileName;
-    QFile m_logFile;
+    // Read for every call, from all the threads, hence no mutex
+    QAtomicInt m_logLevel;
+    QAtomicInt m_logFormat;
+    QAtomicInt m_maxPendingCalls;
+    QAtomicInt m_maxPendingCallsPerThread;
+    QAtomicInt m_retryAfter;
+    QAtomicInt m_pendingCalls;
+    QAtomicInt m_xmlParser;
+    QAtomicInt m_maxConnections;
+    QAtomicInt m_keepAliveTimeout;
+    QAtomicInt m_maxRequestsPerConnection;
+    QAtomicInt m_compressionThreshold;
+    QAtomicInt m_compressionLevel;
+    QAtomicInt m_maxDecompressedRequestSize;
+    QAtomicInt m_responseChunkSize;
+    QAtomicInt m_responseDeadline;
+    QAtomicInt m_ioBackend;
+    KDSoapLogWriter m_logWriter;
+    KDSoapWsdlCache m_wsdlCache; // thread-safe
+    KDSoapTlsSessionCache m_tlsSessionCache; // thread-safe
 
     QMutex m_serverDataMutex;
     QString m_wsdlFile;
     QString m_wsdlPathInUrl;
-    QString m_path;
-    int m_maxConnections;
+    RequestSettingsPtr m_requestSettings;
 
+    bool m_reusePort;
     QHostAddress m_addressBeforeSuspend;
     quint16 m_portBeforeSuspend;
 
@@ -85,6 +166,9 @@ KDSoapServer::KDSoapServer(QObject *parent)
 
 KDSoapServer::~KDSoapServer()
 {
+    if (d->m_reusePort && isListening()) {
+        d->m_threadPool->closeListeners(this);
+    }
     delete d;
 }
 
@@ -94,12 +178,10 @@ void KDSoapServer::incomingConnection(qintptr socketDescriptor)
 void KDSoapServer::incomingConnection(int socketDescriptor)
 #endif
 {
-    const int max = maxConnections();
-    const int numSockets = numConnectedSockets();
-    if (max > -1 && numSockets >= max) {
-        emit connectionRejected();
-        log(QByteArray("ERROR Too many connections (") + QByteArray::number(numSockets) + "), incoming connection rejected\n");
-    } else if (d->m_threadPool) {
+    if (rejectConnection(socketDescriptor)) {
+        return;
+    }
+    if (d->m_threadPool) {
         //qDebug() << "incomingConnection: using thread pool";
         d->m_threadPool->handleIncomingConnection(socketDescriptor, this);
     } else {
@@ -111,6 +193,85 @@ void KDSoapServer::incomingConnection(int socketDescriptor)
     }
 }
 
+// Called from the thread accepting the connection: the thread of the server, or the threads
+// of the thread pool (listenWithReusePort). A rejected connection is closed right away,
+// QTcpServer hands over the descriptor and nobody else would close it.
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+bool KDSoapServer::rejectConnection(qintptr socketDescriptor)
+#else
+bool KDSoapServer::rejectConnection(int socketDescriptor)
+#endif
+{
+    const int max = maxConnections();
+    if (max < 0) { // unlimited, no need to count the sockets
+        return false;
+    }
+    const int numSockets = numConnectedSockets();
+    if (numSockets < max) {
+        return false;
+    }
+    QTcpSocket socket;
+    if (socket.setSocketDescriptor(socketDescriptor)) {
+        socket.abort();
+    } else {
+        KDSoapReusePort::closeSocket(int(socketDescriptor));
+    }
+    emit connectionRejected();
+    log(QByteArray("ERROR Too many connections (") + QByteArray::number(numSockets) + "), incoming connection rejected\n");
+    return true;
+}
+
+bool KDSoapServer::listenWithReusePort(const QHostAddress &address, quint16 port)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    if (!d->m_threadPool) {
+        qWarning("KDSoapServer: listenWithReusePort() requires a thread pool");
+        return false;
+    }
+    // Bound but not listening: holds the port (and picks it, if port is 0), without getting any connection
+    const int socketDescriptor = KDSoapReusePort::bindSocket(address, port);
+    if (socketDescriptor == -1) {
+        return false;
+    }
+    if (!setSocketDescriptor(socketDescriptor)) {
+        KDSoapReusePort::closeSocket(socketDescriptor);
+        return false;
+    }
+    pauseAccepting(); // there is nothing to accept
+    if (!d->m_threadPool->listenWithReusePort(this, address, serverPort())) {
+        close();
+        return false;
+    }
+    d->m_reusePort = true;
+    return true;
+#else
+    Q_UNUSED(address);
+    Q_UNUSED(port);
+    qWarning("KDSoapServer: listenWithReusePort() requires Qt 5");
+    return false;
+#endif
+}
+
+void KDSoapServer::setIoBackend(IoBackend backend)
+{
+    d->m_ioBackend.fetchAndStoreRelease(backend);
+}
+
+KDSoapServer::IoBackend KDSoapServer::ioBackend() const
+{
+    return static_cast<KDSoapServer::IoBackend>(Private::load(d->m_ioBackend));
+}
+
+void KDSoapServer::setXmlParser(XmlParser parser)
+{
+    d->m_xmlParser.fetchAndStoreRelease(parser);
+}
+
+KDSoapServer::XmlParser KDSoapServer::xmlParser() const
+{
+    return static_cast<KDSoapServer::XmlParser>(Private::load(d->m_xmlParser));
+}
+
 int KDSoapServer::numConnectedSockets() const
 {
     if (d->m_threadPool) {
@@ -142,6 +303,33 @@ void KDSoapServer::resetTotalConnectionCount()
     }
 }
 
+KDSoapServerMetrics KDSoapServer::metrics() const
+{
+    KDSoapServerMetrics metrics;
+    if (d->m_threadPool) {
+        d->m_threadPool->collectMetrics(this, metrics); // including the connection counts
+    } else {
+        if (d->m_mainThreadSocketList) {
+            d->m_mainThreadSocketList->metrics()->addTo(metrics);
+        }
+        metrics.setConnectionCounts(numConnectedSockets(), totalConnectionCount());
+    }
+    return metrics;
+}
+
+void KDSoapServer::setMetricsPath(const QString &pathInUrl)
+{
+    QMutexLocker lock(&d->m_serverDataMutex);
+    Private::RequestSettings *settings = d->copyRequestSettings();
+    settings->metricsPath = pathInUrl;
+    d->publishRequestSettings(settings);
+}
+
+QString KDSoapServer::metricsPath() const
+{
+    return d->requestSettings()->metricsPath;
+}
+
 void KDSoapServer::setThreadPool(KDSoapThreadPool *threadPool)
 {
     d->m_threadPool = threadPool;
@@ -163,7 +351,7 @@ QString KDSoapServer::endPoint() const
            .arg(QString::fromLatin1((d->m_features & Ssl) ? "https" : "http"))
            .arg(addressStr)
            .arg(serverPort())
-           .arg(d->m_path);
+           .arg(path());
 }
 
 void KDSoapServer::setUse(KDSoapMessage::Use use)
@@ -178,58 +366,76 @@ KDSoapMessage::Use KDSoapServer::use() const
 
 void KDSoapServer::setLogLevel(KDSoapServer::LogLevel level)
 {
-    QMutexLocker lock(&d->m_logMutex);
-    d->m_logLevel = level;
+    d->m_logLevel.fetchAndStoreRelease(level);
 }
 
 KDSoapServer::LogLevel KDSoapServer::logLevel() const
 {
-    QMutexLocker lock(&d->m_logMutex);
-    return d->m_logLevel;
+    return static_cast<KDSoapServer::LogLevel>(Private::load(d->m_logLevel));
+}
+
+void KDSoapServer::setLogFormat(KDSoapServer::LogFormat format)
+{
+    d->m_logFormat.fetchAndStoreRelease(format);
+}
+
+KDSoapServer::LogFormat KDSoapServer::logFormat() const
+{
+    return static_cast<KDSoapServer::LogFormat>(Private::load(d->m_logFormat));
 }
 
 void KDSoapServer::setLogFileName(const QString &fileName)
 {
-    QMutexLocker lock(&d->m_logMutex);
-    d->m_logFileName = fileName;
+    d->m_logWriter.setFileName(fileName);
 }
 
 QString KDSoapServer::logFileName() const
 {
-    QMutexLocker lock(&d->m_logMutex);
-    return d->m_logFileName;
+    return d->m_logWriter.fileName();
+}
+
+void KDSoapServer::setLogFileMaxSize(qint64 maxSize)
+{
+    d->m_logWriter.setMaxFileSize(maxSize);
+}
+
+qint64 KDSoapServer::logFileMaxSize() const
+{
+    return d->m_logWriter.maxFileSize();
 }
 
+void KDSoapServer::setLogFileBackupCount(int count)
+{
+    d->m_logWriter.setBackupCount(count);
+}
+
+int KDSoapServer::logFileBackupCount() const
+{
+    return d->m_logWriter.backupCount();
+}
+
+// Called from any thread, for the lines which are not logged by the socket threads (see KDSoapSocketList::log)
 void KDSoapServer::log(const QByteArray &text)
 {
-    if (d->m_logLevel == KDSoapServer::LogNothing) {
+    if (logLevel() == KDSoapServer::LogNothing) {
         return;
     }
+    d->m_logWriter.log(text);
+}
 
-    QMutexLocker lock(&d->m_logMutex);
-    if (!d->m_logFile.isOpen() && !d->m_logFileName.isEmpty()) {
-        d->m_logFile.setFileName(d->m_logFileName);
-        if (!d->m_logFile.open(QIODevice::Append)) {
-            qCritical("Could not open log file for writing: %s", qPrintable(d->m_logFileName));
-            d->m_logFileName.clear(); // don't retry every time log() is called
-            return;
-        }
-    }
-    d->m_logFile.write(text);
+KDSoapLogBuffer *KDSoapServer::createLogBuffer()
+{
+    return d->m_logWriter.createBuffer();
 }
 
 void KDSoapServer::flushLogFile()
 {
-    if (d->m_logFile.isOpen()) {
-        d->m_logFile.flush();
-    }
+    d->m_logWriter.flush();
 }
 
 void KDSoapServer::closeLogFile()
 {
-    if (d->m_logFile.isOpen()) {
-        d->m_logFile.close();
-    }
+    d->m_logWriter.close();
 }
 
 bool KDSoapServer::setExpectedSocketCount(int sockets)
@@ -287,6 +493,9 @@ void KDSoapServer::suspend()
     d->m_portBeforeSuspend = serverPort();
     d->m_addressBeforeSuspend = serverAddress();
     close();
+    if (d->m_reusePort) {
+        d->m_threadPool->closeListeners(this);
+    }
 
     // Disconnect connected sockets, otherwise they could still make calls
     if (d->m_threadPool) {
@@ -301,7 +510,9 @@ void KDSoapServer::resume()
     if (d->m_portBeforeSuspend == 0) {
         qWarning("KDSoapServer: resume() called without calling suspend() first");
     } else {
-        if (!listen(d->m_addressBeforeSuspend, d->m_portBeforeSuspend)) {
+        const bool listening = d->m_reusePort ? listenWithReusePort(d->m_addressBeforeSuspend, d->m_portBeforeSuspend)
+                               : listen(d->m_addressBeforeSuspend, d->m_portBeforeSuspend);
+        if (!listening) {
             qWarning("KDSoapServer: failed to listen on %s port %d", qPrintable(d->m_addressBeforeSuspend.toString()), d->m_portBeforeSuspend);
         }
         d->m_portBeforeSuspend = 0;
@@ -310,9 +521,12 @@ void KDSoapServer::resume()
 
 void KDSoapServer::setWsdlFile(const QString &file, const QString &pathInUrl)
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    d->m_wsdlFile = file;
-    d->m_wsdlPathInUrl = pathInUrl;
+    {
+        QMutexLocker lock(&d->m_serverDataMutex);
+        d->m_wsdlFile = file;
+        d->m_wsdlPathInUrl = pathInUrl;
+    }
+    d->m_wsdlCache.setFile(file, pathInUrl); // loads the file, outside of the lock
 }
 
 QString KDSoapServer::wsdlFile() const
@@ -327,28 +541,179 @@ QString KDSoapServer::wsdlPathInUrl() const
     return d->m_wsdlPathInUrl;
 }
 
+KDSoapWsdlCache *KDSoapServer::wsdlCache() const
+{
+    return &d->m_wsdlCache;
+}
+
 void KDSoapServer::setPath(const QString &path)
 {
     QMutexLocker lock(&d->m_serverDataMutex);
-    d->m_path = path;
+    Private::RequestSettings *settings = d->copyRequestSettings();
+    settings->path = path;
+    d->publishRequestSettings(settings);
 }
 
 QString KDSoapServer::path() const
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    return d->m_path;
+    return d->requestSettings()->path;
 }
 
 void KDSoapServer::setMaxConnections(int sockets)
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    d->m_maxConnections = sockets;
+    d->m_maxConnections.fetchAndStoreRelease(sockets);
 }
 
 int KDSoapServer::maxConnections() const
+{
+    return Private::load(d->m_maxConnections);
+}
+
+void KDSoapServer::setKeepAliveTimeout(int seconds)
+{
+    d->m_keepAliveTimeout.fetchAndStoreRelease(seconds);
+}
+
+int KDSoapServer::keepAliveTimeout() const
+{
+    return Private::load(d->m_keepAliveTimeout);
+}
+
+void KDSoapServer::setMaxRequestsPerConnection(int requests)
+{
+    d->m_maxRequestsPerConnection.fetchAndStoreRelease(requests);
+}
+
+int KDSoapServer::maxRequestsPerConnection() const
+{
+    return Private::load(d->m_maxRequestsPerConnection);
+}
+
+void KDSoapServer::setCompressionThreshold(int minimumSize)
+{
+    d->m_compressionThreshold.fetchAndStoreRelease(minimumSize);
+}
+
+int KDSoapServer::compressionThreshold() const
+{
+    return Private::load(d->m_compressionThreshold);
+}
+
+void KDSoapServer::setCompressionLevel(int level)
+{
+    d->m_compressionLevel.fetchAndStoreRelease(level);
+}
+
+int KDSoapServer::compressionLevel() const
+{
+    return Private::load(d->m_compressionLevel);
+}
+
+void KDSoapServer::setMaxDecompressedRequestSize(int size)
+{
+    d->m_maxDecompressedRequestSize.fetchAndStoreRelease(size);
+}
+
+int KDSoapServer::maxDecompressedRequestSize() const
+{
+    return Private::load(d->m_maxDecompressedRequestSize);
+}
+
+void KDSoapServer::setResponseChunkSize(int chunkSize)
+{
+    d->m_responseChunkSize.fetchAndStoreRelease(chunkSize);
+}
+
+int KDSoapServer::responseChunkSize() const
+{
+    return Private::load(d->m_responseChunkSize);
+}
+
+void KDSoapServer::setMaxPendingCalls(int maxCalls)
+{
+    d->m_maxPendingCalls.fetchAndStoreRelease(maxCalls);
+}
+
+int KDSoapServer::maxPendingCalls() const
+{
+    return Private::load(d->m_maxPendingCalls);
+}
+
+void KDSoapServer::setMaxPendingCallsPerThread(int maxCalls)
+{
+    d->m_maxPendingCallsPerThread.fetchAndStoreRelease(maxCalls);
+}
+
+int KDSoapServer::maxPendingCallsPerThread() const
+{
+    return Private::load(d->m_maxPendingCallsPerThread);
+}
+
+void KDSoapServer::setRetryAfter(int seconds)
+{
+    d->m_retryAfter.fetchAndStoreRelease(seconds);
+}
+
+int KDSoapServer::retryAfter() const
+{
+    return Private::load(d->m_retryAfter);
+}
+
+int KDSoapServer::pendingCallCount() const
+{
+    return Private::load(d->m_pendingCalls);
+}
+
+void KDSoapServer::setResponseDeadline(int msecs)
+{
+    d->m_responseDeadline.fetchAndStoreRelease(msecs);
+}
+
+void KDSoapServer::setOperationResponseDeadline(const QString &operation, int msecs)
 {
     QMutexLocker lock(&d->m_serverDataMutex);
-    return d->m_maxConnections;
+    Private::RequestSettings *settings = d->copyRequestSettings();
+    settings->operationResponseDeadlines.insert(operation, msecs);
+    d->publishRequestSettings(settings);
+}
+
+void KDSoapServer::clearOperationResponseDeadline(const QString &operation)
+{
+    QMutexLocker lock(&d->m_serverDataMutex);
+    Private::RequestSettings *settings = d->copyRequestSettings();
+    settings->operationResponseDeadlines.remove(operation);
+    d->publishRequestSettings(settings);
+}
+
+int KDSoapServer::responseDeadline(const QString &operation) const
+{
+    const Private::RequestSettingsPtr settings = d->requestSettings();
+    const QHash<QString, int> &deadlines = settings->operationResponseDeadlines;
+    if (!deadlines.isEmpty()) {
+        const QHash<QString, int>::const_iterator it = deadlines.constFind(operation);
+        if (it != deadlines.constEnd()) {
+            return it.value();
+        }
+    }
+    return Private::load(d->m_responseDeadline);
+}
+
+// Called by the socket threads, see KDSoapSocketList::admitCall.
+// The calls are always counted, so that the limit can be changed at any time.
+bool KDSoapServer::admitCall()
+{
+    const int max = maxPendingCalls();
+    const int pending = d->m_pendingCalls.fetchAndAddOrdered(1);
+    if (max > -1 && pending >= max) {
+        d->m_pendingCalls.deref();
+        return false;
+    }
+    return true;
+}
+
+void KDSoapServer::releaseCall()
+{
+    d->m_pendingCalls.deref();
 }
 
 void KDSoapServer::setFeatures(Features features)
@@ -371,6 +736,31 @@ void KDSoapServer::setSslConfiguration(const QSslConfiguration &config)
 {
     d->m_sslConfiguration = config;
 }
+
+void KDSoapServer::setTlsSessionLifetime(int seconds)
+{
+    d->m_tlsSessionCache.setSessionLifetime(seconds);
+}
+
+int KDSoapServer::tlsSessionLifetime() const
+{
+    return d->m_tlsSessionCache.sessionLifetime();
+}
+
+void KDSoapServer::setTlsTicketKeyLifetime(int seconds)
+{
+    d->m_tlsSessionCache.setTicketKeyLifetime(seconds);
+}
+
+int KDSoapServer::tlsTicketKeyLifetime() const
+{
+    return d->m_tlsSessionCache.ticketKeyLifetime();
+}
 #endif
 
+KDSoapTlsSessionCache *KDSoapServer::tlsSessionCache() const
+{
+    return &d->m_tlsSessionCache;
+}
+
 #include "moc_KDSoapServer.cpp"
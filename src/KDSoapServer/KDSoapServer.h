@@ -24,11 +24,15 @@
 #define KDSOAPSERVER_H
 
 #include "KDSoapServerGlobal.h"
+#include "KDSoapServerMetrics.h"
 #include <KDSoapClient/KDSoapMessage.h>
 #include <QtNetwork/QTcpServer>
 #include <QtNetwork/QSslConfiguration>
 
 class KDSoapThreadPool;
+class KDSoapLogBuffer;
+class KDSoapWsdlCache;
+class KDSoapTlsSessionCache;
 
 /**
  * HTTP soap server.
@@ -89,6 +93,87 @@ public:
      */
     KDSoapThreadPool *threadPool() const;
 
+    /**
+     * Starts listening on \p address and \p port, with one listening socket per thread
+     * of the thread pool, all bound to the same port with SO_REUSEPORT.
+     * The operating system then spreads the incoming connections over the threads directly,
+     * instead of the thread of the server accepting all of them and handing them over to the
+     * thread pool. This scales better when clients open many connections per second.
+     *
+     * A thread pool must be set first (see setThreadPool()), all of its threads are started.
+     * The server itself holds the port, so that serverPort() and endPoint() work as usual,
+     * but it doesn't accept connections.
+     *
+     * Returns false if listening failed, or if this mode isn't available (it requires Qt 5,
+     * and an operating system supporting SO_REUSEPORT such as Linux 3.9 or later);
+     * call listen() then.
+     * \since 1.7
+     */
+    bool listenWithReusePort(const QHostAddress &address = QHostAddress::Any, quint16 port = 0);
+
+    /**
+     * The ways of handling the connections, see setIoBackend.
+     * \since 1.7
+     */
+    enum IoBackend {
+        QtIoBackend,   ///< one QTcpSocket per connection (default)
+        EpollIoBackend ///< one edge-triggered epoll instance per thread (Linux only)
+    };
+
+    /**
+     * Selects how the connections accepted from now on are handled.
+     *
+     * With EpollIoBackend, each thread (see setThreadPool) watches its connections with a single
+     * epoll instance, and keeps a small structure per connection instead of a QTcpSocket,
+     * so that a server with tens of thousands of connections uses much less memory and
+     * spends much less time in the event dispatcher.
+     * SOAP calls (HTTP POST requests) are handled directly, including keep-alive,
+     * pipelining, setMaxPendingCalls and the metrics.
+     * Everything else hands the connection over to a QTcpSocket, for the rest of its lifetime:
+     * GET requests (WSDL file, file downloads, metrics), other HTTP methods, compressed requests,
+     * and calls made while compression, streaming (setResponseChunkSize), logging,
+     * KDSoapThreadPool::RequestScheduling, KDSoapServerAuthInterface or KDSoapServerRawXMLInterface
+     * are used. This also happens during a call, when the server object calls
+     * KDSoapServerObjectInterface::prepareDelayedResponse(), serverSocket(), writeHTTP() or writeXML().
+     *
+     * EpollIoBackend is ignored on other operating systems than Linux, and for SSL servers.
+     * \since 1.7
+     */
+    void setIoBackend(IoBackend backend);
+
+    /**
+     * Returns the value set by setIoBackend.
+     * \since 1.7
+     */
+    IoBackend ioBackend() const;
+
+    /**
+     * The XML parsers available for the requests, see setXmlParser.
+     * \since 1.7
+     */
+    enum XmlParser {
+        QtXmlParser,  ///< QXmlStreamReader (default)
+        SimdXmlParser ///< a tokenizer specialized for SOAP messages, using SSE2/SSE4.2/AVX2 when available
+    };
+
+    /**
+     * Selects the XML parser used for the requests received from now on.
+     *
+     * SimdXmlParser works on the UTF-8 data directly, and scans the text and the attribute values
+     * 16 or 32 bytes at a time with the best instruction set supported by the CPU
+     * (with a plain C++ fallback), which makes parsing large requests significantly faster.
+     * It rejects document type declarations, which aren't allowed in SOAP messages anyway,
+     * and hands the requests which aren't encoded in UTF-8 over to QXmlStreamReader.
+     * \since 1.7
+     */
+    void setXmlParser(XmlParser parser);
+
+    /**
+     * Returns the value set by setXmlParser.
+     * \since 1.7
+     */
+    XmlParser xmlParser() const;
+
     /**
      * Sets the path that the server expects in client requests.
      * By default the path is '/', but this can be changed here.
@@ -142,9 +227,10 @@ public:
      *  <li>LogEveryCall: log every call, successful or not.</li>
      * </ul>
      *
-     * Warning: enabling logging reduces performance severely. Not only
-     * because of the time spent logging, but also because the threads can
-     * only write one at a time to the file, to avoid mixed output.
+     * The log lines are written to the file by a separate thread, so that the
+     * threads handling the calls never wait for the disk. If that thread can't
+     * keep up with a very high rate of calls, some lines are dropped, and
+     * a warning with the number of dropped lines is written instead.
      */
     void setLogLevel(LogLevel level);
     /**
@@ -152,10 +238,31 @@ public:
      */
     LogLevel logLevel() const;
 
+    enum LogFormat { PlainLogFormat, StructuredLogFormat };
+    /**
+     * Sets the format of the log lines:
+     * <ul>
+     *  <li>PlainLogFormat: "CALL method" and "FAULT method -- fault description" (the default).</li>
+     *  <li>StructuredLogFormat: one access-log line per call, made of key=value pairs:
+     *  time, client address, method, HTTP status, duration in microseconds (from the
+     *  end of the request headers to the response being written), size of the request body
+     *  and size of the response, and the fault description for faults. For instance
+     *  <pre>time=2017-05-04T10:21:07.264Z client=127.0.0.1 method=getEmployeeCountry status=200 duration_us=215 bytes_in=312 bytes_out=480</pre></li>
+     * </ul>
+     * \since 1.7
+     */
+    void setLogFormat(LogFormat format);
+    /**
+     * Returns the format set by setLogFormat.
+     * \since 1.7
+     */
+    LogFormat logFormat() const;
+
     /**
      * Sets the name of the file where logging should go.
      * The server always appends to this file, you should delete it
-     * or rename it first if you don't want an ever-growing log file.
+     * or rename it first if you don't want an ever-growing log file,
+     * or use setLogFileMaxSize().
      */
     void setLogFileName(const QString &fileName);
 
@@ -164,8 +271,37 @@ public:
      */
     QString logFileName() const;
 
+    /**
+     * Sets the maximum size of the log file, in bytes. When writing more lines
+     * would make the file bigger than that, it is renamed to "<fileName>.1"
+     * (the previous "<fileName>.1" becoming "<fileName>.2", and so on, see
+     * setLogFileBackupCount), and a new file is started.
+     * The default value, 0, means no maximum size.
+     * \since 1.7
+     */
+    void setLogFileMaxSize(qint64 maxSize);
+    /**
+     * Returns the size given to setLogFileMaxSize.
+     * \since 1.7
+     */
+    qint64 logFileMaxSize() const;
+
+    /**
+     * Sets the number of rotated log files to keep, see setLogFileMaxSize.
+     * The default value is 1. With 0, the log file is simply truncated when full.
+     * \since 1.7
+     */
+    void setLogFileBackupCount(int count);
+    /**
+     * Returns the number given to setLogFileBackupCount.
+     * \since 1.7
+     */
+    int logFileBackupCount() const;
+
     /**
      * Force flushing the log file to disk.
+     * This writes all the lines logged so far, including the ones still
+     * waiting for the log thread.
      */
     void flushLogFile();
 
@@ -191,6 +327,211 @@ public:
      */
     int maxConnections() const;
 
+    /**
+     * Sets the time after which connections are closed when the client doesn't send anything.
+     * This allows the server to get rid of connections which clients keep open (HTTP keep-alive)
+     * but don't use anymore.
+     *
+     * The default value -1 means no timeout, connections stay open until the client closes them.
+     * \param seconds the idle timeout, in seconds
+     * \since 1.7
+     */
+    void setKeepAliveTimeout(int seconds);
+
+    /**
+     * Returns the idle timeout set by setKeepAliveTimeout.
+     * \since 1.7
+     */
+    int keepAliveTimeout() const;
+
+    /**
+     * Sets the maximum number of requests a client can send over the same connection.
+     * The response to the last request tells the client that the connection is being closed
+     * (header "Connection: close"), and the server then closes it.
+     *
+     * The special value -1 means unlimited (the default).
+     * \since 1.7
+     */
+    void setMaxRequestsPerConnection(int requests);
+
+    /**
+     * Returns the maximum number of requests per connection, as set by setMaxRequestsPerConnection.
+     * \since 1.7
+     */
+    int maxRequestsPerConnection() const;
+
+    /**
+     * Enables the compression of the responses, for clients which accept it
+     * (gzip or deflate, depending on the Accept-Encoding header of the request).
+     * Only the responses of at least \p minimumSize bytes are compressed, since compressing
+     * small responses costs more CPU time than it saves bandwidth.
+     *
+     * The default value -1 means that responses are never compressed.
+     * Compressed requests (Content-Encoding: gzip or deflate) are always accepted.
+     *
+     * Compression is only available if KD SOAP was built with zlib.
+     * \since 1.7
+     */
+    void setCompressionThreshold(int minimumSize);
+
+    /**
+     * Returns the minimum size of compressed responses, as set by setCompressionThreshold.
+     * \since 1.7
+     */
+    int compressionThreshold() const;
+
+    /**
+     * Sets the compression level used for the responses, from 1 (fastest)
+     * to 9 (smallest responses). The default value is 6.
+     * \see setCompressionThreshold
+     * \since 1.7
+     */
+    void setCompressionLevel(int level);
+
+    /**
+     * Returns the compression level set by setCompressionLevel.
+     * \since 1.7
+     */
+    int compressionLevel() const;
+
+    /**
+     * Sets the maximum size of a compressed request (Content-Encoding: gzip or deflate)
+     * once decompressed, in bytes. The requests which decompress to more are answered
+     * with "413 Request Entity Too Large", as soon as their decompressed data exceeds this size:
+     * a small request can't make the server decompress gigabytes of data.
+     *
+     * The default value is 16 MB; -1 means no limit.
+     * \since 1.7
+     */
+    void setMaxDecompressedRequestSize(int size);
+
+    /**
+     * Returns the maximum size set by setMaxDecompressedRequestSize.
+     * \since 1.7
+     */
+    int maxDecompressedRequestSize() const;
+
+    /**
+     * Enables streaming of large responses: instead of serializing the whole response
+     * in memory before sending it, the response is serialized in chunks of about \p chunkSize
+     * bytes, sent with the HTTP/1.1 chunked transfer encoding. The serialization is paused
+     * while the client doesn't read the data already sent, so that slow clients don't make the
+     * server buffer large responses.
+     *
+     * Responses which fit in a single chunk are sent as usual, with a Content-Length header.
+     * Responses to HTTP/1.0 requests, and compressed responses (see setCompressionThreshold),
+     * are never streamed. In KDSoapThreadPool::RequestScheduling mode, the responses are
+     * serialized by the worker threads and are not streamed either.
+     *
+     * The default value -1 means that responses are never streamed.
+     * \since 1.7
+     */
+    void setResponseChunkSize(int chunkSize);
+
+    /**
+     * Returns the size of the chunks of streamed responses, as set by setResponseChunkSize.
+     * \since 1.7
+     */
+    int responseChunkSize() const;
+
+    /**
+     * Limits the number of SOAP calls being handled by the server at the same time, including
+     * the calls waiting for a delayed response, and the calls waiting for a worker thread
+     * in KDSoapThreadPool::RequestScheduling mode.
+     *
+     * Beyond that limit, calls are rejected as soon as their HTTP headers are received, without
+     * parsing their SOAP message: the client gets a "503 Service Unavailable" response, with a
+     * Retry-After header (see setRetryAfter). KDSoapServerMetrics::shedCallCount() counts them.
+     * Unlike setMaxConnections(), this also protects the server from a few connections sending
+     * many requests, and keeps the latency of the accepted calls bounded under overload.
+     *
+     * The default value -1 means no limit. HTTP GET requests (WSDL file, file downloads, metrics)
+     * are not limited.
+     * \since 1.7
+     */
+    void setMaxPendingCalls(int maxCalls);
+
+    /**
+     * Returns the maximum number of SOAP calls handled at the same time, as set by setMaxPendingCalls.
+     * \since 1.7
+     */
+    int maxPendingCalls() const;
+
+    /**
+     * Same as setMaxPendingCalls, for the calls received by each thread of the thread pool
+     * (or by the server's thread, without a thread pool).
+     * The default value -1 means no limit.
+     * \since 1.7
+     */
+    void setMaxPendingCallsPerThread(int maxCalls);
+
+    /**
+     * Returns the maximum number of SOAP calls handled at the same time by each thread,
+     * as set by setMaxPendingCallsPerThread.
+     * \since 1.7
+     */
+    int maxPendingCallsPerThread() const;
+
+    /**
+     * Sets the value of the Retry-After header sent with the "503 Service Unavailable" responses,
+     * in seconds. The default value is 1.
+     * \see setMaxPendingCalls
+     * \since 1.7
+     */
+    void setRetryAfter(int seconds);
+
+    /**
+     * Returns the value set by setRetryAfter.
+     * \since 1.7
+     */
+    int retryAfter() const;
+
+    /**
+     * Returns the number of SOAP calls being handled by the server.
+     * \see setMaxPendingCalls
+     * \since 1.7
+     */
+    int pendingCallCount() const;
+
+    /**
+     * Sets the maximum time, in milliseconds, given to the server object to send a delayed response
+     * (see KDSoapServerObjectInterface::prepareDelayedResponse), including, in
+     * KDSoapThreadPool::RequestScheduling mode, the time spent waiting for a worker thread.
+     *
+     * When the deadline expires, the client gets a "Server.Timeout" fault, the connection
+     * can be used for the next request, and the response sent later on by the server object is
+     * ignored. The deadlines are checked with a resolution of a quarter of a second.
+     *
+     * Note that in KDSoapThreadPool::RequestScheduling mode, a call which never finishes still
+     * holds its worker thread: the deadline only frees the connection.
+     *
+     * The default value -1 means no deadline.
+     * \see setOperationResponseDeadline
+     * \since 1.7
+     */
+    void setResponseDeadline(int msecs);
+
+    /**
+     * Sets a response deadline for the calls to the operation \p operation, overriding
+     * the one set by setResponseDeadline. The value -1 means no deadline for this operation,
+     * use clearOperationResponseDeadline to use the server's deadline again.
+     * \since 1.7
+     */
+    void setOperationResponseDeadline(const QString &operation, int msecs);
+
+    /**
+     * Removes the deadline set by setOperationResponseDeadline for the operation \p operation.
+     * \since 1.7
+     */
+    void clearOperationResponseDeadline(const QString &operation);
+
+    /**
+     * Returns the response deadline which applies to the calls to the operation \p operation,
+     * or, if \p operation is empty, the one set by setResponseDeadline.
+     * \since 1.7
+     */
+    int responseDeadline(const QString &operation = QString()) const;
+
     /**
      * Sets the number of expected sockets (connections) in this process.
      * This is necessary in order to increase system limits when a large number of clients
@@ -223,11 +564,38 @@ public:
      */
     void resetTotalConnectionCount();
 
+    /**
+     * Returns a snapshot of the metrics collected by the server: number of calls, faults,
+     * bytes received and sent, for each operation, and the latencies of each phase of the
+     * call handling. The values of all the threads are added up when calling this method.
+     * \since 1.7
+     */
+    KDSoapServerMetrics metrics() const;
+
+    /**
+     * Sets the path where the metrics can be downloaded (HTTP GET) from the server,
+     * in the Prometheus text format, for instance "/metrics".
+     * The default empty path means that the metrics are not available over HTTP.
+     * Like all requests, these downloads are subject to KDSoapServerAuthInterface.
+     * \since 1.7
+     */
+    void setMetricsPath(const QString &pathInUrl);
+
+    /**
+     * \returns the path given to setMetricsPath
+     * \since 1.7
+     */
+    QString metricsPath() const;
+
     /**
      * Sets the .wsdl file that users can download from the soap server.
      * \param file relative or absolute path to the .wsdl file (including the filename), on disk
      * \param pathInUrl that clients can use in order to download the file:
      *                  for instance "/files/myservice.wsdl" for "http://myserver.example.com/files/myservice.wsdl" as final URL.
+     *
+     * Since KD SOAP 1.7, the file is loaded immediately and kept in memory, and reloaded whenever
+     * it changes on disk. It is sent compressed to the clients which accept gzip (if KD SOAP was built
+     * with zlib), and conditional requests (If-None-Match, If-Modified-Since) get a 304 Not Modified response.
      */
     void setWsdlFile(const QString &file, const QString &pathInUrl);
 
@@ -252,6 +620,46 @@ public:
      * \param config ssl configuration to use for new connections
      */
     void setSslConfiguration(const QSslConfiguration &config);
+
+    /**
+     * Sets for how long the clients can resume their TLS sessions, in seconds.
+     *
+     * A client which reconnects within this time, presenting the session ID or the session ticket
+     * it got from any connection to this server (in any of its threads), skips the certificate
+     * exchange and the key agreement of a full handshake.
+     * 0 disables session resumption, which is the default.
+     *
+     * Session resumption requires KD SOAP to be built with the KDSoap_TLS_SESSION_CACHE option
+     * (OpenSSL and the private API of QtNetwork), and to run with the Qt version it was built
+     * against; otherwise tlsSessionLifetime() returns 0 and every handshake is a full one.
+     * Keep-alive connections (see setKeepAliveTimeout) avoid the handshakes in any case.
+     * See KDSoapServerMetrics::tlsResumedHandshakeCount().
+     * \since 1.7
+     */
+    void setTlsSessionLifetime(int seconds);
+
+    /**
+     * \returns the lifetime set by setTlsSessionLifetime, 0 if session resumption isn't available
+     * \since 1.7
+     */
+    int tlsSessionLifetime() const;
+
+    /**
+     * Sets how often the keys encrypting the session tickets are replaced, in seconds.
+     *
+     * A replaced key is kept for tlsSessionLifetime() seconds more, so that the tickets
+     * it encrypted can still be used. 0 disables session tickets: only the sessions
+     * kept in memory by the server, found with their session ID, can be resumed.
+     * The default is 3600 seconds.
+     * \since 1.7
+     */
+    void setTlsTicketKeyLifetime(int seconds);
+
+    /**
+     * \returns the lifetime set by setTlsTicketKeyLifetime, 0 if session resumption isn't available
+     * \since 1.7
+     */
+    int tlsTicketKeyLifetime() const;
 #endif
 
 public Q_SLOTS:
@@ -282,7 +690,19 @@ protected:
 
 private:
     friend class KDSoapServerSocket;
+    friend class KDSoapServerAcceptor;
+    friend class KDSoapSocketList;
     void log(const QByteArray &text);
+    KDSoapLogBuffer *createLogBuffer();
+    KDSoapWsdlCache *wsdlCache() const;
+    KDSoapTlsSessionCache *tlsSessionCache() const;
+    bool admitCall();
+    void releaseCall();
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    bool rejectConnection(qintptr socketDescriptor);
+#else
+    bool rejectConnection(int socketDescriptor);
+#endif
     class Private;
     Private *const d;
 };
@@ -19,19 +19,45 @@ INSTALLHEADERS = KDSoapServer.h \
                  KDSoapServerObjectInterface.h \
                  KDSoapServerGlobal.h \
                  KDSoapDelayedResponseHandle.h \
-                 KDSoapServerCustomVerbRequestInterface.h
+                 KDSoapServerCustomVerbRequestInterface.h \
+                 KDSoapServerMetrics.h
 
 HEADERS = $$INSTALLHEADERS \
     KDSoapThreadPool.h \
     KDSoapServerSocket_p.h \
+    KDSoapServerCall_p.h \
+    KDSoapHttpRequestParser_p.h \
+    KDSoapReusePort_p.h \
     KDSoapServerThread_p.h \
     KDSoapSocketList_p.h \
+    KDSoapEpollReactor_p.h \
+    KDSoapTimerWheel_p.h \
+    KDSoapMetricsRecorder_p.h \
+    KDSoapLogWriter_p.h \
+    KDSoapCompression_p.h \
+    KDSoapFileResponse_p.h \
+    KDSoapWsdlCache_p.h \
+    KDSoapTlsSessionCache_p.h \
+    KDSoapWorkerPool_p.h \
 
 SOURCES = KDSoapServer.cpp \
+    KDSoapServerMetrics.cpp \
+    KDSoapMetricsRecorder.cpp \
+    KDSoapLogWriter.cpp \
+    KDSoapCompression.cpp \
+    KDSoapFileResponse.cpp \
+    KDSoapWsdlCache.cpp \
+    KDSoapTlsSessionCache.cpp \
     KDSoapThreadPool.cpp \
     KDSoapServerSocket.cpp \
+    KDSoapServerCall.cpp \
+    KDSoapHttpRequestParser.cpp \
+    KDSoapReusePort.cpp \
     KDSoapServerThread.cpp \
     KDSoapSocketList.cpp \
+    KDSoapEpollReactor.cpp \
+    KDSoapTimerWheel.cpp \
+    KDSoapWorkerPool.cpp \
     KDSoapServerAuthInterface.cpp \
     KDSoapServerRawXMLInterface.cpp \
     KDSoapServerObjectInterface.cpp \
@@ -45,6 +71,23 @@ INCLUDEPATH += . $${TOP_SOURCE_DIR}/src
 DEPENDPATH += . $${TOP_SOURCE_DIR}/src
 LIBS        += -L$$DESTDIR -l$$KDSOAPLIB
 
+# Optional, for HTTP compression
+unix:packagesExist(zlib) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += zlib
+    DEFINES += KDSOAP_HAVE_ZLIB
+}
+
+# Optional, for TLS session resumption: needs the SSL objects of QSslSocket, only available in the private API of Qt 5,
+# whose layout can change in any Qt release. So it's only built on request (qmake CONFIG+=kdsoap_tls_session_cache),
+# against the Qt version used at runtime.
+greaterThan(QT_MAJOR_VERSION, 4):unix:kdsoap_tls_session_cache {
+    QT += core-private network-private
+    CONFIG += link_pkgconfig
+    PKGCONFIG += openssl
+    DEFINES += KDSOAP_HAVE_TLS_SESSION_CACHE
+}
+
 # installation targets:
 target.path = $$INSTALL_PREFIX/lib$$LIB_SUFFIX
 INSTALLS += target
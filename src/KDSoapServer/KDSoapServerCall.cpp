@@ -0,0 +1,156 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapServerCall_p.h"
+#include "KDSoapServerSocket_p.h"
+#include "KDSoapServerObjectInterface.h"
+#include "KDSoapServer.h"
+#include "KDSoapMetricsRecorder_p.h"
+
+KDSoapServerCall::KDSoapServerCall(KDSoapServer *server, const KDSoapMessage &requestMsg, const KDSoapHeaders &requestHeaders,
+                                   const QByteArray &soapAction, const QString &path,
+                                   const QString &method, const QString &messageNamespace)
+    : QObject(0),
+      m_server(server),
+      m_requestMsg(requestMsg),
+      m_requestHeaders(requestHeaders),
+      m_soapAction(soapAction),
+      m_path(path),
+      m_method(method),
+      m_messageNamespace(messageNamespace),
+      m_delayedResponse(false),
+      m_refCount(1), // released once the reply was handled by the socket
+      m_replied(0),
+      m_dispatchTime(0),
+      m_serializeTime(0)
+{
+}
+
+KDSoapServerCall::~KDSoapServerCall()
+{
+}
+
+KDSoapServer *KDSoapServerCall::server() const
+{
+    return m_server;
+}
+
+void KDSoapServerCall::run(QObject *serverObject)
+{
+    KDSoapServerObjectInterface *serverObjectInterface = qobject_cast<KDSoapServerObjectInterface *>(serverObject);
+    // Already checked by the socket, on its own instance of the same server object class
+    Q_ASSERT(serverObjectInterface);
+
+    KDSoapMessage replyMsg;
+    replyMsg.setUse(m_server->use());
+    ref(); // the socket can handle the reply before this returns
+
+    // The socket belongs to another thread, it must not be used from here
+    serverObjectInterface->setServerSocket(0);
+    serverObjectInterface->setServerCall(this);
+    QElapsedTimer timer;
+    timer.start();
+    KDSoapServerSocket::makeCall(m_server, serverObjectInterface, m_requestMsg, replyMsg, m_requestHeaders, m_soapAction, m_path);
+    m_dispatchTime = KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+    serverObjectInterface->setServerCall(0);
+
+    if (!m_delayedResponse) {
+        sendReply(serverObjectInterface, replyMsg);
+    }
+    release();
+}
+
+void KDSoapServerCall::setResponseDelayed()
+{
+    m_delayedResponse = true;
+}
+
+void KDSoapServerCall::sendReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg)
+{
+    if (!m_replied.testAndSetOrdered(0, 1)) {
+        qWarning("KDSoapServer: a reply was already sent for this call");
+        return;
+    }
+    // Serialize here, in the worker thread, the socket only has to write the result.
+    QElapsedTimer timer;
+    timer.start();
+    m_replyMsg = replyMsg;
+    m_response = KDSoapServerSocket::replyToXml(serverObjectInterface, replyMsg, m_method, m_messageNamespace);
+    m_serializeTime = KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+    QMetaObject::invokeMethod(this, "slotReplyReady", Qt::QueuedConnection);
+}
+
+KDSoapMessage KDSoapServerCall::replyMessage() const
+{
+    return m_replyMsg;
+}
+
+QByteArray KDSoapServerCall::response() const
+{
+    return m_response;
+}
+
+qint64 KDSoapServerCall::dispatchTime() const
+{
+    return m_dispatchTime;
+}
+
+qint64 KDSoapServerCall::serializeTime() const
+{
+    return m_serializeTime;
+}
+
+void KDSoapServerCall::addResponseHandle()
+{
+    ref();
+}
+
+void KDSoapServerCall::releaseResponseHandle()
+{
+    if (m_replied.testAndSetOrdered(0, 1)) {
+        // The delayed response was abandoned, the reply will never come
+        release();
+    }
+    release();
+}
+
+void KDSoapServerCall::ref()
+{
+    m_refCount.ref();
+}
+
+// Can be called from any thread, the call is deleted in the thread of the socket
+void KDSoapServerCall::release()
+{
+    if (!m_refCount.deref()) {
+        deleteLater();
+    }
+}
+
+void KDSoapServerCall::slotReplyReady()
+{
+    // Nobody is connected anymore if the client disconnected in the meantime
+    emit finished(this);
+    release();
+}
+
+#include "moc_KDSoapServerCall_p.cpp"
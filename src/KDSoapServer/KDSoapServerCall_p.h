@@ -0,0 +1,98 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPSERVERCALL_P_H
+#define KDSOAPSERVERCALL_P_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <KDSoapClient/KDSoapMessage.h>
+
+class KDSoapServer;
+class KDSoapServerObjectInterface;
+
+/**
+ * A SOAP call handed over to a worker thread, see KDSoapThreadPool::RequestScheduling.
+ *
+ * The call object lives in the thread of the socket which received the request.
+ * The worker thread runs it on its own server object and sends the reply back,
+ * finished() is then emitted in the thread of the socket.
+ *
+ * The call is reference-counted: it deletes itself once the reply was handled by the socket,
+ * and once run() and the KDSoapDelayedResponseHandle objects for it are gone, whichever comes last.
+ * If the last handle of a delayed response is destroyed without a reply, no reply will ever come:
+ * the call is deleted without emitting finished(), the socket only gets its response deadline.
+ */
+class KDSoapServerCall : public QObject
+{
+    Q_OBJECT
+public:
+    KDSoapServerCall(KDSoapServer *server, const KDSoapMessage &requestMsg, const KDSoapHeaders &requestHeaders,
+                     const QByteArray &soapAction, const QString &path,
+                     const QString &method, const QString &messageNamespace);
+    ~KDSoapServerCall();
+
+    KDSoapServer *server() const;
+
+    // Called in the worker thread
+    void run(QObject *serverObject);
+    void setResponseDelayed();
+    void sendReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg);
+
+    // Called by KDSoapDelayedResponseHandle, in any thread
+    void addResponseHandle();
+    void releaseResponseHandle();
+
+    // Called in the thread of the socket, from a slot connected to finished()
+    KDSoapMessage replyMessage() const;
+    QByteArray response() const;
+    qint64 dispatchTime() const; // microseconds
+    qint64 serializeTime() const;
+
+Q_SIGNALS:
+    void finished(KDSoapServerCall *call);
+
+private Q_SLOTS:
+    void slotReplyReady();
+
+private:
+    void ref();
+    void release();
+
+    KDSoapServer *m_server;
+    KDSoapMessage m_requestMsg;
+    KDSoapHeaders m_requestHeaders;
+    QByteArray m_soapAction;
+    QString m_path;
+    QString m_method;
+    QString m_messageNamespace;
+    bool m_delayedResponse;
+    QAtomicInt m_refCount;
+    QAtomicInt m_replied; // only the first reply is sent
+
+    KDSoapMessage m_replyMsg;
+    QByteArray m_response;
+    qint64 m_dispatchTime;
+    qint64 m_serializeTime;
+};
+
+#endif // KDSOAPSERVERCALL_P_H
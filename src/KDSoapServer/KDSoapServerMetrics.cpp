@@ -0,0 +1,312 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapServerMetrics.h"
+#include <QSharedData>
+#include <QMap>
+
+static const qint64 s_latencyBucketBounds[] = {
+    10, 25, 50, 100, 250, 500,
+    1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+static const int s_latencyBucketCount = sizeof(s_latencyBucketBounds) / sizeof(*s_latencyBucketBounds) + 1;
+
+class KDSoapServerMetricsData : public QSharedData
+{
+public:
+    struct Counters {
+        Counters() : requests(0), faults(0), bytesReceived(0), bytesSent(0), inFlight(0) {}
+        qint64 requests;
+        qint64 faults;
+        qint64 bytesReceived;
+        qint64 bytesSent;
+        qint64 inFlight;
+    };
+    struct Latencies {
+        Latencies() : histogram(s_latencyBucketCount), count(0), sum(0) {}
+        QVector<qint64> histogram;
+        qint64 count;
+        qint64 sum;
+    };
+
+    KDSoapServerMetricsData()
+        : connectedSockets(0), totalConnectionCount(0), shedCalls(0),
+          tlsHandshakes(0), tlsResumedHandshakes(0), tlsHandshakeFailures(0), tlsHandshakeTime(0)
+    {}
+
+    Counters counters(const QString &operation) const;
+
+    int connectedSockets;
+    int totalConnectionCount;
+    qint64 shedCalls;
+    qint64 tlsHandshakes;
+    qint64 tlsResumedHandshakes;
+    qint64 tlsHandshakeFailures;
+    qint64 tlsHandshakeTime;
+    Counters total;
+    QMap<QString, Counters> operations;
+    Latencies latencies[KDSoapServerMetrics::PhaseCount];
+};
+
+KDSoapServerMetricsData::Counters KDSoapServerMetricsData::counters(const QString &operation) const
+{
+    if (operation.isEmpty()) {
+        return total;
+    }
+    return operations.value(operation);
+}
+
+KDSoapServerMetrics::KDSoapServerMetrics()
+    : d(new KDSoapServerMetricsData)
+{
+}
+
+KDSoapServerMetrics::KDSoapServerMetrics(const KDSoapServerMetrics &other)
+    : d(other.d)
+{
+}
+
+KDSoapServerMetrics &KDSoapServerMetrics::operator=(const KDSoapServerMetrics &other)
+{
+    d = other.d;
+    return *this;
+}
+
+KDSoapServerMetrics::~KDSoapServerMetrics()
+{
+}
+
+int KDSoapServerMetrics::connectedSockets() const
+{
+    return d->connectedSockets;
+}
+
+int KDSoapServerMetrics::totalConnectionCount() const
+{
+    return d->totalConnectionCount;
+}
+
+QStringList KDSoapServerMetrics::operations() const
+{
+    return d->operations.keys();
+}
+
+qint64 KDSoapServerMetrics::requestCount(const QString &operation) const
+{
+    return d->counters(operation).requests;
+}
+
+qint64 KDSoapServerMetrics::faultCount(const QString &operation) const
+{
+    return d->counters(operation).faults;
+}
+
+qint64 KDSoapServerMetrics::bytesReceived(const QString &operation) const
+{
+    return d->counters(operation).bytesReceived;
+}
+
+qint64 KDSoapServerMetrics::bytesSent(const QString &operation) const
+{
+    return d->counters(operation).bytesSent;
+}
+
+qint64 KDSoapServerMetrics::inFlightCalls(const QString &operation) const
+{
+    return d->counters(operation).inFlight;
+}
+
+qint64 KDSoapServerMetrics::shedCallCount() const
+{
+    return d->shedCalls;
+}
+
+qint64 KDSoapServerMetrics::tlsHandshakeCount() const
+{
+    return d->tlsHandshakes;
+}
+
+qint64 KDSoapServerMetrics::tlsResumedHandshakeCount() const
+{
+    return d->tlsResumedHandshakes;
+}
+
+qint64 KDSoapServerMetrics::tlsHandshakeFailureCount() const
+{
+    return d->tlsHandshakeFailures;
+}
+
+qint64 KDSoapServerMetrics::tlsHandshakeTime() const
+{
+    return d->tlsHandshakeTime;
+}
+
+QVector<qint64> KDSoapServerMetrics::latencyBucketBounds()
+{
+    QVector<qint64> bounds(s_latencyBucketCount - 1);
+    for (int i = 0; i < bounds.count(); ++i) {
+        bounds[i] = s_latencyBucketBounds[i];
+    }
+    return bounds;
+}
+
+QVector<qint64> KDSoapServerMetrics::latencyHistogram(Phase phase) const
+{
+    return d->latencies[phase].histogram;
+}
+
+qint64 KDSoapServerMetrics::latencyCount(Phase phase) const
+{
+    return d->latencies[phase].count;
+}
+
+qint64 KDSoapServerMetrics::latencySum(Phase phase) const
+{
+    return d->latencies[phase].sum;
+}
+
+void KDSoapServerMetrics::setConnectionCounts(int connectedSockets, int totalConnectionCount)
+{
+    d->connectedSockets = connectedSockets;
+    d->totalConnectionCount = totalConnectionCount;
+}
+
+void KDSoapServerMetrics::addOperation(const QString &operation, qint64 requests, qint64 faults, qint64 bytesReceived, qint64 bytesSent, qint64 inFlight)
+{
+    KDSoapServerMetricsData::Counters *counters[2] = { &d->total, &d->operations[operation] };
+    for (int i = 0; i < 2; ++i) {
+        counters[i]->requests += requests;
+        counters[i]->faults += faults;
+        counters[i]->bytesReceived += bytesReceived;
+        counters[i]->bytesSent += bytesSent;
+        counters[i]->inFlight += inFlight;
+    }
+}
+
+void KDSoapServerMetrics::addLatencies(Phase phase, const QVector<qint64> &histogram, qint64 count, qint64 sum)
+{
+    KDSoapServerMetricsData::Latencies &latencies = d->latencies[phase];
+    Q_ASSERT(histogram.count() == latencies.histogram.count());
+    for (int i = 0; i < histogram.count(); ++i) {
+        latencies.histogram[i] += histogram.at(i);
+    }
+    latencies.count += count;
+    latencies.sum += sum;
+}
+
+void KDSoapServerMetrics::addShedCalls(qint64 count)
+{
+    d->shedCalls += count;
+}
+
+void KDSoapServerMetrics::addTlsHandshakes(qint64 count, qint64 resumed, qint64 failures, qint64 usecs)
+{
+    d->tlsHandshakes += count;
+    d->tlsResumedHandshakes += resumed;
+    d->tlsHandshakeFailures += failures;
+    d->tlsHandshakeTime += usecs;
+}
+
+// Label values are quoted, with backslash, double-quote and line feed escaped
+static QByteArray escapeLabelValue(const QString &value)
+{
+    QByteArray escaped = value.toUtf8();
+    escaped.replace('\\', "\\\\");
+    escaped.replace('"', "\\\"");
+    escaped.replace('\n', "\\n");
+    return escaped;
+}
+
+static QByteArray formatSeconds(qint64 usecs)
+{
+    return QByteArray::number(double(usecs) / 1000000.0, 'g', 12);
+}
+
+static void writeHeader(QByteArray &text, const char *name, const char *type, const char *help)
+{
+    text += "# HELP ";
+    text += name;
+    text += ' ';
+    text += help;
+    text += "\n# TYPE ";
+    text += name;
+    text += ' ';
+    text += type;
+    text += '\n';
+}
+
+QByteArray KDSoapServerMetrics::toPrometheusText() const
+{
+    QByteArray text;
+    writeHeader(text, "kdsoap_connected_sockets", "gauge", "Number of connected sockets.");
+    text += "kdsoap_connected_sockets " + QByteArray::number(d->connectedSockets) + '\n';
+    writeHeader(text, "kdsoap_connections_total", "counter", "Number of sockets which sent requests.");
+    text += "kdsoap_connections_total " + QByteArray::number(d->totalConnectionCount) + '\n';
+    writeHeader(text, "kdsoap_shed_calls_total", "counter", "Number of SOAP calls rejected because of overload.");
+    text += "kdsoap_shed_calls_total " + QByteArray::number(d->shedCalls) + '\n';
+    writeHeader(text, "kdsoap_tls_handshakes_total", "counter", "Number of TLS handshakes.");
+    text += "kdsoap_tls_handshakes_total{result=\"full\"} " + QByteArray::number(d->tlsHandshakes - d->tlsResumedHandshakes) + '\n';
+    text += "kdsoap_tls_handshakes_total{result=\"resumed\"} " + QByteArray::number(d->tlsResumedHandshakes) + '\n';
+    text += "kdsoap_tls_handshakes_total{result=\"failure\"} " + QByteArray::number(d->tlsHandshakeFailures) + '\n';
+    writeHeader(text, "kdsoap_tls_handshake_seconds_total", "counter", "Time spent in the successful TLS handshakes.");
+    text += "kdsoap_tls_handshake_seconds_total " + formatSeconds(d->tlsHandshakeTime) + '\n';
+
+    static const struct {
+        const char *name;
+        const char *type;
+        const char *help;
+        qint64 KDSoapServerMetricsData::Counters::*counter;
+    } counterMetrics[] = {
+        { "kdsoap_requests_total", "counter", "Number of SOAP calls.", &KDSoapServerMetricsData::Counters::requests },
+        { "kdsoap_faults_total", "counter", "Number of faults sent back.", &KDSoapServerMetricsData::Counters::faults },
+        { "kdsoap_received_bytes_total", "counter", "Size of the SOAP requests.", &KDSoapServerMetricsData::Counters::bytesReceived },
+        { "kdsoap_sent_bytes_total", "counter", "Size of the HTTP responses.", &KDSoapServerMetricsData::Counters::bytesSent },
+        { "kdsoap_in_flight_calls", "gauge", "Number of calls being handled.", &KDSoapServerMetricsData::Counters::inFlight }
+    };
+    for (size_t m = 0; m < sizeof(counterMetrics) / sizeof(*counterMetrics); ++m) {
+        writeHeader(text, counterMetrics[m].name, counterMetrics[m].type, counterMetrics[m].help);
+        QMap<QString, KDSoapServerMetricsData::Counters>::const_iterator it = d->operations.constBegin();
+        for (; it != d->operations.constEnd(); ++it) {
+            text += counterMetrics[m].name;
+            text += "{operation=\"" + escapeLabelValue(it.key()) + "\"} ";
+            text += QByteArray::number(it.value().*counterMetrics[m].counter);
+            text += '\n';
+        }
+    }
+
+    static const char *const phaseNames[PhaseCount] = { "parse", "dispatch", "serialize", "write" };
+    writeHeader(text, "kdsoap_phase_duration_seconds", "histogram", "Time spent in each phase of the call handling.");
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        const KDSoapServerMetricsData::Latencies &latencies = d->latencies[phase];
+        const QByteArray labels = QByteArray("phase=\"") + phaseNames[phase] + '"';
+        qint64 cumulated = 0;
+        for (int i = 0; i < s_latencyBucketCount; ++i) {
+            cumulated += latencies.histogram.at(i);
+            const QByteArray bound = i < s_latencyBucketCount - 1 ? formatSeconds(s_latencyBucketBounds[i]) : QByteArray("+Inf");
+            text += "kdsoap_phase_duration_seconds_bucket{" + labels + ",le=\"" + bound + "\"} " + QByteArray::number(cumulated) + '\n';
+        }
+        text += "kdsoap_phase_duration_seconds_sum{" + labels + "} " + formatSeconds(latencies.sum) + '\n';
+        text += "kdsoap_phase_duration_seconds_count{" + labels + "} " + QByteArray::number(latencies.count) + '\n';
+    }
+    return text;
+}
@@ -0,0 +1,173 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPSERVERMETRICS_H
+#define KDSOAPSERVERMETRICS_H
+
+#include "KDSoapServerGlobal.h"
+#include <QtCore/QSharedDataPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+class KDSoapServerMetricsData;
+
+/**
+ * A snapshot of the metrics collected by a KDSoapServer, see KDSoapServer::metrics().
+ *
+ * The counters are available for the whole server, or for each operation (SOAP method).
+ * The time spent handling the calls is available as a latency histogram for each
+ * phase of the call handling, with the bucket bounds given by latencyBucketBounds().
+ *
+ * \since 1.7
+ */
+class KDSOAPSERVER_EXPORT KDSoapServerMetrics
+{
+public:
+    enum Phase {
+        ParsePhase,     ///< parsing the SOAP request
+        DispatchPhase,  ///< calling the server object (processRequest)
+        SerializePhase, ///< converting the response to XML
+        WritePhase      ///< writing the HTTP response to the socket
+    };
+    enum { PhaseCount = WritePhase + 1 };
+
+    /**
+     * Constructs an empty snapshot.
+     */
+    KDSoapServerMetrics();
+    KDSoapServerMetrics(const KDSoapServerMetrics &other);
+    KDSoapServerMetrics &operator=(const KDSoapServerMetrics &other);
+    ~KDSoapServerMetrics();
+
+    /**
+     * Returns the number of sockets connected when the snapshot was taken.
+     */
+    int connectedSockets() const;
+
+    /**
+     * Returns the number of sockets which connected since the last call to
+     * KDSoapServer::resetTotalConnectionCount().
+     */
+    int totalConnectionCount() const;
+
+    /**
+     * Returns the operations (SOAP methods) which were called, sorted by name.
+     */
+    QStringList operations() const;
+
+    /**
+     * Returns the number of SOAP calls made to \p operation, or to any operation if \p operation is empty.
+     */
+    qint64 requestCount(const QString &operation = QString()) const;
+
+    /**
+     * Returns the number of faults sent back for calls to \p operation, or to any operation if \p operation is empty.
+     */
+    qint64 faultCount(const QString &operation = QString()) const;
+
+    /**
+     * Returns the size of the SOAP requests received for \p operation, or for any operation if \p operation is empty.
+     */
+    qint64 bytesReceived(const QString &operation = QString()) const;
+
+    /**
+     * Returns the size of the HTTP responses sent for \p operation, or for any operation if \p operation is empty.
+     */
+    qint64 bytesSent(const QString &operation = QString()) const;
+
+    /**
+     * Returns the number of calls to \p operation (or to any operation, if \p operation is empty)
+     * which were still being handled when the snapshot was taken, for instance delayed responses.
+     */
+    qint64 inFlightCalls(const QString &operation = QString()) const;
+
+    /**
+     * Returns the number of SOAP calls rejected with "503 Service Unavailable", because of the
+     * limits set with KDSoapServer::setMaxPendingCalls() and KDSoapServer::setMaxPendingCallsPerThread().
+     */
+    qint64 shedCallCount() const;
+
+    /**
+     * Returns the number of successful TLS handshakes, with KDSoapServer::Ssl,
+     * full handshakes and resumed sessions.
+     * Use keep-alive connections (see KDSoapServer::setKeepAliveTimeout()) to avoid handshakes.
+     */
+    qint64 tlsHandshakeCount() const;
+
+    /**
+     * Returns the number of successful TLS handshakes which resumed a previous session,
+     * see KDSoapServer::setTlsSessionLifetime().
+     */
+    qint64 tlsResumedHandshakeCount() const;
+
+    /**
+     * Returns the number of TLS handshakes which failed, or which didn't finish
+     * before the client disconnected.
+     */
+    qint64 tlsHandshakeFailureCount() const;
+
+    /**
+     * Returns the total time spent in the successful TLS handshakes, in microseconds.
+     */
+    qint64 tlsHandshakeTime() const;
+
+    /**
+     * Returns the upper bounds of the latency histogram buckets, in microseconds.
+     * The histograms have one more bucket, for the latencies above the last bound.
+     */
+    static QVector<qint64> latencyBucketBounds();
+
+    /**
+     * Returns the number of calls in each latency bucket, for the given \p phase.
+     * The counts are not cumulative.
+     */
+    QVector<qint64> latencyHistogram(Phase phase) const;
+
+    /**
+     * Returns the number of latencies recorded for the given \p phase.
+     */
+    qint64 latencyCount(Phase phase) const;
+
+    /**
+     * Returns the total time spent in the given \p phase, in microseconds.
+     */
+    qint64 latencySum(Phase phase) const;
+
+    /**
+     * Returns the metrics in the Prometheus text exposition format,
+     * as served by KDSoapServer on the path set with KDSoapServer::setMetricsPath().
+     */
+    QByteArray toPrometheusText() const;
+
+private:
+    friend class KDSoapServer;
+    friend class KDSoapThreadPool;
+    friend class KDSoapMetricsRecorder;
+    void setConnectionCounts(int connectedSockets, int totalConnectionCount);
+    void addOperation(const QString &operation, qint64 requests, qint64 faults, qint64 bytesReceived, qint64 bytesSent, qint64 inFlight);
+    void addLatencies(Phase phase, const QVector<qint64> &histogram, qint64 count, qint64 sum);
+    void addShedCalls(qint64 count);
+    void addTlsHandshakes(qint64 count, qint64 resumed, qint64 failures, qint64 usecs);
+    QSharedDataPointer<KDSoapServerMetricsData> d;
+};
+
+#endif // KDSOAPSERVERMETRICS_H
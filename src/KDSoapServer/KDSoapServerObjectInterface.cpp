@@ -22,6 +22,8 @@
 **********************************************************************/
 #include "KDSoapServerObjectInterface.h"
 #include "KDSoapServerSocket_p.h"
+#include "KDSoapServerCall_p.h"
+#include "KDSoapEpollReactor_p.h"
 #include <QDebug>
 #include <QPointer>
 
@@ -29,10 +31,22 @@ class KDSoapServerObjectInterface::Private
 {
 public:
     Private() :
-        m_serverSocket(0)
+        m_serverSocket(0),
+        m_serverCall(0),
+        m_epollReactor(0)
     {
     }
 
+    // With KDSoapServer::EpollIoBackend, there's no socket unless the server object needs one
+    KDSoapServerSocket *serverSocket()
+    {
+        if (!m_serverSocket && m_epollReactor) {
+            m_serverSocket = m_epollReactor->takeOverConnection();
+            m_epollReactor = 0;
+        }
+        return m_serverSocket;
+    }
+
     KDSoapHeaders m_requestHeaders;
     KDSoapHeaders m_responseHeaders;
     QString m_faultCode;
@@ -44,6 +58,10 @@ public:
     QByteArray m_soapAction;
     // QPointer in case the client disconnects during a delayed response
     QPointer<KDSoapServerSocket> m_serverSocket;
+    // Set instead of the socket when running in a worker thread, see KDSoapThreadPool::RequestScheduling
+    KDSoapServerCall *m_serverCall;
+    // Set instead of the socket when the call comes from a connection handled by the epoll reactor
+    KDSoapEpollReactor *m_epollReactor;
 };
 
 KDSoapServerObjectInterface::KDSoapServerObjectInterface()
@@ -135,7 +153,7 @@ bool KDSoapServerObjectInterface::hasFault() const
 
 QAbstractSocket *KDSoapServerObjectInterface::serverSocket() const
 {
-    return d->m_serverSocket;
+    return d->serverSocket();
 }
 
 KDSoapHeaders KDSoapServerObjectInterface::requestHeaders() const
@@ -169,7 +187,10 @@ QByteArray KDSoapServerObjectInterface::soapAction() const
 
 KDSoapDelayedResponseHandle KDSoapServerObjectInterface::prepareDelayedResponse()
 {
-    return KDSoapDelayedResponseHandle(d->m_serverSocket);
+    if (d->m_serverCall) {
+        return KDSoapDelayedResponseHandle(d->m_serverCall);
+    }
+    return KDSoapDelayedResponseHandle(d->serverSocket());
 }
 
 void KDSoapServerObjectInterface::setServerSocket(KDSoapServerSocket *serverSocket)
@@ -177,24 +198,49 @@ void KDSoapServerObjectInterface::setServerSocket(KDSoapServerSocket *serverSock
     d->m_serverSocket = serverSocket;
 }
 
+void KDSoapServerObjectInterface::setServerCall(KDSoapServerCall *serverCall)
+{
+    d->m_serverCall = serverCall;
+}
+
+void KDSoapServerObjectInterface::setEpollReactor(KDSoapEpollReactor *reactor)
+{
+    d->m_epollReactor = reactor;
+}
+
 void KDSoapServerObjectInterface::sendDelayedResponse(const KDSoapDelayedResponseHandle &responseHandle, const KDSoapMessage &response)
 {
+    KDSoapServerCall *call = responseHandle.serverCall();
+    if (call) {
+        call->sendReply(this, response);
+        return;
+    }
     KDSoapServerSocket *socket = responseHandle.serverSocket();
     if (socket) {
-        socket->sendDelayedReply(this, response);
+        socket->sendDelayedReply(this, response, responseHandle.responseId());
     }
 }
 
 void KDSoapServerObjectInterface::writeHTTP(const QByteArray &httpReply)
 {
-    const qint64 written = d->m_serverSocket->write(httpReply);
+    KDSoapServerSocket *socket = d->serverSocket();
+    if (!socket) {
+        qWarning("KDSoapServerObjectInterface::writeHTTP: no socket to write to, e.g. for a call handled in a worker thread");
+        return;
+    }
+    const qint64 written = socket->write(httpReply);
     Q_ASSERT(written == httpReply.size()); // Please report a bug if you hit this.
     Q_UNUSED(written);
 }
 
 void KDSoapServerObjectInterface::writeXML(const QByteArray &reply, bool isFault)
 {
-    d->m_serverSocket->writeXML(reply, isFault);
+    KDSoapServerSocket *socket = d->serverSocket();
+    if (!socket) {
+        qWarning("KDSoapServerObjectInterface::writeXML: no socket to write to, e.g. for a call handled in a worker thread");
+        return;
+    }
+    socket->writeXML(reply, isFault);
 }
 
 void KDSoapServerObjectInterface::setResponseNamespace(const QString &ns)
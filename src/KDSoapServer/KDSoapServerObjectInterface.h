@@ -31,6 +31,8 @@
 #include <QIODevice>
 
 class KDSoapServerSocket;
+class KDSoapServerCall;
+class KDSoapEpollReactor;
 class QAbstractSocket;
 
 /**
@@ -101,6 +103,11 @@ public:
      *       For instance "text/plain" for a plain text file.
      * \return an iodevice for reading from. For instance a new QFile.
      * KDSoap will delete the iodevice after reading all its contents.
+     *
+     * Since KD SOAP 1.7, the file is sent progressively, as the client reads it, rather than
+     * copied into memory all at once. Random-access devices support byte range requests, and
+     * QFile devices also support conditional requests (ETag, Last-Modified). On Linux,
+     * QFile devices are sent with sendfile() on unencrypted connections.
      * \since 1.3
      */
     virtual QIODevice *processFileRequest(const QString &path, QByteArray &contentType);
@@ -193,6 +200,8 @@ public:
     /**
      * Returns a pointer to the server socket. Only valid during processRequest().
      * This can be used to retrieve information from the server socket, such as peerAddress etc.
+     * Returns null when the call is made in a worker thread, see KDSoapThreadPool::RequestScheduling.
+     * With KDSoapServer::EpollIoBackend, calling this method hands the connection over to a socket.
      * \since 1.3
      */
     QAbstractSocket *serverSocket() const;
@@ -203,6 +212,10 @@ public:
      * it should call prepareDelayedResponse() from within the call handler, store
      * the handle, return a dummy value (this allows to go back to the event loop),
      * and use the handle later on (typically from a slot) in order to send the delayed response.
+     *
+     * If a response deadline is set (see KDSoapServer::setResponseDeadline), and the response
+     * isn't sent in time, the client gets a "Server.Timeout" fault instead, and the response
+     * sent later on with this handle is ignored.
      * \since 1.2
      */
     KDSoapDelayedResponseHandle prepareDelayedResponse(); // only valid during processRequest()
@@ -225,6 +238,8 @@ public:
      * Low-level method, not needed for normal operations.
      * Call this method to write an HTTP reply back, e.g. in case of an error.
      * Example: writeHTTP("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+     * Not available when the call is made in a worker thread (see KDSoapThreadPool::RequestScheduling):
+     * nothing is written then, and a warning is printed.
      * \since 1.5
      */
     void writeHTTP(const QByteArray &httpReply);
@@ -235,13 +250,19 @@ public:
      * of the necessary HTTP headers.
      * @param reply the SOAP reply in XML
      * @param isFault true if the reply is a fault (which means sending back the HTTP error code 500, as per the specification)
+     * Not available when the call is made in a worker thread (see KDSoapThreadPool::RequestScheduling):
+     * nothing is written then, and a warning is printed.
      * \since 1.5
      */
     void writeXML(const QByteArray &reply, bool isFault = false);
 
 private:
     friend class KDSoapServerSocket;
+    friend class KDSoapServerCall;
+    friend class KDSoapEpollReactor;
     void setServerSocket(KDSoapServerSocket *serverSocket); // only valid during processRequest()
+    void setServerCall(KDSoapServerCall *serverCall); // only valid during processRequest()
+    void setEpollReactor(KDSoapEpollReactor *reactor); // only valid during processRequest()
     void setRequestHeaders(const KDSoapHeaders &headers, const QByteArray &soapAction);
     KDSoapHeaders responseHeaders() const;
     QString responseNamespace() const;
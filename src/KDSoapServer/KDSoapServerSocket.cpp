@@ -22,6 +22,11 @@
 **********************************************************************/
 #include "KDSoapServerSocket_p.h"
 #include "KDSoapSocketList_p.h"
+#include "KDSoapServerCall_p.h"
+#include "KDSoapFileResponse_p.h"
+#include "KDSoapWsdlCache_p.h"
+#include "KDSoapTlsSessionCache_p.h"
+#include "KDSoapThreadPool.h"
 #include "KDSoapServerObjectInterface.h"
 #include "KDSoapServerAuthInterface.h"
 #include "KDSoapServerRawXMLInterface.h"
@@ -29,15 +34,14 @@
 #include "KDSoapServer.h"
 #include <KDSoapClient/KDSoapMessage.h>
 #include <KDSoapClient/KDSoapNamespaceManager.h>
-#include <KDSoapClient/KDSoapMessageReader_p.h>
 #include <KDSoapClient/KDSoapMessageWriter_p.h>
-#include <QBuffer>
 #include <QThread>
 #include <QMetaMethod>
 #include <QFile>
 #include <QDir>
 #include <QFileInfo>
 #include <QVarLengthArray>
+#include <QDateTime>
 
 KDSoapServerSocket::KDSoapServerSocket(KDSoapSocketList *owner, QObject *serverObject)
 #ifndef QT_NO_OPENSSL
@@ -50,13 +54,37 @@ KDSoapServerSocket::KDSoapServerSocket(KDSoapSocketList *owner, QObject *serverO
       m_delayedResponse(false),
       m_socketEnabled(true),
       m_receivedData(false),
+      m_keepAlive(true),
+      m_requestCount(0),
+      m_idleTimeout(owner->server()->keepAliveTimeout()),
+      m_compressionThreshold(-1),
+      m_compressionLevel(6),
+      m_responseEncoding(KDSoapCompression::Identity),
+      m_inflating(false),
+      m_delayedResponseId(0),
+      m_lastDelayedResponseId(0),
+      m_responseDeadline(-1),
+      m_scheduledCall(0),
+      m_handshakePending(false),
+      m_callAdmitted(false),
+      m_responseChunkSize(-1),
+      m_streamWriter(0),
+      m_streamedReply(0),
+      m_streamBytesSent(0),
+      m_streamSerializeTime(0),
+      m_streamWriteTime(0),
+      m_fileResponse(0),
       m_useRawXML(false),
-      m_bytesReceived(0),
-      m_chunkStart(0)
+      m_requestSize(0),
+      m_parseTime(0),
+      m_callMetrics(0)
 {
     connect(this, SIGNAL(readyRead()),
             this, SLOT(slotReadyRead()));
+    connect(this, SIGNAL(bytesWritten(qint64)),
+            this, SLOT(slotBytesWritten()));
     m_doDebug = qgetenv("KDSOAP_DEBUG").toInt();
+    scheduleIdleTimeout();
 }
 
 // The socket is deleted when it emits disconnected() (see KDSoapSocketList::handleIncomingConnection).
@@ -64,53 +92,9 @@ KDSoapServerSocket::~KDSoapServerSocket()
 {
     // same as m_owner->socketDeleted, but safe in case m_owner is deleted first
     emit socketDeleted(this);
-}
-
-typedef QMap<QByteArray, QByteArray> HeadersMap;
-static HeadersMap parseHeaders(const QByteArray &headerData)
-{
-    HeadersMap headersMap;
-    QBuffer sourceBuffer;
-    sourceBuffer.setData(headerData);
-    sourceBuffer.open(QIODevice::ReadOnly);
-    // The first line is special, it's the GET or POST line
-    const QList<QByteArray> firstLine = sourceBuffer.readLine().split(' ');
-    if (firstLine.count() < 3) {
-        qDebug() << "Malformed HTTP request:" << firstLine;
-        return headersMap;
-    }
-    const QByteArray requestType = firstLine.at(0);
-    const QByteArray path = QDir::cleanPath(QString::fromLatin1(firstLine.at(1).constData())).toLatin1();
-    const QByteArray httpVersion = firstLine.at(2);
-    headersMap.insert("_requestType", requestType);
-    headersMap.insert("_path", path);
-    headersMap.insert("_httpVersion", httpVersion);
-
-    while (!sourceBuffer.atEnd()) {
-        const QByteArray line = sourceBuffer.readLine();
-        const int pos = line.indexOf(':');
-        if (pos == -1) {
-            qDebug() << "Malformed HTTP header:" << line;
-        }
-        const QByteArray header = line.left(pos).toLower(); // RFC2616 section 4.2 "Field names are case-insensitive"
-        const QByteArray value = line.mid(pos + 1).trimmed(); // remove space before and \r\n after
-        //qDebug() << "HEADER" << header << "VALUE" << value;
-        headersMap.insert(header, value);
-    }
-    return headersMap;
-}
-
-// We could parse headers as we go along looking for \r\n, and stop at empty header line, to avoid all this memory copying
-// But in practice XML parsing (and writing) is far far slower anyway.
-static bool splitHeadersAndData(const QByteArray &request, QByteArray &header, QByteArray &data)
-{
-    const int sep = request.indexOf("\r\n\r\n");
-    if (sep <= 0) {
-        return false;
-    }
-    header = request.left(sep);
-    data = request.mid(sep + 4);
-    return true;
+    delete m_streamWriter;
+    delete m_streamedReply;
+    delete m_fileResponse;
 }
 
 static QByteArray stripQuotes(const QByteArray &bar)
@@ -122,24 +106,41 @@ static QByteArray stripQuotes(const QByteArray &bar)
     return bar;
 }
 
-static QByteArray httpResponseHeaders(bool fault, const QByteArray &contentType, int responseDataSize)
+static int httpStatusCode(bool fault, int responseDataSize)
 {
-    QByteArray httpResponse;
-    httpResponse.reserve(50);
     if (fault) {
         // http://www.w3.org/TR/2007/REC-soap12-part0-20070427 and look for 500
+        return 500;
+    }
+    return responseDataSize == 0 ? 204 : 200;
+}
+
+QByteArray KDSoapServerSocket::httpResponseHeaders(bool fault, const QByteArray &contentType, int responseDataSize, const QByteArray &connectionHeaders)
+{
+    QByteArray httpResponse;
+    httpResponse.reserve(50);
+    switch (httpStatusCode(fault, responseDataSize)) {
+    case 500:
         httpResponse += "HTTP/1.1 500 Internal Server Error\r\n";
-    } else if (responseDataSize == 0) {
+        break;
+    case 204:
         httpResponse += "HTTP/1.1 204 No Content\r\n";
-    } else {
+        break;
+    default:
         httpResponse += "HTTP/1.1 200 OK\r\n";
+        break;
     }
 
     httpResponse += "Content-Type: ";
     httpResponse += contentType;
-    httpResponse += "\r\nContent-Length: ";
-    httpResponse += QByteArray::number(responseDataSize);
-    httpResponse += "\r\n";
+    if (responseDataSize < 0) { // streamed response, see KDSoapServerSocket::startStreaming
+        httpResponse += "\r\nTransfer-Encoding: chunked\r\n";
+    } else {
+        httpResponse += "\r\nContent-Length: ";
+        httpResponse += QByteArray::number(responseDataSize);
+        httpResponse += "\r\n";
+    }
+    httpResponse += connectionHeaders;
 
     httpResponse += "\r\n"; // end of headers
     return httpResponse;
@@ -160,119 +161,264 @@ void KDSoapServerSocket::slotReadyRead()
 
     //qDebug() << this << QThread::currentThread() << "slotReadyRead!";
 
-    QByteArray buf(2048, ' ');
-    qint64 nread = -1;
-    while (nread != 0) {
-        nread = read(buf.data(), buf.size());
+    scheduleIdleTimeout();
+
+    // Read straight into the parser's buffer, the parser resumes where it stopped last time.
+    QByteArray &buffer = m_requestParser.buffer();
+    qint64 available;
+    while ((available = bytesAvailable()) > 0) {
+        const int oldSize = buffer.size();
+        buffer.resize(oldSize + int(available));
+        const qint64 nread = read(buffer.data() + oldSize, available);
         if (nread < 0) {
+            buffer.resize(oldSize);
             qDebug() << "Error reading from server socket:" << errorString();
             return;
         }
-        m_requestBuffer += buf.left(nread);
-        m_bytesReceived += nread;
+        buffer.resize(oldSize + int(nread));
+        if (nread == 0) {
+            break;
+        }
     }
 
+    handleRequests();
+}
+
+// Handles all the requests in the receive buffer, so that pipelined requests (HTTP/1.1, section 8.1.2.2)
+// are handled in order, and their responses are written in the same order.
+void KDSoapServerSocket::handleRequests()
+{
     KDSoapServerRawXMLInterface *rawXmlInterface = qobject_cast<KDSoapServerRawXMLInterface *>(m_serverObject);
 
-    if (m_httpHeaders.isEmpty()) {
-        // New request: see if we can parse headers
-        QByteArray receivedHttpHeaders, receivedData;
-        const bool splitOK = splitHeadersAndData(m_requestBuffer, receivedHttpHeaders, receivedData);
-        if (!splitOK) {
-            //qDebug() << "Incomplete SOAP request, wait for more data";
-            //incomplete request, wait for more data
-            return;
+    // Stop after a delayed response: the following requests are handled once it was sent,
+    // see setSocketEnabled(), so that the responses don't get mixed up.
+    while (m_socketEnabled) {
+        KDSoapHttpRequestParser::Status status;
+        while ((status = m_requestParser.parse()) == KDSoapHttpRequestParser::HeadersComplete) {
+            // New request
+            setupKeepAlive();
+            setupEncodings();
+            m_useRawXML = false;
+            setupMessageReader(m_messageReader, m_owner->server());
+            m_requestSize = 0;
+            m_parseTime = 0;
+            m_requestTimer.start();
+            if (!admitCall()) {
+                continue; // the body is ignored, see takeBody
+            }
+            if (rawXmlInterface) {
+                KDSoapServerObjectInterface *serverObjectInterface = qobject_cast<KDSoapServerObjectInterface *>(m_serverObject);
+                serverObjectInterface->setServerSocket(this);
+                m_useRawXML = rawXmlInterface->newRequest(m_requestParser.requestType(), m_requestParser.headersMap());
+            }
         }
-        m_httpHeaders = parseHeaders(receivedHttpHeaders);
-        // Leave only the actual data in the buffer
-        m_requestBuffer = receivedData;
-        m_bytesReceived = receivedData.size();
-        m_useRawXML = false;
-        if (rawXmlInterface) {
-            KDSoapServerObjectInterface *serverObjectInterface = qobject_cast<KDSoapServerObjectInterface *>(m_serverObject);
-            serverObjectInterface->setServerSocket(this);
-            m_useRawXML = rawXmlInterface->newRequest(m_httpHeaders.value("_requestType"), m_httpHeaders);
+
+        if (status == KDSoapHttpRequestParser::BadRequest) {
+            const QByteArray badRequest = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+            write(badRequest);
+            m_requestParser.clear();
+            // No way to tell where the next request would start
+            m_keepAlive = false;
+            finishResponse();
+            return;
         }
-    }
 
-    if (m_doDebug) {
-        qDebug() << "headers:" << m_httpHeaders;
-        qDebug() << "data received:" << m_requestBuffer;
-    }
+        if (m_doDebug) {
+            qDebug() << "headers:" << m_requestParser.headersMap();
+            qDebug() << "data received:" << m_requestParser.body();
+        }
 
-    if (m_httpHeaders.value("transfer-encoding") != "chunked") {
-        if (m_useRawXML) {
-            rawXmlInterface->processXML(m_requestBuffer);
-            m_requestBuffer.clear();
+        if (m_useRawXML && m_requestParser.bodySize() > 0) {
+            QByteArray data;
+            if (takeBody(data)) {
+                rawXmlInterface->processXML(data);
+            }
+        } else if (m_requestParser.bodySize() > 0 && m_requestParser.requestType() == "POST") {
+            // Parse the SOAP envelope while the rest of the request is still arriving,
+            // so that the request body doesn't have to be kept around.
+            QByteArray data;
+            if (takeBody(data)) {
+                QElapsedTimer timer;
+                timer.start();
+                m_messageReader.addData(data);
+                m_parseTime += KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+            }
         }
 
-        const QByteArray contentLength = m_httpHeaders.value("content-length");
-        if (m_bytesReceived < contentLength.toInt()) {
-            return;    // incomplete request, wait for more data
+        if (status == KDSoapHttpRequestParser::NeedMoreData) {
+            //qDebug() << "Incomplete SOAP request, wait for more data";
+            return;
         }
 
-        if (m_useRawXML) {
+        if (m_inflating && m_requestError.isEmpty() && !m_inflater.isFinished()) {
+            m_requestError = "400 Bad Request"; // truncated compressed data
+        }
+        if (!m_requestError.isEmpty()) {
+            write("HTTP/1.1 " + m_requestError + "\r\nContent-Length: 0\r\n" + m_requestErrorHeaders + m_connectionHeaders + "\r\n");
+        } else if (m_useRawXML) {
             rawXmlInterface->endRequest();
         } else {
-            handleRequest(m_httpHeaders, m_requestBuffer);
+            handleRequest(m_requestParser);
+        }
+        // Keeps the data received for the next request, if any
+        m_requestParser.reset();
+        m_receivedData = 0;
+        if (m_socketEnabled) { // otherwise see sendDelayedReply
+            finishResponse();
         }
+    }
+}
+
+void KDSoapServerSocket::setupKeepAlive()
+{
+    m_idleTimeout = m_owner->server()->keepAliveTimeout();
+    m_connectionHeaders = keepAliveHeaders(m_requestParser, ++m_requestCount, m_owner->server(), m_idleTimeout, m_keepAlive);
+}
+
+// Decides whether the connection stays open after the response to \p request, the \p requestCount'th one
+// received on the connection (RFC 2616 section 8.1), and returns the corresponding response headers.
+// \p idleTimeout is the server's keepAliveTimeout(), which the caller also needs.
+QByteArray KDSoapServerSocket::keepAliveHeaders(const KDSoapHttpRequestParser &request, int requestCount, KDSoapServer *server, int idleTimeout, bool &keepAlive)
+{
+    const int maxRequests = server->maxRequestsPerConnection();
+
+    const QByteArray connection = request.header("connection").toLower();
+    const bool http10 = request.httpVersion() == "HTTP/1.0";
+    if (http10) {
+        keepAlive = connection.contains("keep-alive");
     } else {
-        //qDebug() << "requestBuffer has " << m_requestBuffer.size() << "bytes, starting at" << m_chunkStart;
-        while (m_chunkStart >= 0) {
-            const int nextEOL = m_requestBuffer.indexOf("\r\n", m_chunkStart);
-            if (nextEOL == -1) {
-                return;
-            }
-            const QByteArray chunkSizeStr = m_requestBuffer.mid(m_chunkStart, nextEOL - m_chunkStart);
-            //qDebug() << m_chunkStart << nextEOL << "chunkSizeStr=" << chunkSizeStr;
-            bool ok;
-            int chunkSize = chunkSizeStr.toInt(&ok, 16);
-            if (!ok) {
-                const QByteArray badRequest = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
-                write(badRequest);
-                return;
-            }
-            if (chunkSize == 0) { // done!
-                m_requestBuffer = m_requestBuffer.mid(nextEOL);
-                m_chunkStart = -1;
-                break;
-            }
-            if (nextEOL + 2 + chunkSize + 2 >= m_requestBuffer.size()) {
-                return; // not enough data, chunk is incomplete
-            }
-            const QByteArray chunk = m_requestBuffer.mid(nextEOL + 2, chunkSize);
-            if (m_useRawXML) {
-                rawXmlInterface->processXML(chunk);
-            } else {
-                m_decodedRequestBuffer += chunk;
+        keepAlive = !connection.contains("close");
+    }
+    if (maxRequests > -1 && requestCount >= maxRequests) {
+        keepAlive = false;
+    }
+
+    if (!keepAlive) {
+        return "Connection: close\r\n";
+    }
+    QByteArray headers;
+    if (http10) {
+        headers += "Connection: keep-alive\r\n";
+    }
+    if (idleTimeout > 0 || maxRequests > -1) {
+        QByteArray keepAliveParams;
+        if (idleTimeout > 0) {
+            keepAliveParams += "timeout=" + QByteArray::number(idleTimeout);
+        }
+        if (maxRequests > -1) {
+            if (!keepAliveParams.isEmpty()) {
+                keepAliveParams += ", ";
             }
-            m_chunkStart = nextEOL + 2 + chunkSize + 2;
+            keepAliveParams += "max=" + QByteArray::number(maxRequests - requestCount);
         }
-        // We have the full data, now ensure we read trailers
-        if (!m_requestBuffer.contains("\r\n\r\n")) {
-            return;
+        headers += "Keep-Alive: " + keepAliveParams + "\r\n";
+    }
+    return headers;
+}
+
+// Prepares the decompression of the request body, and picks the compression of the response
+// and whether it can be streamed
+void KDSoapServerSocket::setupEncodings()
+{
+    KDSoapServer *server = m_owner->server();
+    m_compressionThreshold = server->compressionThreshold();
+    m_compressionLevel = server->compressionLevel();
+    m_responseEncoding = KDSoapCompression::Identity;
+    if (m_compressionThreshold > -1) {
+        m_responseEncoding = KDSoapCompression::negotiate(m_requestParser.header("accept-encoding"));
+    }
+
+    // Chunked transfer encoding only exists in HTTP/1.1
+    m_responseChunkSize = -1;
+    if (m_responseEncoding == KDSoapCompression::Identity && m_requestParser.httpVersion() != "HTTP/1.0") {
+        m_responseChunkSize = server->responseChunkSize();
+    }
+
+    m_requestError.clear();
+    m_requestErrorHeaders.clear();
+    m_inflating = false;
+    const KDSoapCompression::Encoding requestEncoding = KDSoapCompression::encodingFromHeader(m_requestParser.header("content-encoding"));
+    if (requestEncoding != KDSoapCompression::Identity) {
+        m_inflater.setMaxOutputSize(server->maxDecompressedRequestSize());
+        m_inflating = m_inflater.start(requestEncoding);
+        if (!m_inflating) {
+            m_requestError = "415 Unsupported Media Type";
         }
-        if (m_useRawXML) {
-            rawXmlInterface->endRequest();
+    }
+}
+
+// Moves the body data received so far into \p data, decompressed if necessary.
+// Returns false if there's nothing to process, because of an error.
+bool KDSoapServerSocket::takeBody(QByteArray &data)
+{
+    const QByteArray body = m_requestParser.body();
+    m_requestSize += body.size();
+    if (m_requestError.isEmpty()) {
+        if (m_inflating) {
+            if (!m_inflater.inflate(body.constData(), body.size(), data)) {
+                m_requestError = m_inflater.isTooLarge() ? "413 Request Entity Too Large" : "400 Bad Request";
+            }
+        } else {
+            // Deep copy: the body is a view into the receive buffer, which is about to be reused
+            data = QByteArray(body.constData(), body.size());
+        }
+    }
+    m_requestParser.discardBody();
+    return m_requestError.isEmpty();
+}
+
+// Called once the response to the current request was written
+void KDSoapServerSocket::finishResponse()
+{
+    if (takeAdmittedCall()) {
+        m_owner->releaseCall();
+    }
+    if (m_keepAlive) {
+        scheduleIdleTimeout();
+    } else {
+        m_socketEnabled = false; // ignore anything else the client sends
+        disconnectFromHost(); // after writing out the response
+    }
+}
+
+void KDSoapServerSocket::scheduleIdleTimeout()
+{
+    if (m_idleTimeout > 0) {
+        m_owner->timerWheel()->schedule(this, m_idleTimeout * 1000);
+    }
+}
+
+void KDSoapServerSocket::timeout()
+{
+    if (m_responseDeadline > -1) {
+        const qint64 remaining = m_responseDeadline - m_deadlineTimer.elapsed();
+        if (remaining > 0) {
+            m_owner->timerWheel()->schedule(this, int(remaining));
         } else {
-            handleRequest(m_httpHeaders, m_decodedRequestBuffer);
+            responseDeadlineExpired();
         }
-        m_decodedRequestBuffer.clear();
-        m_chunkStart = 0;
+        return;
+    }
+    if (m_delayedResponse) {
+        // Not idle, the server object is busy preparing the response
+        scheduleIdleTimeout();
+        return;
+    }
+    if (m_doDebug) {
+        qDebug() << "KDSoapServerSocket: closing idle connection" << this;
     }
-    m_requestBuffer.clear();
-    m_httpHeaders.clear();
-    m_receivedData = 0;
+    m_socketEnabled = false;
+    disconnectFromHost();
 }
 
-void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpHeaders, const QByteArray &receivedData)
+void KDSoapServerSocket::handleRequest(const KDSoapHttpRequestParser &request)
 {
-    const QByteArray requestType = httpHeaders.value("_requestType");
-    const QString path = QString::fromLatin1(httpHeaders.value("_path").constData());
+    const QByteArray requestType = request.requestType();
+    const QString path = QString::fromLatin1(request.path().constData());
 
     KDSoapServerAuthInterface *serverAuthInterface = qobject_cast<KDSoapServerAuthInterface *>(m_serverObject);
     if (serverAuthInterface) {
-        const QByteArray authValue = httpHeaders.value("authorization");
+        const QByteArray authValue = request.header("authorization");
         if (!serverAuthInterface->handleHttpAuth(authValue, path)) {
             // send auth request (Qt supports basic, ntlm and digest)
             const QByteArray unauthorized = "HTTP/1.1 401 Authorization Required\r\nWWW-Authenticate: Basic realm=\"example\"\r\nContent-Length: 0\r\n\r\n";
@@ -284,7 +430,10 @@ void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpH
     if (requestType != "GET" && requestType != "POST") {
         KDSoapServerCustomVerbRequestInterface *serverCustomRequest = qobject_cast<KDSoapServerCustomVerbRequestInterface *>(m_serverObject);
         QByteArray customVerbRequestAnswer;
-        if (serverCustomRequest && serverCustomRequest->processCustomVerbRequest(requestType, receivedData, httpHeaders, customVerbRequestAnswer)) {
+        const QByteArray receivedData = request.body();
+        if (serverCustomRequest && serverCustomRequest->processCustomVerbRequest(QByteArray(requestType.constData(), requestType.size()),
+                QByteArray(receivedData.constData(), receivedData.size()),
+                request.headersMap(), customVerbRequestAnswer)) {
             write(customVerbRequestAnswer);
             return;
         } else {
@@ -312,7 +461,11 @@ void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpH
     }
 
     if (requestType == "GET") {
-        if (path == server->wsdlPathInUrl() && handleWsdlDownload()) {
+        const QString metricsPath = server->metricsPath();
+        if (handleWsdlDownload(path)) {
+            return;
+        } else if (!metricsPath.isEmpty() && path == metricsPath) {
+            handleMetricsRequest();
             return;
         } else if (handleFileDownload(serverObjectInterface, path)) {
             return;
@@ -329,20 +482,68 @@ void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpH
     //parse message
     KDSoapMessage requestMsg;
     KDSoapHeaders requestHeaders;
-    KDSoapMessageReader reader;
-    KDSoapMessageReader::XmlError err = reader.xmlToMessage(receivedData, &requestMsg, &m_messageNamespace, &requestHeaders);
+    QElapsedTimer timer;
+    timer.start();
+    KDSoapMessageReader::XmlError err = m_messageReader.finish(&requestMsg, &m_messageNamespace, &requestHeaders);
+    m_parseTime += KDSoapMetricsRecorder::elapsedMicroseconds(timer);
     if (err == KDSoapMessageReader::PrematureEndOfDocumentError) {
-        //qDebug() << "Incomplete SOAP message, wait for more data";
-        // This should never happen, since we check for content-size above.
+        // The body is complete (see Content-Length), but the envelope isn't: reply with a fault,
+        // instead of waiting for more data, and don't trust the client with more requests.
+        m_keepAlive = false;
+        m_connectionHeaders = "Connection: close\r\n";
+        handleError(replyMsg, "Client.Data", QString::fromLatin1("Incomplete SOAP message"));
+        sendReply(0, replyMsg);
         return;
     } //TODO handle parse errors?
 
-    // check soap version and extract soapAction header
+    const QByteArray soapAction = soapActionFromHeaders(request);
+    m_method = requestMsg.name();
+    KDSoapMetricsRecorder *metrics = m_owner->metrics();
+    m_callMetrics = metrics->callStarted(m_method, m_requestSize, m_parseTime);
+
+    if (scheduleCall(requestMsg, requestHeaders, soapAction, path)) {
+        return;
+    }
+
+    if (!replyMsg.isFault()) {
+        timer.start();
+        makeCall(server, serverObjectInterface, requestMsg, replyMsg, requestHeaders, soapAction, path);
+        metrics->recordLatency(KDSoapServerMetrics::DispatchPhase, KDSoapMetricsRecorder::elapsedMicroseconds(timer));
+    }
+
+    if (serverObjectInterface && m_delayedResponse) {
+        // Delayed response. Disable the socket to make sure we don't handle another call at the same time.
+        setSocketEnabled(false);
+    } else {
+        sendReply(serverObjectInterface, replyMsg);
+    }
+}
+
+// Discards the previous request, and applies KDSoapServer::setXmlParser
+void KDSoapServerSocket::setupMessageReader(KDSoapMessageReader &reader, KDSoapServer *server)
+{
+    const KDSoapMessageReader::Tokenizer tokenizer = server->xmlParser() == KDSoapServer::SimdXmlParser
+            ? KDSoapMessageReader::SimdTokenizer : KDSoapMessageReader::QXmlStreamTokenizer;
+    if (reader.tokenizer() != tokenizer) {
+        reader.setTokenizer(tokenizer);
+    }
+    if (!reader.sanitizeInput()) {
+        // The requests are parsed incrementally, so the invalid characters can't be repaired
+        // by parsing them a second time, as xmlToMessage does. Also resets the reader.
+        reader.setSanitizeInput(true);
+    } else {
+        reader.reset();
+    }
+}
+
+// Checks the SOAP version and extracts the SOAP action
+QByteArray KDSoapServerSocket::soapActionFromHeaders(const KDSoapHttpRequestParser &request)
+{
     QByteArray soapAction;
-    const QByteArray contentType = httpHeaders.value("content-type");
+    const QByteArray contentType = request.header("content-type");
     if (contentType.startsWith("text/xml")) { //krazy:exclude=strings
         // SOAP 1.1
-        soapAction = httpHeaders.value("soapaction");
+        soapAction = request.header("soapaction");
         // The SOAP standard allows quotation marks around the SoapAction, so we have to get rid of these.
         soapAction = stripQuotes(soapAction);
 
@@ -356,35 +557,44 @@ void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpH
             }
         }
     }
+    // The header values point into the receive buffer, but the server object keeps the soap action around
+    return QByteArray(soapAction.constData(), soapAction.size());
+}
 
-    m_method = requestMsg.name();
-
-    if (!replyMsg.isFault()) {
-        makeCall(serverObjectInterface, requestMsg, replyMsg, requestHeaders, soapAction, path);
+// The WSDL file and its response headers are prepared in advance, see KDSoapWsdlCache
+bool KDSoapServerSocket::handleWsdlDownload(const QString &path)
+{
+    const KDSoapWsdlCache::DocumentPtr wsdl = m_owner->server()->wsdlCache()->document();
+    if (!wsdl || path != wsdl->pathInUrl) {
+        return false;
     }
+    const bool gzip = !wsdl->gzip.contents.isEmpty()
+                      && KDSoapCompression::negotiate(m_requestParser.header("accept-encoding")) == KDSoapCompression::Gzip;
+    const KDSoapWsdlCache::Representation &representation = gzip ? wsdl->gzip : wsdl->identity;
 
-    if (serverObjectInterface && m_delayedResponse) {
-        // Delayed response. Disable the socket to make sure we don't handle another call at the same time.
-        setSocketEnabled(false);
+    bool notModified = false;
+    const QByteArray ifNoneMatch = m_requestParser.header("if-none-match");
+    if (!ifNoneMatch.isEmpty()) {
+        notModified = KDSoapFileResponse::etagMatches(ifNoneMatch, representation.etag);
     } else {
-        sendReply(serverObjectInterface, replyMsg);
+        const QDateTime ifModifiedSince = KDSoapFileResponse::parseHttpDate(m_requestParser.header("if-modified-since"));
+        notModified = ifModifiedSince.isValid() && wsdl->lastModified <= ifModifiedSince;
     }
+
+    write(notModified ? representation.notModifiedHeaders : representation.headers);
+    write(m_connectionHeaders);
+    write("\r\n", 2); // end of headers
+    if (!notModified) {
+        write(representation.contents);
+    }
+    return true;
 }
 
-bool KDSoapServerSocket::handleWsdlDownload()
+void KDSoapServerSocket::handleMetricsRequest()
 {
-    KDSoapServer *server = m_owner->server();
-    const QString wsdlFile = server->wsdlFile();
-    QFile wf(wsdlFile);
-    if (wf.open(QIODevice::ReadOnly)) {
-        //qDebug() << "Returning wsdl file contents";
-        const QByteArray responseText = wf.readAll();
-        const QByteArray response = httpResponseHeaders(false, "application/xml", responseText.size());
-        write(response);
-        write(responseText);
-        return true;
-    }
-    return false;
+    const QByteArray text = m_owner->server()->metrics().toPrometheusText();
+    write(httpResponseHeaders(false, "text/plain; version=0.0.4", text.size(), m_connectionHeaders));
+    write(text);
 }
 
 bool KDSoapServerSocket::handleFileDownload(KDSoapServerObjectInterface *serverObjectInterface, const QString &path)
@@ -402,7 +612,13 @@ bool KDSoapServerSocket::handleFileDownload(KDSoapServerObjectInterface *serverO
         delete device;
         return true; // handled!
     }
-    const QByteArray response = httpResponseHeaders(false, contentType, device->size());
+#ifndef QT_NO_OPENSSL
+    const bool allowZeroCopy = mode() == QSslSocket::UnencryptedMode;
+#else
+    const bool allowZeroCopy = true;
+#endif
+    KDSoapFileResponse *fileResponse = new KDSoapFileResponse(device, allowZeroCopy);
+    const QByteArray response = fileResponse->responseHeaders(m_requestParser, contentType, m_connectionHeaders);
     if (m_doDebug) {
         qDebug() << "KDSoapServerSocket: file download response" << response;
     }
@@ -410,96 +626,455 @@ bool KDSoapServerSocket::handleFileDownload(KDSoapServerObjectInterface *serverO
     Q_ASSERT(written == response.size()); // Please report a bug if you hit this.
     Q_UNUSED(written);
 
-    char block[4096] = {0};
-    qint64 totalRead = 0;
-    while (!device->atEnd()) {
-        const qint64 in = device->read(block, sizeof(block));
-        if (in <= 0) {
-            break;
-        }
-        totalRead += in;
-        if (in != write(block, in)) {
-            //error = true;
-            break;
-        }
+    if (!fileResponse->writeBody(this)) {
+        qWarning() << "KDSoapServerSocket: error reading the downloaded file";
+        m_keepAlive = false; // the client will see that the response is truncated
+    } else if (!fileResponse->atEnd()) {
+        // Like for a delayed response, the next requests are handled once the file was entirely sent,
+        // see writeFileData()
+        m_fileResponse = fileResponse;
+        m_delayedResponse = true;
+        setSocketEnabled(false);
+        return true;
     }
-    //if (totalRead != device->size()) {
-    //    // Unable to read from the source.
-    //    error = true;
-    //}
-
-    delete device;
+    delete fileResponse;
     // TODO log the file request, if logging is enabled?
     return true;
 }
 
-void KDSoapServerSocket::writeXML(const QByteArray &xmlResponse, bool isFault)
+qint64 KDSoapServerSocket::writeXML(const QByteArray &xmlResponse, bool isFault)
 {
-    const QByteArray httpHeaders = httpResponseHeaders(isFault, "text/xml", xmlResponse.size()); // TODO return application/soap+xml;charset=utf-8 instead for SOAP 1.2
+    QByteArray responseData = xmlResponse;
+    QByteArray extraHeaders = m_connectionHeaders;
+    if (m_compressionThreshold > -1) {
+        extraHeaders += "Vary: Accept-Encoding\r\n";
+        if (m_responseEncoding != KDSoapCompression::Identity && xmlResponse.size() >= m_compressionThreshold) {
+            const QByteArray compressed = KDSoapCompression::compress(xmlResponse, m_responseEncoding, m_compressionLevel);
+            if (!compressed.isEmpty()) {
+                responseData = compressed;
+                extraHeaders += "Content-Encoding: " + KDSoapCompression::encodingName(m_responseEncoding) + "\r\n";
+            }
+        }
+    }
+    const QByteArray httpHeaders = httpResponseHeaders(isFault, "text/xml", responseData.size(), extraHeaders); // TODO return application/soap+xml;charset=utf-8 instead for SOAP 1.2
     if (m_doDebug) {
         qDebug() << "KDSoapServerSocket: writing" << httpHeaders << xmlResponse;
     }
     qint64 written = write(httpHeaders);
     Q_ASSERT(written == httpHeaders.size()); // Please report a bug if you hit this.
-    written = write(xmlResponse);
-    Q_ASSERT(written == xmlResponse.size()); // Please report a bug if you hit this.
+    written = write(responseData);
+    Q_ASSERT(written == responseData.size()); // Please report a bug if you hit this.
     Q_UNUSED(written);
     // flush() ?
+    return httpHeaders.size() + responseData.size();
 }
 
-void KDSoapServerSocket::sendReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg)
+QByteArray KDSoapServerSocket::replyToXml(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg,
+                                          const QString &method, const QString &messageNamespace)
 {
-    const bool isFault = replyMsg.isFault();
+    if (replyMsg.isNull()) {
+        return QByteArray();
+    }
+    KDSoapMessageWriter msgWriter;
+    QString responseName;
+    KDSoapHeaders responseHeaders;
+    setupReplyWriter(serverObjectInterface, replyMsg, method, messageNamespace, msgWriter, responseName, responseHeaders);
+    return msgWriter.messageToXml(replyMsg, responseName, responseHeaders, QMap<QString, KDSoapMessage>());
+}
 
-    QByteArray xmlResponse;
-    if (!replyMsg.isNull()) {
-        KDSoapMessageWriter msgWriter;
-        // Note that the kdsoap client parsing code doesn't care for the name (except if it's fault), even in
-        // Document mode. Other implementations do, though.
-        QString responseName = isFault ? QString::fromLatin1("Fault") : replyMsg.name();
-        if (responseName.isEmpty()) {
-            responseName = m_method;
+void KDSoapServerSocket::setupReplyWriter(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg,
+                                          const QString &method, const QString &messageNamespace,
+                                          KDSoapMessageWriter &msgWriter, QString &responseName, KDSoapHeaders &responseHeaders)
+{
+    // Note that the kdsoap client parsing code doesn't care for the name (except if it's fault), even in
+    // Document mode. Other implementations do, though.
+    responseName = replyMsg.isFault() ? QString::fromLatin1("Fault") : replyMsg.name();
+    if (responseName.isEmpty()) {
+        responseName = method;
+    }
+    QString responseNamespace = messageNamespace;
+    if (serverObjectInterface) {
+        responseHeaders = serverObjectInterface->responseHeaders();
+        if (!serverObjectInterface->responseNamespace().isEmpty()) {
+            responseNamespace = serverObjectInterface->responseNamespace();
         }
-        QString responseNamespace = m_messageNamespace;
-        KDSoapHeaders responseHeaders;
-        if (serverObjectInterface) {
-            responseHeaders = serverObjectInterface->responseHeaders();
-            if (!serverObjectInterface->responseNamespace().isEmpty()) {
-                responseNamespace = serverObjectInterface->responseNamespace();
-            }
+    }
+    msgWriter.setMessageNamespace(responseNamespace);
+}
+
+void KDSoapServerSocket::sendReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg)
+{
+    if (m_responseChunkSize > 0 && !replyMsg.isNull()) {
+        startStreaming(serverObjectInterface, replyMsg);
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray xmlResponse = replyToXml(serverObjectInterface, replyMsg, m_method, m_messageNamespace);
+    writeReply(xmlResponse, replyMsg, KDSoapMetricsRecorder::elapsedMicroseconds(timer));
+}
+
+void KDSoapServerSocket::writeReply(const QByteArray &xmlResponse, const KDSoapMessage &replyMsg, qint64 serializeTime)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 bytesSent = writeXML(xmlResponse, replyMsg.isFault());
+    replyWritten(replyMsg, xmlResponse.size(), bytesSent, serializeTime, KDSoapMetricsRecorder::elapsedMicroseconds(timer));
+}
+
+void KDSoapServerSocket::replyWritten(const KDSoapMessage &replyMsg, int responseSize, qint64 bytesSent, qint64 serializeTime, qint64 writeTime)
+{
+    if (m_callMetrics) {
+        KDSoapMetricsRecorder *metrics = m_owner->metrics();
+        metrics->recordLatency(KDSoapServerMetrics::SerializePhase, serializeTime);
+        metrics->recordLatency(KDSoapServerMetrics::WritePhase, writeTime);
+        metrics->callFinished(m_callMetrics, replyMsg.isFault(), bytesSent);
+        m_callMetrics = 0;
+    }
+    logReply(replyMsg, responseSize, bytesSent);
+}
+
+// Serializes the first chunk of the response. If there's more, sends it with the chunked transfer encoding,
+// and serializes the rest of the response as the client reads it, see writeNextChunks().
+// A response which fits in a single chunk is sent as usual.
+void KDSoapServerSocket::startStreaming(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg)
+{
+    QElapsedTimer timer;
+    timer.start();
+    KDSoapMessageWriter msgWriter;
+    QString responseName;
+    KDSoapHeaders responseHeaders;
+    setupReplyWriter(serverObjectInterface, replyMsg, m_method, m_messageNamespace, msgWriter, responseName, responseHeaders);
+    KDSoapMessageStreamWriter *streamWriter = new KDSoapMessageStreamWriter(msgWriter, replyMsg, responseName, responseHeaders, QMap<QString, KDSoapMessage>());
+    const QByteArray firstChunk = streamWriter->next(m_responseChunkSize);
+    if (streamWriter->atEnd()) {
+        delete streamWriter;
+        writeReply(firstChunk, replyMsg, KDSoapMetricsRecorder::elapsedMicroseconds(timer));
+        return;
+    }
+    m_streamWriter = streamWriter;
+    m_streamedReply = new KDSoapMessage(replyMsg);
+    m_streamSerializeTime = KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+
+    timer.start();
+    const QByteArray httpHeaders = httpResponseHeaders(replyMsg.isFault(), "text/xml", -1, m_connectionHeaders);
+    if (m_doDebug) {
+        qDebug() << "KDSoapServerSocket: streaming" << httpHeaders << firstChunk;
+    }
+    write(httpHeaders);
+    m_streamBytesSent = httpHeaders.size() + writeChunk(firstChunk);
+    m_streamWriteTime = KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+
+    // Like for a delayed response, the next requests are handled once the response was entirely sent.
+    // The rest of the response is written from slotBytesWritten(), never from here, so that
+    // delayedResponseSent() isn't called while handling the request.
+    m_delayedResponse = true;
+    setSocketEnabled(false);
+}
+
+void KDSoapServerSocket::slotBytesWritten()
+{
+    if (m_streamWriter) {
+        writeNextChunks();
+    } else if (m_fileResponse) {
+        writeFileData();
+    }
+}
+
+// Writes more of the downloaded file, as long as the client keeps up with reading it.
+void KDSoapServerSocket::writeFileData()
+{
+    const bool ok = m_fileResponse->writeBody(this);
+    if (ok && !m_fileResponse->atEnd()) {
+        return;
+    }
+    if (!ok) {
+        qWarning() << "KDSoapServerSocket: error reading the downloaded file";
+        m_keepAlive = false; // the client will see that the response is truncated
+    }
+    delete m_fileResponse;
+    m_fileResponse = 0;
+    delayedResponseSent();
+}
+
+// Serializes more of the streamed response, as long as the client keeps up with reading it.
+void KDSoapServerSocket::writeNextChunks()
+{
+    const qint64 highWaterMark = 4 * qint64(m_responseChunkSize);
+    while (bytesToWrite() < highWaterMark) {
+        QElapsedTimer timer;
+        timer.start();
+        const QByteArray chunk = m_streamWriter->next(m_responseChunkSize);
+        m_streamSerializeTime += KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+
+        timer.start();
+        m_streamBytesSent += writeChunk(chunk);
+        if (m_streamWriter->atEnd()) {
+            static const char lastChunk[] = "0\r\n\r\n";
+            write(lastChunk, sizeof(lastChunk) - 1);
+            m_streamBytesSent += sizeof(lastChunk) - 1;
+            m_streamWriteTime += KDSoapMetricsRecorder::elapsedMicroseconds(timer);
+
+            delete m_streamWriter;
+            m_streamWriter = 0;
+            replyWritten(*m_streamedReply, -1, m_streamBytesSent, m_streamSerializeTime, m_streamWriteTime);
+            delete m_streamedReply;
+            m_streamedReply = 0;
+            delayedResponseSent();
+            return;
         }
-        msgWriter.setMessageNamespace(responseNamespace);
-        xmlResponse = msgWriter.messageToXml(replyMsg, responseName, responseHeaders, QMap<QString, KDSoapMessage>());
+        m_streamWriteTime += KDSoapMetricsRecorder::elapsedMicroseconds(timer);
     }
+}
+
+// Writes \p data as one chunk (RFC 7230, section 4.1), returns the number of bytes written
+qint64 KDSoapServerSocket::writeChunk(const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return 0; // an empty chunk would terminate the response
+    }
+    const QByteArray chunkHeader = QByteArray::number(data.size(), 16) + "\r\n";
+    write(chunkHeader);
+    write(data);
+    write("\r\n", 2);
+    return chunkHeader.size() + data.size() + 2;
+}
+
+// Admission control (KDSoapServer::setMaxPendingCalls), before anything is done with the request.
+// Returns false if the call is rejected: its body is then ignored, and a 503 response is sent.
+bool KDSoapServerSocket::admitCall()
+{
+    if (m_requestParser.requestType() != "POST") {
+        return true;
+    }
+    if (!m_owner->admitCall()) {
+        m_requestError = "503 Service Unavailable";
+        m_requestErrorHeaders = "Retry-After: " + QByteArray::number(m_owner->server()->retryAfter()) + "\r\n";
+        return false;
+    }
+    m_callAdmitted = true;
+    return true;
+}
 
-    writeXML(xmlResponse, isFault);
+#ifndef QT_NO_OPENSSL
+void KDSoapServerSocket::startHandshake()
+{
+    m_handshakePending = true;
+    m_handshakeTimer.start();
+    connect(this, SIGNAL(encrypted()), this, SLOT(slotEncrypted()));
+    startServerEncryption();
+    m_owner->server()->tlsSessionCache()->setupSocket(this); // before the ClientHello is read
+}
+#endif
+
+void KDSoapServerSocket::slotEncrypted()
+{
+    m_handshakePending = false;
+#ifndef QT_NO_OPENSSL
+    const bool resumed = m_owner->server()->tlsSessionCache()->isResumed(this);
+#else
+    const bool resumed = false;
+#endif
+    m_owner->metrics()->tlsHandshakeFinished(KDSoapMetricsRecorder::elapsedMicroseconds(m_handshakeTimer), resumed);
+}
+
+bool KDSoapServerSocket::takePendingHandshake()
+{
+    const bool pending = m_handshakePending;
+    m_handshakePending = false;
+    return pending;
+}
+
+bool KDSoapServerSocket::takeAdmittedCall()
+{
+    const bool admitted = m_callAdmitted;
+    m_callAdmitted = false;
+    return admitted;
+}
+
+KDSoapMetricsRecorder::Operation *KDSoapServerSocket::takeCallMetrics()
+{
+    KDSoapMetricsRecorder::Operation *callMetrics = m_callMetrics;
+    m_callMetrics = 0;
+    return callMetrics;
+}
 
+void KDSoapServerSocket::logReply(const KDSoapMessage &replyMsg, int responseSize, qint64 bytesSent)
+{
     // All done, check if we should log this
+    const bool isFault = replyMsg.isFault();
     KDSoapServer *server = m_owner->server();
-    const KDSoapServer::LogLevel logLevel = server->logLevel(); // we do this here in order to support dynamic settings changes (at the price of a mutex)
+    const KDSoapServer::LogLevel logLevel = server->logLevel(); // we do this here in order to support dynamic settings changes
     if (logLevel != KDSoapServer::LogNothing) {
         if (logLevel == KDSoapServer::LogEveryCall ||
                 (logLevel == KDSoapServer::LogFaults && isFault)) {
 
-            if (isFault) {
-                server->log("FAULT " + m_method.toLatin1() + " -- " + replyMsg.faultAsString().toUtf8() + '\n');
+            if (server->logFormat() == KDSoapServer::StructuredLogFormat) {
+                m_owner->log(accessLogLine(replyMsg, responseSize, bytesSent));
+            } else if (isFault) {
+                m_owner->log("FAULT " + m_method.toLatin1() + " -- " + replyMsg.faultAsString().toUtf8() + '\n');
             } else {
-                server->log("CALL " + m_method.toLatin1() + '\n');
+                m_owner->log("CALL " + m_method.toLatin1() + '\n');
             }
         }
     }
 }
 
-void KDSoapServerSocket::sendDelayedReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg)
+static QByteArray quotedLogValue(const QString &value)
+{
+    QByteArray result = value.toUtf8();
+    result.replace('\\', "\\\\");
+    result.replace('"', "\\\"");
+    result.replace('\n', "\\n");
+    result.replace('\r', "\\r");
+    return '"' + result + '"';
+}
+
+QByteArray KDSoapServerSocket::accessLogLine(const KDSoapMessage &replyMsg, int responseSize, qint64 bytesSent) const
+{
+    const bool isFault = replyMsg.isFault();
+    QByteArray line;
+    line.reserve(200);
+    line += "time=";
+    line += QDateTime::currentDateTimeUtc().toString(QString::fromLatin1("yyyy-MM-dd'T'hh:mm:ss.zzz'Z'")).toLatin1();
+    line += " client=";
+    line += peerAddress().toString().toLatin1();
+    line += " method=";
+    line += m_method.toUtf8();
+    line += " status=";
+    line += QByteArray::number(httpStatusCode(isFault, responseSize));
+    line += " duration_us=";
+    line += QByteArray::number(KDSoapMetricsRecorder::elapsedMicroseconds(m_requestTimer));
+    line += " bytes_in=";
+    line += QByteArray::number(m_requestSize);
+    line += " bytes_out=";
+    line += QByteArray::number(bytesSent);
+    if (isFault) {
+        line += " fault=";
+        line += quotedLogValue(replyMsg.faultAsString());
+    }
+    line += '\n';
+    return line;
+}
+
+void KDSoapServerSocket::sendDelayedReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg, int responseId)
 {
+    if (responseId != m_delayedResponseId || responseId == 0) {
+        qWarning("KDSoapServer: ignoring a delayed response which was already sent, or whose deadline expired");
+        return;
+    }
+    m_delayedResponseId = 0;
+    cancelResponseDeadline();
     sendReply(serverObjectInterface, replyMsg);
+    if (!m_streamWriter) { // otherwise see writeNextChunks
+        delayedResponseSent();
+    }
+}
+
+void KDSoapServerSocket::delayedResponseSent()
+{
     m_delayedResponse = false;
-    setSocketEnabled(true);
+    finishResponse();
+    if (m_keepAlive) {
+        setSocketEnabled(true);
+    }
 }
 
-void KDSoapServerSocket::setResponseDelayed()
+// Finishes the call during which KDSoapEpollReactor handed the connection over to this socket,
+// see KDSoapEpollReactor::takeOverConnection. Same as the end of handleRequest and handleRequests.
+void KDSoapServerSocket::finishAdoptedCall(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg)
 {
+    if (m_delayedResponse) {
+        setSocketEnabled(false);
+        return;
+    }
+    sendReply(serverObjectInterface, replyMsg);
+    if (m_socketEnabled) { // otherwise see writeNextChunks
+        finishResponse();
+        handleRequests(); // pipelined requests, if any
+    }
+}
+
+// In KDSoapThreadPool::RequestScheduling mode, hands the call over to a worker thread.
+// The socket is disabled meanwhile, like for a delayed response.
+bool KDSoapServerSocket::scheduleCall(const KDSoapMessage &requestMsg, const KDSoapHeaders &requestHeaders,
+                                      const QByteArray &soapAction, const QString &path)
+{
+    KDSoapServer *server = m_owner->server();
+    KDSoapThreadPool *threadPool = server->threadPool();
+    if (!threadPool || threadPool->schedulingMode() != KDSoapThreadPool::RequestScheduling || requestMsg.isFault()) {
+        return false;
+    }
+    KDSoapServerCall *call = new KDSoapServerCall(server, requestMsg, requestHeaders, soapAction, path, m_method, m_messageNamespace);
+    connect(call, SIGNAL(finished(KDSoapServerCall*)), this, SLOT(slotCallFinished(KDSoapServerCall*)));
+    m_scheduledCall = call;
     m_delayedResponse = true;
+    setSocketEnabled(false);
+    startResponseDeadline(); // including the time spent waiting for a worker thread
+    threadPool->scheduleCall(call);
+    return true;
+}
+
+void KDSoapServerSocket::slotCallFinished(KDSoapServerCall *call)
+{
+    if (call != m_scheduledCall) {
+        return; // already queued when its deadline expired
+    }
+    m_scheduledCall = 0;
+    cancelResponseDeadline();
+    m_owner->metrics()->recordLatency(KDSoapServerMetrics::DispatchPhase, call->dispatchTime());
+    writeReply(call->response(), call->replyMessage(), call->serializeTime());
+    delayedResponseSent();
+}
+
+// Returns the identifier of the delayed response, for sendDelayedReply
+int KDSoapServerSocket::setResponseDelayed()
+{
+    m_delayedResponse = true;
+    m_delayedResponseId = ++m_lastDelayedResponseId;
+    if (m_delayedResponseId <= 0) { // wrapped around
+        m_delayedResponseId = m_lastDelayedResponseId = 1;
+    }
+    startResponseDeadline();
+    return m_delayedResponseId;
+}
+
+// The timer wheel calls timeout() at the deadline (see KDSoapServer::setResponseDeadline),
+// instead of the idle timeout, which doesn't apply while the server is busy with the call.
+void KDSoapServerSocket::startResponseDeadline()
+{
+    m_responseDeadline = m_owner->server()->responseDeadline(m_method);
+    if (m_responseDeadline > -1) {
+        m_deadlineTimer.start();
+        m_owner->timerWheel()->schedule(this, m_responseDeadline);
+    }
+}
+
+void KDSoapServerSocket::cancelResponseDeadline()
+{
+    if (m_responseDeadline > -1) {
+        m_responseDeadline = -1;
+        m_owner->timerWheel()->remove(this); // finishResponse() schedules the idle timeout again
+    }
+}
+
+// Sends a timeout fault in place of the response, which will be ignored if it comes later
+void KDSoapServerSocket::responseDeadlineExpired()
+{
+    const int deadline = m_responseDeadline;
+    m_responseDeadline = -1;
+    m_delayedResponseId = 0;
+    if (m_scheduledCall) {
+        disconnect(m_scheduledCall, SIGNAL(finished(KDSoapServerCall*)), this, SLOT(slotCallFinished(KDSoapServerCall*)));
+        m_scheduledCall = 0;
+    }
+    KDSoapMessage replyMsg;
+    replyMsg.setUse(m_owner->server()->use());
+    handleError(replyMsg, "Server.Timeout", QString::fromLatin1("No response to %1 after %2 ms").arg(m_method).arg(deadline));
+    sendReply(0, replyMsg);
+    if (!m_streamWriter) { // otherwise see writeNextChunks
+        delayedResponseSent();
+    }
 }
 
 void KDSoapServerSocket::handleError(KDSoapMessage &replyMsg, const char *errorCode, const QString &error)
@@ -510,7 +1085,7 @@ void KDSoapServerSocket::handleError(KDSoapMessage &replyMsg, const char *errorC
     replyMsg.addArgument(QString::fromLatin1("faultstring"), error);
 }
 
-void KDSoapServerSocket::makeCall(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &requestMsg, KDSoapMessage &replyMsg, const KDSoapHeaders &requestHeaders, const QByteArray &soapAction, const QString &path)
+void KDSoapServerSocket::makeCall(KDSoapServer *server, KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &requestMsg, KDSoapMessage &replyMsg, const KDSoapHeaders &requestHeaders, const QByteArray &soapAction, const QString &path)
 {
     Q_ASSERT(serverObjectInterface);
 
@@ -525,7 +1100,6 @@ void KDSoapServerSocket::makeCall(KDSoapServerObjectInterface *serverObjectInter
         // Call method on m_serverObject
         serverObjectInterface->setRequestHeaders(requestHeaders, soapAction);
 
-        KDSoapServer *server = m_owner->server();
         if (path != server->path()) {
             serverObjectInterface->processRequestWithPath(requestMsg, replyMsg, soapAction, path);
         } else {
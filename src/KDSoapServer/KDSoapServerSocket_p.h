@@ -24,6 +24,7 @@
 #define KDSOAPSERVERSOCKET_P_H
 
 #include <QtGlobal>
+#include <QPointer>
 
 #ifndef QT_NO_OPENSSL
 #include <QSslSocket>
@@ -31,7 +32,11 @@
 #include <QTcpSocket>
 #endif
 
-#include <QMap>
+#include "KDSoapHttpRequestParser_p.h"
+#include "KDSoapMetricsRecorder_p.h"
+#include "KDSoapCompression_p.h"
+#include <KDSoapClient/KDSoapMessageReader_p.h>
+
 QT_BEGIN_NAMESPACE
 class QObject;
 QT_END_NAMESPACE
@@ -39,6 +44,11 @@ class KDSoapSocketList;
 class KDSoapServerObjectInterface;
 class KDSoapMessage;
 class KDSoapHeaders;
+class KDSoapServer;
+class KDSoapServerCall;
+class KDSoapMessageWriter;
+class KDSoapMessageStreamWriter;
+class KDSoapFileResponse;
 
 class KDSoapServerSocket
 #ifndef QT_NO_OPENSSL
@@ -52,27 +62,73 @@ public:
     KDSoapServerSocket(KDSoapSocketList *owner, QObject *serverObject);
     ~KDSoapServerSocket();
 
-    void setResponseDelayed();
-    void sendDelayedReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg);
+    int setResponseDelayed();
+    void sendDelayedReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg, int responseId);
     void sendReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg);
+    void timeout(); // called by KDSoapTimerWheel
+    KDSoapMetricsRecorder::Operation *takeCallMetrics(); // called by KDSoapSocketList
+    bool takeAdmittedCall(); // called by KDSoapSocketList
+    bool takePendingHandshake(); // called by KDSoapSocketList
+#ifndef QT_NO_OPENSSL
+    void startHandshake(); // called by KDSoapSocketList
+#endif
+
+    // Also used by KDSoapServerCall, in the worker threads
+    static void makeCall(KDSoapServer *server, KDSoapServerObjectInterface *serverObjectInterface,
+                         const KDSoapMessage &requestMsg, KDSoapMessage &replyMsg,
+                         const KDSoapHeaders &requestHeaders,
+                         const QByteArray &soapAction, const QString &path);
+    static QByteArray replyToXml(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg,
+                                 const QString &method, const QString &messageNamespace);
+    static void setupReplyWriter(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg,
+                                 const QString &method, const QString &messageNamespace,
+                                 KDSoapMessageWriter &msgWriter, QString &responseName, KDSoapHeaders &responseHeaders);
+    // Also used by KDSoapEpollReactor
+    static QByteArray httpResponseHeaders(bool fault, const QByteArray &contentType, int responseDataSize, const QByteArray &connectionHeaders);
+    static QByteArray soapActionFromHeaders(const KDSoapHttpRequestParser &request);
+    static QByteArray keepAliveHeaders(const KDSoapHttpRequestParser &request, int requestCount, KDSoapServer *server, int idleTimeout, bool &keepAlive);
+    static void setupMessageReader(KDSoapMessageReader &reader, KDSoapServer *server);
 Q_SIGNALS:
     void socketDeleted(KDSoapServerSocket *);
 
 private Q_SLOTS:
     void slotReadyRead();
+    void slotCallFinished(KDSoapServerCall *call);
+    void slotBytesWritten();
+    void slotEncrypted();
 
 private:
-    void handleRequest(const QMap<QByteArray, QByteArray> &headers, const QByteArray &receivedData);
-    bool handleWsdlDownload();
+    void handleRequests();
+    void setupKeepAlive();
+    void setupEncodings();
+    bool admitCall();
+    bool takeBody(QByteArray &data);
+    void finishResponse();
+    void scheduleIdleTimeout();
+    void handleRequest(const KDSoapHttpRequestParser &request);
+    bool handleWsdlDownload(const QString &path);
+    void handleMetricsRequest();
     bool handleFileDownload(KDSoapServerObjectInterface *serverObjectInterface, const QString &path);
-    void makeCall(KDSoapServerObjectInterface *serverObjectInterface,
-                  const KDSoapMessage &requestMsg, KDSoapMessage &replyMsg,
-                  const KDSoapHeaders &requestHeaders,
-                  const QByteArray &soapAction, const QString &path);
-    void handleError(KDSoapMessage &replyMsg, const char *errorCode, const QString &error);
+    bool scheduleCall(const KDSoapMessage &requestMsg, const KDSoapHeaders &requestHeaders,
+                      const QByteArray &soapAction, const QString &path);
+    static void handleError(KDSoapMessage &replyMsg, const char *errorCode, const QString &error);
+    void writeReply(const QByteArray &xmlResponse, const KDSoapMessage &replyMsg, qint64 serializeTime);
+    void replyWritten(const KDSoapMessage &replyMsg, int responseSize, qint64 bytesSent, qint64 serializeTime, qint64 writeTime);
+    void startStreaming(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg);
+    void writeNextChunks();
+    qint64 writeChunk(const QByteArray &data);
+    void writeFileData();
+    void logReply(const KDSoapMessage &replyMsg, int responseSize, qint64 bytesSent);
+    QByteArray accessLogLine(const KDSoapMessage &replyMsg, int responseSize, qint64 bytesSent) const;
+    void delayedResponseSent();
+    void startResponseDeadline();
+    void cancelResponseDeadline();
+    void responseDeadlineExpired();
     void setSocketEnabled(bool enabled);
-    void writeXML(const QByteArray &xmlResponse, bool isFault);
+    qint64 writeXML(const QByteArray &xmlResponse, bool isFault);
+    void finishAdoptedCall(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg);
     friend class KDSoapServerObjectInterface;
+    friend class KDSoapEpollReactor; // hands its connections over, with their state
 
     KDSoapSocketList *m_owner;
     QObject *m_serverObject;
@@ -81,17 +137,60 @@ private:
     bool m_socketEnabled;
     bool m_receivedData;
 
+    // Connection handling (keep-alive)
+    bool m_keepAlive;
+    int m_requestCount;
+    int m_idleTimeout;
+    QByteArray m_connectionHeaders;
+
+    // Compression (Content-Encoding)
+    int m_compressionThreshold;
+    int m_compressionLevel;
+    KDSoapCompression::Encoding m_responseEncoding;
+    bool m_inflating;
+    KDSoapInflater m_inflater;
+    QByteArray m_requestError; // status line, if the request body can't be decoded (or the call is rejected)
+    QByteArray m_requestErrorHeaders;
+
+    // Delayed responses (including the calls handed over to worker threads)
+    int m_delayedResponseId; // of the pending delayed response, 0 if none
+    int m_lastDelayedResponseId;
+    int m_responseDeadline; // msecs, -1 if none
+    QElapsedTimer m_deadlineTimer;
+    QPointer<KDSoapServerCall> m_scheduledCall; // also deleted if its delayed response is abandoned
+
+    // TLS handshake, until encrypted() (or the socket deletion, if it failed)
+    bool m_handshakePending;
+    QElapsedTimer m_handshakeTimer;
+
+    // Admission control
+    bool m_callAdmitted; // counted by m_owner as a pending call, until the response is sent
+
+    // Streamed response (Transfer-Encoding: chunked)
+    int m_responseChunkSize; // -1 if the response can't be streamed
+    KDSoapMessageStreamWriter *m_streamWriter;
+    KDSoapMessage *m_streamedReply;
+    qint64 m_streamBytesSent;
+    qint64 m_streamSerializeTime; // microseconds
+    qint64 m_streamWriteTime; // microseconds
+
+    // File download being sent, see handleFileDownload
+    KDSoapFileResponse *m_fileResponse;
+
     // Current request being assembled
     bool m_useRawXML;
-    int m_bytesReceived;
-    int m_chunkStart;
-    QMap<QByteArray, QByteArray> m_httpHeaders;
-    QByteArray m_requestBuffer;
-    QByteArray m_decodedRequestBuffer; // used for chunked transfer encoding only
+    KDSoapHttpRequestParser m_requestParser;
+    KDSoapMessageReader m_messageReader;
 
     // Data for the current call (stored here for delayed replies)
     QString m_messageNamespace;
     QString m_method;
+
+    // Metrics for the current call
+    qint64 m_requestSize;
+    qint64 m_parseTime; // microseconds
+    QElapsedTimer m_requestTimer;
+    KDSoapMetricsRecorder::Operation *m_callMetrics;
 };
 
 #endif // KDSOAPSERVERSOCKET_P_H
@@ -71,6 +71,13 @@ int KDSoapServerThread::totalConnectionCountForServer(const KDSoapServer *server
     return 0;
 }
 
+void KDSoapServerThread::collectMetricsForServer(const KDSoapServer *server, KDSoapServerMetrics &metrics) const
+{
+    if (d) {
+        d->collectMetricsForServer(server, metrics);
+    }
+}
+
 void KDSoapServerThread::resetTotalConnectionCountForServer(const KDSoapServer *server)
 {
     if (d) {
@@ -85,6 +92,24 @@ void KDSoapServerThread::disconnectSocketsForServer(KDSoapServer *server, QSemap
     }
 }
 
+// Blocks until the thread created its listening socket
+bool KDSoapServerThread::listenForServer(KDSoapServer *server, int socketDescriptor)
+{
+    bool ok = false;
+    if (d) {
+        QMetaObject::invokeMethod(d, "listenForServer", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, ok),
+                                  Q_ARG(KDSoapServer *, server), Q_ARG(int, socketDescriptor));
+    }
+    return ok;
+}
+
+void KDSoapServerThread::closeListenerForServer(KDSoapServer *server)
+{
+    if (d) {
+        QMetaObject::invokeMethod(d, "closeListenerForServer", Qt::BlockingQueuedConnection, Q_ARG(KDSoapServer *, server));
+    }
+}
+
 void KDSoapServerThread::startThread()
 {
     QThread::start();
@@ -105,22 +130,34 @@ void KDSoapServerThread::handleIncomingConnection(int socketDescriptor, KDSoapSe
 ////
 
 KDSoapServerThreadImpl::KDSoapServerThreadImpl()
-    : QObject(0), m_incomingConnectionCount(0)
+    : QObject(0), m_socketLists(new SocketLists), m_incomingConnectionCount(0)
 {
+    m_socketListSnapshots.append(socketLists());
 }
 
 KDSoapServerThreadImpl::~KDSoapServerThreadImpl()
 {
-    qDeleteAll(m_socketLists.values());
+    qDeleteAll(m_acceptors.values());
+    qDeleteAll(socketLists()->values());
+    qDeleteAll(m_socketListSnapshots);
+}
+
+const KDSoapServerThreadImpl::SocketLists *KDSoapServerThreadImpl::socketLists() const
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    return m_socketLists.loadAcquire();
+#else
+    return m_socketLists;
+#endif
 }
 
 // Called from main thread!
 int KDSoapServerThreadImpl::socketCount()
 {
-    QMutexLocker lock(&m_socketListMutex);
+    const SocketLists *lists = socketLists();
     int sc = 0;
-    SocketLists::const_iterator it = m_socketLists.constBegin();
-    for (; it != m_socketLists.constEnd(); ++it) {
+    SocketLists::const_iterator it = lists->constBegin();
+    for (; it != lists->constEnd(); ++it) {
         sc += it.value()->socketCount();
     }
 #if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
@@ -131,15 +168,20 @@ int KDSoapServerThreadImpl::socketCount()
     return sc;
 }
 
+// Only called in this thread, which is the only one publishing new socket lists
 KDSoapSocketList *KDSoapServerThreadImpl::socketListForServer(KDSoapServer *server)
 {
-    KDSoapSocketList *sockets = m_socketLists.value(server);
+    const SocketLists *lists = socketLists();
+    KDSoapSocketList *sockets = lists->value(server);
     if (sockets) {
         return sockets;
     }
 
     sockets = new KDSoapSocketList(server); // creates the server object
-    m_socketLists.insert(server, sockets);
+    SocketLists *newLists = new SocketLists(*lists);
+    newLists->insert(server, sockets); // detaches, readers can still use lists
+    m_socketListSnapshots.append(newLists);
+    m_socketLists.fetchAndStoreRelease(newLists);
     return sockets;
 }
 
@@ -152,11 +194,36 @@ void KDSoapServerThreadImpl::addIncomingConnection()
 // are created in the thread.
 void KDSoapServerThreadImpl::handleIncomingConnection(int socketDescriptor, KDSoapServer *server)
 {
-    QMutexLocker lock(&m_socketListMutex);
     KDSoapSocketList *sockets = socketListForServer(server);
     KDSoapServerSocket *socket = sockets->handleIncomingConnection(socketDescriptor);
     Q_UNUSED(socket);
-    m_incomingConnectionCount.fetchAndAddAcquire(-1);
+    // After the socket was counted by its socket list, so that socketCount doesn't miss it
+    m_incomingConnectionCount.fetchAndAddRelease(-1);
+}
+
+// Called by the acceptor of this thread, without going through the thread of the server
+void KDSoapServerThreadImpl::acceptConnection(int socketDescriptor, KDSoapServer *server)
+{
+    KDSoapSocketList *sockets = socketListForServer(server);
+    sockets->handleIncomingConnection(socketDescriptor);
+}
+
+// Takes ownership of the socket descriptor, on success
+bool KDSoapServerThreadImpl::listenForServer(KDSoapServer *server, int socketDescriptor)
+{
+    KDSoapServerAcceptor *acceptor = new KDSoapServerAcceptor(this, server);
+    if (!acceptor->setSocketDescriptor(socketDescriptor)) {
+        delete acceptor;
+        return false;
+    }
+    delete m_acceptors.value(server);
+    m_acceptors.insert(server, acceptor);
+    return true;
+}
+
+void KDSoapServerThreadImpl::closeListenerForServer(KDSoapServer *server)
+{
+    delete m_acceptors.take(server);
 }
 
 void KDSoapServerThreadImpl::quit()
@@ -166,15 +233,13 @@ void KDSoapServerThreadImpl::quit()
 
 int KDSoapServerThreadImpl::socketCountForServer(const KDSoapServer *server)
 {
-    QMutexLocker lock(&m_socketListMutex);
-    KDSoapSocketList *sockets = m_socketLists.value(const_cast<KDSoapServer *>(server));
+    KDSoapSocketList *sockets = socketLists()->value(server);
     return sockets ? sockets->socketCount() : 0;
 }
 
 void KDSoapServerThreadImpl::disconnectSocketsForServer(KDSoapServer *server, QSemaphore *semaphore)
 {
-    QMutexLocker lock(&m_socketListMutex);
-    KDSoapSocketList *sockets = m_socketLists.value(server);
+    KDSoapSocketList *sockets = socketLists()->value(server);
     if (sockets) {
         sockets->disconnectAll();
     }
@@ -183,16 +248,41 @@ void KDSoapServerThreadImpl::disconnectSocketsForServer(KDSoapServer *server, QS
 
 int KDSoapServerThreadImpl::totalConnectionCountForServer(const KDSoapServer *server)
 {
-    QMutexLocker lock(&m_socketListMutex);
-    KDSoapSocketList *sockets = m_socketLists.value(const_cast<KDSoapServer *>(server));
+    KDSoapSocketList *sockets = socketLists()->value(server);
     return sockets ? sockets->totalConnectionCount() : 0;
 }
 
+void KDSoapServerThreadImpl::collectMetricsForServer(const KDSoapServer *server, KDSoapServerMetrics &metrics)
+{
+    KDSoapSocketList *sockets = socketLists()->value(server);
+    if (sockets) {
+        sockets->metrics()->addTo(metrics);
+    }
+}
+
 void KDSoapServerThreadImpl::resetTotalConnectionCountForServer(const KDSoapServer *server)
 {
-    QMutexLocker lock(&m_socketListMutex);
-    KDSoapSocketList *sockets = m_socketLists.value(const_cast<KDSoapServer *>(server));
+    KDSoapSocketList *sockets = socketLists()->value(server);
     if (sockets) {
         sockets->resetTotalConnectionCount();
     }
 }
+
+////
+
+KDSoapServerAcceptor::KDSoapServerAcceptor(KDSoapServerThreadImpl *thread, KDSoapServer *server)
+    : QTcpServer(0), m_thread(thread), m_server(server)
+{
+    setMaxPendingConnections(1000);
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+void KDSoapServerAcceptor::incomingConnection(qintptr socketDescriptor)
+#else
+void KDSoapServerAcceptor::incomingConnection(int socketDescriptor)
+#endif
+{
+    if (!m_server->rejectConnection(socketDescriptor)) {
+        m_thread->acceptConnection(socketDescriptor, m_server);
+    }
+}
@@ -25,10 +25,33 @@
 
 #include <QThread>
 #include <QSemaphore>
-#include <QMutex>
 #include <QHash>
+#include <QList>
+#include <QAtomicPointer>
+#include <QTcpServer>
 class KDSoapServer;
 class KDSoapSocketList;
+class KDSoapServerThreadImpl;
+class KDSoapServerMetrics;
+
+// Listening socket owned by a thread, see KDSoapServer::listenWithReusePort
+class KDSoapServerAcceptor : public QTcpServer
+{
+    Q_OBJECT
+public:
+    KDSoapServerAcceptor(KDSoapServerThreadImpl *thread, KDSoapServer *server);
+
+protected:
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    void incomingConnection(qintptr socketDescriptor);
+#else
+    void incomingConnection(int socketDescriptor);
+#endif
+
+private:
+    KDSoapServerThreadImpl *m_thread;
+    KDSoapServer *m_server;
+};
 
 class KDSoapServerThreadImpl : public QObject
 {
@@ -40,20 +63,31 @@ public:
 public Q_SLOTS:
     void handleIncomingConnection(int socketDescriptor, KDSoapServer *server);
     void disconnectSocketsForServer(KDSoapServer *server, QSemaphore *semaphore);
+    bool listenForServer(KDSoapServer *server, int socketDescriptor);
+    void closeListenerForServer(KDSoapServer *server);
     void quit();
 
 public:
     int socketCount();
     int socketCountForServer(const KDSoapServer *server);
     int totalConnectionCountForServer(const KDSoapServer *server);
+    void collectMetricsForServer(const KDSoapServer *server, KDSoapServerMetrics &metrics);
     void resetTotalConnectionCountForServer(const KDSoapServer *server);
 
     void addIncomingConnection();
+    void acceptConnection(int socketDescriptor, KDSoapServer *server);
 private:
-    QMutex m_socketListMutex;
     KDSoapSocketList *socketListForServer(KDSoapServer *server);
-    typedef QHash<KDSoapServer *, KDSoapSocketList *> SocketLists;
-    SocketLists m_socketLists;
+    typedef QHash<const KDSoapServer *, KDSoapSocketList *> SocketLists;
+    const SocketLists *socketLists() const;
+
+    // The socket lists are read from other threads (e.g. to pick the least busy thread),
+    // without locking: this thread never modifies a published SocketLists, it publishes
+    // a modified copy instead. The previous copies are kept until the thread exits,
+    // since readers might still be using them (there's one per server, this is cheap).
+    QAtomicPointer<const SocketLists> m_socketLists;
+    QList<const SocketLists *> m_socketListSnapshots;
+    QHash<KDSoapServer *, KDSoapServerAcceptor *> m_acceptors;
 
     QAtomicInt m_incomingConnectionCount;
 };
@@ -71,10 +105,13 @@ public:
     int socketCount() const;
     int socketCountForServer(const KDSoapServer *server) const;
     int totalConnectionCountForServer(const KDSoapServer *server) const;
+    void collectMetricsForServer(const KDSoapServer *server, KDSoapServerMetrics &metrics) const;
     void resetTotalConnectionCountForServer(const KDSoapServer *server);
 
     void disconnectSocketsForServer(KDSoapServer *server, QSemaphore &semaphore);
     void handleIncomingConnection(int socketDescriptor, KDSoapServer *server);
+    bool listenForServer(KDSoapServer *server, int socketDescriptor);
+    void closeListenerForServer(KDSoapServer *server);
 
 protected:
     virtual void run();
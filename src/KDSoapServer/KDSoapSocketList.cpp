@@ -22,11 +22,13 @@
 **********************************************************************/
 #include "KDSoapSocketList_p.h"
 #include "KDSoapServerSocket_p.h"
+#include "KDSoapEpollReactor_p.h"
 #include "KDSoapServer.h"
+#include "KDSoapLogWriter_p.h"
 #include <QDebug>
 
 KDSoapSocketList::KDSoapSocketList(KDSoapServer *server)
-    : m_server(server), m_serverObject(server->createServerObject()), m_totalConnectionCount(0)
+    : m_server(server), m_serverObject(server->createServerObject()), m_epollReactor(0), m_socketCount(0), m_totalConnectionCount(0), m_logBuffer(0), m_pendingCalls(0)
 {
     Q_ASSERT(m_server);
     Q_ASSERT(m_serverObject);
@@ -34,28 +36,46 @@ KDSoapSocketList::KDSoapSocketList(KDSoapServer *server)
 
 KDSoapSocketList::~KDSoapSocketList()
 {
+    delete m_epollReactor;
     delete m_serverObject;
 }
 
+// Returns null if the connection is handled by the epoll reactor
 KDSoapServerSocket *KDSoapSocketList::handleIncomingConnection(int socketDescriptor)
 {
-    KDSoapServerSocket *socket = new KDSoapServerSocket(this, m_serverObject);
-    socket->setSocketDescriptor(socketDescriptor);
+    if (m_server->ioBackend() == KDSoapServer::EpollIoBackend && !(m_server->features() & KDSoapServer::Ssl)) {
+        if (!m_epollReactor) {
+            m_epollReactor = new KDSoapEpollReactor(this, m_serverObject);
+        }
+        if (m_epollReactor->addConnection(socketDescriptor)) {
+            return 0;
+        }
+    }
+
+    KDSoapServerSocket *socket = createSocket(socketDescriptor);
 
 #ifndef QT_NO_OPENSSL
     if (m_server->features() & KDSoapServer::Ssl) {
         // We could call a virtual "m_server->setSslConfiguration(socket)" here,
         // if more control is needed (e.g. due to SNI)
-        if (!m_server->sslConfiguration().isNull()) {
-            socket->setSslConfiguration(m_server->sslConfiguration());
+        const QSslConfiguration sslConfiguration = m_server->sslConfiguration();
+        if (!sslConfiguration.isNull()) {
+            socket->setSslConfiguration(sslConfiguration);
         }
-        socket->startServerEncryption();
+        socket->startHandshake();
     }
 #endif
+    return socket;
+}
 
+KDSoapServerSocket *KDSoapSocketList::createSocket(int socketDescriptor)
+{
+    KDSoapServerSocket *socket = new KDSoapServerSocket(this, m_serverObject);
+    socket->setSocketDescriptor(socketDescriptor);
     QObject::connect(socket, SIGNAL(disconnected()),
                      socket, SLOT(deleteLater()));
     m_sockets.insert(socket);
+    socketAdded();
     connect(socket, SIGNAL(socketDeleted(KDSoapServerSocket*)), this, SLOT(socketDeleted(KDSoapServerSocket*)));
     return socket;
 }
@@ -64,11 +84,65 @@ void KDSoapSocketList::socketDeleted(KDSoapServerSocket *socket)
 {
     //qDebug() << Q_FUNC_INFO;
     m_sockets.remove(socket);
+    socketRemoved();
+    m_timerWheel.remove(socket);
+    KDSoapMetricsRecorder::Operation *callMetrics = socket->takeCallMetrics();
+    if (callMetrics) {
+        m_metrics.callAborted(callMetrics);
+    }
+    if (socket->takeAdmittedCall()) {
+        releaseCall();
+    }
+    if (socket->takePendingHandshake()) {
+        m_metrics.tlsHandshakeFailed();
+    }
+}
+
+// Lock-free, since only this thread writes to its log buffer
+void KDSoapSocketList::log(const QByteArray &line)
+{
+    if (!m_logBuffer) {
+        m_logBuffer = m_server->createLogBuffer();
+    }
+    m_logBuffer->append(line);
+}
+
+// Checks the limit of this thread first, so that the calls it rejects don't use up the server-wide limit
+bool KDSoapSocketList::admitCall()
+{
+    const int maxPerThread = m_server->maxPendingCallsPerThread();
+    if ((maxPerThread > -1 && m_pendingCalls >= maxPerThread) || !m_server->admitCall()) {
+        m_metrics.callShed();
+        return false;
+    }
+    ++m_pendingCalls;
+    return true;
+}
+
+void KDSoapSocketList::releaseCall()
+{
+    Q_ASSERT(m_pendingCalls > 0);
+    --m_pendingCalls;
+    m_server->releaseCall();
 }
 
 int KDSoapSocketList::socketCount() const
 {
-    return m_sockets.count();
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    return m_socketCount.loadAcquire();
+#else
+    return m_socketCount;
+#endif
+}
+
+void KDSoapSocketList::socketAdded()
+{
+    m_socketCount.ref();
+}
+
+void KDSoapSocketList::socketRemoved()
+{
+    m_socketCount.deref();
 }
 
 void KDSoapSocketList::disconnectAll()
@@ -76,6 +150,9 @@ void KDSoapSocketList::disconnectAll()
     Q_FOREACH (KDSoapServerSocket *socket, m_sockets) {
         socket->close();    // will disconnect
     }
+    if (m_epollReactor) {
+        m_epollReactor->closeAll();
+    }
 }
 
 int KDSoapSocketList::totalConnectionCount() const
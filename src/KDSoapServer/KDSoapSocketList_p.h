@@ -25,12 +25,16 @@
 
 #include <QSet>
 #include <QObject>
+#include "KDSoapTimerWheel_p.h"
+#include "KDSoapMetricsRecorder_p.h"
 QT_BEGIN_NAMESPACE
 class QTcpSocket;
 class QObject;
 QT_END_NAMESPACE
 class KDSoapServer;
 class KDSoapServerSocket;
+class KDSoapLogBuffer;
+class KDSoapEpollReactor;
 
 class KDSoapSocketList : public QObject
 {
@@ -40,8 +44,12 @@ public:
     ~KDSoapSocketList();
 
     KDSoapServerSocket *handleIncomingConnection(int socketDescriptor);
+    KDSoapServerSocket *createSocket(int socketDescriptor); // also used by KDSoapEpollReactor
 
+    // Lock-free, called from the thread accepting the connections
     int socketCount() const;
+    void socketAdded(); // also used by KDSoapEpollReactor
+    void socketRemoved();
     void disconnectAll();
 
     int totalConnectionCount() const;
@@ -53,6 +61,22 @@ public:
         return m_server;
     }
 
+    KDSoapTimerWheel *timerWheel()
+    {
+        return &m_timerWheel;
+    }
+
+    KDSoapMetricsRecorder *metrics()
+    {
+        return &m_metrics;
+    }
+
+    void log(const QByteArray &line);
+
+    // Admission control, see KDSoapServer::setMaxPendingCalls
+    bool admitCall();
+    void releaseCall();
+
 public Q_SLOTS:
     void socketDeleted(KDSoapServerSocket *socket);
 
@@ -60,7 +84,13 @@ private:
     KDSoapServer *m_server;
     QObject *m_serverObject;
     QSet<KDSoapServerSocket *> m_sockets;
+    KDSoapEpollReactor *m_epollReactor; // see KDSoapServer::EpollIoBackend, created on demand
+    QAtomicInt m_socketCount; // m_sockets and the connections of m_epollReactor
     QAtomicInt m_totalConnectionCount;
+    KDSoapTimerWheel m_timerWheel; // for the timeouts of all the sockets in this thread
+    KDSoapMetricsRecorder m_metrics;
+    KDSoapLogBuffer *m_logBuffer; // owned by the server's log writer
+    int m_pendingCalls; // calls admitted in this thread, and not answered yet
 };
 
 #endif // KDSOAPSOCKETLIST_P_H
@@ -22,21 +22,35 @@
 **********************************************************************/
 #include "KDSoapThreadPool.h"
 #include "KDSoapServerThread_p.h"
+#include "KDSoapWorkerPool_p.h"
+#include "KDSoapReusePort_p.h"
+#include "KDSoapServerMetrics.h"
+#include <QHostAddress>
 #include <QDebug>
 
 class KDSoapThreadPool::Private
 {
 public:
     Private()
-        : m_maxThreadCount(QThread::idealThreadCount())
+        : m_maxThreadCount(QThread::idealThreadCount()),
+          m_schedulingMode(ConnectionScheduling),
+          m_workerThreadCount(QThread::idealThreadCount()),
+          m_workerPool(0)
     {
     }
 
     KDSoapServerThread *chooseNextThread();
+    KDSoapServerThread *createThread();
 
     int m_maxThreadCount;
+    SchedulingMode m_schedulingMode;
+    int m_workerThreadCount;
+    QMutex m_workerPoolMutex;
+    KDSoapWorkerPool *m_workerPool; // created on demand, by the first socket thread scheduling a call
     typedef QList<KDSoapServerThread *> ThreadCollection;
+    ThreadCollection threads();
     ThreadCollection m_threads;
+    QMutex m_threadsMutex; // for adding threads, and for reading them from other threads than the server's
 };
 
 KDSoapThreadPool::KDSoapThreadPool(QObject *parent)
@@ -55,6 +69,8 @@ KDSoapThreadPool::~KDSoapThreadPool()
         thread->wait();
         delete thread;
     }
+    // after the socket threads, which might still be scheduling calls
+    delete d->m_workerPool;
 
     delete d;
 }
@@ -69,6 +85,26 @@ int KDSoapThreadPool::maxThreadCount() const
     return d->m_maxThreadCount;
 }
 
+void KDSoapThreadPool::setSchedulingMode(SchedulingMode mode)
+{
+    d->m_schedulingMode = mode;
+}
+
+KDSoapThreadPool::SchedulingMode KDSoapThreadPool::schedulingMode() const
+{
+    return d->m_schedulingMode;
+}
+
+void KDSoapThreadPool::setWorkerThreadCount(int workerThreadCount)
+{
+    d->m_workerThreadCount = workerThreadCount;
+}
+
+int KDSoapThreadPool::workerThreadCount() const
+{
+    return d->m_workerThreadCount;
+}
+
 KDSoapServerThread *KDSoapThreadPool::Private::chooseNextThread()
 {
     KDSoapServerThread *chosenThread = 0;
@@ -103,14 +139,28 @@ KDSoapServerThread *KDSoapThreadPool::Private::chooseNextThread()
 
     // Create new thread
     if (!chosenThread) {
-        chosenThread = new KDSoapServerThread(0);
-        //qDebug() << "Creating KDSoapServerThread" << chosenThread;
-        m_threads.append(chosenThread);
-        chosenThread->startThread();
+        chosenThread = createThread();
     }
     return chosenThread;
 }
 
+KDSoapServerThread *KDSoapThreadPool::Private::createThread()
+{
+    KDSoapServerThread *thread = new KDSoapServerThread(0);
+    //qDebug() << "Creating KDSoapServerThread" << thread;
+    thread->startThread();
+    QMutexLocker lock(&m_threadsMutex);
+    m_threads.append(thread);
+    return thread;
+}
+
+// For the callers in other threads than the server's one; the lock is only held while copying
+KDSoapThreadPool::Private::ThreadCollection KDSoapThreadPool::Private::threads()
+{
+    QMutexLocker lock(&m_threadsMutex);
+    return m_threads;
+}
+
 void KDSoapThreadPool::handleIncomingConnection(int socketDescriptor, KDSoapServer *server)
 {
     // First, pick or create a thread.
@@ -120,10 +170,69 @@ void KDSoapThreadPool::handleIncomingConnection(int socketDescriptor, KDSoapServ
     chosenThread->handleIncomingConnection(socketDescriptor, server);
 }
 
+// Called from the socket threads
+void KDSoapThreadPool::scheduleCall(KDSoapServerCall *call)
+{
+    KDSoapWorkerPool *workerPool;
+    {
+        QMutexLocker lock(&d->m_workerPoolMutex);
+        if (!d->m_workerPool) {
+            d->m_workerPool = new KDSoapWorkerPool(d->m_workerThreadCount);
+        }
+        workerPool = d->m_workerPool;
+    }
+    workerPool->schedule(call);
+}
+
+// One listening socket per thread, for KDSoapServer::listenWithReusePort
+bool KDSoapThreadPool::listenWithReusePort(KDSoapServer *server, const QHostAddress &address, quint16 port)
+{
+    while (d->m_threads.count() < qMax(1, d->m_maxThreadCount)) {
+        d->createThread();
+    }
+    Q_FOREACH (KDSoapServerThread *thread, d->m_threads) {
+        const int socketDescriptor = KDSoapReusePort::bindSocket(address, port);
+        if (socketDescriptor == -1 || !KDSoapReusePort::listen(socketDescriptor)) {
+            if (socketDescriptor != -1) {
+                KDSoapReusePort::closeSocket(socketDescriptor);
+            }
+            closeListeners(server);
+            return false;
+        }
+        if (!thread->listenForServer(server, socketDescriptor)) {
+            KDSoapReusePort::closeSocket(socketDescriptor);
+            closeListeners(server);
+            return false;
+        }
+    }
+    return true;
+}
+
+void KDSoapThreadPool::closeListeners(KDSoapServer *server)
+{
+    Q_FOREACH (KDSoapServerThread *thread, d->m_threads) {
+        thread->closeListenerForServer(server);
+    }
+}
+
+// Unlike the other methods, this one can be called from the threads of the pool (KDSoapServer::setMetricsPath)
+void KDSoapThreadPool::collectMetrics(const KDSoapServer *server, KDSoapServerMetrics &metrics) const
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    int connectedSockets = 0;
+    int totalConnections = 0;
+    Q_FOREACH (KDSoapServerThread *thread, d->m_threads) {
+        thread->collectMetricsForServer(server, metrics);
+        connectedSockets += thread->socketCountForServer(server);
+        totalConnections += thread->totalConnectionCountForServer(server);
+    }
+    metrics.setConnectionCounts(connectedSockets, totalConnections);
+}
+
 int KDSoapThreadPool::numConnectedSockets(const KDSoapServer *server) const
 {
     int sc = 0;
-    Q_FOREACH (KDSoapServerThread *thread, d->m_threads) {
+    Q_FOREACH (KDSoapServerThread *thread, d->threads()) {
         sc += thread->socketCountForServer(server);
     }
     return sc;
@@ -142,7 +251,7 @@ void KDSoapThreadPool::disconnectSockets(KDSoapServer *server)
 int KDSoapThreadPool::totalConnectionCount(const KDSoapServer *server) const
 {
     int sc = 0;
-    Q_FOREACH (KDSoapServerThread *thread, d->m_threads) {
+    Q_FOREACH (KDSoapServerThread *thread, d->threads()) {
         sc += thread->totalConnectionCountForServer(server);
     }
     return sc;
@@ -27,6 +27,11 @@
 #include <QtCore/QHash>
 #include "KDSoapServerGlobal.h"
 class KDSoapServer;
+class KDSoapServerCall;
+class KDSoapServerMetrics;
+QT_BEGIN_NAMESPACE
+class QHostAddress;
+QT_END_NAMESPACE
 
 /**
  * Pool of threads that can be used to handle SOAP requests in a SOAP server.
@@ -40,6 +45,32 @@ class KDSOAPSERVER_EXPORT KDSoapThreadPool : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * How the work is distributed over the threads.
+     * \since 1.7
+     */
+    enum SchedulingMode {
+        /**
+         * Each connection is assigned to a thread, which handles all the requests
+         * received on that connection. This is the default.
+         */
+        ConnectionScheduling,
+        /**
+         * The threads handling the connections only read and parse the requests.
+         * The SOAP calls themselves are made in a separate pool of worker threads,
+         * each one with its own server object, and idle workers take over calls
+         * queued for busy ones. This keeps all the cores busy even when a few
+         * connections send most of the requests.
+         *
+         * In the worker threads, KDSoapServerObjectInterface::serverSocket() returns null,
+         * and writeHTTP() or writeXML() cannot be used. Delayed responses are supported,
+         * sendDelayedResponse() must then be called from the worker thread.
+         * Authentication, file requests and raw XML requests are still handled by the
+         * server object of the connection thread.
+         */
+        RequestScheduling
+    };
+
     /**
      * Constructs a thread pool with the given \p parent.
      */
@@ -63,6 +94,35 @@ public:
      */
     int maxThreadCount() const;
 
+    /**
+     * Sets how the work is distributed over the threads.
+     * Must be called before the server starts handling connections.
+     * The default mode is ConnectionScheduling.
+     * \since 1.7
+     */
+    void setSchedulingMode(SchedulingMode mode);
+
+    /**
+     * Returns how the work is distributed over the threads.
+     * \since 1.7
+     */
+    SchedulingMode schedulingMode() const;
+
+    /**
+     * Sets the number of worker threads making the SOAP calls, in RequestScheduling mode.
+     * These come in addition to the (up to maxThreadCount()) threads handling the connections.
+     * Must be called before the server starts handling connections.
+     * The default workerThreadCount is QThread::idealThreadCount().
+     * \since 1.7
+     */
+    void setWorkerThreadCount(int workerThreadCount);
+
+    /**
+     * Returns the number of worker threads making the SOAP calls, in RequestScheduling mode.
+     * \since 1.7
+     */
+    int workerThreadCount() const;
+
     /**
      * Returns the number of connected sockets for a given server
      */
@@ -88,7 +148,12 @@ public:
 
 private:
     friend class KDSoapServer;
+    friend class KDSoapServerSocket;
     void handleIncomingConnection(int socketDescriptor, KDSoapServer *server);
+    bool listenWithReusePort(KDSoapServer *server, const QHostAddress &address, quint16 port);
+    void closeListeners(KDSoapServer *server);
+    void collectMetrics(const KDSoapServer *server, KDSoapServerMetrics &metrics) const;
+    void scheduleCall(KDSoapServerCall *call);
     class Private;
     Private *const d;
 };
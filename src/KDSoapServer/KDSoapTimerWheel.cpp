@@ -0,0 +1,118 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapTimerWheel_p.h"
+#include "KDSoapServerSocket_p.h"
+#include <QTimerEvent>
+
+KDSoapTimerWheel::KDSoapTimerWheel(QObject *parent)
+    : QObject(parent), m_currentTick(0), m_slots(SlotCount)
+{
+    m_clock.start();
+}
+
+KDSoapTimerWheel::~KDSoapTimerWheel()
+{
+}
+
+void KDSoapTimerWheel::schedule(KDSoapServerSocket *socket, int msecs)
+{
+    const qint64 now = m_clock.elapsed();
+    if (!m_timer.isActive()) {
+        m_currentTick = now / TickInterval;
+        m_timer.start(TickInterval, this);
+    }
+    const qint64 deadline = now + msecs;
+    const qint64 tick = deadline / TickInterval + 1; // the first tick after the deadline
+
+    Entries::iterator it = m_entries.find(socket);
+    if (it != m_entries.end()) {
+        it->deadline = deadline;
+        if (tick >= it->tick) {
+            return; // see timerEvent
+        }
+        m_slots[it->tick % SlotCount].remove(socket);
+        it->tick = tick;
+    } else {
+        const Entry entry = { deadline, tick };
+        m_entries.insert(socket, entry);
+    }
+    m_slots[tick % SlotCount].insert(socket);
+}
+
+void KDSoapTimerWheel::remove(KDSoapServerSocket *socket)
+{
+    Entries::iterator it = m_entries.find(socket);
+    if (it != m_entries.end()) {
+        m_slots[it->tick % SlotCount].remove(socket);
+        m_entries.erase(it);
+        if (m_entries.isEmpty()) {
+            m_timer.stop();
+        }
+    }
+}
+
+void KDSoapTimerWheel::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != m_timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    QVector<KDSoapServerSocket *> expired;
+    // Usually a single tick, unless the event loop was busy for a while
+    while (m_currentTick < now / TickInterval) {
+        ++m_currentTick;
+        Slot &slot = m_slots[m_currentTick % SlotCount];
+        Slot::iterator sit = slot.begin();
+        while (sit != slot.end()) {
+            Entry &entry = m_entries[*sit];
+            if (entry.tick > m_currentTick) { // for a later turn of the wheel
+                ++sit;
+                continue;
+            }
+            if (entry.deadline <= now) {
+                expired.append(*sit);
+                m_entries.remove(*sit);
+                sit = slot.erase(sit);
+                continue;
+            }
+            // The deadline was moved since the socket was put into this slot
+            entry.tick = entry.deadline / TickInterval + 1;
+            if (entry.tick % SlotCount == m_currentTick % SlotCount) {
+                ++sit;
+            } else {
+                m_slots[entry.tick % SlotCount].insert(*sit);
+                sit = slot.erase(sit);
+            }
+        }
+    }
+    if (m_entries.isEmpty()) {
+        m_timer.stop();
+    }
+
+    // Last, since the sockets could call schedule() or remove()
+    Q_FOREACH (KDSoapServerSocket *socket, expired) {
+        socket->timeout();
+    }
+}
@@ -0,0 +1,79 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPTIMERWHEEL_P_H
+#define KDSOAPTIMERWHEEL_P_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+class KDSoapServerSocket;
+
+/**
+ * A hashed timer wheel, for timeouts on a large number of sockets.
+ * One QTimer per socket, restarted on every bit of activity, would cost far more.
+ *
+ * The wheel has one slot per tick, and a single timer processes the slot of the current tick.
+ * Moving a deadline further away (the common case, on activity) only updates the deadline:
+ * the socket is moved to the right slot when its current slot comes up.
+ * \internal
+ */
+class KDSoapTimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    explicit KDSoapTimerWheel(QObject *parent = 0);
+    ~KDSoapTimerWheel();
+
+    /**
+     * Calls KDSoapServerSocket::timeout() on \p socket in \p msecs milliseconds
+     * (at most one tick later), unless schedule() or remove() are called again for it before that.
+     */
+    void schedule(KDSoapServerSocket *socket, int msecs);
+    void remove(KDSoapServerSocket *socket);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    enum {
+        TickInterval = 250, // msecs
+        SlotCount = 256     // ~ one minute per turn of the wheel
+    };
+    struct Entry {
+        qint64 deadline; // in msecs, see m_clock
+        qint64 tick;     // the tick of the slot the socket is in
+    };
+    typedef QHash<KDSoapServerSocket *, Entry> Entries;
+    typedef QSet<KDSoapServerSocket *> Slot;
+
+    QElapsedTimer m_clock;
+    QBasicTimer m_timer;
+    qint64 m_currentTick; // the last tick processed
+    Entries m_entries;
+    QVector<Slot> m_slots;
+};
+
+#endif // KDSOAPTIMERWHEEL_P_H
@@ -0,0 +1,350 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapTlsSessionCache_p.h"
+#include <QDateTime>
+#include <QDebug>
+#include <string.h>
+
+#ifdef KDSOAP_HAVE_TLS_SESSION_CACHE
+#include <QtCore/private/qobject_p.h>
+#include <QtNetwork/private/qsslsocket_openssl_p.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+#endif
+
+static const int s_maxSessionCount = 20000;
+
+static qint64 now()
+{
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+static int loadInt(const QAtomicInt &value)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+    return value.loadAcquire();
+#else
+    return int(value);
+#endif
+}
+
+#ifdef KDSOAP_HAVE_TLS_SESSION_CACHE
+
+// QSslSocket has no public API for its SSL object
+static SSL *sslHandle(QSslSocket *socket)
+{
+    return static_cast<QSslSocketBackendPrivate *>(QObjectPrivate::get(socket))->ssl;
+}
+
+// Where the SSL contexts point to their KDSoapTlsSessionCache.
+// Allocated by the first constructor, in the thread of the first server.
+static int contextDataIndex()
+{
+    static const int index = SSL_CTX_get_ex_new_index(0, 0, 0, 0, 0);
+    return index;
+}
+
+static KDSoapTlsSessionCache *cacheOf(SSL_CTX *context)
+{
+    return static_cast<KDSoapTlsSessionCache *>(SSL_CTX_get_ex_data(context, contextDataIndex()));
+}
+
+static KDSoapTlsSessionCache *cacheOf(SSL *ssl)
+{
+    return cacheOf(SSL_get_SSL_CTX(ssl));
+}
+
+static QByteArray sessionId(SSL_SESSION *session)
+{
+    unsigned int length;
+    const unsigned char *id = SSL_SESSION_get_id(session, &length);
+    return QByteArray(reinterpret_cast<const char *>(id), length);
+}
+
+static int newSessionCallback(SSL *ssl, SSL_SESSION *session)
+{
+    const int size = i2d_SSL_SESSION(session, 0);
+    if (size > 0) {
+        QByteArray data;
+        data.resize(size);
+        unsigned char *p = reinterpret_cast<unsigned char *>(data.data());
+        i2d_SSL_SESSION(session, &p);
+        cacheOf(ssl)->storeSession(sessionId(session), data);
+    }
+    return 0; // no reference kept to session
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+static SSL_SESSION *getSessionCallback(SSL *ssl, const unsigned char *id, int length, int *copy)
+#else
+static SSL_SESSION *getSessionCallback(SSL *ssl, unsigned char *id, int length, int *copy)
+#endif
+{
+    *copy = 0; // OpenSSL gets the only reference to the new session
+    const QByteArray data = cacheOf(ssl)->findSession(QByteArray(reinterpret_cast<const char *>(id), length));
+    if (data.isEmpty()) {
+        return 0;
+    }
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data.constData());
+    return d2i_SSL_SESSION(0, &p, data.size());
+}
+
+static void removeSessionCallback(SSL_CTX *context, SSL_SESSION *session)
+{
+    cacheOf(context)->removeSession(sessionId(session));
+}
+
+// RFC 5077: AES-256-CBC encryption of the ticket, HMAC-SHA256 authentication
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX KDSoapMacContext;
+static bool initMac(EVP_MAC_CTX *context, const KDSoapTlsSessionCache::TicketKey &key)
+{
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA256"), 0),
+        OSSL_PARAM_construct_end()
+    };
+    return EVP_MAC_init(context, key.hmacKey, sizeof(key.hmacKey), params) == 1;
+}
+#else
+typedef HMAC_CTX KDSoapMacContext;
+static bool initMac(HMAC_CTX *context, const KDSoapTlsSessionCache::TicketKey &key)
+{
+    return HMAC_Init_ex(context, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), 0) == 1;
+}
+#endif
+
+// Returns -1 on error, 0 if the ticket can't be decrypted (full handshake),
+// 1 if it can, 2 if it can but should be replaced with one encrypted with the current key
+static int ticketKeyCallback(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+                             EVP_CIPHER_CTX *cipherContext, KDSoapMacContext *macContext, int encrypt)
+{
+    KDSoapTlsSessionCache::TicketKey key;
+    if (encrypt) {
+        if (!cacheOf(ssl)->encryptionKey(&key) || RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+            return -1;
+        }
+        memcpy(keyName, key.name, sizeof(key.name));
+        if (EVP_EncryptInit_ex(cipherContext, EVP_aes_256_cbc(), 0, key.aesKey, iv) != 1 || !initMac(macContext, key)) {
+            return -1;
+        }
+        return 1;
+    }
+    bool renew;
+    if (!cacheOf(ssl)->decryptionKey(keyName, &key, &renew)) {
+        return 0; // expired key
+    }
+    if (!initMac(macContext, key) || EVP_DecryptInit_ex(cipherContext, EVP_aes_256_cbc(), 0, key.aesKey, iv) != 1) {
+        return -1;
+    }
+    return renew ? 2 : 1;
+}
+
+// The same for all the servers: a server only finds its own sessions anyway
+static const unsigned char s_sessionIdContext[] = "KDSoapServer";
+
+#endif // KDSOAP_HAVE_TLS_SESSION_CACHE
+
+KDSoapTlsSessionCache::KDSoapTlsSessionCache()
+    : m_available(false),
+      m_sessionLifetime(0),
+      m_ticketKeyLifetime(3600)
+{
+#ifdef KDSOAP_HAVE_TLS_SESSION_CACHE
+    // Our OpenSSL calls must go to the library which Qt loaded
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    const long linkedVersion = long(OpenSSL_version_num());
+#else
+    const long linkedVersion = long(SSLeay());
+#endif
+    m_available = QSslSocket::supportsSsl() && QSslSocket::sslLibraryVersionNumber() == linkedVersion;
+    if (m_available && qstrcmp(qVersion(), QT_VERSION_STR) != 0) {
+        // The layout of the private classes of QtNetwork can change in any release
+        qWarning() << "KDSoapServer: TLS session resumption disabled, built against Qt" << QT_VERSION_STR
+                   << "but running with Qt" << qVersion();
+        m_available = false;
+    } else if (m_available) {
+        contextDataIndex();
+    } else if (QSslSocket::supportsSsl()) {
+        qWarning() << "KDSoapServer: TLS session resumption disabled, Qt uses" << QSslSocket::sslLibraryVersionString()
+                   << "instead of" << OPENSSL_VERSION_TEXT;
+    }
+#endif
+}
+
+void KDSoapTlsSessionCache::setSessionLifetime(int seconds)
+{
+    m_sessionLifetime.fetchAndStoreRelaxed(seconds);
+}
+
+int KDSoapTlsSessionCache::sessionLifetime() const
+{
+    return m_available ? loadInt(m_sessionLifetime) : 0;
+}
+
+void KDSoapTlsSessionCache::setTicketKeyLifetime(int seconds)
+{
+    m_ticketKeyLifetime.fetchAndStoreRelaxed(seconds);
+}
+
+int KDSoapTlsSessionCache::ticketKeyLifetime() const
+{
+    return m_available ? loadInt(m_ticketKeyLifetime) : 0;
+}
+
+void KDSoapTlsSessionCache::setupSocket(QSslSocket *socket)
+{
+#ifdef KDSOAP_HAVE_TLS_SESSION_CACHE
+    if (!m_available) {
+        return;
+    }
+    SSL *ssl = sslHandle(socket);
+    if (!ssl) { // the SSL context couldn't be created, the handshake fails
+        return;
+    }
+    SSL_CTX *context = SSL_get_SSL_CTX(ssl);
+    const int lifetime = sessionLifetime();
+    if (lifetime <= 0) {
+        SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+        SSL_set_options(ssl, SSL_OP_NO_TICKET);
+        return;
+    }
+    SSL_CTX_set_ex_data(context, contextDataIndex(), this);
+    SSL_set_session_id_context(ssl, s_sessionIdContext, sizeof(s_sessionIdContext) - 1);
+    SSL_CTX_set_timeout(context, lifetime);
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(context, newSessionCallback);
+    SSL_CTX_sess_set_get_cb(context, getSessionCallback);
+    SSL_CTX_sess_set_remove_cb(context, removeSessionCallback);
+    if (ticketKeyLifetime() > 0) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(context, ticketKeyCallback);
+#else
+        SSL_CTX_set_tlsext_ticket_key_cb(context, ticketKeyCallback);
+#endif
+    } else {
+        SSL_set_options(ssl, SSL_OP_NO_TICKET);
+    }
+#else
+    Q_UNUSED(socket);
+#endif
+}
+
+bool KDSoapTlsSessionCache::isResumed(QSslSocket *socket) const
+{
+#ifdef KDSOAP_HAVE_TLS_SESSION_CACHE
+    if (m_available) {
+        SSL *ssl = sslHandle(socket);
+        return ssl && SSL_session_reused(ssl);
+    }
+#else
+    Q_UNUSED(socket);
+#endif
+    return false;
+}
+
+void KDSoapTlsSessionCache::storeSession(const QByteArray &id, const QByteArray &session)
+{
+    const qint64 currentTime = now();
+    QMutexLocker lock(&m_mutex);
+    // Forget the expired sessions, and the oldest ones if there are too many
+    while (!m_sessionOrder.isEmpty()) {
+        const QHash<QByteArray, Session>::iterator it = m_sessions.find(m_sessionOrder.head());
+        if (it != m_sessions.end()) {
+            if (it.value().expiry > currentTime && m_sessions.count() < s_maxSessionCount) {
+                break;
+            }
+            m_sessions.erase(it);
+        }
+        m_sessionOrder.dequeue();
+    }
+    const Session entry = { session, currentTime + qint64(loadInt(m_sessionLifetime)) * 1000 };
+    m_sessions.insert(id, entry);
+    m_sessionOrder.enqueue(id);
+}
+
+QByteArray KDSoapTlsSessionCache::findSession(const QByteArray &id) const
+{
+    QMutexLocker lock(&m_mutex);
+    const QHash<QByteArray, Session>::const_iterator it = m_sessions.constFind(id);
+    if (it == m_sessions.constEnd() || it.value().expiry <= now()) {
+        return QByteArray();
+    }
+    return it.value().data;
+}
+
+void KDSoapTlsSessionCache::removeSession(const QByteArray &id)
+{
+    QMutexLocker lock(&m_mutex);
+    m_sessions.remove(id); // and later from m_sessionOrder, by storeSession
+}
+
+bool KDSoapTlsSessionCache::encryptionKey(TicketKey *key)
+{
+    const qint64 currentTime = now();
+    const qint64 keyLifetime = qint64(loadInt(m_ticketKeyLifetime)) * 1000;
+    QMutexLocker lock(&m_mutex);
+    if (m_ticketKeys.isEmpty() || m_ticketKeys.first().created + keyLifetime <= currentTime) {
+#ifdef KDSOAP_HAVE_TLS_SESSION_CACHE
+        TicketKey newKey;
+        if (RAND_bytes(newKey.name, sizeof(newKey.name)) != 1 || RAND_bytes(newKey.aesKey, sizeof(newKey.aesKey)) != 1
+                || RAND_bytes(newKey.hmacKey, sizeof(newKey.hmacKey)) != 1) {
+            return false;
+        }
+        newKey.created = currentTime;
+        m_ticketKeys.prepend(newKey);
+#else
+        return false;
+#endif
+        // The previous keys decrypt the tickets they encrypted, until these expire
+        const qint64 sessionLifetime = qint64(loadInt(m_sessionLifetime)) * 1000;
+        while (m_ticketKeys.count() > 1 && m_ticketKeys.last().created + keyLifetime + sessionLifetime <= currentTime) {
+            m_ticketKeys.pop_back();
+        }
+    }
+    *key = m_ticketKeys.first();
+    return true;
+}
+
+bool KDSoapTlsSessionCache::decryptionKey(const unsigned char *name, TicketKey *key, bool *renew) const
+{
+    const qint64 currentTime = now();
+    const qint64 maxAge = qint64(loadInt(m_ticketKeyLifetime) + loadInt(m_sessionLifetime)) * 1000;
+    QMutexLocker lock(&m_mutex);
+    for (int i = 0; i < m_ticketKeys.count(); ++i) {
+        const TicketKey &ticketKey = m_ticketKeys.at(i);
+        if (memcmp(ticketKey.name, name, sizeof(ticketKey.name)) == 0) {
+            if (ticketKey.created + maxAge <= currentTime) {
+                return false;
+            }
+            *key = ticketKey;
+            *renew = i > 0;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPTLSSESSIONCACHE_P_H
+#define KDSOAPTLSSESSIONCACHE_P_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QSslSocket;
+QT_END_NAMESPACE
+
+/**
+ * \internal
+ * TLS session resumption for the sockets of a KDSoapServer, in all its threads.
+ *
+ * QSslSocket creates an SSL context per socket, so the session cache and the session ticket keys
+ * of OpenSSL only cover one connection. setupSocket() installs callbacks on the context of each
+ * socket, right after startServerEncryption(), which use the sessions (for session IDs) and the
+ * rotating ticket keys (for session tickets) of this object, shared by all the sockets of the server.
+ *
+ * Only available if KD SOAP was built with the KDSoap_TLS_SESSION_CACHE option, which needs OpenSSL
+ * and the private API of QtNetwork (KDSOAP_HAVE_TLS_SESSION_CACHE), and if the same Qt version and
+ * OpenSSL library are used at runtime.
+ * Otherwise isAvailable() returns false, and every handshake is a full one.
+ */
+class KDSoapTlsSessionCache
+{
+public:
+    KDSoapTlsSessionCache();
+
+    bool isAvailable() const
+    {
+        return m_available;
+    }
+
+    // Can be called from any thread
+    void setSessionLifetime(int seconds);
+    int sessionLifetime() const;
+    void setTicketKeyLifetime(int seconds);
+    int ticketKeyLifetime() const;
+
+    // Called in the thread of the socket
+    void setupSocket(QSslSocket *socket);
+    bool isResumed(QSslSocket *socket) const;
+
+    // Called by the OpenSSL callbacks, from any thread
+    struct TicketKey {
+        unsigned char name[16];
+        unsigned char aesKey[32];
+        unsigned char hmacKey[32];
+        qint64 created; // msecs since epoch
+    };
+    void storeSession(const QByteArray &id, const QByteArray &session);
+    QByteArray findSession(const QByteArray &id) const;
+    void removeSession(const QByteArray &id);
+    bool encryptionKey(TicketKey *key);
+    bool decryptionKey(const unsigned char *name, TicketKey *key, bool *renew) const;
+
+private:
+    Q_DISABLE_COPY(KDSoapTlsSessionCache)
+    struct Session {
+        QByteArray data; // DER
+        qint64 expiry; // msecs since epoch
+    };
+
+    bool m_available;
+    QAtomicInt m_sessionLifetime;
+    QAtomicInt m_ticketKeyLifetime;
+    mutable QMutex m_mutex; // for the rest
+    QHash<QByteArray, Session> m_sessions; // by session ID
+    QQueue<QByteArray> m_sessionOrder; // the session IDs, oldest first: they all have the same lifetime
+    QVector<TicketKey> m_ticketKeys; // newest first, the first one encrypts the new tickets
+};
+
+#endif // KDSOAPTLSSESSIONCACHE_P_H
@@ -0,0 +1,209 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapWorkerPool_p.h"
+#include "KDSoapServerCall_p.h"
+#include "KDSoapServer.h"
+
+KDSoapWorker::KDSoapWorker(KDSoapWorkerPool *pool, KDSoapWorkerThread *thread)
+    : QObject(0), m_pool(pool), m_thread(thread)
+{
+}
+
+KDSoapWorker::~KDSoapWorker()
+{
+    qDeleteAll(m_serverObjects.values());
+}
+
+// Called in the thread itself so that the server objects are created in the thread.
+QObject *KDSoapWorker::serverObject(KDSoapServer *server)
+{
+    QObject *&serverObject = m_serverObjects[server];
+    if (!serverObject) {
+        serverObject = server->createServerObject();
+        Q_ASSERT(serverObject);
+    }
+    return serverObject;
+}
+
+void KDSoapWorker::processCalls()
+{
+    KDSoapServerCall *call = m_pool->takeCall(m_thread);
+    if (!call) {
+        // Look again once marked as idle, a call might have been queued in the meantime
+        // without waking us up (see KDSoapWorkerPool::schedule).
+        m_thread->setIdle();
+        call = m_pool->takeCall(m_thread);
+        if (!call) {
+            return;
+        }
+        // Unless schedule() claimed us first (then it also posted a wake-up, which won't find anything)
+        m_thread->claimIfIdle();
+    }
+
+    call->run(serverObject(call->server()));
+
+    // One call at a time, so that the events of the server objects (timers, network replies
+    // for delayed responses...) are processed in between.
+    QMetaObject::invokeMethod(this, "processCalls", Qt::QueuedConnection);
+}
+
+void KDSoapWorker::quit()
+{
+    thread()->quit();
+}
+
+////
+
+KDSoapWorkerThread::KDSoapWorkerThread(KDSoapWorkerPool *pool)
+    : QThread(0), m_pool(pool), d(0), m_idle(1)
+{
+}
+
+KDSoapWorkerThread::~KDSoapWorkerThread()
+{
+}
+
+void KDSoapWorkerThread::run()
+{
+    KDSoapWorker worker(m_pool, this);
+    d = &worker;
+    m_semaphore.release();
+    exec();
+    d = 0;
+}
+
+void KDSoapWorkerThread::startThread()
+{
+    QThread::start();
+    m_semaphore.acquire(); // wait for init to be done
+}
+
+void KDSoapWorkerThread::quitThread()
+{
+    QMetaObject::invokeMethod(d, "quit");
+}
+
+void KDSoapWorkerThread::enqueue(KDSoapServerCall *call)
+{
+    QMutexLocker lock(&m_mutex);
+    m_calls.enqueue(call);
+}
+
+KDSoapServerCall *KDSoapWorkerThread::takeFirst()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_calls.isEmpty() ? 0 : m_calls.dequeue();
+}
+
+KDSoapServerCall *KDSoapWorkerThread::takeLast()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_calls.isEmpty() ? 0 : m_calls.takeLast();
+}
+
+void KDSoapWorkerThread::setIdle()
+{
+    m_idle.fetchAndStoreOrdered(1);
+}
+
+// Returns true if the thread was idle; it isn't anymore, and the caller has to wake it up.
+bool KDSoapWorkerThread::claimIfIdle()
+{
+    return m_idle.testAndSetOrdered(1, 0);
+}
+
+void KDSoapWorkerThread::wakeUp()
+{
+    QMetaObject::invokeMethod(d, "processCalls", Qt::QueuedConnection);
+}
+
+////
+
+KDSoapWorkerPool::KDSoapWorkerPool(int threadCount)
+    : m_nextThread(0)
+{
+    m_threads.resize(qMax(1, threadCount));
+    for (int i = 0; i < m_threads.count(); ++i) {
+        m_threads[i] = new KDSoapWorkerThread(this);
+        m_threads[i]->startThread();
+    }
+}
+
+KDSoapWorkerPool::~KDSoapWorkerPool()
+{
+    // ask all threads to finish, then delete them all
+    Q_FOREACH (KDSoapWorkerThread *thread, m_threads) {
+        thread->quitThread();
+    }
+    Q_FOREACH (KDSoapWorkerThread *thread, m_threads) {
+        thread->wait();
+    }
+    // The calls which no thread took anymore: nothing else references them yet
+    Q_FOREACH (KDSoapWorkerThread *thread, m_threads) {
+        while (KDSoapServerCall *call = thread->takeFirst()) {
+            delete call;
+        }
+        delete thread;
+    }
+}
+
+void KDSoapWorkerPool::schedule(KDSoapServerCall *call)
+{
+    const int count = m_threads.count();
+    const int start = (m_nextThread.fetchAndAddRelaxed(1) & 0x7fffffff) % count;
+
+    // Prefer an idle thread
+    for (int i = 0; i < count; ++i) {
+        KDSoapWorkerThread *thread = m_threads.at((start + i) % count);
+        if (thread->claimIfIdle()) {
+            thread->enqueue(call);
+            thread->wakeUp();
+            return;
+        }
+    }
+
+    // All threads are busy: the first one running out of work will take it, or steal it.
+    KDSoapWorkerThread *thread = m_threads.at(start);
+    thread->enqueue(call);
+    if (thread->claimIfIdle()) { // went idle in the meantime, without seeing the call
+        thread->wakeUp();
+    }
+}
+
+KDSoapServerCall *KDSoapWorkerPool::takeCall(KDSoapWorkerThread *thread)
+{
+    KDSoapServerCall *call = thread->takeFirst();
+    if (call) {
+        return call;
+    }
+    // Steal work from the other threads
+    const int count = m_threads.count();
+    const int index = m_threads.indexOf(thread);
+    for (int i = 1; i < count; ++i) {
+        call = m_threads.at((index + i) % count)->takeLast();
+        if (call) {
+            return call;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPWORKERPOOL_P_H
+#define KDSOAPWORKERPOOL_P_H
+
+#include <QThread>
+#include <QSemaphore>
+#include <QMutex>
+#include <QQueue>
+#include <QHash>
+#include <QVector>
+class KDSoapServer;
+class KDSoapServerCall;
+class KDSoapWorkerPool;
+class KDSoapWorkerThread;
+
+// Lives in the worker thread, and owns the server objects used by it.
+class KDSoapWorker : public QObject
+{
+    Q_OBJECT
+public:
+    KDSoapWorker(KDSoapWorkerPool *pool, KDSoapWorkerThread *thread);
+    ~KDSoapWorker();
+
+public Q_SLOTS:
+    void processCalls();
+    void quit();
+
+private:
+    QObject *serverObject(KDSoapServer *server);
+
+    KDSoapWorkerPool *m_pool;
+    KDSoapWorkerThread *m_thread;
+    QHash<KDSoapServer *, QObject *> m_serverObjects;
+};
+
+class KDSoapWorkerThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit KDSoapWorkerThread(KDSoapWorkerPool *pool);
+    ~KDSoapWorkerThread();
+
+    void startThread();
+    void quitThread();
+
+    // The queue of the thread: the thread itself takes the oldest call,
+    // other threads steal the most recent one, from the other end.
+    void enqueue(KDSoapServerCall *call);
+    KDSoapServerCall *takeFirst();
+    KDSoapServerCall *takeLast();
+
+    void setIdle();
+    bool claimIfIdle();
+    void wakeUp();
+
+protected:
+    virtual void run();
+
+private:
+    void start(); // use startThread instead
+    void quit(); // use quitThread instead
+    KDSoapWorkerPool *m_pool;
+    KDSoapWorker *d;
+    QSemaphore m_semaphore;
+    QMutex m_mutex;
+    QQueue<KDSoapServerCall *> m_calls;
+    QAtomicInt m_idle;
+};
+
+// Executes the SOAP calls parsed by the socket threads, in KDSoapThreadPool::RequestScheduling mode.
+class KDSoapWorkerPool
+{
+public:
+    explicit KDSoapWorkerPool(int threadCount);
+    ~KDSoapWorkerPool();
+
+    // Called from the socket threads
+    void schedule(KDSoapServerCall *call);
+
+    // Called from the worker threads
+    KDSoapServerCall *takeCall(KDSoapWorkerThread *thread);
+
+private:
+    QVector<KDSoapWorkerThread *> m_threads;
+    QAtomicInt m_nextThread;
+};
+
+#endif // KDSOAPWORKERPOOL_P_H
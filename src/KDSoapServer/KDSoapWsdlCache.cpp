@@ -0,0 +1,166 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapWsdlCache_p.h"
+#include "KDSoapCompression_p.h"
+#include "KDSoapFileResponse_p.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QMutexLocker>
+
+KDSoapWsdlCache::KDSoapWsdlCache(QObject *parent)
+    : QObject(parent),
+      m_watcher(0)
+{
+}
+
+void KDSoapWsdlCache::setFile(const QString &fileName, const QString &pathInUrl)
+{
+    const DocumentPtr document = load(fileName, pathInUrl);
+    {
+        QMutexLocker lock(&m_mutex);
+        m_fileName = fileName;
+        m_pathInUrl = pathInUrl;
+        m_document = document;
+    }
+    // The watcher can only be used from our own thread
+    QMetaObject::invokeMethod(this, "watchFile");
+}
+
+KDSoapWsdlCache::DocumentPtr KDSoapWsdlCache::document() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_document;
+}
+
+void KDSoapWsdlCache::watchFile()
+{
+    if (!m_watcher) {
+        m_watcher = new QFileSystemWatcher(this);
+        connect(m_watcher, SIGNAL(fileChanged(QString)), this, SLOT(slotFileChanged()));
+        connect(m_watcher, SIGNAL(directoryChanged(QString)), this, SLOT(slotDirectoryChanged()));
+    }
+    QString fileName;
+    {
+        QMutexLocker lock(&m_mutex);
+        fileName = m_fileName;
+    }
+    QStringList paths;
+    if (!fileName.isEmpty()) {
+        if (QFile::exists(fileName)) {
+            paths.append(fileName);
+        }
+        const QString directory = QFileInfo(fileName).absolutePath();
+        if (QFileInfo(directory).isDir()) {
+            paths.append(directory);
+        }
+    }
+    const QStringList watchedPaths = m_watcher->files() + m_watcher->directories();
+    Q_FOREACH (const QString &path, watchedPaths) {
+        if (!paths.contains(path)) {
+            m_watcher->removePath(path);
+        }
+    }
+    Q_FOREACH (const QString &path, paths) {
+        if (!watchedPaths.contains(path)) {
+            m_watcher->addPath(path);
+        }
+    }
+}
+
+void KDSoapWsdlCache::slotFileChanged()
+{
+    reload();
+    // Editors often replace the file rather than modifying it, which stops the watching
+    watchFile();
+}
+
+// The changes of the file itself are reported by slotFileChanged, only its creation or deletion matters
+void KDSoapWsdlCache::slotDirectoryChanged()
+{
+    QString fileName;
+    bool loaded;
+    {
+        QMutexLocker lock(&m_mutex);
+        fileName = m_fileName;
+        loaded = !m_document.isNull();
+    }
+    const bool exists = QFile::exists(fileName);
+    if (exists != m_watcher->files().contains(fileName) || exists != loaded) {
+        reload();
+        watchFile();
+    }
+}
+
+void KDSoapWsdlCache::reload()
+{
+    QString fileName;
+    QString pathInUrl;
+    {
+        QMutexLocker lock(&m_mutex);
+        fileName = m_fileName;
+        pathInUrl = m_pathInUrl;
+    }
+    const DocumentPtr document = load(fileName, pathInUrl);
+    QMutexLocker lock(&m_mutex);
+    if (m_fileName == fileName) { // unless setFile was called meanwhile
+        m_document = document;
+    }
+}
+
+static void setupRepresentation(KDSoapWsdlCache::Representation &representation, const QByteArray &contents,
+                                const QByteArray &etag, const QByteArray &lastModified, const QByteArray &extraHeaders)
+{
+    representation.contents = contents;
+    representation.etag = etag;
+    const QByteArray validators = "ETag: " + etag + "\r\nLast-Modified: " + lastModified + "\r\n" + extraHeaders;
+    representation.headers = "HTTP/1.1 200 OK\r\nContent-Type: application/xml\r\nContent-Length: "
+                             + QByteArray::number(contents.size()) + "\r\n" + validators;
+    representation.notModifiedHeaders = "HTTP/1.1 304 Not Modified\r\n" + validators;
+}
+
+KDSoapWsdlCache::DocumentPtr KDSoapWsdlCache::load(const QString &fileName, const QString &pathInUrl)
+{
+    QFile file(fileName);
+    if (fileName.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return DocumentPtr();
+    }
+    const QByteArray contents = file.readAll();
+    Document *document = new Document;
+    document->pathInUrl = pathInUrl;
+    document->lastModified = QDateTime::fromTime_t(QFileInfo(file).lastModified().toTime_t()).toUTC();
+    const QByteArray lastModified = KDSoapFileResponse::httpDate(document->lastModified);
+
+    // Strong validators: they change whenever the contents change, and differ between the two representations
+    const QByteArray hash = QCryptographicHash::hash(contents, QCryptographicHash::Sha1).toHex().left(20);
+    const QByteArray gzipContents = KDSoapCompression::compress(contents, KDSoapCompression::Gzip, 9);
+    if (!gzipContents.isEmpty() && gzipContents.size() < contents.size()) {
+        setupRepresentation(document->identity, contents, '"' + hash + '"', lastModified, "Vary: Accept-Encoding\r\n");
+        setupRepresentation(document->gzip, gzipContents, "\"" + hash + "-gzip\"", lastModified,
+                            "Vary: Accept-Encoding\r\nContent-Encoding: gzip\r\n");
+    } else {
+        setupRepresentation(document->identity, contents, '"' + hash + '"', lastModified, QByteArray());
+    }
+    return DocumentPtr(document);
+}
@@ -0,0 +1,84 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#ifndef KDSOAPWSDLCACHE_P_H
+#define KDSOAPWSDLCACHE_P_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QFileSystemWatcher;
+QT_END_NAMESPACE
+
+/**
+ * The WSDL file set with KDSoapServer::setWsdlFile, loaded once and kept in memory along with
+ * everything needed to answer a download: the response headers, a gzip-compressed variant and
+ * strong entity tags. A file watcher reloads it whenever the file changes on disk; its directory
+ * is watched as well, for a file which doesn't exist yet, or which is deleted and created again.
+ */
+class KDSoapWsdlCache : public QObject
+{
+    Q_OBJECT
+public:
+    // One way to send the document: as is, or compressed
+    struct Representation {
+        QByteArray contents; // empty for the gzip variant, if KD SOAP was built without zlib
+        QByteArray etag;
+        QByteArray headers; // up to the connection headers
+        QByteArray notModifiedHeaders; // same, for the 304 response
+    };
+    struct Document {
+        QString pathInUrl;
+        QDateTime lastModified; // UTC, second precision
+        Representation identity;
+        Representation gzip;
+    };
+    typedef QSharedPointer<const Document> DocumentPtr;
+
+    explicit KDSoapWsdlCache(QObject *parent = 0);
+
+    // Can be called from any thread
+    void setFile(const QString &fileName, const QString &pathInUrl);
+    DocumentPtr document() const;
+
+private Q_SLOTS:
+    void watchFile();
+    void slotFileChanged();
+    void slotDirectoryChanged();
+
+private:
+    static DocumentPtr load(const QString &fileName, const QString &pathInUrl);
+    void reload();
+
+    mutable QMutex m_mutex;
+    QString m_fileName;
+    QString m_pathInUrl;
+    DocumentPtr m_document;
+    QFileSystemWatcher *m_watcher; // created on demand, only used from the thread of this object
+};
+
+#endif // KDSOAPWSDLCACHE_P_H
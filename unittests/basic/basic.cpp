@@ -23,6 +23,11 @@
 
 #include "KDSoapValue.h"
 #include "KDDateTime.h"
+#include "KDSoapMessage.h"
+#include "KDSoapNamespaceManager.h"
+#include "KDSoapClient/KDSoapMessageWriter_p.h"
+#include "KDSoapClient/KDSoapMessageReader_p.h"
+#include "KDSoapClient/KDSoapObjectPool_p.h"
 #include <QtTest/QtTest>
 
 class Basic : public QObject
@@ -65,6 +70,109 @@ private Q_SLOTS:
         kdt.setTimeZone(QString::fromLatin1("+01:00"));
         QCOMPARE(kdt.toDateString(), QString::fromLatin1("2011-03-15T23:59:59.999+01:00"));
     }
+
+    // Once warmed up, parsing the same message again must not allocate any value or message data
+    void testObjectPool()
+    {
+        const QByteArray xml =
+            "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+            "<soap:Header><n1:SessionElement xmlns:n1=\"http://www.kdab.com/xml/MyWsdl/\"><n1:sessionId>42</n1:sessionId></n1:SessionElement></soap:Header>"
+            "<soap:Body><n1:getEmployeeCountry xmlns:n1=\"http://www.kdab.com/xml/MyWsdl/\">"
+            "<employeeName>David Faure</employeeName><team><member>Kevin</member><member>Thomas</member></team>"
+            "</n1:getEmployeeCountry></soap:Body></soap:Envelope>";
+        KDSoapMessageReader reader;
+        for (int i = 0; i < 2; ++i) {
+            KDSoapMessage message;
+            KDSoapHeaders headers;
+            QCOMPARE(reader.xmlToMessage(xml, &message, 0, &headers), KDSoapMessageReader::NoError);
+        }
+        const int heapAllocations = KDSoapObjectPool::heapAllocationCount();
+        for (int i = 0; i < 100; ++i) {
+            KDSoapMessage message;
+            KDSoapHeaders headers;
+            QCOMPARE(reader.xmlToMessage(xml, &message, 0, &headers), KDSoapMessageReader::NoError);
+            QCOMPARE(message.childValues().child(QString::fromLatin1("team")).childValues().count(), 2);
+        }
+        QCOMPARE(KDSoapObjectPool::heapAllocationCount(), heapAllocations);
+
+        KDSoapObjectPool pool(2);
+        void *blocks[3];
+        for (int i = 0; i < 3; ++i) {
+            blocks[i] = pool.allocate(sizeof(KDSoapValue));
+        }
+        for (int i = 0; i < 3; ++i) {
+            pool.release(blocks[i], sizeof(KDSoapValue));
+        }
+        QCOMPARE(pool.freeBlockCount(), 2); // the third one was freed
+        const int poolAllocations = KDSoapObjectPool::heapAllocationCount();
+        pool.release(pool.allocate(sizeof(KDSoapValue)), sizeof(KDSoapValue));
+        QCOMPARE(KDSoapObjectPool::heapAllocationCount(), poolAllocations);
+
+        // Blocks of another size than the first one are never recycled
+        const size_t biggerSize = 2 * sizeof(KDSoapValue) + 64;
+        void *bigBlock = pool.allocate(biggerSize);
+        QVERIFY(bigBlock != blocks[0] && bigBlock != blocks[1]);
+        QCOMPARE(pool.freeBlockCount(), 2);
+        QCOMPARE(KDSoapObjectPool::heapAllocationCount(), poolAllocations + 1);
+        pool.release(bigBlock, biggerSize);
+        QCOMPARE(pool.freeBlockCount(), 2);
+    }
+
+    void testMessageStreamWriter_data()
+    {
+        QTest::addColumn<int>("chunkSize");
+        QTest::newRow("1") << 1;
+        QTest::newRow("50") << 50;
+        QTest::newRow("large") << 100000;
+    }
+
+    // The streamed XML must be identical to the one from messageToXml
+    void testMessageStreamWriter()
+    {
+        QFETCH(int, chunkSize);
+        const QString ns = QString::fromLatin1("http://www.kdab.com/xml/MyWsdl/");
+        KDSoapMessage message;
+        message.setUse(KDSoapMessage::EncodedUse);
+        message.addArgument(QString::fromLatin1("employeeName"), QString::fromLatin1("David Faure & co"),
+                            KDSoapNamespaceManager::xmlSchema2001(), QString::fromLatin1("string"));
+        KDSoapValueList array;
+        array.setArrayType(KDSoapNamespaceManager::xmlSchema2001(), QString::fromLatin1("int"));
+        for (int i = 0; i < 10; ++i) {
+            array.addArgument(QString::fromLatin1("item"), i);
+        }
+        array.attributes().append(KDSoapValue(QString::fromLatin1("id"), QString::fromLatin1("a1")));
+        message.addArgument(QString::fromLatin1("numbers"), array, ns, QString::fromLatin1("ArrayOfInt"));
+        message.addArgument(QString::fromLatin1("empty"), QVariant());
+
+        KDSoapMessage header;
+        header.addArgument(QString::fromLatin1("sessionId"), QString::fromLatin1("42"));
+        KDSoapHeaders headers;
+        headers.append(header);
+        QMap<QString, KDSoapMessage> persistentHeaders;
+
+        KDSoapMessageWriter msgWriter;
+        msgWriter.setMessageNamespace(ns);
+        const QByteArray expected = msgWriter.messageToXml(message, QString::fromLatin1("getEmployee"), headers, persistentHeaders);
+
+        KDSoapMessageStreamWriter streamWriter(msgWriter, message, QString::fromLatin1("getEmployee"), headers, persistentHeaders);
+        QByteArray streamed;
+        int chunks = 0;
+        while (!streamWriter.atEnd()) {
+            const QByteArray chunk = streamWriter.next(chunkSize);
+            QVERIFY(!chunk.isEmpty());
+            if (!streamWriter.atEnd()) {
+                QVERIFY(chunk.size() >= chunkSize);
+            }
+            streamed += chunk;
+            ++chunks;
+        }
+        QCOMPARE(QString::fromUtf8(streamed), QString::fromUtf8(expected));
+        if (chunkSize > expected.size()) {
+            QCOMPARE(chunks, 1);
+        } else {
+            QVERIFY(chunks > 1);
+        }
+    }
 };
 
 QTEST_MAIN(Basic)
@@ -0,0 +1,223 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+
+#include "KDSoapCompression_p.h"
+#include <QtTest/QtTest>
+
+// A typical response: many similar elements
+static QByteArray soapResponse(int count)
+{
+    QByteArray response = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body>"
+                          "<n1:getEmployeesResponse xmlns:n1=\"http://www.kdab.com/xml/MyWsdl/\">";
+    for (int i = 0; i < count; ++i) {
+        response += "<employee><name>Employee " + QByteArray::number(i) + "</name><country>France</country>"
+                    "<salary>" + QByteArray::number(30000 + (i * 7919) % 20000) + "</salary></employee>";
+    }
+    response += "</n1:getEmployeesResponse></soap:Body></soap:Envelope>";
+    return response;
+}
+
+// Decompresses the data, fed in chunks of chunkSize bytes
+static bool inflateData(KDSoapCompression::Encoding encoding, const QByteArray &data, int chunkSize, QByteArray &output)
+{
+    KDSoapInflater inflater;
+    if (!inflater.start(encoding)) {
+        return false;
+    }
+    for (int pos = 0; pos < data.size(); pos += chunkSize) {
+        if (!inflater.inflate(data.constData() + pos, qMin(chunkSize, data.size() - pos), output)) {
+            return false;
+        }
+    }
+    return inflater.isFinished();
+}
+
+class CompressionTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        if (!KDSoapCompression::isSupported()) {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+            QSKIP("KD SOAP was built without zlib");
+#else
+            QSKIP("KD SOAP was built without zlib", SkipAll);
+#endif
+        }
+    }
+
+    void testNegotiate_data()
+    {
+        QTest::addColumn<QByteArray>("acceptEncoding");
+        QTest::addColumn<int>("expectedEncoding");
+
+        QTest::newRow("none") << QByteArray() << int(KDSoapCompression::Identity);
+        QTest::newRow("identity") << QByteArray("identity") << int(KDSoapCompression::Identity);
+        QTest::newRow("qnam") << QByteArray("gzip, deflate") << int(KDSoapCompression::Gzip);
+        QTest::newRow("deflate") << QByteArray("deflate") << int(KDSoapCompression::Deflate);
+        QTest::newRow("x-gzip") << QByteArray("X-GZIP") << int(KDSoapCompression::Gzip);
+        QTest::newRow("quality") << QByteArray("gzip;q=0.5, deflate;q=1.0") << int(KDSoapCompression::Deflate);
+        QTest::newRow("gzip_refused") << QByteArray("gzip;q=0, deflate") << int(KDSoapCompression::Deflate);
+        QTest::newRow("all_refused") << QByteArray("gzip;q=0, *;q=0") << int(KDSoapCompression::Identity);
+        QTest::newRow("star") << QByteArray("*") << int(KDSoapCompression::Gzip);
+        QTest::newRow("unknown") << QByteArray("br, compress") << int(KDSoapCompression::Identity);
+    }
+
+    void testNegotiate()
+    {
+        QFETCH(QByteArray, acceptEncoding);
+        QFETCH(int, expectedEncoding);
+        QCOMPARE(int(KDSoapCompression::negotiate(acceptEncoding)), expectedEncoding);
+    }
+
+    void testEncodingFromHeader()
+    {
+        QCOMPARE(KDSoapCompression::encodingFromHeader(QByteArray()), KDSoapCompression::Identity);
+        QCOMPARE(KDSoapCompression::encodingFromHeader(" gzip "), KDSoapCompression::Gzip);
+        QCOMPARE(KDSoapCompression::encodingFromHeader("Deflate"), KDSoapCompression::Deflate);
+        QCOMPARE(KDSoapCompression::encodingFromHeader("br"), KDSoapCompression::Unsupported);
+    }
+
+    void testRoundTrip_data()
+    {
+        QTest::addColumn<int>("encoding");
+        QTest::addColumn<int>("chunkSize");
+
+        QTest::newRow("gzip") << int(KDSoapCompression::Gzip) << 100000;
+        QTest::newRow("gzip_chunks") << int(KDSoapCompression::Gzip) << 7;
+        QTest::newRow("deflate") << int(KDSoapCompression::Deflate) << 100000;
+        QTest::newRow("deflate_bytes") << int(KDSoapCompression::Deflate) << 1;
+    }
+
+    void testRoundTrip()
+    {
+        QFETCH(int, encoding);
+        QFETCH(int, chunkSize);
+        const KDSoapCompression::Encoding enc = static_cast<KDSoapCompression::Encoding>(encoding);
+        const QByteArray data = soapResponse(200);
+        const QByteArray compressed = KDSoapCompression::compress(data, enc, 6);
+        QVERIFY(!compressed.isEmpty());
+        QVERIFY(compressed.size() * 10 < data.size());
+        if (enc == KDSoapCompression::Gzip) {
+            QVERIFY(compressed.startsWith("\x1f\x8b"));
+        }
+        QByteArray output;
+        QVERIFY(inflateData(enc, compressed, chunkSize, output));
+        QCOMPARE(output, data);
+    }
+
+    void testRawDeflate()
+    {
+        // Some clients send raw deflate data instead of the zlib format
+        const QByteArray data = soapResponse(10);
+        const QByteArray zlibData = KDSoapCompression::compress(data, KDSoapCompression::Deflate, 6);
+        const QByteArray rawData = zlibData.mid(2, zlibData.size() - 6); // without header and checksum
+        QByteArray output;
+        QVERIFY(inflateData(KDSoapCompression::Deflate, rawData, 100, output));
+        QCOMPARE(output, data);
+    }
+
+    void testInvalidData()
+    {
+        QByteArray compressed = KDSoapCompression::compress(soapResponse(10), KDSoapCompression::Gzip, 6);
+        QByteArray output;
+        // Truncated
+        QVERIFY(!inflateData(KDSoapCompression::Gzip, compressed.left(compressed.size() / 2), 100, output));
+        // Garbage
+        compressed[20] = char(~compressed.at(20));
+        compressed[21] = char(~compressed.at(21));
+        output.clear();
+        QVERIFY(!inflateData(KDSoapCompression::Gzip, compressed, 100, output));
+        QVERIFY(!inflateData(KDSoapCompression::Gzip, "not compressed", 100, output));
+        KDSoapInflater inflater;
+        QVERIFY(!inflater.start(KDSoapCompression::Unsupported));
+    }
+
+    void testMaxOutputSize()
+    {
+        // 10 MB of zeros compress to about 10 KB
+        const QByteArray data(10 * 1024 * 1024, '\0');
+        const QByteArray compressed = KDSoapCompression::compress(data, KDSoapCompression::Gzip, 9);
+        QVERIFY(compressed.size() < 20000);
+
+        KDSoapInflater inflater;
+        inflater.setMaxOutputSize(100000);
+        QVERIFY(inflater.start(KDSoapCompression::Gzip));
+        QByteArray output;
+        QVERIFY(!inflater.inflate(compressed.constData(), compressed.size(), output));
+        QVERIFY(inflater.isTooLarge());
+        QVERIFY(output.size() <= 100000); // stopped early
+        QVERIFY(!inflater.inflate(compressed.constData(), 0, output));
+
+        // The limit applies to each stream
+        inflater.setMaxOutputSize(data.size());
+        QVERIFY(inflater.start(KDSoapCompression::Gzip));
+        QVERIFY(!inflater.isTooLarge());
+        output.clear();
+        QVERIFY(inflater.inflate(compressed.constData(), compressed.size(), output));
+        QVERIFY(inflater.isFinished());
+        QCOMPARE(output.size(), data.size());
+    }
+
+    // Size and CPU time for each level, to choose KDSoapServer::setCompressionLevel
+    void benchmarkCompress_data()
+    {
+        QTest::addColumn<int>("level");
+        QTest::addColumn<int>("encoding");
+
+        QTest::newRow("gzip_1") << 1 << int(KDSoapCompression::Gzip);
+        QTest::newRow("gzip_6") << 6 << int(KDSoapCompression::Gzip);
+        QTest::newRow("gzip_9") << 9 << int(KDSoapCompression::Gzip);
+        QTest::newRow("deflate_6") << 6 << int(KDSoapCompression::Deflate);
+    }
+
+    void benchmarkCompress()
+    {
+        QFETCH(int, level);
+        QFETCH(int, encoding);
+        const KDSoapCompression::Encoding enc = static_cast<KDSoapCompression::Encoding>(encoding);
+        const QByteArray data = soapResponse(2000);
+        QByteArray compressed;
+        QBENCHMARK {
+            compressed = KDSoapCompression::compress(data, enc, level);
+        }
+        qDebug() << data.size() << "bytes compressed to" << compressed.size()
+                 << "bytes, ratio" << double(data.size()) / compressed.size();
+    }
+
+    void benchmarkInflate()
+    {
+        const QByteArray data = soapResponse(2000);
+        const QByteArray compressed = KDSoapCompression::compress(data, KDSoapCompression::Gzip, 6);
+        QBENCHMARK {
+            QByteArray output;
+            QVERIFY(inflateData(KDSoapCompression::Gzip, compressed, 4096, output));
+        }
+    }
+};
+
+QTEST_MAIN(CompressionTest)
+
+#include "compression.moc"
@@ -0,0 +1,8 @@
+include( $${TOP_SOURCE_DIR}/unittests/unittests.pri )
+SOURCES = compression.cpp
+test.target = test
+test.commands = ./$(TARGET)
+test.depends = $(TARGET)
+QMAKE_EXTRA_TARGETS += test
+
+LIBS        += -L$${TOP_BUILD_DIR}/lib -l$$KDSOAPSERVERLIB
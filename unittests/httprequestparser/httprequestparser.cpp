@@ -0,0 +1,274 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+
+#include "KDSoapHttpRequestParser_p.h"
+#include <QtTest/QtTest>
+#include <QBuffer>
+#include <QDir>
+
+static QByteArray soapRequest(const QByteArray &message)
+{
+    return "POST /path/../ HTTP/1.1\r\n"
+           "SoapAction: \"http://www.kdab.com/xml/MyWsdl/getEmployeeCountry\"\r\n"
+           "Content-Type: text/xml;charset=utf-8\r\n"
+           "Content-Length: " + QByteArray::number(message.size()) + "\r\n"
+           "Host: 127.0.0.1:12345\r\n"
+           "Accept-Encoding: gzip, deflate\r\n"
+           "Accept-Language: en-US,*\r\n"
+           "User-Agent: Mozilla/5.0\r\n"
+           "Connection: Keep-Alive\r\n"
+           "\r\n" + message;
+}
+
+static QByteArray soapMessage()
+{
+    return "<?xml version=\"1.0\" encoding=\"UTF-8\"?><soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body>"
+           "<n1:getEmployeeCountry xmlns:n1=\"http://www.kdab.com/xml/MyWsdl/\"><employeeName>David Faure</employeeName></n1:getEmployeeCountry>"
+           "</soap:Body></soap:Envelope>";
+}
+
+// The code used by KDSoapServerSocket before the incremental parser, kept for comparison
+namespace Legacy
+{
+typedef QMap<QByteArray, QByteArray> HeadersMap;
+static HeadersMap parseHeaders(const QByteArray &headerData)
+{
+    HeadersMap headersMap;
+    QBuffer sourceBuffer;
+    sourceBuffer.setData(headerData);
+    sourceBuffer.open(QIODevice::ReadOnly);
+    const QList<QByteArray> firstLine = sourceBuffer.readLine().split(' ');
+    if (firstLine.count() < 3) {
+        return headersMap;
+    }
+    headersMap.insert("_requestType", firstLine.at(0));
+    headersMap.insert("_path", QDir::cleanPath(QString::fromLatin1(firstLine.at(1).constData())).toLatin1());
+    headersMap.insert("_httpVersion", firstLine.at(2));
+    while (!sourceBuffer.atEnd()) {
+        const QByteArray line = sourceBuffer.readLine();
+        const int pos = line.indexOf(':');
+        headersMap.insert(line.left(pos).toLower(), line.mid(pos + 1).trimmed());
+    }
+    return headersMap;
+}
+
+static bool splitHeadersAndData(const QByteArray &request, QByteArray &header, QByteArray &data)
+{
+    const int sep = request.indexOf("\r\n\r\n");
+    if (sep <= 0) {
+        return false;
+    }
+    header = request.left(sep);
+    data = request.mid(sep + 4);
+    return true;
+}
+
+static QByteArray receive(const QByteArray &request, int readSize)
+{
+    QByteArray requestBuffer;
+    HeadersMap httpHeaders;
+    QByteArray buf(2048, ' ');
+    for (int pos = 0; pos < request.size(); pos += readSize) {
+        const int nread = qMin(readSize, request.size() - pos);
+        memcpy(buf.data(), request.constData() + pos, nread);
+        requestBuffer += buf.left(nread);
+        if (httpHeaders.isEmpty()) {
+            QByteArray receivedHttpHeaders, receivedData;
+            if (!splitHeadersAndData(requestBuffer, receivedHttpHeaders, receivedData)) {
+                continue;
+            }
+            httpHeaders = parseHeaders(receivedHttpHeaders);
+            requestBuffer = receivedData;
+        }
+        if (requestBuffer.size() >= httpHeaders.value("content-length").toInt()) {
+            return requestBuffer;
+        }
+    }
+    return QByteArray();
+}
+}
+
+static QByteArray receive(KDSoapHttpRequestParser &parser, const QByteArray &request, int readSize)
+{
+    for (int pos = 0; pos < request.size(); pos += readSize) {
+        const int nread = qMin(readSize, request.size() - pos);
+        QByteArray &buffer = parser.buffer();
+        const int oldSize = buffer.size();
+        buffer.resize(oldSize + nread);
+        memcpy(buffer.data() + oldSize, request.constData() + pos, nread);
+        KDSoapHttpRequestParser::Status status;
+        while ((status = parser.parse()) == KDSoapHttpRequestParser::HeadersComplete) {
+        }
+        if (status == KDSoapHttpRequestParser::RequestComplete) {
+            return parser.body();
+        }
+    }
+    return QByteArray();
+}
+
+class HttpRequestParserTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testHeaders()
+    {
+        KDSoapHttpRequestParser parser;
+        parser.buffer() = soapRequest(soapMessage());
+        QCOMPARE(parser.parse(), KDSoapHttpRequestParser::HeadersComplete);
+        QCOMPARE(parser.requestType(), QByteArray("POST"));
+        QCOMPARE(parser.path(), QByteArray("/"));
+        QCOMPARE(parser.httpVersion(), QByteArray("HTTP/1.1"));
+        QCOMPARE(parser.headerCount(), 8);
+        QCOMPARE(parser.header("soapaction"), QByteArray("\"http://www.kdab.com/xml/MyWsdl/getEmployeeCountry\""));
+        QCOMPARE(parser.header("CONTENT-TYPE"), QByteArray("text/xml;charset=utf-8"));
+        QVERIFY(!parser.hasHeader("authorization"));
+        QCOMPARE(parser.contentLength(), qint64(soapMessage().size()));
+
+        const QMap<QByteArray, QByteArray> headers = parser.headersMap();
+        QCOMPARE(headers.value("_requestType"), QByteArray("POST"));
+        QCOMPARE(headers.value("host"), QByteArray("127.0.0.1:12345"));
+
+        QCOMPARE(parser.parse(), KDSoapHttpRequestParser::RequestComplete);
+        QCOMPARE(parser.body(), soapMessage());
+    }
+
+    void testIncremental_data()
+    {
+        QTest::addColumn<int>("readSize");
+        QTest::addColumn<bool>("chunked");
+
+        const int sizes[] = { 1, 2, 7, 50, 4096 };
+        for (uint i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+            const QByteArray name = QByteArray::number(sizes[i]);
+            QTest::newRow(name.constData()) << sizes[i] << false;
+            QTest::newRow((name + "_chunked").constData()) << sizes[i] << true;
+        }
+    }
+
+    void testIncremental()
+    {
+        QFETCH(int, readSize);
+        QFETCH(bool, chunked);
+
+        const QByteArray message = soapMessage();
+        QByteArray request;
+        if (chunked) {
+            request = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+            for (int pos = 0; pos < message.size(); pos += 20) {
+                const QByteArray chunk = message.mid(pos, 20);
+                request += QByteArray::number(chunk.size(), 16) + "\r\n" + chunk + "\r\n";
+            }
+            request += "0\r\nIgnore: me\r\n\r\n";
+        } else {
+            request = soapRequest(message);
+        }
+        // A pipelined request follows, it must not end up in the body
+        request += "GET /next HTTP/1.1\r\n\r\n";
+
+        KDSoapHttpRequestParser parser;
+        QCOMPARE(receive(parser, request, readSize), message);
+        QCOMPARE(parser.isChunked(), chunked);
+
+        parser.reset();
+        while (parser.parse() == KDSoapHttpRequestParser::HeadersComplete) {
+        }
+        QVERIFY(parser.isComplete());
+        QCOMPARE(parser.requestType(), QByteArray("GET"));
+        QCOMPARE(parser.path(), QByteArray("/next"));
+    }
+
+    void testDiscardBody()
+    {
+        const QByteArray message = soapMessage();
+        const QByteArray request = soapRequest(message);
+        KDSoapHttpRequestParser parser;
+        QByteArray received;
+        for (int pos = 0; pos < request.size(); pos += 10) {
+            parser.buffer() += request.mid(pos, 10);
+            while (parser.parse() == KDSoapHttpRequestParser::HeadersComplete) {
+            }
+            received += parser.body();
+            parser.discardBody();
+        }
+        QVERIFY(parser.isComplete());
+        QCOMPARE(received, message);
+        QCOMPARE(parser.header("host"), QByteArray("127.0.0.1:12345"));
+    }
+
+    void testBadRequest_data()
+    {
+        QTest::addColumn<QByteArray>("request");
+
+        QTest::newRow("no_version") << QByteArray("GET /\r\n\r\n");
+        QTest::newRow("bad_chunk_size") << QByteArray("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nxyz\r\n");
+        QTest::newRow("bad_content_length") << QByteArray("POST / HTTP/1.1\r\nContent-Length: -5\r\n\r\n");
+    }
+
+    void testBadRequest()
+    {
+        QFETCH(QByteArray, request);
+        KDSoapHttpRequestParser parser;
+        parser.buffer() = request;
+        KDSoapHttpRequestParser::Status status;
+        while ((status = parser.parse()) == KDSoapHttpRequestParser::HeadersComplete) {
+        }
+        QCOMPARE(status, KDSoapHttpRequestParser::BadRequest);
+    }
+
+    void benchmarkReceive_data()
+    {
+        QTest::addColumn<bool>("legacy");
+        QTest::addColumn<int>("readSize");
+
+        QTest::newRow("legacy_one_read") << true << 2048;
+        QTest::newRow("parser_one_read") << false << 2048;
+        QTest::newRow("legacy_small_reads") << true << 100;
+        QTest::newRow("parser_small_reads") << false << 100;
+    }
+
+    void benchmarkReceive()
+    {
+        QFETCH(bool, legacy);
+        QFETCH(int, readSize);
+
+        const QByteArray message = soapMessage();
+        const QByteArray request = soapRequest(message);
+        QByteArray body;
+        if (legacy) {
+            QBENCHMARK {
+                body = Legacy::receive(request, readSize);
+            }
+        } else {
+            KDSoapHttpRequestParser parser;
+            QBENCHMARK {
+                parser.clear();
+                body = receive(parser, request, readSize);
+            }
+        }
+        QCOMPARE(body, message);
+    }
+};
+
+QTEST_MAIN(HttpRequestParserTest)
+
+#include "httprequestparser.moc"
@@ -0,0 +1,472 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+
+// kdsoap-bench: load generator for KDSoapServer.
+// Starts a server on the loopback interface and drives it with keep-alive client connections,
+// each sending its next request as soon as the previous response arrived.
+// Reports the throughput and the latency percentiles, in order to catch performance regressions.
+
+#include "KDSoapServer.h"
+#include "KDSoapServerObjectInterface.h"
+#include "KDSoapThreadPool.h"
+#include "KDSoapMessage.h"
+#include "KDSoapMetricsRecorder_p.h"
+#include "httpserver_p.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+#include <QFile>
+#include <QHash>
+#include <QTextStream>
+#ifndef QT_NO_OPENSSL
+#include <QSslSocket>
+#include <QSslConfiguration>
+#endif
+#include <algorithm>
+
+static const char s_benchNamespace[] = "http://www.kdab.com/xml/KDSoapBench/";
+
+struct BenchOptions {
+    BenchOptions()
+        : threads(0), requestScheduling(false), connections(10), clientThreads(2),
+          duration(10), requests(0), rpc(false), payload(QString::fromLatin1("small")), ssl(false), epoll(false)
+    {}
+    int threads;
+    bool requestScheduling;
+    int connections;
+    int clientThreads;
+    int duration; // seconds, when requests == 0
+    int requests; // per connection
+    bool rpc;
+    QString payload;
+    bool ssl;
+    bool epoll;
+};
+
+// Echoes the arguments, so that the response has the same shape as the request
+class BenchServerObject : public QObject, public KDSoapServerObjectInterface
+{
+    Q_OBJECT
+    Q_INTERFACES(KDSoapServerObjectInterface)
+public:
+    void processRequest(const KDSoapMessage &request, KDSoapMessage &response, const QByteArray &soapAction)
+    {
+        Q_UNUSED(soapAction);
+        setResponseNamespace(QLatin1String(s_benchNamespace));
+        response = KDSoapValue(request.name() + QLatin1String("Response"), request.childValues());
+        response.setUse(request.use());
+    }
+};
+
+class BenchServer : public KDSoapServer
+{
+    Q_OBJECT
+public:
+    QObject *createServerObject()
+    {
+        return new BenchServerObject;
+    }
+};
+
+static QByteArray payloadXml(const BenchOptions &options)
+{
+    QByteArray arguments;
+    const QByteArray type = options.rpc ? " xsi:type=\"xsd:string\"" : "";
+    if (options.payload == QLatin1String("large")) {
+        arguments = "<text" + type + '>' + QByteArray(64 * 1024, 'x') + "</text>";
+    } else if (options.payload == QLatin1String("array")) {
+        arguments = "<items>";
+        for (int i = 0; i < 100; ++i) {
+            arguments += "<item" + QByteArray(options.rpc ? " xsi:type=\"xsd:int\"" : "") + '>' + QByteArray::number(i) + "</item>";
+        }
+        arguments += "</items>";
+    } else {
+        arguments = "<text" + type + ">Hello world</text>";
+    }
+
+    QByteArray body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                      "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\""
+                      " xmlns:soap-enc=\"http://schemas.xmlsoap.org/soap/encoding/\""
+                      " xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\""
+                      " xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"><soap:Body>";
+    if (options.rpc) {
+        body += "<n1:echo xmlns:n1=\"" + QByteArray(s_benchNamespace) + "\" soap:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+                + arguments + "</n1:echo>";
+    } else {
+        body += "<n1:EchoRequest xmlns:n1=\"" + QByteArray(s_benchNamespace) + "\">" + arguments + "</n1:EchoRequest>";
+    }
+    body += "</soap:Body></soap:Envelope>";
+
+    return "POST / HTTP/1.1\r\n"
+           "Host: 127.0.0.1\r\n"
+           "Content-Type: text/xml;charset=utf-8\r\n"
+           "SoapAction: \"" + QByteArray(s_benchNamespace) + "echo\"\r\n"
+           "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+           "\r\n" + body;
+}
+
+// Runs in a client thread, with some of the connections
+class BenchClient : public QObject
+{
+    Q_OBJECT
+public:
+    BenchClient(const BenchOptions &options, quint16 port, int connections, const QByteArray &request)
+        : m_options(options), m_port(port), m_connectionCount(connections), m_request(request),
+          m_runningConnections(0), m_errors(0)
+    {
+    }
+    ~BenchClient()
+    {
+        qDeleteAll(m_connections);
+    }
+
+    QVector<qint64> latencies() const
+    {
+        return m_latencies; // microseconds
+    }
+    int errors() const
+    {
+        return m_errors;
+    }
+
+public Q_SLOTS:
+    void start()
+    {
+        m_clock.start();
+        for (int i = 0; i < m_connectionCount; ++i) {
+            Connection *connection = new Connection;
+#ifndef QT_NO_OPENSSL
+            QSslSocket *socket = new QSslSocket(this);
+            connection->socket = socket;
+            connect(socket, SIGNAL(sslErrors(QList<QSslError>)), socket, SLOT(ignoreSslErrors()));
+            if (m_options.ssl) {
+                connect(socket, SIGNAL(encrypted()), this, SLOT(slotConnected()));
+                socket->connectToHostEncrypted(QString::fromLatin1("127.0.0.1"), m_port);
+            } else {
+                connect(socket, SIGNAL(connected()), this, SLOT(slotConnected()));
+                socket->connectToHost(QString::fromLatin1("127.0.0.1"), m_port);
+            }
+#else
+            QTcpSocket *socket = new QTcpSocket(this);
+            connection->socket = socket;
+            connect(socket, SIGNAL(connected()), this, SLOT(slotConnected()));
+            socket->connectToHost(QString::fromLatin1("127.0.0.1"), m_port);
+#endif
+            m_connections.insert(socket, connection);
+            connect(socket, SIGNAL(readyRead()), this, SLOT(slotReadyRead()));
+            connect(socket, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
+            ++m_runningConnections;
+        }
+    }
+
+Q_SIGNALS:
+    void finished();
+
+private Q_SLOTS:
+    void slotConnected()
+    {
+        sendRequest(connectionFor(sender()));
+    }
+
+    void slotReadyRead()
+    {
+        Connection *connection = connectionFor(sender());
+        connection->buffer += connection->socket->readAll();
+        while (true) {
+            if (connection->responseSize == -1) {
+                const int headersEnd = connection->buffer.indexOf("\r\n\r\n");
+                if (headersEnd == -1) {
+                    return;
+                }
+                const QByteArray headers = connection->buffer.left(headersEnd + 2).toLower();
+                const int lengthPos = headers.indexOf("\r\ncontent-length: ");
+                if (lengthPos == -1 || !headers.startsWith("http/1.1 200 ")) {
+                    ++m_errors;
+                    finishConnection(connection);
+                    return;
+                }
+                const int valuePos = lengthPos + 18;
+                connection->responseSize = headersEnd + 4 + headers.mid(valuePos, headers.indexOf("\r\n", valuePos) - valuePos).toInt();
+            }
+            if (connection->buffer.size() < connection->responseSize) {
+                return;
+            }
+            connection->buffer.remove(0, connection->responseSize);
+            connection->responseSize = -1;
+            m_latencies.append(KDSoapMetricsRecorder::elapsedMicroseconds(m_clock) - connection->requestStart);
+            ++connection->responses;
+            sendRequest(connection);
+        }
+    }
+
+    void slotDisconnected()
+    {
+        Connection *connection = connectionFor(sender());
+        if (!connection->done) {
+            ++m_errors;
+            finishConnection(connection);
+        }
+    }
+
+private:
+    struct Connection {
+        Connection() : socket(0), responseSize(-1), requestStart(0), responses(0), done(false) {}
+        QTcpSocket *socket;
+        QByteArray buffer;
+        int responseSize; // including the headers, -1 until they are received
+        qint64 requestStart; // microseconds
+        int responses;
+        bool done;
+    };
+
+    Connection *connectionFor(QObject *socket) const
+    {
+        return m_connections.value(socket);
+    }
+
+    void sendRequest(Connection *connection)
+    {
+        const bool over = m_options.requests > 0 ? connection->responses >= m_options.requests
+                          : m_clock.elapsed() >= m_options.duration * 1000;
+        if (over) {
+            finishConnection(connection);
+            return;
+        }
+        connection->requestStart = KDSoapMetricsRecorder::elapsedMicroseconds(m_clock);
+        connection->socket->write(m_request);
+    }
+
+    void finishConnection(Connection *connection)
+    {
+        if (connection->done) {
+            return;
+        }
+        connection->done = true;
+        connection->socket->disconnectFromHost();
+        if (--m_runningConnections == 0) {
+            emit finished();
+        }
+    }
+
+    const BenchOptions m_options;
+    const quint16 m_port;
+    const int m_connectionCount;
+    const QByteArray m_request;
+    int m_runningConnections;
+    int m_errors;
+    QElapsedTimer m_clock;
+    QHash<QObject *, Connection *> m_connections;
+    QVector<qint64> m_latencies;
+};
+
+static qint64 percentile(const QVector<qint64> &sortedLatencies, double fraction)
+{
+    if (sortedLatencies.isEmpty()) {
+        return 0;
+    }
+    const int index = qMin(sortedLatencies.count() - 1, int(fraction * sortedLatencies.count()));
+    return sortedLatencies.at(index);
+}
+
+static void usage()
+{
+    QTextStream err(stderr);
+    err << "Usage: kdsoap-bench [options]\n"
+        << "  --threads N            size of the server's thread pool (default 0: no thread pool)\n"
+        << "  --request-scheduling   hand each call over to the thread pool's worker threads\n"
+        << "  --connections N        number of keep-alive client connections (default 10)\n"
+        << "  --client-threads N     number of threads running the clients (default 2)\n"
+        << "  --duration S           duration of the run in seconds (default 10)\n"
+        << "  --requests N           number of requests per connection, instead of --duration\n"
+        << "  --style rpc|document   style of the SOAP messages (default document)\n"
+        << "  --payload small|large|array  size and shape of the messages (default small)\n"
+        << "  --ssl                  use HTTPS\n"
+        << "  --epoll                use KDSoapServer::EpollIoBackend (Linux, without --ssl)\n";
+}
+
+static bool parseArguments(const QStringList &args, BenchOptions &options)
+{
+    for (int i = 1; i < args.count(); ++i) {
+        const QString arg = args.at(i);
+        const QString value = i + 1 < args.count() ? args.at(i + 1) : QString();
+        bool ok = true;
+        if (arg == QLatin1String("--threads")) {
+            options.threads = value.toInt(&ok);
+            ++i;
+        } else if (arg == QLatin1String("--request-scheduling")) {
+            options.requestScheduling = true;
+        } else if (arg == QLatin1String("--connections")) {
+            options.connections = value.toInt(&ok);
+            ok = ok && options.connections > 0;
+            ++i;
+        } else if (arg == QLatin1String("--client-threads")) {
+            options.clientThreads = value.toInt(&ok);
+            ok = ok && options.clientThreads > 0;
+            ++i;
+        } else if (arg == QLatin1String("--duration")) {
+            options.duration = value.toInt(&ok);
+            ++i;
+        } else if (arg == QLatin1String("--requests")) {
+            options.requests = value.toInt(&ok);
+            ++i;
+        } else if (arg == QLatin1String("--style")) {
+            ok = value == QLatin1String("rpc") || value == QLatin1String("document");
+            options.rpc = value == QLatin1String("rpc");
+            ++i;
+        } else if (arg == QLatin1String("--payload")) {
+            ok = value == QLatin1String("small") || value == QLatin1String("large") || value == QLatin1String("array");
+            options.payload = value;
+            ++i;
+        } else if (arg == QLatin1String("--ssl")) {
+            options.ssl = true;
+        } else if (arg == QLatin1String("--epoll")) {
+            options.epoll = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    BenchOptions options;
+    if (app.arguments().contains(QLatin1String("--help"))) {
+        usage();
+        return 0;
+    }
+    if (!parseArguments(app.arguments(), options)) {
+        usage();
+        return 1;
+    }
+
+    BenchServer server;
+    if (options.ssl) {
+#ifndef QT_NO_OPENSSL
+        if (!QSslSocket::supportsSsl() || !KDSoapUnitTestHelpers::setSslConfiguration()) {
+            qWarning("No SSL support");
+            return 1;
+        }
+        QSslConfiguration sslConfig = server.sslConfiguration();
+        QFile certFile(QString::fromLatin1(":/certs/test-127.0.0.1-cert.pem"));
+        QFile keyFile(QString::fromLatin1(":/certs/test-127.0.0.1-key.pem"));
+        if (!certFile.open(QIODevice::ReadOnly) || !keyFile.open(QIODevice::ReadOnly)) {
+            qWarning("Test certificate not found");
+            return 1;
+        }
+        sslConfig.setLocalCertificate(QSslCertificate(certFile.readAll()));
+        sslConfig.setPrivateKey(QSslKey(keyFile.readAll(), QSsl::Rsa));
+        server.setSslConfiguration(sslConfig);
+        server.setFeatures(KDSoapServer::Ssl);
+#else
+        qWarning("KDSoap was built without SSL support");
+        return 1;
+#endif
+    }
+    if (options.epoll) {
+        server.setIoBackend(KDSoapServer::EpollIoBackend);
+    }
+    KDSoapThreadPool threadPool;
+    if (options.threads > 0) {
+        threadPool.setMaxThreadCount(options.threads);
+        if (options.requestScheduling) {
+            threadPool.setSchedulingMode(KDSoapThreadPool::RequestScheduling);
+        }
+        server.setThreadPool(&threadPool);
+    }
+    if (!server.listen(QHostAddress::LocalHost)) {
+        qWarning("Could not listen: %s", qPrintable(server.errorString()));
+        return 1;
+    }
+
+    // Spread the connections over the client threads, the server runs in the main thread's event loop
+    const QByteArray request = payloadXml(options);
+    QList<QThread *> threads;
+    QList<BenchClient *> clients;
+    int runningClients = 0;
+    for (int i = 0; i < options.clientThreads; ++i) {
+        const int connections = options.connections / options.clientThreads + (i < options.connections % options.clientThreads ? 1 : 0);
+        if (connections == 0) {
+            continue;
+        }
+        QThread *thread = new QThread;
+        BenchClient *client = new BenchClient(options, server.serverPort(), connections, request);
+        client->moveToThread(thread);
+        QObject::connect(client, SIGNAL(finished()), thread, SLOT(quit()));
+        QObject::connect(thread, SIGNAL(finished()), &app, SLOT(quit()));
+        thread->start();
+        QMetaObject::invokeMethod(client, "start", Qt::QueuedConnection);
+        threads.append(thread);
+        clients.append(client);
+        ++runningClients;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    while (runningClients > 0) {
+        app.exec(); // until a client thread finishes
+        runningClients = 0;
+        Q_FOREACH (QThread *thread, threads) {
+            if (thread->isRunning()) {
+                ++runningClients;
+            }
+        }
+    }
+    const qint64 elapsed = timer.elapsed();
+
+    QVector<qint64> latencies;
+    int errors = 0;
+    for (int i = 0; i < clients.count(); ++i) {
+        threads.at(i)->wait();
+        latencies += clients.at(i)->latencies();
+        errors += clients.at(i)->errors();
+        delete clients.at(i);
+        delete threads.at(i);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    QTextStream out(stdout);
+    out << "style=" << (options.rpc ? "rpc" : "document") << " payload=" << options.payload
+        << " ssl=" << (options.ssl ? "on" : "off") << " io=" << (options.epoll ? "epoll" : "qt")
+        << " threads=" << options.threads
+        << (options.requestScheduling ? " (request scheduling)" : "")
+        << " connections=" << options.connections << '\n';
+    out << "requests: " << latencies.count() << " errors: " << errors
+        << " in " << elapsed << " ms (" << (elapsed > 0 ? latencies.count() * 1000 / elapsed : 0) << " requests/s)\n";
+    out << "latency (us): p50 " << percentile(latencies, 0.5)
+        << " p99 " << percentile(latencies, 0.99)
+        << " p999 " << percentile(latencies, 0.999)
+        << " max " << (latencies.isEmpty() ? 0 : latencies.last()) << '\n';
+    return errors > 0 ? 2 : 0;
+}
+
+#include "kdsoap-bench.moc"
@@ -0,0 +1,12 @@
+include( $${TOP_SOURCE_DIR}/unittests/unittests.pri )
+TARGET = kdsoap-bench
+QT += network xml
+SOURCES = kdsoap-bench.cpp
+# Not a unittest: run it by hand (see --help) to measure the server's throughput and latency.
+# The short run done by "make test" only checks that it still works.
+test.target = test
+test.commands = ./$(TARGET) --requests 20 --connections 4
+test.depends = $(TARGET)
+QMAKE_EXTRA_TARGETS += test
+
+LIBS        += -L$${TOP_BUILD_DIR}/lib -l$$KDSOAPSERVERLIB
@@ -23,8 +23,167 @@
 
 #include "KDSoapMessage.h"
 #include "KDSoapMessageReader_p.h"
+#include "KDSoapAtomTable_p.h"
+#include "KDSoapNamespaceManager.h"
+#include "KDSoapTypeRegistry.h"
+#include "KDSoapXmlSanitizer_p.h"
 #include <QtTest/QtTest>
 
+// Similar to the responses of the fixtures in msexchange_wsdl and the onvif tests, with many items
+static QByteArray msExchangeResponse(int itemCount)
+{
+    QByteArray xml =
+        "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\">"
+        "<s:Header>"
+        "<h:ServerVersionInfo MajorVersion=\"15\" MinorVersion=\"0\" MajorBuildNumber=\"995\" MinorBuildNumber=\"28\" Version=\"V2_15\" xmlns:h=\"http://schemas.microsoft.com/exchange/services/2006/types\"/>"
+        "</s:Header>"
+        "<s:Body>"
+        "<m:SyncFolderItemsResponse xmlns:m=\"http://schemas.microsoft.com/exchange/services/2006/messages\" xmlns:t=\"http://schemas.microsoft.com/exchange/services/2006/types\">"
+        "<m:ResponseMessages>"
+        "<m:SyncFolderItemsResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:IncludesLastItemInRange>true</m:IncludesLastItemInRange>"
+        "<m:Changes>";
+    for (int i = 0; i < itemCount; ++i) {
+        xml += "<t:Create><t:Message>"
+               "<t:ItemId Id=\"AAMkAGNiY2YxMjY3LTUxYjgtNGI1Yy1hOTM2LTU4MTM5OTZiNjdjYgBGAAAAAABW2gY0kRG1Sqgg" + QByteArray::number(i) + "\" ChangeKey=\"CQAAABYAAADEhKstbSqtRYSQ+LCX0M/RAAAAY37E\"/>"
+               "<t:Subject>Subject " + QByteArray::number(i) + "</t:Subject>"
+               "<t:Sensitivity>Normal</t:Sensitivity>"
+               "<t:Size xsi:type=\"xsd:int\">14070</t:Size>"
+               "<t:DateTimeSent>2014-10-02T13:24:47Z</t:DateTimeSent>"
+               "<t:DateTimeCreated>2014-10-02T13:24:49Z</t:DateTimeCreated>"
+               "<t:HasAttachments>false</t:HasAttachments>"
+               "<t:From><t:Mailbox>"
+               "<t:Name>Simon Hain</t:Name>"
+               "<t:EmailAddress>Simon.Hain@isec7.com</t:EmailAddress>"
+               "<t:RoutingType>SMTP</t:RoutingType>"
+               "</t:Mailbox></t:From>"
+               "<t:IsRead>true</t:IsRead>"
+               "</t:Message></t:Create>";
+    }
+    xml += "</m:Changes>"
+           "</m:SyncFolderItemsResponseMessage>"
+           "</m:ResponseMessages>"
+           "</m:SyncFolderItemsResponse>"
+           "</s:Body>"
+           "</s:Envelope>";
+    return xml;
+}
+
+static QByteArray onvifResponse(int profileCount)
+{
+    QByteArray xml =
+        "<env:Envelope xmlns:env=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\" xmlns:tt=\"http://www.onvif.org/ver10/schema\">"
+        "<env:Body>"
+        "<trt:GetProfilesResponse>";
+    for (int i = 0; i < profileCount; ++i) {
+        const QByteArray n = QByteArray::number(i);
+        xml += "<trt:Profiles token=\"Profile_" + n + "\" fixed=\"true\">"
+               "<tt:Name>Profile " + n + "</tt:Name>"
+               "<tt:VideoSourceConfiguration token=\"VideoSourceConfig_" + n + "\">"
+               "<tt:Name>VideoSourceConfig</tt:Name><tt:UseCount>2</tt:UseCount>"
+               "<tt:SourceToken>VideoSource_1</tt:SourceToken>"
+               "<tt:Bounds x=\"0\" y=\"0\" width=\"1920\" height=\"1080\"/>"
+               "</tt:VideoSourceConfiguration>"
+               "<tt:VideoEncoderConfiguration token=\"VideoEncoderConfig_" + n + "\">"
+               "<tt:Name>VideoEncoderConfig</tt:Name><tt:UseCount>1</tt:UseCount>"
+               "<tt:Encoding>H264</tt:Encoding>"
+               "<tt:Resolution><tt:Width>1920</tt:Width><tt:Height>1080</tt:Height></tt:Resolution>"
+               "<tt:Quality>5</tt:Quality>"
+               "<tt:RateControl><tt:FrameRateLimit>25</tt:FrameRateLimit><tt:EncodingInterval>1</tt:EncodingInterval><tt:BitrateLimit>4096</tt:BitrateLimit></tt:RateControl>"
+               "<tt:H264><tt:GovLength>50</tt:GovLength><tt:H264Profile>Main</tt:H264Profile></tt:H264>"
+               "<tt:Multicast><tt:Address><tt:Type>IPv4</tt:Type><tt:IPv4Address>0.0.0.0</tt:IPv4Address></tt:Address>"
+               "<tt:Port>0</tt:Port><tt:TTL>5</tt:TTL><tt:AutoStart>false</tt:AutoStart></tt:Multicast>"
+               "<tt:SessionTimeout>PT60S</tt:SessionTimeout>"
+               "</tt:VideoEncoderConfiguration>"
+               "</trt:Profiles>";
+    }
+    xml += "</trt:GetProfilesResponse>"
+           "</env:Body>"
+           "</env:Envelope>";
+    return xml;
+}
+
+static QByteArray encodedResponse(const QByteArray &type, const QByteArray &text, int count = 1)
+{
+    QByteArray xml =
+        "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\" xmlns:soapenc=\"http://schemas.xmlsoap.org/soap/encoding/\""
+        " xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\">"
+        "<soap:Body><n1:getValuesResponse xmlns:n1=\"urn:test\">"
+        "<values xsi:type=\"soapenc:Array\" soapenc:arrayType=\"xsd:" + type + "[" + QByteArray::number(count) + "]\">";
+    for (int i = 0; i < count; ++i) {
+        xml += "<item xsi:type=\"xsd:" + type + "\">" + text + "</item>";
+    }
+    xml += "</values></n1:getValuesResponse></soap:Body></soap:Envelope>";
+    return xml;
+}
+
+static bool decodeDuration(const QString &text, QVariant &value)
+{
+    // Only PTnS, enough for the test
+    if (!text.startsWith(QLatin1String("PT")) || !text.endsWith(QLatin1Char('S'))) {
+        return false;
+    }
+    bool ok;
+    const int seconds = text.mid(2, text.length() - 3).toInt(&ok);
+    if (ok) {
+        value = seconds * 1000;
+    }
+    return ok;
+}
+
+// KDSoapValue::operator== only compares the values which share their data, so compare the contents
+static QString dumpValue(const KDSoapValue &value)
+{
+    QString dump = value.name() + QLatin1Char('=') + value.value().toString() + QLatin1Char('[');
+    Q_FOREACH (const KDSoapValue &attribute, value.childValues().attributes()) {
+        dump += dumpValue(attribute);
+    }
+    Q_FOREACH (const KDSoapValue &child, value.childValues()) {
+        dump += dumpValue(child);
+    }
+    return dump + QLatin1Char(']');
+}
+
+class DumpThread : public QThread
+{
+public:
+    explicit DumpThread(const KDSoapValue &value) : m_value(value) {}
+    void run()
+    {
+        m_dump = dumpValue(m_value);
+    }
+    const KDSoapValue m_value;
+    QString m_dump;
+};
+
+static void compareValues(const KDSoapValue &actual, const KDSoapValue &expected)
+{
+    QCOMPARE(actual.name(), expected.name());
+    QCOMPARE(actual.namespaceUri(), expected.namespaceUri());
+    QCOMPARE(actual.type(), expected.type());
+    QCOMPARE(actual.typeNs(), expected.typeNs());
+    QCOMPARE(actual.isNil(), expected.isNil());
+    QCOMPARE(actual.value().userType(), expected.value().userType());
+    QCOMPARE(actual.value(), expected.value());
+    const KDSoapValueList &attributes = actual.childValues().attributes();
+    QCOMPARE(attributes.count(), expected.childValues().attributes().count());
+    for (int i = 0; i < attributes.count(); ++i) {
+        compareValues(attributes.at(i), expected.childValues().attributes().at(i));
+        if (QTest::currentTestFailed()) {
+            return;
+        }
+    }
+    const KDSoapValueList &children = actual.childValues();
+    QCOMPARE(children.count(), expected.childValues().count());
+    for (int i = 0; i < children.count(); ++i) {
+        compareValues(children.at(i), expected.childValues().at(i));
+        if (QTest::currentTestFailed()) {
+            return;
+        }
+    }
+}
+
 class TestMessageReader : public QObject
 {
     Q_OBJECT
@@ -77,9 +236,541 @@ private Q_SLOTS:
             qDebug() << msg2;
         }
     }
+
+    void testIncremental_data()
+    {
+        QTest::addColumn<QByteArray>("xml");
+        QTest::addColumn<int>("expectedError");
+
+        QTest::newRow("headers") << QByteArray(
+                                     "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                                     "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\" xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\">\n"
+                                     "  <soap:Header><n1:session xmlns:n1=\"urn:test\">abc&amp;def</n1:session><n1:extra xmlns:n1=\"urn:test\" attr=\"1\"/></soap:Header>\n"
+                                     "  <soap:Body>\n"
+                                     "    <n1:getEmployeeCountry xmlns:n1=\"http://www.kdab.com/xml/MyWsdl/\">\n"
+                                     "      <employeeName xsi:type=\"xsd:string\">David Faure</employeeName>\n"
+                                     "      <count xsi:type=\"xsd:int\">42</count>\n"
+                                     "      <!-- comment --><data>&lt;not a tag&gt;</data>\n"
+                                     "    </n1:getEmployeeCountry>\n"
+                                     "  </soap:Body>\n"
+                                     "</soap:Envelope>\n") << int(KDSoapMessageReader::NoError);
+        QTest::newRow("fault") << QByteArray(
+                                   "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body>"
+                                   "<soap:Fault><faultcode>Server.Error</faultcode><faultstring>Oops</faultstring></soap:Fault>"
+                                   "</soap:Body></soap:Envelope>") << int(KDSoapMessageReader::NoError);
+        QTest::newRow("empty_body") << QByteArray(
+                                        "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body/></soap:Envelope>")
+                                    << int(KDSoapMessageReader::NoError);
+        QTest::newRow("truncated") << QByteArray(
+                                       "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body><n1:op xmlns:n1=\"urn:test\"><a>1</a>")
+                                   << int(KDSoapMessageReader::PrematureEndOfDocumentError);
+        QTest::newRow("no_body") << QByteArray(
+                                     "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Header/></soap:Envelope>")
+                                 << int(KDSoapMessageReader::ParseError);
+        QTest::newRow("no_envelope") << QByteArray("<foo/>") << int(KDSoapMessageReader::ParseError);
+    }
+
+    void testIncremental()
+    {
+        QFETCH(QByteArray, xml);
+        QFETCH(int, expectedError);
+
+        const KDSoapMessageReader reader;
+        QString expectedNs;
+        KDSoapMessage expectedMsg;
+        KDSoapHeaders expectedHeaders;
+        QCOMPARE(int(reader.xmlToMessage(xml, &expectedMsg, &expectedNs, &expectedHeaders)), expectedError);
+
+        // Feeding the document in parts of any size gives the same result
+        KDSoapMessageReader incrementalReader;
+        for (int partSize = 1; partSize <= xml.size(); partSize += (partSize < 10 ? 1 : 37)) {
+            for (int pos = 0; pos < xml.size(); pos += partSize) {
+                incrementalReader.addData(xml.mid(pos, partSize));
+            }
+            QString ns;
+            KDSoapMessage msg;
+            KDSoapHeaders headers;
+            QCOMPARE(int(incrementalReader.finish(&msg, &ns, &headers)), expectedError);
+            QCOMPARE(msg, expectedMsg);
+            QCOMPARE(ns, expectedNs);
+            QCOMPARE(headers.count(), expectedHeaders.count());
+            for (int i = 0; i < headers.count(); ++i) {
+                QCOMPARE(headers.at(i), expectedHeaders.at(i));
+            }
+        }
+    }
+
+    void testIncrementalReset()
+    {
+        const QByteArray xml = "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body><op>1</op></soap:Body></soap:Envelope>";
+        KDSoapMessageReader reader;
+        reader.addData(xml.left(50));
+        reader.reset();
+        reader.addData(xml);
+        KDSoapMessage msg;
+        KDSoapHeaders headers;
+        QCOMPARE(reader.finish(&msg, 0, &headers), KDSoapMessageReader::NoError);
+        QCOMPARE(msg.name(), QString::fromLatin1("op"));
+        QCOMPARE(msg.value().toString(), QString::fromLatin1("1"));
+    }
+
+    void testInternedNames()
+    {
+        const KDSoapMessageReader reader;
+        KDSoapMessage msg1, msg2;
+        KDSoapHeaders headers;
+        QCOMPARE(reader.xmlToMessage(msExchangeResponse(2), &msg1, 0, &headers), KDSoapMessageReader::NoError);
+        QCOMPARE(reader.xmlToMessage(msExchangeResponse(1), &msg2, 0, &headers), KDSoapMessageReader::NoError);
+
+        // The names and namespaces repeated within a message, and across messages, share their data
+        const KDSoapValueList creates1 = msg1.childValues().child(QLatin1String("ResponseMessages")).childValues().at(0).childValues().child(QLatin1String("Changes")).childValues();
+        QCOMPARE(creates1.count(), 2);
+        const KDSoapValue message1 = creates1.at(0).childValues().at(0);
+        const KDSoapValue message2 = creates1.at(1).childValues().at(0);
+        QCOMPARE(message1.name(), QString::fromLatin1("Message"));
+        QCOMPARE(message1.name().constData(), message2.name().constData());
+        QCOMPARE(message1.namespaceUri().constData(), message2.namespaceUri().constData());
+        QCOMPARE(msg1.name().constData(), msg2.name().constData());
+        QCOMPARE(msg1.namespaceUri().constData(), msg2.namespaceUri().constData());
+        const KDSoapValue itemId = message1.childValues().at(0);
+        QCOMPARE(itemId.childValues().attributes().at(0).name(), QString::fromLatin1("Id"));
+        QCOMPARE(itemId.childValues().attributes().at(0).name().constData(),
+                 message2.childValues().at(0).childValues().attributes().at(0).name().constData());
+
+        // xsi:type is still resolved
+        const KDSoapValue size = message1.childValues().child(QLatin1String("Size"));
+        QCOMPARE(size.type(), QString::fromLatin1("int"));
+        QCOMPARE(size.typeNs(), KDSoapNamespaceManager::xmlSchema2001());
+        QCOMPARE(size.value(), QVariant(14070));
+    }
+
+    void testAtomTable()
+    {
+        int atom;
+        const QString envelope = KDSoapAtomTable::intern(QString::fromLatin1("http://schemas.xmlsoap.org/soap/envelope/"), &atom);
+        QCOMPARE(atom, int(KDSoapAtomTable::SoapEnvelope));
+        QCOMPARE(envelope.constData(), KDSoapNamespaceManager::soapEnvelope().constData());
+
+        int otherAtom;
+        const QString name = KDSoapAtomTable::intern(QString::fromLatin1("testAtomTable"), &atom);
+        QVERIFY(atom >= KDSoapAtomTable::WellKnownAtomCount);
+        QCOMPARE(KDSoapAtomTable::string(atom), name);
+        QCOMPARE(KDSoapAtomTable::intern(QString::fromLatin1("testAtomTable"), &otherAtom).constData(), name.constData());
+        QCOMPARE(otherAtom, atom);
+
+        KDSoapAtomTable::intern(QString(), &atom);
+        QCOMPARE(atom, int(KDSoapAtomTable::NoAtom));
+
+        // Long names aren't kept in the table
+        const int atomCount = KDSoapAtomTable::atomCount();
+        const QString longName(KDSoapAtomTable::maxAtomLength() + 1, QLatin1Char('x'));
+        QCOMPARE(KDSoapAtomTable::intern(longName, &atom), longName);
+        QCOMPARE(atom, int(KDSoapAtomTable::NoAtom));
+        QCOMPARE(KDSoapAtomTable::atomCount(), atomCount);
+        KDSoapAtomTable::intern(longName.left(KDSoapAtomTable::maxAtomLength()), &atom);
+        QVERIFY(atom != KDSoapAtomTable::NoAtom);
+    }
+
+    void testTypedValues_data()
+    {
+        QTest::addColumn<QByteArray>("type");
+        QTest::addColumn<QByteArray>("text");
+        QTest::addColumn<QVariant>("expectedValue");
+
+        QTest::newRow("int") << QByteArray("int") << QByteArray("-42") << QVariant(-42);
+        QTest::newRow("long") << QByteArray("long") << QByteArray("9000000000") << QVariant(Q_INT64_C(9000000000));
+        QTest::newRow("unsignedInt") << QByteArray("unsignedInt") << QByteArray("4000000000") << QVariant(Q_UINT64_C(4000000000));
+        QTest::newRow("double") << QByteArray("double") << QByteArray("3.25") << QVariant(3.25);
+        QTest::newRow("float") << QByteArray("float") << QByteArray("1.5") << QVariant(1.5f);
+        QTest::newRow("true") << QByteArray("boolean") << QByteArray("true") << QVariant(true);
+        QTest::newRow("false") << QByteArray("boolean") << QByteArray("false") << QVariant(false);
+        QTest::newRow("0") << QByteArray("boolean") << QByteArray("0") << QVariant(false);
+        QTest::newRow("date") << QByteArray("date") << QByteArray("2017-03-14") << QVariant(QDate(2017, 3, 14));
+        QTest::newRow("time") << QByteArray("time") << QByteArray("13:24:47") << QVariant(QTime(13, 24, 47));
+        QTest::newRow("string") << QByteArray("string") << QByteArray("12") << QVariant(QString::fromLatin1("12"));
+        // Not decoded: the text is kept
+        QTest::newRow("invalid_int") << QByteArray("int") << QByteArray("twelve") << QVariant(QString::fromLatin1("twelve"));
+        QTest::newRow("invalid_date") << QByteArray("date") << QByteArray("yesterday") << QVariant(QString::fromLatin1("yesterday"));
+        QTest::newRow("dateTime") << QByteArray("dateTime") << QByteArray("2014-10-02T13:24:47Z") << QVariant(QString::fromLatin1("2014-10-02T13:24:47Z"));
+        QTest::newRow("unknown") << QByteArray("gYear") << QByteArray("2017") << QVariant(QString::fromLatin1("2017"));
+    }
+
+    void testTypedValues()
+    {
+        QFETCH(QByteArray, type);
+        QFETCH(QByteArray, text);
+        QFETCH(QVariant, expectedValue);
+
+        const KDSoapMessageReader reader;
+        KDSoapMessage msg;
+        KDSoapHeaders headers;
+        QCOMPARE(reader.xmlToMessage(encodedResponse(type, text), &msg, 0, &headers), KDSoapMessageReader::NoError);
+        const KDSoapValue item = msg.childValues().child(QLatin1String("values")).childValues().at(0);
+        QCOMPARE(item.type(), QString::fromLatin1(type));
+        QCOMPARE(item.value().userType(), expectedValue.userType());
+        QCOMPARE(item.value(), expectedValue);
+    }
+
+    void testCustomTypeDecoder()
+    {
+        const KDSoapMessageReader reader;
+        KDSoapMessage msg;
+        KDSoapHeaders headers;
+        KDSoapTypeRegistry::registerDecoder(QString::fromLatin1("duration"), decodeDuration);
+        QCOMPARE(reader.xmlToMessage(encodedResponse("duration", "PT90S"), &msg, 0, &headers), KDSoapMessageReader::NoError);
+        QCOMPARE(msg.childValues().child(QLatin1String("values")).childValues().at(0).value(), QVariant(90000));
+
+        QVariant value;
+        QVERIFY(!KDSoapTypeRegistry::decode(QString::fromLatin1("duration"), QString::fromLatin1("P1D"), value));
+        QVERIFY(KDSoapTypeRegistry::decode(QString::fromLatin1("duration"), QString::fromLatin1("PT1S"), value));
+        QCOMPARE(value, QVariant(1000));
+
+        // Looking up a type doesn't add its name to the atom table
+        const int atomCount = KDSoapAtomTable::atomCount();
+        QVERIFY(!KDSoapTypeRegistry::decode(QString::fromLatin1("unregisteredType"), QString::fromLatin1("1"), value));
+        QCOMPARE(KDSoapAtomTable::atomCount(), atomCount);
+        QCOMPARE(KDSoapAtomTable::find(QString::fromLatin1("unregisteredType")), int(KDSoapAtomTable::NoAtom));
+
+        KDSoapTypeRegistry::registerDecoder(QString::fromLatin1("duration"), 0);
+        QCOMPARE(reader.xmlToMessage(encodedResponse("duration", "PT90S"), &msg, 0, &headers), KDSoapMessageReader::NoError);
+        QCOMPARE(msg.childValues().child(QLatin1String("values")).childValues().at(0).value(), QVariant(QString::fromLatin1("PT90S")));
+    }
+
+    void testLazyValues_data()
+    {
+        QTest::addColumn<QByteArray>("xml");
+
+        QTest::newRow("msexchange") << msExchangeResponse(3);
+        QTest::newRow("onvif") << onvifResponse(2);
+        QTest::newRow("encoded") << encodedResponse("int", "42", 3);
+        QTest::newRow("texts") << QByteArray(
+                                   "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+                                   "<soap:Header><n1:session xmlns:n1=\"urn:test\">abc&amp;def</n1:session><n1:extra xmlns:n1=\"urn:test\" attr=\"\"/></soap:Header>"
+                                   "<soap:Body><n1:op xmlns:n1=\"urn:test\">\n"
+                                   "  <a>1<![CDATA[<2>]]>3</a> <b>x<!-- comment -->y</b><c><d/>tail</c><e>  </e><f/>\n"
+                                   "</n1:op></soap:Body></soap:Envelope>");
+        QTest::newRow("truncated") << QByteArray(
+                                       "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body><n1:op xmlns:n1=\"urn:test\"><a>1</a><b>2");
+    }
+
+    void testLazyValues()
+    {
+        QFETCH(QByteArray, xml);
+
+        const KDSoapMessageReader reader;
+        KDSoapMessage expectedMsg;
+        KDSoapHeaders expectedHeaders;
+        QString expectedNs;
+        const KDSoapMessageReader::XmlError expectedError = reader.xmlToMessage(xml, &expectedMsg, &expectedNs, &expectedHeaders);
+
+        // The values created on demand are the same as the ones created by the parser
+        KDSoapMessageReader lazyReader;
+        lazyReader.setLazyValues(true);
+        KDSoapMessage msg;
+        KDSoapHeaders headers;
+        QString ns;
+        QCOMPARE(lazyReader.xmlToMessage(xml, &msg, &ns, &headers), expectedError);
+        QCOMPARE(ns, expectedNs);
+        compareValues(msg, expectedMsg);
+        QCOMPARE(headers.count(), expectedHeaders.count());
+        for (int i = 0; i < headers.count(); ++i) {
+            compareValues(headers.at(i), expectedHeaders.at(i));
+        }
+
+        // Also when parsing incrementally
+        for (int pos = 0; pos < xml.size(); pos += 7) {
+            lazyReader.addData(xml.mid(pos, 7));
+        }
+        KDSoapMessage incrementalMsg;
+        QCOMPARE(lazyReader.finish(&incrementalMsg, 0, &headers), expectedError);
+        compareValues(incrementalMsg, expectedMsg);
+    }
+
+    void testLazyValuesShared()
+    {
+        KDSoapMessageReader reader;
+        reader.setLazyValues(true);
+        KDSoapMessage msg;
+        KDSoapHeaders headers;
+        QCOMPARE(reader.xmlToMessage(onvifResponse(2), &msg, 0, &headers), KDSoapMessageReader::NoError);
+
+        // The copies share the values created from the arena, and modifying a copy doesn't change the others
+        const KDSoapMessage copy = msg;
+        const KDSoapValue profile = msg.childValues().at(1);
+        QCOMPARE(copy.childValues().at(1).childValues().attributes().at(0).value().toString(), QString::fromLatin1("Profile_1"));
+        KDSoapValue name = profile.childValues().child(QLatin1String("Name"));
+        const KDSoapValue nameCopy = name;
+        name.setValue(QString::fromLatin1("renamed"));
+        QCOMPARE(nameCopy.value().toString(), QString::fromLatin1("Profile 1"));
+        QCOMPARE(name.value().toString(), QString::fromLatin1("renamed"));
+        QVERIFY(!profile.childValues().child(QLatin1String("VideoSourceConfiguration")).childValues().child(QLatin1String("Bounds")).isNil());
+    }
+
+    void testLazyValuesThreads()
+    {
+        const QByteArray xml = onvifResponse(20);
+        const KDSoapMessageReader reader;
+        KDSoapMessage expectedMsg;
+        KDSoapHeaders headers;
+        QCOMPARE(reader.xmlToMessage(xml, &expectedMsg, 0, &headers), KDSoapMessageReader::NoError);
+        const QString expectedDump = dumpValue(expectedMsg);
+
+        // Several threads create the values of copies of the same lazy message at the same time
+        for (int iteration = 0; iteration < 20; ++iteration) {
+            KDSoapMessageReader lazyReader;
+            lazyReader.setLazyValues(true);
+            KDSoapMessage msg;
+            QCOMPARE(lazyReader.xmlToMessage(xml, &msg, 0, &headers), KDSoapMessageReader::NoError);
+            QList<DumpThread *> threads;
+            for (int i = 0; i < 4; ++i) {
+                threads.append(new DumpThread(msg));
+            }
+            Q_FOREACH (DumpThread *thread, threads) {
+                thread->start();
+            }
+            Q_FOREACH (DumpThread *thread, threads) {
+                QVERIFY(thread->wait());
+                QCOMPARE(thread->m_dump, expectedDump);
+            }
+            qDeleteAll(threads);
+        }
+    }
+
+    void testSanitizer_data()
+    {
+        QTest::addColumn<QByteArray>("xml");
+        QTest::addColumn<QByteArray>("expectedXml");
+        QTest::addColumn<int>("expectedCount");
+
+        QTest::newRow("valid") << QByteArray("<a b=\"&#x41;\">&#65;&#x10FFFF;&amp;\t\r\n</a>") << QByteArray() << 0;
+        QTest::newRow("references") << QByteArray("<a b=\"&#x1f;\">x&#x13;y&#0;&#xD800;&#xFFFE;&#x110000;&#99999999999;z</a>")
+                                    << QByteArray("<a b=\"?\">x?y?????z</a>") << 7;
+        QTest::newRow("control_characters") << QByteArray("<a>\x01x\x1by\x7f</a>") << QByteArray("<a>xy\x7f</a>") << 2;
+        QTest::newRow("malformed_references") << QByteArray("<a>&#x;&#xZZ;&#12a;&#x41</a>") << QByteArray() << 0;
+        QTest::newRow("comment_and_cdata") << QByteArray("<a><!-- &#x1; --><![CDATA[&#x2;]]]]>&#x3;</a>")
+                                           << QByteArray("<a><!-- &#x1; --><![CDATA[&#x2;]]]]>?</a>") << 1;
+        QTest::newRow("utf16") << QByteArray("\xff\xfe<\0a\0/\0>\0", 10) << QByteArray() << 0;
+    }
+
+    void testSanitizer()
+    {
+        QFETCH(QByteArray, xml);
+        QFETCH(QByteArray, expectedXml);
+        QFETCH(int, expectedCount);
+        if (expectedXml.isEmpty()) {
+            expectedXml = xml;
+        }
+
+        int count = -1;
+        QCOMPARE(KDSoapXmlSanitizer::sanitize(xml, &count), expectedXml);
+        QCOMPARE(count, expectedCount);
+
+        // Same result when filtering the document in parts of any size
+        KDSoapXmlSanitizer sanitizer;
+        for (int partSize = 1; partSize <= xml.size(); ++partSize) {
+            QByteArray result;
+            for (int pos = 0; pos < xml.size(); pos += partSize) {
+                result += sanitizer.filter(xml.mid(pos, partSize));
+            }
+            result += sanitizer.finish();
+            QCOMPARE(result, expectedXml);
+            QCOMPARE(sanitizer.fixedCount(), expectedCount);
+            sanitizer.reset();
+        }
+    }
+
+    void testSanitizeInput()
+    {
+        QByteArray xml = "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body><n1:op xmlns:n1=\"urn:test\">";
+        for (int i = 0; i < 10; ++i) {
+            xml += "<subject>subject &#x13;&#x41;</subject>";
+        }
+        xml += "</n1:op></soap:Body></soap:Envelope>";
+
+        // xmlToMessage repairs the document even without setSanitizeInput
+        for (int i = 0; i < 2; ++i) {
+            const bool sanitize = i == 1;
+            KDSoapMessageReader reader;
+            reader.setSanitizeInput(sanitize);
+            KDSoapMessage msg;
+            KDSoapHeaders headers;
+            QCOMPARE(reader.xmlToMessage(xml, &msg, 0, &headers), KDSoapMessageReader::NoError);
+            QCOMPARE(reader.fixedCharacterCount(), 10);
+            QCOMPARE(msg.childValues().count(), 10);
+            QCOMPARE(msg.childValues().at(9).value().toString(), QString::fromLatin1("subject ?A"));
+        }
+
+        // Incremental parsing only repairs it with setSanitizeInput
+        KDSoapMessageReader reader;
+        for (int i = 0; i < 2; ++i) {
+            const bool sanitize = i == 1;
+            reader.setSanitizeInput(sanitize);
+            for (int pos = 0; pos < xml.size(); pos += 5) {
+                reader.addData(xml.mid(pos, 5));
+            }
+            KDSoapMessage msg;
+            KDSoapHeaders headers;
+            QCOMPARE(reader.finish(&msg, 0, &headers), sanitize ? KDSoapMessageReader::NoError : KDSoapMessageReader::ParseError);
+            QCOMPARE(reader.fixedCharacterCount(), sanitize ? 10 : 0);
+        }
+    }
+
+    // A response with many invalid character references used to be parsed again for each of them
+    void benchmarkInvalidCharacters()
+    {
+        QByteArray xml = "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body><n1:op xmlns:n1=\"urn:test\">";
+        for (int i = 0; i < 2000; ++i) {
+            xml += "<subject>subject &#x13;" + QByteArray::number(i) + "</subject>";
+        }
+        xml += "</n1:op></soap:Body></soap:Envelope>";
+
+        const KDSoapMessageReader reader;
+        QBENCHMARK {
+            KDSoapMessage msg;
+            KDSoapHeaders headers;
+            QCOMPARE(reader.xmlToMessage(xml, &msg, 0, &headers), KDSoapMessageReader::NoError);
+        }
+        QCOMPARE(reader.fixedCharacterCount(), 2000);
+    }
+
+    // Arrays of numbers, as sent by the services using use="encoded"
+    void benchmarkNumericArray_data()
+    {
+        QTest::addColumn<QByteArray>("xml");
+
+        QTest::newRow("int") << encodedResponse("int", "123456", 2000);
+        QTest::newRow("double") << encodedResponse("double", "1234.5678", 2000);
+    }
+
+    void benchmarkNumericArray()
+    {
+        QFETCH(QByteArray, xml);
+
+        const KDSoapMessageReader reader;
+        QBENCHMARK {
+            KDSoapMessage msg;
+            KDSoapHeaders headers;
+            QCOMPARE(reader.xmlToMessage(xml, &msg, 0, &headers), KDSoapMessageReader::NoError);
+            QCOMPARE(msg.childValues().at(0).childValues().count(), 2000);
+        }
+    }
+
+    void benchmarkParse_data()
+    {
+        QTest::addColumn<QByteArray>("xml");
+        QTest::addColumn<bool>("lazy");
+
+        QTest::newRow("msexchange") << msExchangeResponse(200) << false;
+        QTest::newRow("onvif") << onvifResponse(100) << false;
+        QTest::newRow("msexchange_lazy") << msExchangeResponse(200) << true;
+        QTest::newRow("onvif_lazy") << onvifResponse(100) << true;
+    }
+
+    void benchmarkParse()
+    {
+        QFETCH(QByteArray, xml);
+        QFETCH(bool, lazy);
+
+        KDSoapMessageReader reader;
+        reader.setLazyValues(lazy);
+        QBENCHMARK {
+            KDSoapMessage msg;
+            KDSoapHeaders headers;
+            QCOMPARE(reader.xmlToMessage(xml, &msg, 0, &headers), KDSoapMessageReader::NoError);
+        }
+        // The names of all these elements fit in a few atoms
+        QVERIFY(KDSoapAtomTable::atomCount() < 200);
+    }
+};
+
+// Run last, since the atom table can't be emptied
+class TestFullAtomTable : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase()
+    {
+        for (int i = 0; i < 10000; ++i) {
+            KDSoapAtomTable::intern(QString::fromLatin1("name%1").arg(i));
+        }
+        int atom;
+        KDSoapAtomTable::intern(QString::fromLatin1("unknownName"), &atom);
+        QCOMPARE(atom, int(KDSoapAtomTable::NoAtom));
+    }
+
+    void testInternWhenFull()
+    {
+        QCOMPARE(KDSoapAtomTable::atomCount(), KDSoapAtomTable::maxAtomCount());
+        int atom;
+        const QString name = KDSoapAtomTable::intern(QString::fromLatin1("name5"), &atom);
+        QVERIFY(atom != KDSoapAtomTable::NoAtom);
+        QCOMPARE(KDSoapAtomTable::string(atom), name);
+        // A name without an atom isn't copied again by the same thread
+        const QString first = KDSoapAtomTable::intern(QString::fromLatin1("otherUnknownName"), &atom);
+        QCOMPARE(atom, int(KDSoapAtomTable::NoAtom));
+        const QString second = KDSoapAtomTable::intern(QString::fromLatin1("otherUnknownName"), &atom);
+        QCOMPARE(atom, int(KDSoapAtomTable::NoAtom));
+        QCOMPARE(second, first);
+        QCOMPARE(second.constData(), first.constData());
+    }
+
+    void testBuiltinTypes_data()
+    {
+        QTest::addColumn<bool>("lazy");
+        QTest::newRow("eager") << false;
+        QTest::newRow("lazy") << true;
+    }
+
+    void testBuiltinTypes()
+    {
+        QFETCH(bool, lazy);
+        KDSoapMessageReader reader;
+        reader.setLazyValues(lazy);
+        KDSoapMessage msg;
+        KDSoapHeaders headers;
+        QCOMPARE(reader.xmlToMessage(encodedResponse("int", "42"), &msg, 0, &headers), KDSoapMessageReader::NoError);
+        const QVariant value = msg.childValues().child(QLatin1String("values")).childValues().at(0).value();
+        QCOMPARE(value.userType(), int(QVariant::Int));
+        QCOMPARE(value, QVariant(42));
+    }
+
+    void testCustomTypeDecoder_data()
+    {
+        testBuiltinTypes_data();
+    }
+
+    // A type registered once the table is full has no atom, it's found by name
+    void testCustomTypeDecoder()
+    {
+        QFETCH(bool, lazy);
+        KDSoapMessageReader reader;
+        reader.setLazyValues(lazy);
+        KDSoapMessage msg;
+        KDSoapHeaders headers;
+        KDSoapTypeRegistry::registerDecoder(QString::fromLatin1("period"), decodeDuration);
+        QCOMPARE(reader.xmlToMessage(encodedResponse("period", "PT90S"), &msg, 0, &headers), KDSoapMessageReader::NoError);
+        QCOMPARE(msg.childValues().child(QLatin1String("values")).childValues().at(0).value(), QVariant(90000));
+        QVariant value;
+        QVERIFY(KDSoapTypeRegistry::decode(QString::fromLatin1("period"), QString::fromLatin1("PT1S"), value));
+        QCOMPARE(value, QVariant(1000));
+        KDSoapTypeRegistry::registerDecoder(QString::fromLatin1("period"), 0);
+        QVERIFY(!KDSoapTypeRegistry::decode(QString::fromLatin1("period"), QString::fromLatin1("PT1S"), value));
+    }
 };
 
-QTEST_MAIN(TestMessageReader)
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    TestMessageReader test;
+    int result = QTest::qExec(&test, argc, argv);
+    // Again with the SIMD tokenizer (see the xmltokenizer test), which must give the same messages;
+    // this also runs the benchmarks with both tokenizers
+    KDSoapMessageReader::setDefaultTokenizer(KDSoapMessageReader::SimdTokenizer);
+    result |= QTest::qExec(&test, argc, argv);
+    TestFullAtomTable fullAtomTableTest;
+    result |= QTest::qExec(&fullAtomTableTest, argc, argv);
+    return result;
+}
 
 #include "messagereader.moc"
 
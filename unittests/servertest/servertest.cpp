@@ -33,6 +33,9 @@
 #include "KDSoapServerObjectInterface.h"
 #include "KDSoapServerRawXMLInterface.h"
 #include "KDSoapServerCustomVerbRequestInterface.h"
+#include "KDSoapCompression_p.h"
+#include "KDSoapFileResponse_p.h"
+#include "KDSoapHttpRequestParser_p.h"
 #include "httpserver_p.h" // KDSoapUnitTestHelpers
 #include <QtTest/QtTest>
 #include <QDebug>
@@ -221,22 +224,78 @@ public: // SOAP-accessible methods
         }
         return input1 + input2;
     }
+
+private Q_SLOTS:
+    void slotSendDelayedResponse()
+    {
+        KDSoapMessage response;
+        response.setValue(QLatin1String("getEmployeeCountryResponse"));
+        response.addArgument(QLatin1String("employeeCountry"), QString::fromLatin1("Delayed France"));
+        sendDelayedResponse(m_delayedResponseHandle, response);
+    }
+    void slotSendLateResponse()
+    {
+        KDSoapMessage response;
+        response.setValue(QLatin1String("getEmployeeCountryResponse"));
+        response.addArgument(QLatin1String("employeeCountry"), QString::fromLatin1("Late France"));
+        sendDelayedResponse(m_lateResponseHandle, response);
+    }
+
 private:
     bool m_requireAuth;
     bool m_useRawXML;
     bool m_rawXMLValid;
     QByteArray m_assembledXML;
+    KDSoapDelayedResponseHandle m_delayedResponseHandle;
+    KDSoapDelayedResponseHandle m_lateResponseHandle;
+
+};
+
+// Only implements KDSoapServerObjectInterface, so that KDSoapServer::EpollIoBackend
+// can handle its calls without sockets
+class PlainCountryServerObject : public QObject, public KDSoapServerObjectInterface
+{
+    Q_OBJECT
+    Q_INTERFACES(KDSoapServerObjectInterface)
+public:
+    virtual void processRequest(const KDSoapMessage &request, KDSoapMessage &response, const QByteArray &soapAction)
+    {
+        Q_UNUSED(soapAction);
+        setResponseNamespace(QLatin1String(myWsdlNamespace));
+        const QString employeeName = request.childValues().child(QLatin1String("employeeName")).value().toString();
+        if (employeeName == QLatin1String("Delayed")) {
+            m_delayedResponseHandle = prepareDelayedResponse();
+            QTimer::singleShot(100, this, SLOT(slotSendDelayedResponse()));
+            return;
+        }
+        response.setValue(QLatin1String("getEmployeeCountryResponse"));
+        response.addArgument(QLatin1String("employeeCountry"), employeeName + QString::fromLatin1(" France"));
+    }
 
+private Q_SLOTS:
+    void slotSendDelayedResponse()
+    {
+        KDSoapMessage response;
+        response.setValue(QLatin1String("getEmployeeCountryResponse"));
+        response.addArgument(QLatin1String("employeeCountry"), QString::fromLatin1("Delayed France"));
+        sendDelayedResponse(m_delayedResponseHandle, response);
+    }
+
+private:
+    KDSoapDelayedResponseHandle m_delayedResponseHandle;
 };
 
 class CountryServer : public KDSoapServer
 {
     Q_OBJECT
 public:
-    CountryServer() : KDSoapServer(), m_requireAuth(false), m_useRawXML(false) {}
+    CountryServer() : KDSoapServer(), m_requireAuth(false), m_useRawXML(false), m_plainServerObject(false) {}
 
     virtual QObject *createServerObject()
     {
+        if (m_plainServerObject) {
+            return new PlainCountryServerObject;
+        }
         return new CountryServerObject(m_requireAuth, m_useRawXML);
     }
 
@@ -248,6 +307,10 @@ public:
     {
         m_useRawXML = b;
     }
+    void setPlainServerObject(bool b)
+    {
+        m_plainServerObject = b;
+    }
 
 Q_SIGNALS:
     void releaseSemaphore();
@@ -271,6 +334,7 @@ public Q_SLOTS:
 private:
     bool m_requireAuth;
     bool m_useRawXML;
+    bool m_plainServerObject;
 };
 
 // We need to do the listening and socket handling in a separate thread,
@@ -282,7 +346,7 @@ class CountryServerThread : public QThread
     Q_OBJECT
 public:
     CountryServerThread(KDSoapThreadPool *pool = 0)
-        : m_threadPool(pool), m_pServer(0)
+        : m_threadPool(pool), m_reusePort(false), m_pServer(0)
     {}
     ~CountryServerThread()
     {
@@ -292,6 +356,10 @@ public:
         }
         wait();
     }
+    void setReusePort(bool reusePort)
+    {
+        m_reusePort = reusePort;
+    }
     CountryServer *startThread()
     {
         start();
@@ -316,12 +384,15 @@ protected:
         if (m_threadPool) {
             server.setThreadPool(m_threadPool);
         }
-        if (server.listen()) {
+        const bool listening = m_reusePort ? server.listenWithReusePort() : server.listen();
+        if (listening) {
             m_pServer = &server;
         }
         connect(&server, SIGNAL(releaseSemaphore()), this, SLOT(slotReleaseSemaphore()), Qt::DirectConnection);
         m_semaphore.release();
-        exec();
+        if (listening) { // otherwise nobody would make us quit
+            exec();
+        }
         m_pServer = 0;
     }
 private Q_SLOTS:
@@ -332,6 +403,7 @@ private Q_SLOTS:
 
 private:
     KDSoapThreadPool *m_threadPool;
+    bool m_reusePort;
     QSemaphore m_semaphore;
     CountryServer *m_pServer;
 };
@@ -347,6 +419,43 @@ public:
     }
 };
 
+// Connects and disconnects in a loop, so that the threads of the pool keep accepting connections
+class ConnectingThread : public QThread
+{
+public:
+    ConnectingThread(const QString &host, quint16 port)
+        : m_host(host), m_port(port), m_stop(0), m_connections(0) {}
+
+    void stop()
+    {
+        m_stop.fetchAndStoreOrdered(1);
+        wait();
+    }
+    int connectionCount() const
+    {
+        return m_connections;
+    }
+
+protected:
+    void run()
+    {
+        while (m_stop.fetchAndAddOrdered(0) == 0) {
+            QTcpSocket socket;
+            socket.connectToHost(m_host, m_port);
+            if (socket.waitForConnected()) {
+                ++m_connections;
+            }
+            socket.disconnectFromHost();
+        }
+    }
+
+private:
+    QString m_host;
+    quint16 m_port;
+    QAtomicInt m_stop;
+    int m_connections; // only read after stop()
+};
+
 class ServerTest : public QObject
 {
     Q_OBJECT
@@ -579,6 +688,83 @@ private Q_SLOTS:
         QCOMPARE(s_serverObjects.count(), 0);
     }
 
+    void testRequestScheduling()
+    {
+        {
+            KDSoapThreadPool threadPool;
+            threadPool.setMaxThreadCount(1);
+            threadPool.setSchedulingMode(KDSoapThreadPool::RequestScheduling);
+            threadPool.setWorkerThreadCount(2);
+            CountryServerThread serverThread(&threadPool);
+            CountryServer *server = serverThread.startThread();
+
+            // Pipelined requests, the responses (including a delayed one) must still arrive in order
+            ClientSocket socket(server);
+            QVERIFY(socket.waitForConnected());
+            QList<QByteArray> employeeNames;
+            employeeNames << "David" << "Delayed" << "Kevin";
+            QByteArray requests;
+            Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+                requests += countryRequest(employeeName);
+            }
+            socket.write(requests);
+            QVERIFY(socket.waitForBytesWritten());
+            QByteArray buffer;
+            Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+                QByteArray headers, body;
+                QVERIFY(readSocketResponse(socket, buffer, headers, body));
+                QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+                QVERIFY(xmlBufferCompare(body, expectedCountryResponse(employeeName)));
+            }
+
+            // An abandoned delayed response: the call is deleted with its handle, the client gets the timeout
+            server->setResponseDeadline(300);
+            socket.write(countryRequest("Abandoned"));
+            QByteArray headers, body;
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+            QVERIFY(body.contains(">Server.Timeout<"));
+            socket.write(countryRequest("Kevin"));
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+            QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+            server->setResponseDeadline(-1);
+
+            // There's no socket to write to in a worker thread
+            QTest::ignoreMessage(QtWarningMsg, "KDSoapServerObjectInterface::writeHTTP: no socket to write to, e.g. for a call handled in a worker thread");
+            socket.write(countryRequest("WriteHTTP"));
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+            QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+            QVERIFY(xmlBufferCompare(body, expectedCountryResponse("WriteHTTP")));
+
+            // Concurrent calls, with request and response headers
+            KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+            m_returnMessages.clear();
+            m_returnHeaders.clear();
+            m_expectedMessages = 4;
+            for (int i = 0; i < m_expectedMessages; ++i) {
+                KDSoapPendingCall pendingCall = client.asyncCall(QLatin1String("getStuff"), getStuffMessage(), QString::fromLatin1("MySoapAction"), getStuffRequestHeaders());
+                KDSoapPendingCallWatcher *watcher = new KDSoapPendingCallWatcher(pendingCall, this);
+                connect(watcher, SIGNAL(finished(KDSoapPendingCallWatcher*)),
+                        this, SLOT(slotFinished(KDSoapPendingCallWatcher*)));
+            }
+            m_eventLoop.exec();
+            QCOMPARE(m_returnMessages.count(), m_expectedMessages);
+            Q_FOREACH (const KDSoapMessage &response, m_returnMessages) {
+                QCOMPARE(response.value().toDouble(), double(4 + 3.2 + 123456.789));
+            }
+            Q_FOREACH (const KDSoapHeaders &headers, m_returnHeaders) {
+                QCOMPARE(headers.header(QLatin1String("header2"), QLatin1String("http://foo")).value().toString(), QLatin1String("responseHeader"));
+            }
+
+            // Faults
+            makeFaultyCall(server->endPoint());
+
+            // The calls were made by the workers, not by the connection thread
+            QVERIFY(s_serverObjects.count() >= 2);
+            QVERIFY(s_serverObjects.count() <= 3);
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
 // OSX: "Fault code 99: Unknown error", sometimes
 // Windows/Linux with Qt 4.8 or 5.5: nothing happens after "82 sockets seen. 100 connected right now. Messages received 100"
 #if 0
@@ -756,6 +942,127 @@ private Q_SLOTS:
         serverThread.resume();
     }
 
+    void testListenWithReusePort()
+    {
+        {
+            KDSoapThreadPool threadPool;
+            threadPool.setMaxThreadCount(3);
+            CountryServerThread serverThread(&threadPool);
+            serverThread.setReusePort(true);
+            CountryServer *server = serverThread.startThread();
+            if (!server) {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+                QSKIP("SO_REUSEPORT not supported");
+#else
+                QSKIP("requires Qt 5", SkipSingle);
+#endif
+            }
+            const quint16 port = server->serverPort();
+            QVERIFY(port != 0);
+
+            // One connection per client, accepted by the threads of the pool
+            const int numClients = 6;
+            for (int i = 0; i < numClients; ++i) {
+                makeSimpleCall(server->endPoint());
+            }
+            QCOMPARE(server->totalConnectionCount(), numClients);
+            QVERIFY(s_serverObjects.count() >= 1);
+            QVERIFY(s_serverObjects.count() <= 3);
+            QVERIFY(!s_serverObjects.contains(&serverThread));
+
+            serverThread.suspend();
+            QCOMPARE(server->endPoint(), QString());
+            serverThread.resume();
+            QCOMPARE(server->serverPort(), port);
+            makeSimpleCall(server->endPoint());
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
+    // Connections per second, with a single accepting thread or with SO_REUSEPORT
+    void benchmarkConnections_data()
+    {
+        QTest::addColumn<bool>("reusePort");
+
+        QTest::newRow("single acceptor") << false;
+        QTest::newRow("SO_REUSEPORT") << true;
+    }
+
+    void benchmarkConnections()
+    {
+        QFETCH(bool, reusePort);
+
+        KDSoapThreadPool threadPool;
+        threadPool.setMaxThreadCount(4);
+        CountryServerThread serverThread(&threadPool);
+        serverThread.setReusePort(reusePort);
+        CountryServer *server = serverThread.startThread();
+        if (!server) {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+            QSKIP("SO_REUSEPORT not supported");
+#else
+            QSKIP("requires Qt 5", SkipSingle);
+#endif
+        }
+
+        const int numConnections = 50;
+        const QByteArray request = countryRequest("David", "HTTP/1.1", "Connection: close\r\n");
+        QElapsedTimer timer;
+        timer.start();
+        int connections = 0;
+        QBENCHMARK {
+            QVector<ClientSocket *> sockets(numConnections);
+            for (int i = 0; i < numConnections; ++i) {
+                sockets[i] = new ClientSocket(server);
+            }
+            for (int i = 0; i < numConnections; ++i) {
+                QVERIFY(sockets[i]->waitForConnected());
+                sockets[i]->write(request);
+            }
+            for (int i = 0; i < numConnections; ++i) {
+                QByteArray buffer, headers, body;
+                QVERIFY(readSocketResponse(*sockets[i], buffer, headers, body));
+            }
+            qDeleteAll(sockets);
+            connections += numConnections;
+        }
+        qDebug() << connections * 1000.0 / qMax(qint64(1), timer.elapsed()) << "connections per second";
+    }
+
+    // numConnectedSockets() and the choice of a thread for each new connection read the
+    // socket counts of all threads: this must not wait for the threads handling connections
+    void benchmarkSocketCount()
+    {
+        KDSoapThreadPool threadPool;
+        threadPool.setMaxThreadCount(4);
+        CountryServerThread serverThread(&threadPool);
+        CountryServer *server = serverThread.startThread();
+
+        QList<ConnectingThread *> connectingThreads;
+        for (int i = 0; i < 4; ++i) {
+            ConnectingThread *thread = new ConnectingThread(QUrl(server->endPoint()).host(), server->serverPort());
+            thread->start();
+            connectingThreads.append(thread);
+        }
+
+        int socketCount = 0;
+        QBENCHMARK {
+            for (int i = 0; i < 1000; ++i) {
+                socketCount = qMax(socketCount, server->numConnectedSockets());
+            }
+        }
+
+        int connections = 0;
+        Q_FOREACH (ConnectingThread *thread, connectingThreads) {
+            thread->stop();
+            connections += thread->connectionCount();
+        }
+        qDeleteAll(connectingThreads);
+        QVERIFY(connections > 0);
+        QVERIFY(socketCount >= 0);
+        qDebug() << connections << "connections accepted meanwhile, up to" << socketCount << "at the same time";
+    }
+
     void testSuspendUnderLoad()
     {
 #ifdef Q_OS_MAC
@@ -810,6 +1117,57 @@ private Q_SLOTS:
         makeFaultyCall(server->endPoint());
     }
 
+    void testMetrics()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        const QString operation = QString::fromLatin1("getEmployeeCountry");
+
+        {
+            KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+            for (int i = 0; i < 3; ++i) {
+                const KDSoapMessage response = client.call(operation, countryMessage());
+                QVERIFY(!response.isFault());
+            }
+        }
+        makeFaultyCall(server->endPoint());
+
+        const KDSoapServerMetrics metrics = server->metrics();
+        QCOMPARE(metrics.operations(), QStringList() << operation);
+        QCOMPARE(metrics.requestCount(operation), qint64(4));
+        QCOMPARE(metrics.faultCount(operation), qint64(1));
+        QCOMPARE(metrics.requestCount(), qint64(4));
+        QCOMPARE(metrics.inFlightCalls(), qint64(0));
+        QVERIFY(metrics.bytesReceived(operation) > 0);
+        QVERIFY(metrics.bytesSent(operation) > 0);
+        QCOMPARE(metrics.totalConnectionCount(), server->totalConnectionCount());
+        for (int phase = 0; phase < KDSoapServerMetrics::PhaseCount; ++phase) {
+            const KDSoapServerMetrics::Phase p = static_cast<KDSoapServerMetrics::Phase>(phase);
+            QCOMPARE(metrics.latencyCount(p), qint64(4));
+            const QVector<qint64> histogram = metrics.latencyHistogram(p);
+            QCOMPARE(histogram.count(), KDSoapServerMetrics::latencyBucketBounds().count() + 1);
+            qint64 total = 0;
+            Q_FOREACH (qint64 count, histogram) {
+                total += count;
+            }
+            QCOMPARE(total, qint64(4));
+        }
+
+        // Not available over HTTP by default
+        QVERIFY(server->metricsPath().isEmpty());
+        server->setMetricsPath(QString::fromLatin1("/metrics"));
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        socket.write("GET /metrics HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+        QByteArray buffer, headers, body;
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(headers.contains("text/plain; version=0.0.4"));
+        QVERIFY(body.contains("kdsoap_requests_total{operation=\"getEmployeeCountry\"} 4\n"));
+        QVERIFY(body.contains("kdsoap_faults_total{operation=\"getEmployeeCountry\"} 1\n"));
+        QVERIFY(body.contains("kdsoap_phase_duration_seconds_count{phase=\"dispatch\"} 4\n"));
+    }
+
     void testLogging()
     {
         CountryServerThread serverThread;
@@ -863,10 +1221,58 @@ private Q_SLOTS:
         server->flushLogFile();
         compareLines(expected, fileName);
 
+        // The server closes the rejected connections, instead of leaving them open
+        QCOMPARE(server->numConnectedSockets(), 2);
+        ClientSocket rejectedSocket(server);
+        QVERIFY(rejectedSocket.waitForConnected());
+        QVERIFY(rejectedSocket.state() == QAbstractSocket::UnconnectedState || rejectedSocket.waitForDisconnected());
+
         qDeleteAll(clients);
         QFile::remove(fileName);
     }
 
+    void testStructuredLogging()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        const QString fileName = QString::fromLatin1("access.log");
+        const QString backupName = fileName + QLatin1String(".1");
+        QFile::remove(fileName);
+        QFile::remove(backupName);
+        server->setLogFileName(fileName);
+        server->setLogLevel(KDSoapServer::LogEveryCall);
+        server->setLogFormat(KDSoapServer::StructuredLogFormat);
+        QCOMPARE(server->logFormat(), KDSoapServer::StructuredLogFormat);
+
+        makeSimpleCall(server->endPoint());
+        makeFaultyCall(server->endPoint());
+        server->flushLogFile();
+
+        QList<QByteArray> lines = readLines(fileName);
+        QCOMPARE(lines.count(), 2);
+        QVERIFY(lines.at(0).startsWith("time="));
+        QVERIFY(lines.at(0).contains(" client="));
+        QVERIFY(lines.at(0).contains("127.0.0.1 method=getEmployeeCountry status=200 duration_us=")); // "::ffff:127.0.0.1" with dual-stack sockets
+        QVERIFY(lines.at(0).contains(" bytes_in="));
+        QVERIFY(!lines.at(0).contains(" bytes_out=0"));
+        QVERIFY(!lines.at(0).contains("fault="));
+        QVERIFY(lines.at(1).contains(" method=getEmployeeCountry status=500 "));
+        QVERIFY(lines.at(1).endsWith(" fault=\"Fault code Client.Data: Empty employee name (CountryServerObject)\"\n"));
+
+        // Rotation: the next line doesn't fit in the current file anymore
+        server->setLogFileMaxSize(QFileInfo(fileName).size() + 10);
+        QCOMPARE(server->logFileBackupCount(), 1);
+        makeSimpleCall(server->endPoint());
+        server->flushLogFile();
+        QCOMPARE(readLines(backupName).count(), 2);
+        QCOMPARE(readLines(fileName).count(), 1);
+
+        server->closeLogFile();
+        QFile::remove(fileName);
+        QFile::remove(backupName);
+    }
+
     void testWsdlFile()
     {
         CountryServerThread serverThread;
@@ -895,6 +1301,126 @@ private Q_SLOTS:
         QFile::remove(fileName);
     }
 
+    void testWsdlCache()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        const QString fileName = QString::fromLatin1("cached.wsdl");
+        QByteArray contents = "<definitions>";
+        for (int i = 0; i < 100; ++i) {
+            contents += "<message name=\"msg" + QByteArray::number(i) + "\"/>";
+        }
+        contents += "</definitions>";
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+        file.close();
+        const QString pathInUrl = QString::fromLatin1("/path/to/cached.wsdl");
+        server->setWsdlFile(fileName, pathInUrl);
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QByteArray buffer, headers, body;
+        const QByteArray request = "GET " + pathInUrl.toLatin1() + " HTTP/1.1\r\nHost: 127.0.0.1:12345\r\n";
+
+        socket.write(request + "\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QCOMPARE(body, contents);
+        const QByteArray etag = headerValue(headers, "ETag");
+        QVERIFY(etag.startsWith('"'));
+
+        // Conditional requests
+        socket.write(request + "If-None-Match: " + etag + "\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 304 Not Modified\r\n"));
+        QCOMPARE(headerValue(headers, "ETag"), etag);
+        socket.write(request + "If-Modified-Since: " + headerValue(headers, "Last-Modified") + "\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 304 Not Modified\r\n"));
+
+        // Pre-compressed variant, with its own entity tag
+        if (KDSoapCompression::isSupported()) {
+            socket.write(request + "Accept-Encoding: gzip\r\n\r\n");
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+            QCOMPARE(headerValue(headers, "Content-Encoding"), QByteArray("gzip"));
+            QVERIFY(headerValue(headers, "ETag") != etag);
+            KDSoapInflater inflater;
+            QVERIFY(inflater.start(KDSoapCompression::Gzip));
+            QByteArray inflated;
+            QVERIFY(inflater.inflate(body.constData(), body.size(), inflated));
+            QCOMPARE(inflated, contents);
+        }
+
+        // The cache is updated when the file changes
+        const QByteArray newContents = "<definitions/>";
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(newContents);
+        file.close();
+        for (int i = 0; i < 50 && body != newContents; ++i) {
+            QTest::qWait(100);
+            socket.write(request + "\r\n");
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        }
+        QCOMPARE(body, newContents);
+        QVERIFY(headerValue(headers, "ETag") != etag);
+        socket.write(request + "If-None-Match: " + etag + "\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+
+        // ... and when it is deleted, then created again
+        QVERIFY(QFile::remove(fileName));
+        const QByteArray recreatedContents = "<definitions name=\"recreated\"/>";
+        QTest::qWait(100);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(recreatedContents);
+        file.close();
+        for (int i = 0; i < 50 && body != recreatedContents; ++i) {
+            QTest::qWait(100);
+            socket.write(request + "\r\n");
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        }
+        QCOMPARE(body, recreatedContents);
+
+        QFile::remove(fileName);
+    }
+
+    // The file is loaded once it exists
+    void testWsdlFileCreatedLater()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        const QString fileName = QString::fromLatin1("later.wsdl");
+        QFile::remove(fileName);
+        const QString pathInUrl = QString::fromLatin1("/path/to/later.wsdl");
+        server->setWsdlFile(fileName, pathInUrl);
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QByteArray buffer, headers, body;
+        const QByteArray request = "GET " + pathInUrl.toLatin1() + " HTTP/1.1\r\nHost: 127.0.0.1:12345\r\n\r\n";
+        socket.write(request);
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(!headers.startsWith("HTTP/1.1 200 OK\r\n"));
+
+        const QByteArray contents = "<definitions/>";
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+        file.close();
+        for (int i = 0; i < 50 && body != contents; ++i) {
+            QTest::qWait(100);
+            socket.write(request);
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        }
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QCOMPARE(body, contents);
+
+        QFile::remove(fileName);
+    }
+
     void testFileDownload_data()
     {
         QTest::addColumn<QString>("fileToDownload"); // client
@@ -969,6 +1495,168 @@ private Q_SLOTS:
         }
     }
 
+    void testFileDownloadRanges()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setRequireAuth(false);
+
+        // Larger than what's written at once, so that the rest is sent as the client reads it
+        QByteArray contents;
+        for (int i = 0; i < 300000; ++i) {
+            contents += char('a' + i % 26);
+        }
+        const QString fileName = QString::fromLatin1("file_download.txt");
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+        file.close();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QByteArray buffer, headers, body;
+        const QByteArray request = "GET /path/to/file_download.txt HTTP/1.1\r\nHost: 127.0.0.1:12345\r\n";
+
+        socket.write(request + "\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QCOMPARE(headerValue(headers, "Accept-Ranges"), QByteArray("bytes"));
+        QCOMPARE(body.size(), contents.size());
+        QVERIFY(body == contents);
+        const QByteArray etag = headerValue(headers, "ETag");
+        const QByteArray lastModified = headerValue(headers, "Last-Modified");
+        QVERIFY(etag.startsWith('"'));
+        QVERIFY(KDSoapFileResponse::parseHttpDate(lastModified).isValid());
+
+        // Byte ranges
+        socket.write(request + "Range: bytes=10-19\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 206 Partial Content\r\n"));
+        QCOMPARE(headerValue(headers, "Content-Range"), QByteArray("bytes 10-19/300000"));
+        QCOMPARE(body, contents.mid(10, 10));
+
+        socket.write(request + "Range: bytes=-5\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QCOMPARE(headerValue(headers, "Content-Range"), QByteArray("bytes 299995-299999/300000"));
+        QCOMPARE(body, contents.right(5));
+
+        socket.write(request + "Range: bytes=100000-\r\nIf-Range: " + etag + "\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 206 Partial Content\r\n"));
+        QVERIFY(body == contents.mid(100000));
+
+        socket.write(request + "Range: bytes=300000-\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 416 Range Not Satisfiable\r\n"));
+        QCOMPARE(headerValue(headers, "Content-Range"), QByteArray("bytes */300000"));
+
+        // The file changed since the client got the first part: send it all
+        socket.write(request + "Range: bytes=10-19\r\nIf-Range: \"other\"\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QCOMPARE(body.size(), contents.size());
+
+        // Conditional requests
+        socket.write(request + "If-None-Match: \"other\", " + etag + "\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 304 Not Modified\r\n"));
+        QCOMPARE(headerValue(headers, "ETag"), etag);
+        QVERIFY(body.isEmpty());
+
+        socket.write(request + "If-Modified-Since: " + lastModified + "\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 304 Not Modified\r\n"));
+
+        socket.write(request + "If-None-Match: \"other\"\r\nIf-Modified-Since: " + lastModified + "\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QCOMPARE(body.size(), contents.size());
+
+        QFile::remove(fileName);
+    }
+
+    void testHttpRangeParsing_data()
+    {
+        QTest::addColumn<QByteArray>("range");
+        QTest::addColumn<int>("expectedResult");
+        QTest::addColumn<qint64>("expectedFirst");
+        QTest::addColumn<qint64>("expectedLast");
+
+        QTest::newRow("first-last") << QByteArray("bytes=0-499") << int(KDSoapFileResponse::ValidRange) << qint64(0) << qint64(499);
+        QTest::newRow("open-ended") << QByteArray("bytes=9500-") << int(KDSoapFileResponse::ValidRange) << qint64(9500) << qint64(9999);
+        QTest::newRow("suffix") << QByteArray("bytes=-500") << int(KDSoapFileResponse::ValidRange) << qint64(9500) << qint64(9999);
+        QTest::newRow("suffix-too-long") << QByteArray("bytes=-20000") << int(KDSoapFileResponse::ValidRange) << qint64(0) << qint64(9999);
+        QTest::newRow("last-too-large") << QByteArray("bytes=9000-20000") << int(KDSoapFileResponse::ValidRange) << qint64(9000) << qint64(9999);
+        QTest::newRow("unsatisfiable") << QByteArray("bytes=10000-") << int(KDSoapFileResponse::UnsatisfiableRange) << qint64(0) << qint64(0);
+        QTest::newRow("empty-suffix") << QByteArray("bytes=-0") << int(KDSoapFileResponse::UnsatisfiableRange) << qint64(0) << qint64(0);
+        QTest::newRow("multiple") << QByteArray("bytes=0-1,5-6") << int(KDSoapFileResponse::NoRange) << qint64(0) << qint64(0);
+        QTest::newRow("reversed") << QByteArray("bytes=500-100") << int(KDSoapFileResponse::NoRange) << qint64(0) << qint64(0);
+        QTest::newRow("other-unit") << QByteArray("items=0-1") << int(KDSoapFileResponse::NoRange) << qint64(0) << qint64(0);
+        QTest::newRow("garbage") << QByteArray("bytes=a-b") << int(KDSoapFileResponse::NoRange) << qint64(0) << qint64(0);
+    }
+
+    void testHttpRangeParsing()
+    {
+        QFETCH(QByteArray, range);
+        QFETCH(int, expectedResult);
+        QFETCH(qint64, expectedFirst);
+        QFETCH(qint64, expectedLast);
+
+        qint64 first = 0;
+        qint64 last = 0;
+        const KDSoapFileResponse::RangeResult result = KDSoapFileResponse::parseRange(range, 10000, first, last);
+        QCOMPARE(int(result), expectedResult);
+        if (result == KDSoapFileResponse::ValidRange) {
+            QCOMPARE(first, expectedFirst);
+            QCOMPARE(last, expectedLast);
+        }
+    }
+
+    void testHttpDate()
+    {
+        const QDateTime dateTime(QDate(1994, 11, 6), QTime(8, 49, 37), Qt::UTC);
+        QCOMPARE(KDSoapFileResponse::httpDate(dateTime), QByteArray("Sun, 06 Nov 1994 08:49:37 GMT"));
+        QCOMPARE(KDSoapFileResponse::parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT"), dateTime);
+        QVERIFY(!KDSoapFileResponse::parseHttpDate("Sunday, 06-Nov-94 08:49:37 GMT").isValid());
+        QVERIFY(KDSoapFileResponse::etagMatches("W/\"1\", \"2\"", "\"1\""));
+        QVERIFY(KDSoapFileResponse::etagMatches("*", "\"1\""));
+        QVERIFY(!KDSoapFileResponse::etagMatches("\"2\"", "\"1\""));
+    }
+
+    // Without sendfile (e.g. for TLS connections), a file truncated while it's being sent
+    // ends the response, instead of crashing the server
+    void testTruncatedFileDownload()
+    {
+        const QString fileName = QString::fromLatin1("truncated_download.txt");
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray(1024 * 1024, 'x'));
+        file.close();
+
+        QTcpServer tcpServer;
+        QVERIFY(tcpServer.listen(QHostAddress::LocalHost));
+        QTcpSocket socket;
+        socket.connectToHost(QHostAddress::LocalHost, tcpServer.serverPort());
+        QVERIFY(socket.waitForConnected());
+
+        QFile *device = new QFile(fileName);
+        QVERIFY(device->open(QIODevice::ReadOnly));
+        KDSoapFileResponse response(device, false /*allowZeroCopy*/);
+        KDSoapHttpRequestParser request;
+        request.buffer() = "GET /truncated_download.txt HTTP/1.1\r\nHost: 127.0.0.1:12345\r\n\r\n";
+        QCOMPARE(request.parse(), KDSoapHttpRequestParser::HeadersComplete);
+        response.responseHeaders(request, "text/plain", QByteArray());
+        QVERIFY(response.writeBody(&socket));
+        QVERIFY(!response.atEnd());
+
+        while (socket.bytesToWrite() > 0) {
+            QVERIFY(socket.waitForBytesWritten());
+        }
+        QVERIFY(file.resize(1000));
+        QVERIFY(!response.writeBody(&socket));
+        QFile::remove(fileName);
+    }
+
     void testFileDownloadAuth_data()
     {
         QTest::addColumn<bool>("requireAuth"); // server
@@ -1196,6 +1884,495 @@ private Q_SLOTS:
         }
     }
 
+    // Several requests sent in one go, without waiting for the responses
+    void testPipelining()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        // The second request gets a delayed response, the responses must still arrive in order
+        QList<QByteArray> employeeNames;
+        employeeNames << "David" << "Delayed" << s_longEmployeeName << "Kevin";
+        QByteArray requests;
+        Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+            requests += countryRequest(employeeName);
+        }
+        socket.write(requests);
+        QVERIFY(socket.waitForBytesWritten());
+
+        QByteArray buffer;
+        Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+            QByteArray headers, body;
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+            QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+            QVERIFY(xmlBufferCompare(body, expectedCountryResponse(employeeName)));
+        }
+        QVERIFY(buffer.isEmpty());
+    }
+
+    void testTruncatedEnvelope_data()
+    {
+        QTest::addColumn<bool>("epoll");
+
+        QTest::newRow("qtio") << false;
+#ifdef Q_OS_LINUX
+        QTest::newRow("epoll") << true;
+#endif
+    }
+
+    void testTruncatedEnvelope()
+    {
+        QFETCH(bool, epoll);
+
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        if (epoll) {
+            server->setPlainServerObject(true);
+            server->setIoBackend(KDSoapServer::EpollIoBackend);
+        }
+
+        // A complete body holding an incomplete envelope, followed by a pipelined call
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QByteArray message = rawCountryMessage("David");
+        message.chop(qstrlen("</soap:Body></soap:Envelope>"));
+        const QByteArray truncatedRequest = "POST / HTTP/1.1\r\n"
+                                            "SoapAction: http://www.kdab.com/xml/MyWsdl/getEmployeeCountry\r\n"
+                                            "Content-Type: text/xml;charset=utf-8\r\n"
+                                            "Content-Length: " + QByteArray::number(message.size()) + "\r\n"
+                                            "\r\n" + message;
+        socket.write(truncatedRequest + countryRequest("Kevin"));
+        QByteArray buffer, headers, body;
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 500 Internal Server Error\r\n"));
+        QVERIFY(headers.contains("\r\nConnection: close\r\n"));
+        QVERIFY(body.contains("Incomplete SOAP message"));
+
+        // The connection is closed, rather than answering the truncated call with the next response
+        QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected());
+        buffer += socket.readAll();
+        QVERIFY(buffer.isEmpty());
+    }
+
+    void testKeepAliveTimeout()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setKeepAliveTimeout(1);
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        socket.write(countryRequest("David"));
+        QByteArray buffer, headers, body;
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.contains("\r\nKeep-Alive: timeout=1\r\n"));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("David")));
+
+        // The connection stays usable until the timeout
+        socket.write(countryRequest("Kevin"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+
+        QTime time;
+        time.start();
+        QVERIFY(socket.waitForDisconnected(5000));
+        QVERIFY(time.elapsed() >= 900);
+    }
+
+    void testMaxRequestsPerConnection()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setMaxRequestsPerConnection(2);
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        socket.write(countryRequest("David") + countryRequest("Kevin"));
+        QByteArray buffer, headers, body;
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.contains("\r\nKeep-Alive: max=1\r\n"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.contains("\r\nConnection: close\r\n"));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+        QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected());
+        QVERIFY(buffer.isEmpty());
+        QVERIFY(socket.readAll().isEmpty());
+    }
+
+    void testConnectionHeader_data()
+    {
+        QTest::addColumn<QByteArray>("httpVersion");
+        QTest::addColumn<QByteArray>("connectionHeader");
+        QTest::addColumn<bool>("expectedKeepAlive");
+
+        QTest::newRow("1.1") << QByteArray("HTTP/1.1") << QByteArray() << true;
+        QTest::newRow("1.1_close") << QByteArray("HTTP/1.1") << QByteArray("Connection: close\r\n") << false;
+        QTest::newRow("1.0") << QByteArray("HTTP/1.0") << QByteArray() << false;
+        QTest::newRow("1.0_keepalive") << QByteArray("HTTP/1.0") << QByteArray("Connection: Keep-Alive\r\n") << true;
+    }
+
+    void testConnectionHeader()
+    {
+        QFETCH(QByteArray, httpVersion);
+        QFETCH(QByteArray, connectionHeader);
+        QFETCH(bool, expectedKeepAlive);
+
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        socket.write(countryRequest("David", httpVersion, connectionHeader));
+        QByteArray buffer, headers, body;
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("David")));
+        if (expectedKeepAlive) {
+            QCOMPARE(headers.contains("\r\nConnection: close\r\n"), false);
+            QCOMPARE(headers.contains("\r\nConnection: keep-alive\r\n"), httpVersion == "HTTP/1.0");
+            QVERIFY(!socket.waitForDisconnected(500));
+        } else {
+            QVERIFY(headers.contains("\r\nConnection: close\r\n"));
+            QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected());
+        }
+    }
+
+    void testEpollBackend()
+    {
+#ifndef Q_OS_LINUX
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+        QSKIP("epoll is only available on Linux");
+#else
+        QSKIP("epoll is only available on Linux", SkipSingle);
+#endif
+#endif
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setPlainServerObject(true);
+        server->setIoBackend(KDSoapServer::EpollIoBackend);
+        QCOMPARE(server->ioBackend(), KDSoapServer::EpollIoBackend);
+
+        // Pipelined calls, handled without creating a socket
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QList<QByteArray> employeeNames;
+        employeeNames << "David" << s_longEmployeeName << "Kevin";
+        QByteArray requests;
+        Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+            requests += countryRequest(employeeName);
+        }
+        socket.write(requests);
+        QByteArray buffer, headers, body;
+        Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+            QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+            QVERIFY(xmlBufferCompare(body, expectedCountryResponse(employeeName)));
+        }
+        QCOMPARE(server->numConnectedSockets(), 1);
+        QCOMPARE(server->metrics().requestCount(QString::fromLatin1("getEmployeeCountry")), qint64(3));
+
+        // A request larger than what a connection reads per event is parsed as it arrives,
+        // the connection is resumed until the pipelined request after it was handled
+        const QByteArray longName(1024 * 1024, 'x');
+        socket.write(countryRequest(longName) + countryRequest("Kevin"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse(longName)));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+        QCOMPARE(server->numConnectedSockets(), 1);
+
+        // A delayed response hands the connection over to a socket, in the middle of the call;
+        // the responses still arrive in order
+        employeeNames.clear();
+        employeeNames << "David" << "Delayed" << "Kevin";
+        requests.clear();
+        Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+            requests += countryRequest(employeeName);
+        }
+        socket.write(requests);
+        Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+            QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+            QVERIFY(xmlBufferCompare(body, expectedCountryResponse(employeeName)));
+        }
+        QVERIFY(buffer.isEmpty());
+
+        // So does a request which isn't a SOAP call
+        ClientSocket getSocket(server);
+        QVERIFY(getSocket.waitForConnected());
+        getSocket.write("GET /nothing_here HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n" + countryRequest("David"));
+        QVERIFY(readSocketResponse(getSocket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 404 Not Found\r\n"));
+        QVERIFY(readSocketResponse(getSocket, buffer, headers, body));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("David")));
+        QCOMPARE(server->numConnectedSockets(), 2);
+
+        // Idle connections are closed after the keep-alive timeout
+        server->setKeepAliveTimeout(1);
+        ClientSocket idleSocket(server);
+        QVERIFY(idleSocket.waitForConnected());
+        idleSocket.write(countryRequest("David"));
+        QVERIFY(readSocketResponse(idleSocket, buffer, headers, body));
+        QVERIFY(headers.contains("\r\nKeep-Alive: timeout=1\r\n"));
+        QVERIFY(idleSocket.waitForDisconnected(5000));
+    }
+
+    void testInvalidCharacterReference_data()
+    {
+        QTest::addColumn<int>("ioBackend");
+        QTest::newRow("qt") << int(KDSoapServer::QtIoBackend);
+#ifdef Q_OS_LINUX
+        QTest::newRow("epoll") << int(KDSoapServer::EpollIoBackend);
+#endif
+    }
+
+    // Replaced with '?' by the sanitizer, with both backends
+    void testInvalidCharacterReference()
+    {
+        QFETCH(int, ioBackend);
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setPlainServerObject(true);
+        server->setIoBackend(KDSoapServer::IoBackend(ioBackend));
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        // In two parts, split in the middle of the character reference
+        const QByteArray request = countryRequest("Da&#x13;vid");
+        const int split = request.indexOf("&#x") + 3;
+        socket.write(request.left(split));
+        QVERIFY(socket.waitForBytesWritten());
+        QTest::qWait(50);
+        socket.write(request.mid(split));
+        QByteArray buffer, headers, body;
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Da?vid")));
+    }
+
+    void testCompression()
+    {
+        if (!KDSoapCompression::isSupported()) {
+#if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
+            QSKIP("KD SOAP was built without zlib");
+#else
+            QSKIP("KD SOAP was built without zlib", SkipSingle);
+#endif
+        }
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        QCOMPARE(server->compressionThreshold(), -1);
+        server->setCompressionThreshold(100);
+        server->setCompressionLevel(9);
+
+        // QNetworkAccessManager asks for, and decompresses, gzip responses
+        makeSimpleCall(server->endPoint());
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QByteArray buffer, headers, body;
+
+        // Compressed request, compressed response
+        const QByteArray message = rawCountryMessage("David");
+        const QByteArray compressedMessage = KDSoapCompression::compress(message, KDSoapCompression::Gzip, 6);
+        QByteArray request = countryRequest("David", "HTTP/1.1", "Accept-Encoding: gzip\r\nContent-Encoding: gzip\r\n");
+        request.replace("Content-Length: " + QByteArray::number(message.size()), "Content-Length: " + QByteArray::number(compressedMessage.size()));
+        request.replace(message, compressedMessage);
+        socket.write(request);
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(headers.contains("\r\nContent-Encoding: gzip\r\n"));
+        QVERIFY(headers.contains("\r\nVary: Accept-Encoding\r\n"));
+        KDSoapInflater inflater;
+        QVERIFY(inflater.start(KDSoapCompression::Gzip));
+        QByteArray response;
+        QVERIFY(inflater.inflate(body.constData(), body.size(), response));
+        QVERIFY(inflater.isFinished());
+        QVERIFY(xmlBufferCompare(response, expectedCountryResponse("David")));
+
+        // Response smaller than the threshold
+        server->setCompressionThreshold(100000);
+        socket.write(countryRequest("Kevin", "HTTP/1.1", "Accept-Encoding: gzip, deflate\r\n"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(!headers.contains("Content-Encoding"));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+
+        // Unknown encoding for the request
+        socket.write(countryRequest("Kevin", "HTTP/1.1", "Content-Encoding: br\r\n"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 415 Unsupported Media Type\r\n"));
+
+        // Corrupted request
+        socket.write(countryRequest("Kevin", "HTTP/1.1", "Content-Encoding: gzip\r\n"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 400 Bad Request\r\n"));
+
+        // Request decompressing to more than the limit
+        QCOMPARE(server->maxDecompressedRequestSize(), 16 * 1024 * 1024);
+        server->setMaxDecompressedRequestSize(message.size() - 1);
+        socket.write(request);
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 413 Request Entity Too Large\r\n"));
+        server->setMaxDecompressedRequestSize(message.size());
+        socket.write(request);
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+    }
+
+    void testLoadShedding_data()
+    {
+        QTest::addColumn<bool>("perThread");
+        QTest::newRow("server") << false;
+        QTest::newRow("thread") << true;
+    }
+
+    void testLoadShedding()
+    {
+        QFETCH(bool, perThread);
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        QCOMPARE(server->maxPendingCalls(), -1);
+        QCOMPARE(server->maxPendingCallsPerThread(), -1);
+        if (perThread) {
+            server->setMaxPendingCallsPerThread(1);
+        } else {
+            server->setMaxPendingCalls(1);
+        }
+        server->setRetryAfter(5);
+
+        // A delayed response keeps one call pending
+        ClientSocket delayedSocket(server);
+        QVERIFY(delayedSocket.waitForConnected());
+        delayedSocket.write(countryRequest("Delayed"));
+        for (int i = 0; i < 100 && server->pendingCallCount() == 0; ++i) {
+            QTest::qWait(10);
+        }
+        QCOMPARE(server->pendingCallCount(), 1);
+
+        // Other calls are rejected meanwhile, but not the GET requests
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QByteArray buffer, headers, body;
+        socket.write(countryRequest("Kevin"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 503 Service Unavailable\r\n"));
+        QCOMPARE(headerValue(headers, "Retry-After"), QByteArray("5"));
+        socket.write("GET /path/to/nonexistent.txt HTTP/1.1\r\nHost: 127.0.0.1:12345\r\n\r\n");
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 404 Not Found\r\n"));
+
+        QByteArray delayedBuffer;
+        QVERIFY(readSocketResponse(delayedSocket, delayedBuffer, headers, body));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Delayed")));
+        QCOMPARE(server->pendingCallCount(), 0);
+
+        // Accepted again, on the same connection
+        socket.write(countryRequest("Kevin"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+        QCOMPARE(server->pendingCallCount(), 0);
+        QCOMPARE(server->metrics().shedCallCount(), qint64(1));
+        QVERIFY(server->metrics().toPrometheusText().contains("\nkdsoap_shed_calls_total 1\n"));
+    }
+
+    void testResponseDeadline()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        QCOMPARE(server->responseDeadline(), -1);
+        server->setResponseDeadline(5000);
+        server->setOperationResponseDeadline(QString::fromLatin1("getEmployeeCountry"), 300);
+        QCOMPARE(server->responseDeadline(QString::fromLatin1("getEmployeeCountry")), 300);
+        QCOMPARE(server->responseDeadline(QString::fromLatin1("getStuff")), 5000);
+
+        // Answered before the deadline
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QByteArray buffer, headers, body;
+        socket.write(countryRequest("Delayed"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Delayed")));
+
+        // Not answered in time: timeout fault, and the connection can be used again
+        QElapsedTimer timer;
+        timer.start();
+        socket.write(countryRequest("Late"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(timer.elapsed() < 1000);
+        QVERIFY(headers.startsWith("HTTP/1.1 500 Internal Server Error\r\n"));
+        QVERIFY(body.contains(">Server.Timeout<"));
+        QCOMPARE(server->pendingCallCount(), 0);
+        socket.write(countryRequest("Kevin"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+
+        // The late response is ignored
+        QTest::qWait(1000);
+        QVERIFY(buffer.isEmpty());
+        QCOMPARE(socket.bytesAvailable(), qint64(0));
+        socket.write(countryRequest("David"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("David")));
+        QVERIFY(buffer.isEmpty());
+
+        // Without a deadline for this operation
+        server->clearOperationResponseDeadline(QString::fromLatin1("getEmployeeCountry"));
+        server->setResponseDeadline(-1);
+        socket.write(countryRequest("Late"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(timer.elapsed() >= 1000);
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Late")));
+    }
+
+    void testStreamedResponse()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        QCOMPARE(server->responseChunkSize(), -1);
+        server->setResponseChunkSize(100);
+
+        // Pipelined requests, the streamed responses (including a delayed one) must arrive in order
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QList<QByteArray> employeeNames;
+        employeeNames << "David" << "Delayed" << "Kevin";
+        QByteArray requests;
+        Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+            requests += countryRequest(employeeName);
+        }
+        socket.write(requests);
+        QVERIFY(socket.waitForBytesWritten());
+        QByteArray buffer, headers, body;
+        Q_FOREACH (const QByteArray &employeeName, employeeNames) {
+            QVERIFY(readSocketResponse(socket, buffer, headers, body));
+            QVERIFY(headers.startsWith("HTTP/1.1 200 OK\r\n"));
+            QVERIFY(headers.contains("\r\nTransfer-Encoding: chunked\r\n"));
+            QVERIFY(!headers.contains("Content-Length"));
+            QVERIFY(xmlBufferCompare(body, expectedCountryResponse(employeeName)));
+        }
+
+        // A response which fits in a single chunk is sent as usual
+        server->setResponseChunkSize(100000);
+        socket.write(countryRequest("Kevin"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.contains("\r\nContent-Length: "));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+
+        // No chunked encoding in HTTP/1.0
+        server->setResponseChunkSize(100);
+        socket.write(countryRequest("Kevin", "HTTP/1.0", "Connection: keep-alive\r\n"));
+        QVERIFY(readSocketResponse(socket, buffer, headers, body));
+        QVERIFY(headers.contains("\r\nContent-Length: "));
+        QVERIFY(xmlBufferCompare(body, expectedCountryResponse("Kevin")));
+
+        // QNetworkAccessManager decodes the chunks
+        makeSimpleCall(server->endPoint());
+    }
+
     void testContentTypeParsing() // SOAP 112
     {
         CountryServerThread serverThread;
@@ -1296,7 +2473,77 @@ private Q_SLOTS:
         CountryServer *server = serverThread.startThread();
         server->setFeatures(KDSoapServer::Ssl);
         QVERIFY(server->endPoint().startsWith(QLatin1String("https")));
+        QCOMPARE(server->metrics().tlsHandshakeCount(), qint64(0));
         makeSimpleCall(server->endPoint());
+        const KDSoapServerMetrics metrics = server->metrics();
+        QVERIFY(metrics.tlsHandshakeCount() >= 1);
+        QVERIFY(metrics.tlsHandshakeTime() > 0);
+        QCOMPARE(metrics.tlsHandshakeFailureCount(), qint64(0));
+
+        // A plain HTTP client never completes the handshake
+        {
+            ClientSocket socket(server);
+            QVERIFY(socket.waitForConnected());
+            socket.write("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+            socket.waitForDisconnected(2000);
+        }
+        for (int i = 0; i < 100 && server->metrics().tlsHandshakeFailureCount() == 0; ++i) {
+            QTest::qWait(10);
+        }
+        QCOMPARE(server->metrics().tlsHandshakeFailureCount(), qint64(1));
+        QVERIFY(server->metrics().toPrometheusText().contains("\nkdsoap_tls_handshakes_total{result=\"failure\"} 1\n"));
+#endif
+    }
+
+    void testTlsSessionResumption()
+    {
+#if !defined(QT_NO_OPENSSL) && QT_VERSION >= QT_VERSION_CHECK(5,2,0) // for QSslConfiguration::sessionTicket
+        if (!QSslSocket::supportsSsl()) {
+            return;
+        }
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setFeatures(KDSoapServer::Ssl);
+        QCOMPARE(server->tlsSessionLifetime(), 0); // disabled by default
+        server->setTlsSessionLifetime(300);
+        if (server->tlsSessionLifetime() == 0) {
+            QSKIP("KD SOAP was built without TLS session resumption");
+        }
+        QCOMPARE(server->tlsSessionLifetime(), 300);
+        QCOMPARE(server->tlsTicketKeyLifetime(), 3600);
+
+        // Each connection resumes the session of the previous one, when the client gives it
+        QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+        config.setProtocol(QSsl::TlsV1_2); // the session ticket is sent during the handshake
+        config.setPeerVerifyMode(QSslSocket::VerifyNone);
+        config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+        QByteArray session;
+        const QUrl url(server->endPoint());
+        const bool resumeSession[] = { false, true, true, // session tickets
+                                       false, true, // session IDs, without ticket keys
+                                       false, true // disabled
+                                     };
+        for (int i = 0; i < 7; ++i) {
+            if (i == 3) {
+                server->setTlsTicketKeyLifetime(0);
+            } else if (i == 5) {
+                server->setTlsSessionLifetime(0);
+            }
+            QSslSocket socket;
+            config.setSessionTicket(resumeSession[i] ? session : QByteArray());
+            socket.setSslConfiguration(config);
+            socket.connectToHostEncrypted(url.host(), server->serverPort());
+            QVERIFY(socket.waitForEncrypted());
+            session = socket.sslConfiguration().sessionTicket();
+        }
+        for (int i = 0; i < 100 && server->metrics().tlsHandshakeCount() < 7; ++i) {
+            QTest::qWait(10);
+        }
+        const KDSoapServerMetrics metrics = server->metrics();
+        QCOMPARE(metrics.tlsHandshakeCount(), qint64(7));
+        QCOMPARE(metrics.tlsResumedHandshakeCount(), qint64(3));
+        QVERIFY(metrics.toPrometheusText().contains("\nkdsoap_tls_handshakes_total{result=\"full\"} 4\n"));
+        QVERIFY(metrics.toPrometheusText().contains("\nkdsoap_tls_handshakes_total{result=\"resumed\"} 3\n"));
 #endif
     }
 
@@ -1387,6 +2634,104 @@ private:
         return QString::fromUtf8("David Ä Faure France");
     }
 
+    static QByteArray countryRequest(const QByteArray &employeeName, const QByteArray &httpVersion = "HTTP/1.1", const QByteArray &extraHeaders = QByteArray())
+    {
+        const QByteArray message = rawCountryMessage(employeeName);
+        return "POST / " + httpVersion + "\r\n"
+               "SoapAction: http://www.kdab.com/xml/MyWsdl/getEmployeeCountry\r\n"
+               "Content-Type: text/xml;charset=utf-8\r\n"
+               "Content-Length: " + QByteArray::number(message.size()) + "\r\n"
+               "Host: 127.0.0.1:12345\r\n" // ignored
+               + extraHeaders +
+               "\r\n" + message;
+    }
+
+    // Reads one response (using its Content-Length, or its chunks) into headers and body.
+    // buffer holds the data received after that response, if any.
+    static bool readSocketResponse(ClientSocket &socket, QByteArray &buffer, QByteArray &headers, QByteArray &body)
+    {
+        int headersEnd;
+        while ((headersEnd = buffer.indexOf("\r\n\r\n")) == -1) {
+            if (!socket.waitForReadyRead()) {
+                return false;
+            }
+            buffer += socket.readAll();
+        }
+        headers = buffer.left(headersEnd + 2);
+        const QByteArray lowerHeaders = headers.toLower();
+        if (lowerHeaders.contains("\r\ntransfer-encoding: chunked\r\n")) {
+            buffer = buffer.mid(headersEnd + 4);
+            return readChunkedBody(socket, buffer, body);
+        }
+        const int lengthPos = lowerHeaders.indexOf("\r\ncontent-length: ");
+        if (lengthPos == -1) {
+            if (headers.startsWith("HTTP/1.1 304 ")) { // never has a body
+                body.clear();
+                buffer = buffer.mid(headersEnd + 4);
+                return true;
+            }
+            return false;
+        }
+        const int valuePos = lengthPos + 18;
+        const int contentLength = lowerHeaders.mid(valuePos, lowerHeaders.indexOf("\r\n", valuePos) - valuePos).toInt();
+        const int responseSize = headersEnd + 4 + contentLength;
+        while (buffer.size() < responseSize) {
+            if (!socket.waitForReadyRead()) {
+                return false;
+            }
+            buffer += socket.readAll();
+        }
+        body = buffer.mid(headersEnd + 4, contentLength);
+        buffer = buffer.mid(responseSize);
+        return true;
+    }
+
+    static QByteArray headerValue(const QByteArray &headers, const QByteArray &name)
+    {
+        const QByteArray prefix = "\r\n" + name + ": ";
+        const int pos = headers.indexOf(prefix);
+        if (pos == -1) {
+            return QByteArray();
+        }
+        const int valuePos = pos + prefix.size();
+        return headers.mid(valuePos, headers.indexOf("\r\n", valuePos) - valuePos);
+    }
+
+    // Decodes a body sent with Transfer-Encoding: chunked
+    static bool readChunkedBody(ClientSocket &socket, QByteArray &buffer, QByteArray &body)
+    {
+        body.clear();
+        Q_FOREVER {
+            int sizeEnd;
+            while ((sizeEnd = buffer.indexOf("\r\n")) == -1) {
+                if (!socket.waitForReadyRead()) {
+                    return false;
+                }
+                buffer += socket.readAll();
+            }
+            bool ok;
+            const int chunkSize = buffer.left(sizeEnd).toInt(&ok, 16);
+            if (!ok) {
+                return false;
+            }
+            const int chunkEnd = sizeEnd + 2 + chunkSize + 2;
+            while (buffer.size() < chunkEnd) {
+                if (!socket.waitForReadyRead()) {
+                    return false;
+                }
+                buffer += socket.readAll();
+            }
+            if (buffer.mid(chunkEnd - 2, 2) != "\r\n") {
+                return false;
+            }
+            body += buffer.mid(sizeEnd + 2, chunkSize);
+            buffer = buffer.mid(chunkEnd);
+            if (chunkSize == 0) {
+                return true;
+            }
+        }
+    }
+
     void verifySocketResponse(ClientSocket &socket, const QByteArray employeeName)
     {
         QVERIFY(socket.waitForReadyRead());
@@ -1468,6 +2813,23 @@ void CountryServerObject::processRequest(const KDSoapMessage &request, KDSoapMes
             return;
         }
         const QString employeeName = request.childValues().child(QLatin1String("employeeName")).value().toString();
+        if (employeeName == QLatin1String("Delayed")) {
+            m_delayedResponseHandle = prepareDelayedResponse();
+            QTimer::singleShot(100, this, SLOT(slotSendDelayedResponse()));
+            return;
+        }
+        if (employeeName == QLatin1String("Late")) {
+            m_lateResponseHandle = prepareDelayedResponse();
+            QTimer::singleShot(1000, this, SLOT(slotSendLateResponse()));
+            return;
+        }
+        if (employeeName == QLatin1String("Abandoned")) {
+            prepareDelayedResponse(); // the handle is dropped, the response will never be sent
+            return;
+        }
+        if (employeeName == QLatin1String("WriteHTTP") && !serverSocket()) {
+            writeHTTP("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n"); // ignored, the normal response follows
+        }
         const QString ret = this->getEmployeeCountry(employeeName);
         if (!hasFault()) {
             response.setValue(QLatin1String("getEmployeeCountryResponse"));
@@ -10,7 +10,11 @@ SUBDIRS = \
   groupwise_wsdl \
   logbook_wsdl \
   messagereader \
+  xmltokenizer \
   servertest \
+  httprequestparser \
+  compression \
+  kdsoap-bench \
   msexchange_noservice_wsdl \
   msexchange_wsdl \
   multiple_input_param \
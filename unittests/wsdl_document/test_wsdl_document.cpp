@@ -640,6 +640,8 @@ private Q_SLOTS:
     void testDisconnectDuringDelayedCall();
     void testServerDifferentPath();
     void testServerDifferentPathFault();
+    void testServerDispatch_data();
+    void testServerDispatch();
 
 public slots:
     void slotFinished(KDSoapPendingCallWatcher *watcher)
@@ -1233,6 +1235,35 @@ void WsdlDocumentTest::testServerDifferentPathFault()
     QCOMPARE(serv.lastError(), QLatin1String("Fault code Server.Implementation: Not implemented (NameServiceServerObject)"));
 }
 
+void WsdlDocumentTest::testServerDispatch_data()
+{
+    QTest::addColumn<QString>("requestName");
+    QTest::addColumn<QByteArray>("soapAction");
+    QTest::addColumn<QString>("expectedMethod");
+
+    // The dispatch cost must not depend on the position of the operation in the WSDL file
+    QTest::newRow("sixth operation") << QString::fromLatin1("listEmployees") << QByteArray() << QString::fromLatin1("listEmployees");
+    QTest::newRow("last operation") << QString::fromLatin1("heart-beat") << QByteArray() << QString::fromLatin1("heartbeat");
+    QTest::newRow("soap action") << QString::fromLatin1("ListEmployeesRequest") << QByteArray("http://www.kdab.com/PleaseListEmployees") << QString::fromLatin1("listEmployees");
+}
+
+void WsdlDocumentTest::testServerDispatch()
+{
+    QFETCH(QString, requestName);
+    QFETCH(QByteArray, soapAction);
+    QFETCH(QString, expectedMethod);
+
+    DocServerObject serverObject;
+    KDSoapMessage request;
+    request = KDSoapValue(requestName, QVariant());
+    KDSoapMessage response;
+    serverObject.processRequest(request, response, soapAction);
+    QCOMPARE(serverObject.m_lastMethodCalled, expectedMethod);
+    QBENCHMARK {
+        serverObject.processRequest(request, response, soapAction);
+    }
+}
+
 QTEST_MAIN(WsdlDocumentTest)
 
 #include "test_wsdl_document.moc"
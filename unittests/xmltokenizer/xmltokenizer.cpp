@@ -0,0 +1,333 @@
+/****************************************************************************
+** Copyright (C) 2010-2017 Klaralvdalens Datakonsult AB, a KDAB Group company, info@kdab.com.
+** All rights reserved.
+**
+** This file is part of the KD Soap library.
+**
+** Licensees holding valid commercial KD Soap licenses may use this file in
+** accordance with the KD Soap Commercial License Agreement provided with
+** the Software.
+**
+**
+** This file may be distributed and/or modified under the terms of the
+** GNU Lesser General Public License version 2.1 and version 3 as published by the
+** Free Software Foundation and appearing in the file LICENSE.LGPL.txt included.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Contact info@kdab.com if any conditions of this licensing are not
+** clear to you.
+**
+**********************************************************************/
+#include "KDSoapXmlTokenizer_p.h"
+#include "KDSoapSimdXmlTokenizer_p.h"
+#include <QtTest/QtTest>
+
+// The elements and texts of a document, in a form which doesn't depend on how the text is split
+// into Characters tokens, or on the comments and processing instructions
+static QStringList tokenize(KDSoapXmlTokenizer &tokenizer, const QByteArray &xml, int partSize)
+{
+    if (partSize == 0) {
+        partSize = qMax(1, xml.size());
+    }
+    tokenizer.clear();
+    QStringList tokens;
+    QString text;
+    int depth = 0;
+    int pos = 0;
+    Q_FOREVER {
+        const QXmlStreamReader::TokenType type = tokenizer.readNext();
+        if (type == QXmlStreamReader::Invalid) {
+            if (tokenizer.error() == QXmlStreamReader::PrematureEndOfDocumentError && pos < xml.size()) {
+                tokenizer.addData(xml.mid(pos, partSize));
+                pos += partSize;
+                continue;
+            }
+            break;
+        }
+        if (type == QXmlStreamReader::EndDocument) {
+            break;
+        }
+        if (type == QXmlStreamReader::Characters) {
+            if (depth > 0) {
+                text += tokenizer.text();
+            }
+            continue;
+        }
+        if (type != QXmlStreamReader::StartElement && type != QXmlStreamReader::EndElement) {
+            continue;
+        }
+        if (!text.isEmpty()) {
+            tokens.append(QString::fromLatin1("T ") + text);
+            text.clear();
+        }
+        QString token = QString::fromLatin1(type == QXmlStreamReader::StartElement ? "S {%1}%2" : "E {%1}%2")
+                        .arg(tokenizer.namespaceUri().toString(), tokenizer.name().toString());
+        if (type == QXmlStreamReader::StartElement) {
+            ++depth;
+            const QXmlStreamNamespaceDeclarations declarations = tokenizer.namespaceDeclarations();
+            Q_FOREACH (const QXmlStreamNamespaceDeclaration &declaration, declarations) {
+                token += QString::fromLatin1(" xmlns:%1=%2").arg(declaration.prefix().toString(), declaration.namespaceUri().toString());
+            }
+            for (int i = 0; i < tokenizer.attributeCount(); ++i) {
+                token += QString::fromLatin1(" {%1}%2=%3").arg(tokenizer.attributeNamespaceUri(i).toString(),
+                                                               tokenizer.attributeName(i).toString(),
+                                                               tokenizer.attributeValue(i).toString());
+            }
+        } else {
+            --depth;
+        }
+        tokens.append(token);
+    }
+    if (tokenizer.error() == QXmlStreamReader::PrematureEndOfDocumentError) {
+        tokens.append(QString::fromLatin1("premature end"));
+    } else if (tokenizer.hasError()) {
+        tokens.append(QString::fromLatin1("error"));
+    }
+    return tokens;
+}
+
+// What findTextDelimiter and findAttributeDelimiter should find
+static bool isTextDelimiter(uchar c)
+{
+    return c == '<' || c == '&' || c == ']' || (c < 0x20 && c != '\t' && c != '\n');
+}
+
+static bool isAttributeDelimiter(uchar c, char quote)
+{
+    return c == uchar(quote) || c == '&' || c == '<' || c < 0x20;
+}
+
+static QList<KDSoapSimdXmlTokenizer::SimdLevel> supportedSimdLevels()
+{
+    QList<KDSoapSimdXmlTokenizer::SimdLevel> levels;
+    for (int level = KDSoapSimdXmlTokenizer::ScalarLevel; level <= KDSoapSimdXmlTokenizer::maximumSimdLevel(); ++level) {
+        const KDSoapSimdXmlTokenizer::SimdLevel used = KDSoapSimdXmlTokenizer::setSimdLevel(KDSoapSimdXmlTokenizer::SimdLevel(level));
+        if (!levels.contains(used)) {
+            levels.append(used);
+        }
+    }
+    return levels;
+}
+
+// Large enough for the SIMD strides to matter: long texts and attribute values, with references
+static QByteArray soapRequest(int itemCount)
+{
+    QByteArray xml =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\">\n"
+        "<soap:Body><n1:storeItems xmlns:n1=\"urn:test\">\n";
+    for (int i = 0; i < itemCount; ++i) {
+        const QByteArray n = QByteArray::number(i);
+        xml += "  <item id=\"item_" + n + "\" description=\"An attribute value long enough to span several SIMD strides &amp; a reference\">\n"
+               "    <name xsi:type=\"xsd:string\">Item number " + n + "</name>\n"
+               "    <text>Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore"
+               " et dolore magna aliqua &lt;" + n + "&gt;. Ut enim ad minim veniam, quis nostrud exercitation ullamco.</text>\n"
+               "    <price>" + n + ".99</price>\n"
+               "  </item>\n";
+    }
+    xml += "</n1:storeItems></soap:Body>\n</soap:Envelope>\n";
+    return xml;
+}
+
+class TestXmlTokenizer : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void cleanup()
+    {
+        KDSoapSimdXmlTokenizer::setSimdLevel(KDSoapSimdXmlTokenizer::maximumSimdLevel());
+    }
+
+    void testScanners()
+    {
+        const char specials[] = { '<', '&', ']', '>', '"', '\'', '\t', '\n', '\r', '\0', '\x01', '\x1f', ' ', '\x7f', char(0x80), char(0xe9) };
+        QByteArray buffer(100, 'a');
+        Q_FOREACH (KDSoapSimdXmlTokenizer::SimdLevel level, supportedSimdLevels()) {
+            KDSoapSimdXmlTokenizer::setSimdLevel(level);
+            for (size_t s = 0; s < sizeof(specials); ++s) {
+                const char special = specials[s];
+                // At every position, relative to the start of the scan and to the end of the buffer
+                for (int pos = 0; pos < buffer.size(); ++pos) {
+                    buffer.fill('a');
+                    buffer[pos] = special;
+                    for (int start = 0; start < 3; ++start) {
+                        const char *begin = buffer.constData() + start;
+                        const char *end = buffer.constData() + buffer.size();
+                        const bool found = pos >= start;
+                        const char *expectedText = found && isTextDelimiter(special) ? buffer.constData() + pos : end;
+                        QCOMPARE(KDSoapSimdXmlTokenizer::findTextDelimiter(begin, end), expectedText);
+                        const char *expectedDoubleQuoted = found && isAttributeDelimiter(special, '"') ? buffer.constData() + pos : end;
+                        QCOMPARE(KDSoapSimdXmlTokenizer::findAttributeDelimiter(begin, end, '"'), expectedDoubleQuoted);
+                        const char *expectedSingleQuoted = found && isAttributeDelimiter(special, '\'') ? buffer.constData() + pos : end;
+                        QCOMPARE(KDSoapSimdXmlTokenizer::findAttributeDelimiter(begin, end, '\''), expectedSingleQuoted);
+                    }
+                }
+            }
+        }
+    }
+
+    void testConformance_data()
+    {
+        QTest::addColumn<QByteArray>("xml");
+
+        QTest::newRow("soap") << soapRequest(3);
+        QTest::newRow("references") << QByteArray("<a>&lt;&gt;&amp;&apos;&quot;&#65;&#x42;&#x1F600;&#xe9; &#0000000065;</a>");
+        QTest::newRow("markup") << QByteArray("<?xml version=\"1.0\"?>\n<!-- first -->\n<a><?pi data?>x<!-- c -->y<![CDATA[<&>]]]]><b/>z<![CDATA[]]></a>\n<!-- last -->\n");
+        QTest::newRow("line_breaks") << QByteArray("<a b=\"1\r\n2\">x\r\ny\rz\r\n<![CDATA[\r\n]]></a>");
+        QTest::newRow("attribute_whitespace") << QByteArray("<a b=\"\t1\n 2 \" c='&#9;&#10;&quot;\"&apos;' d = \"3\" />");
+        QTest::newRow("namespaces") << QByteArray("<p:a xmlns:p=\"urn:p\" xmlns=\"urn:d\"><b p:x=\"1\" y=\"2\"><p:c xmlns:p=\"urn:q\" p:z=\"3\"/><d xmlns=\"\"/></b><p:e/></p:a>");
+        QTest::newRow("utf8") << QByteArray("<\xc3\xa9 \xc3\xbc=\"\xc3\x9f\">\xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x98\x80</\xc3\xa9>");
+        QTest::newRow("bom") << QByteArray("\xef\xbb\xbf<a>x</a>");
+        QTest::newRow("latin1") << QByteArray("<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><a b=\"\xe9\">\xe9t\xe9</a>");
+        QTest::newRow("long_text") << (QByteArray("<a>") + QByteArray(1000, 'x') + "&amp;" + QByteArray(37, 'y') + "\xc3\xa9" + QByteArray(64, ' ') + "</a>");
+        QTest::newRow("long_attribute") << (QByteArray("<a b=\"") + QByteArray(1000, 'x') + "&amp;" + QByteArray(37, 'y') + "\n\xc3\xa9\"/>");
+        QTest::newRow("long_cdata") << (QByteArray("<a><![CDATA[") + QByteArray(1000, 'x') + "]\r\n]]\xc3\xa9" + QByteArray(37, ']') + "]]></a>");
+        QTest::newRow("long_markup") << (QByteArray("<a><!--") + QByteArray("x-").repeated(500) + "\r\n--><?pi " + QByteArray(1000, '?') + "?>x</a>");
+        QTest::newRow("whitespace_outside") << QByteArray("\n  <a/>\n");
+        // Errors
+        QTest::newRow("truncated") << QByteArray("<a><b>text");
+        QTest::newRow("truncated_tag") << QByteArray("<a><b x=\"1");
+        QTest::newRow("mismatched_tag") << QByteArray("<a><b></a>");
+        QTest::newRow("undeclared_prefix") << QByteArray("<a><p:b/></a>");
+        QTest::newRow("invalid_char_ref") << QByteArray("<a>&#x1;</a>");
+        QTest::newRow("undeclared_entity") << QByteArray("<a>&foo;</a>");
+        QTest::newRow("cdata_end") << QByteArray("<a>x]]>y</a>");
+        QTest::newRow("duplicate_attribute") << QByteArray("<a x=\"1\" x=\"2\"/>");
+        QTest::newRow("lt_in_attribute") << QByteArray("<a x=\"<\"/>");
+        QTest::newRow("control_character") << QByteArray("<a>x\x01y</a>");
+        QTest::newRow("text_before_root") << QByteArray("x<a/>");
+    }
+
+    // Same elements, texts and errors as QXmlStreamReader, whatever the SIMD level and the size of the parts of the data
+    void testConformance()
+    {
+        QFETCH(QByteArray, xml);
+
+        KDSoapQXmlStreamTokenizer reference;
+        const QStringList expected = tokenize(reference, xml, 0);
+        QVERIFY(!expected.isEmpty());
+
+        static const int partSizes[] = { 0, 1, 2, 3, 7, 16, 17, 31, 32, 33, 64 };
+        Q_FOREACH (KDSoapSimdXmlTokenizer::SimdLevel level, supportedSimdLevels()) {
+            KDSoapSimdXmlTokenizer::setSimdLevel(level);
+            KDSoapSimdXmlTokenizer tokenizer; // the level is read when the tokenizer is created
+            for (size_t i = 0; i < sizeof(partSizes) / sizeof(*partSizes); ++i) {
+                const QStringList tokens = tokenize(tokenizer, xml, partSizes[i]);
+                if (tokens != expected) {
+                    qDebug() << "SIMD level" << level << "part size" << partSizes[i];
+                }
+                QCOMPARE(tokens, expected);
+            }
+        }
+    }
+
+    void testSplitComment()
+    {
+        // The text of a comment doesn't depend on how it is split either
+        const QByteArray comment = QByteArray("x-").repeated(50) + "\r\n\xe6\x97\xa5-\r" + QByteArray(100, 'x');
+        const QByteArray xml = "<a><!--" + comment + "--></a>";
+        static const int partSizes[] = { 1, 2, 3, 7, 64 };
+        KDSoapSimdXmlTokenizer tokenizer;
+        for (size_t i = 0; i < sizeof(partSizes) / sizeof(*partSizes); ++i) {
+            tokenizer.clear();
+            QString text;
+            int pos = 0;
+            QXmlStreamReader::TokenType type;
+            while ((type = tokenizer.readNext()) != QXmlStreamReader::EndElement) {
+                if (type == QXmlStreamReader::Invalid) {
+                    QCOMPARE(tokenizer.error(), QXmlStreamReader::PrematureEndOfDocumentError);
+                    tokenizer.addData(xml.mid(pos, partSizes[i]));
+                    pos += partSizes[i];
+                } else if (type == QXmlStreamReader::Comment) {
+                    QVERIFY(text.isEmpty());
+                    text = tokenizer.text().toString();
+                }
+            }
+            QCOMPARE(text, QString::fromUtf8(comment).replace(QLatin1String("\r\n"), QLatin1String("\n")).replace(QLatin1Char('\r'), QLatin1Char('\n')));
+        }
+    }
+
+    void testDoctype()
+    {
+        // Not allowed in SOAP messages, and the source of entity expansion attacks
+        KDSoapSimdXmlTokenizer tokenizer;
+        const QStringList tokens = tokenize(tokenizer, "<!DOCTYPE a [<!ENTITY e \"eeeeeeeeee\">]><a>&e;</a>", 0);
+        QCOMPARE(tokens, QStringList() << QString::fromLatin1("error"));
+        QCOMPARE(tokenizer.error(), QXmlStreamReader::NotWellFormedError);
+    }
+
+    void testErrorPosition()
+    {
+        KDSoapSimdXmlTokenizer tokenizer;
+        tokenizer.addData("<a>\n  <b>\n\xc3\xa9</c>");
+        while (tokenizer.readNext() != QXmlStreamReader::Invalid) {
+        }
+        QCOMPARE(tokenizer.error(), QXmlStreamReader::NotWellFormedError);
+        QCOMPARE(tokenizer.lineNumber(), qint64(3));
+
+        // Like QXmlStreamReader, an invalid character reference is reported with the offset following it
+        const QByteArray xml = "<a>x&#x2;y</a>";
+        tokenizer.clear();
+        tokenizer.addData(xml);
+        while (tokenizer.readNext() != QXmlStreamReader::Invalid) {
+        }
+        QCOMPARE(tokenizer.error(), QXmlStreamReader::NotWellFormedError);
+        QCOMPARE(tokenizer.characterOffset(), qint64(xml.indexOf('y')));
+    }
+
+    void testRaiseError()
+    {
+        KDSoapSimdXmlTokenizer tokenizer;
+        tokenizer.addData("<a><b/></a>");
+        QCOMPARE(tokenizer.readNext(), QXmlStreamReader::StartElement);
+        tokenizer.raiseError(QString::fromLatin1("custom"));
+        QCOMPARE(tokenizer.error(), QXmlStreamReader::CustomError);
+        QCOMPARE(tokenizer.errorString(), QString::fromLatin1("custom"));
+        QCOMPARE(tokenizer.readNext(), QXmlStreamReader::Invalid);
+    }
+
+    void benchmarkTokenize_data()
+    {
+        QTest::addColumn<int>("simdLevel"); // -1 for QXmlStreamReader
+
+        QTest::newRow("QXmlStreamReader") << -1;
+        static const char *const names[] = { "scalar", "SSE2", "SSE4.2", "AVX2" };
+        Q_FOREACH (KDSoapSimdXmlTokenizer::SimdLevel level, supportedSimdLevels()) {
+            QTest::newRow(names[level]) << int(level);
+        }
+    }
+
+    void benchmarkTokenize()
+    {
+        QFETCH(int, simdLevel);
+
+        const QByteArray xml = soapRequest(1000);
+        QScopedPointer<KDSoapXmlTokenizer> tokenizer;
+        if (simdLevel < 0) {
+            tokenizer.reset(new KDSoapQXmlStreamTokenizer);
+        } else {
+            KDSoapSimdXmlTokenizer::setSimdLevel(KDSoapSimdXmlTokenizer::SimdLevel(simdLevel));
+            tokenizer.reset(new KDSoapSimdXmlTokenizer);
+        }
+        int elementCount = 0;
+        QBENCHMARK {
+            tokenizer->clear();
+            tokenizer->addData(xml);
+            elementCount = 0;
+            QXmlStreamReader::TokenType type;
+            while ((type = tokenizer->readNext()) != QXmlStreamReader::Invalid && type != QXmlStreamReader::EndDocument) {
+                if (type == QXmlStreamReader::StartElement) {
+                    ++elementCount;
+                }
+            }
+        }
+        QVERIFY(!tokenizer->hasError());
+        QCOMPARE(elementCount, 3 + 1000 * 4);
+    }
+};
+
+QTEST_MAIN(TestXmlTokenizer)
+
+#include "xmltokenizer.moc"
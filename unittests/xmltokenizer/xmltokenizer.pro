@@ -0,0 +1,6 @@
+include( $${TOP_SOURCE_DIR}/unittests/unittests.pri )
+SOURCES = xmltokenizer.cpp
+test.target = test
+test.commands = ./$(TARGET)
+test.depends = first
+QMAKE_EXTRA_TARGETS += test